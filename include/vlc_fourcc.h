@@ -508,6 +508,9 @@
 #define VLC_CODEC_EIA608_4  VLC_FOURCC('c','c','4',' ')
 #define VLC_CODEC_TTML      VLC_FOURCC('T','T','M','L')
 
+/* SCTE-104 automation messages (from SDI, SMPTE 2010) */
+#define VLC_CODEC_SCTE_104  VLC_FOURCC('S','1','0','4')
+
 /* XYZ colorspace 12 bits packed in 16 bits, organisation |XXX0|YYY0|ZZZ0| */
 #define VLC_CODEC_XYZ12     VLC_FOURCC('X','Y','1','2')
 
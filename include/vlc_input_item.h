@@ -364,6 +364,11 @@ struct input_stats_t
     /* Aout */
     int64_t i_played_abuffers;
     int64_t i_lost_abuffers;
+
+    /* Block pool (process-wide) */
+    int64_t i_block_pool_hits;
+    int64_t i_block_pool_misses;
+    int64_t i_block_pool_cached;
 };
 
 #endif
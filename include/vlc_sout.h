@@ -232,6 +232,53 @@ static inline int sout_StreamIdSend( sout_stream_t *s,
     return s->pf_send( s, id, b );
 }
 
+/****************************************************************************
+ * Low latency statistics
+ ****************************************************************************/
+
+/** Period of the sout-low-latency reports */
+#define SOUT_LAG_REPORT_PERIOD CLOCK_FREQ
+
+/**
+ * Lag of the data behind the input clock, at one point of the chain
+ */
+typedef struct sout_lag_t
+{
+    mtime_t  i_total;
+    mtime_t  i_max;
+    unsigned i_count;
+} sout_lag_t;
+
+static inline void sout_LagReset( sout_lag_t *p_lag )
+{
+    p_lag->i_total = 0;
+    p_lag->i_max = 0;
+    p_lag->i_count = 0;
+}
+
+/**
+ * Accounts for data dated i_date by the input clock, seen at i_now
+ */
+static inline void sout_LagAdd( sout_lag_t *p_lag, mtime_t i_date,
+                                mtime_t i_now )
+{
+    if( i_date <= VLC_TS_INVALID )
+        return;
+
+    mtime_t i_lag = i_now - i_date;
+    p_lag->i_total += i_lag;
+    if( p_lag->i_count++ == 0 || i_lag > p_lag->i_max )
+        p_lag->i_max = i_lag;
+}
+
+/**
+ * Average lag, or 0 if nothing was accounted for
+ */
+static inline mtime_t sout_LagAverage( const sout_lag_t *p_lag )
+{
+    return p_lag->i_count ? p_lag->i_total / p_lag->i_count : 0;
+}
+
 /****************************************************************************
  * Encoder
  ****************************************************************************/
@@ -212,6 +212,9 @@ enum {
     VOUT_DISPLAY_EVENT_MOUSE_PRESSED,
     VOUT_DISPLAY_EVENT_MOUSE_RELEASED,
     VOUT_DISPLAY_EVENT_MOUSE_DOUBLE_CLICK,
+
+    /* Pictures accepted by display() but never shown: int count */
+    VOUT_DISPLAY_EVENT_PICTURES_LOST,
 };
 
 /**
@@ -391,6 +394,11 @@ static inline void vout_display_SendEventMouseDoubleClick(vout_display_t *vd)
 {
     vout_display_SendEvent(vd, VOUT_DISPLAY_EVENT_MOUSE_DOUBLE_CLICK);
 }
+/* This one may be sent from any thread */
+static inline void vout_display_SendEventPicturesLost(vout_display_t *vd, int count)
+{
+    vout_display_SendEvent(vd, VOUT_DISPLAY_EVENT_PICTURES_LOST, count);
+}
 
 /**
  * Asks for a new window of a given type.
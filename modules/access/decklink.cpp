@@ -30,6 +30,7 @@
 #include <vlc_plugin.h>
 #include <vlc_demux.h>
 #include <vlc_atomic.h>
+#include <vlc_cpu.h>
 
 #include <arpa/inet.h>
 
@@ -37,6 +38,8 @@
 #include <DeckLinkAPIDispatch.cpp>
 
 #include "sdi.h"
+#include "sdi_pool.h"
+#include "../video_chroma/v210.h"
 
 static int  Open (vlc_object_t *);
 static void Close(vlc_object_t *);
@@ -93,6 +96,13 @@ static const char *const ppsz_audioconns_text[] = {
 #define ASPECT_RATIO_LONGTEXT N_(\
     "Aspect ratio (4:3, 16:9). Default assumes square pixels.")
 
+#define NATIVE_TEXT N_("Pass frames in the card format")
+#define NATIVE_LONGTEXT N_( \
+    "Pass captured video frames downstream without copying them, " \
+    "in the card pixel format (UYVY, or v210 in 10 bits mode). " \
+    "The frames stay in the card buffers until they are released, " \
+    "so a large caching value may cause the card to drop frames.")
+
 vlc_module_begin ()
     set_shortname(N_("DeckLink"))
     set_description(N_("Blackmagic DeckLink SDI input"))
@@ -116,6 +126,7 @@ vlc_module_begin ()
     add_string("decklink-aspect-ratio", NULL,
                 ASPECT_RATIO_TEXT, ASPECT_RATIO_LONGTEXT, true)
     add_bool("decklink-tenbits", false, N_("10 bits"), N_("10 bits"), true)
+    add_bool("decklink-native", false, NATIVE_TEXT, NATIVE_LONGTEXT, true)
 
     add_shortcut("decklink")
     set_capability("access_demux", 10)
@@ -142,6 +153,13 @@ struct demux_sys_t
     es_out_id_t *video_es;
     es_out_id_t *audio_es;
     es_out_id_t *cc_es;
+    es_out_id_t *scte104_es;
+
+    /* VANC, only accessed from the capture callback */
+    mtime_t vanc_pts;
+    block_t *scte104;       /* partial SCTE-104 message */
+    int afd;                /* last Active Format Description, -1 if none */
+    vanc_stats_t vanc_stats;
 
     vlc_mutex_t pts_lock;
     int last_pts;  /* protected by <pts_lock> */
@@ -150,6 +168,10 @@ struct demux_sys_t
     int channels;
 
     bool tenbits;
+    bool native;
+    v210_unpack_line_t v210_unpack;
+
+    sdi_pool_t *frames;     /* copied video frames */
 };
 
 static const char *GetFieldDominance(BMDFieldDominance dom, uint32_t *flags)
@@ -185,7 +207,9 @@ static es_format_t GetModeSettings(demux_t *demux, IDeckLinkDisplayMode *m)
     }
 
     es_format_t video_fmt;
-    vlc_fourcc_t chroma; chroma = sys->tenbits ? VLC_CODEC_I422_10L : VLC_CODEC_UYVY;
+    vlc_fourcc_t chroma = VLC_CODEC_UYVY;
+    if (sys->tenbits)
+        chroma = sys->native ? VLC_CODEC_V210 : VLC_CODEC_I422_10L;
     es_format_Init(&video_fmt, VIDEO_ES, chroma);
 
     video_fmt.video.i_width = m->GetWidth();
@@ -208,6 +232,128 @@ static es_format_t GetModeSettings(demux_t *demux, IDeckLinkDisplayMode *m)
     return video_fmt;
 }
 
+/* Block holding a reference on a captured frame, whose buffer is handed
+ * downstream as is. The frame goes back to the driver on block_Release(). */
+struct decklink_block_t
+{
+    block_t self;
+    IDeckLinkVideoInputFrame *frame;
+};
+
+static void decklink_block_Release(block_t *block)
+{
+    decklink_block_t *b = (decklink_block_t *)block;
+
+    b->frame->Release();
+    free(b);
+}
+
+static block_t *decklink_block_Alloc(IDeckLinkVideoInputFrame *frame)
+{
+    void *bytes;
+    if (frame->GetBytes(&bytes) != S_OK)
+        return NULL;
+
+    decklink_block_t *b = (decklink_block_t *)malloc(sizeof(*b));
+    if (unlikely(b == NULL))
+        return NULL;
+
+    block_Init(&b->self, bytes, frame->GetRowBytes() * frame->GetHeight());
+    b->self.pf_release = decklink_block_Release;
+    b->frame = frame;
+    frame->AddRef();
+    return &b->self;
+}
+
+static void HandleCEA708(void *opaque, const vanc_packet_t *pkt)
+{
+    demux_t *demux = (demux_t *)opaque;
+    demux_sys_t *sys = demux->p_sys;
+
+    block_t *cc = vanc_to_cc(demux, pkt);
+    if (!cc)
+        return;
+    cc->i_pts = cc->i_dts = sys->vanc_pts;
+
+    if (!sys->cc_es) {
+        es_format_t fmt;
+
+        es_format_Init( &fmt, SPU_ES, VLC_FOURCC('c', 'c', '1' , ' ') );
+        fmt.psz_description = strdup(N_("Closed captions 1"));
+        if (fmt.psz_description) {
+            sys->cc_es = es_out_Add(demux->out, &fmt);
+            msg_Dbg(demux, "Adding Closed captions stream");
+        }
+    }
+    if (sys->cc_es)
+        es_out_Send(demux->out, sys->cc_es, cc);
+    else
+        block_Release(cc);
+}
+
+static void HandleSCTE104(void *opaque, const vanc_packet_t *pkt)
+{
+    demux_t *demux = (demux_t *)opaque;
+    demux_sys_t *sys = demux->p_sys;
+
+    block_t *msg = vanc_to_scte104(&sys->scte104, pkt);
+    if (!msg)
+        return;
+    msg->i_pts = msg->i_dts = sys->vanc_pts;
+
+    if (!sys->scte104_es) {
+        es_format_t fmt;
+
+        /* there is no data ES category: as subtitles, the stream output
+         * packetizes it, and the TS muxer converts it to SCTE-35 */
+        es_format_Init(&fmt, SPU_ES, VLC_CODEC_SCTE_104);
+        sys->scte104_es = es_out_Add(demux->out, &fmt);
+        msg_Dbg(demux, "Adding SCTE-104 stream");
+    }
+    if (sys->scte104_es)
+        es_out_Send(demux->out, sys->scte104_es, msg);
+    else
+        block_Release(msg);
+}
+
+static void HandleAFD(void *opaque, const vanc_packet_t *pkt)
+{
+    demux_t *demux = (demux_t *)opaque;
+    demux_sys_t *sys = demux->p_sys;
+    vanc_afd_t afd;
+
+    if (vanc_to_afd(&afd, pkt) != VLC_SUCCESS || afd.afd == sys->afd)
+        return;
+
+    msg_Dbg(demux, "Active Format Description %u (%s), bars 0x%x %u %u",
+            afd.afd, afd.wide ? "16:9" : "4:3", afd.bar_flags,
+            afd.bar[0], afd.bar[1]);
+    sys->afd = afd.afd;
+    var_SetInteger(demux, "decklink-afd", afd.afd);
+}
+
+static void HandleTimecode(void *opaque, const vanc_packet_t *pkt)
+{
+    demux_t *demux = (demux_t *)opaque;
+    vanc_timecode_t tc;
+
+    if (vanc_to_timecode(&tc, pkt) != VLC_SUCCESS)
+        return;
+
+    char str[sizeof("00:00:00:00")];
+    snprintf(str, sizeof(str), "%02u:%02u:%02u%c%02u", tc.hours, tc.minutes,
+             tc.seconds, tc.drop_frame ? ';' : ':', tc.frames);
+    var_SetString(demux, "decklink-timecode", str);
+}
+
+static const vanc_handler_t vanc_handlers[] = {
+    { VANC_DID_CEA708,  VANC_SDID_CEA708,  HandleCEA708 },
+    { VANC_DID_SCTE104, VANC_SDID_SCTE104, HandleSCTE104 },
+    { VANC_DID_AFD,     VANC_SDID_AFD,     HandleAFD },
+    { VANC_DID_RP188,   VANC_SDID_RP188,   HandleTimecode },
+    { 0, 0, NULL },
+};
+
 class DeckLinkCaptureDelegate : public IDeckLinkInputCallback
 {
 public:
@@ -282,58 +428,67 @@ HRESULT DeckLinkCaptureDelegate::VideoInputFrameArrived(IDeckLinkVideoInputFrame
         const int height = videoFrame->GetHeight();
         const int stride = videoFrame->GetRowBytes();
 
-        int bpp = sys->tenbits ? 4 : 2;
-        block_t *video_frame = block_Alloc(width * height * bpp);
-        if (!video_frame)
-            return S_OK;
-
         const uint32_t *frame_bytes;
         videoFrame->GetBytes((void**)&frame_bytes);
 
+        block_t *video_frame;
+        if (sys->tenbits && !sys->native) {
+            video_frame = sdi_pool_Alloc(sys->frames, width * height * 4);
+            if (!video_frame)
+                return S_OK;
+
+            const size_t v210_stride = v210_GetStride(width);
+            uint16_t *y = (uint16_t*)video_frame->p_buffer;
+            uint16_t *u = y + width * height;
+            uint16_t *v = u + width * height / 2;
+            for (int i = 0; i < height; i++) {
+                const uint8_t *src = (const uint8_t *)frame_bytes + v210_stride * i;
+                sys->v210_unpack(y, u, v, (const uint32_t *)src, width);
+                y += width;
+                u += width / 2;
+                v += width / 2;
+            }
+        } else {
+            /* UYVY or v210, as delivered by the card */
+            const int pitch = sys->tenbits ? v210_GetStride(width) : width * 2;
+            if (sys->native && stride == pitch) {
+                video_frame = decklink_block_Alloc(videoFrame);
+                if (!video_frame)
+                    return S_OK;
+            } else {
+                video_frame = sdi_pool_Alloc(sys->frames, pitch * height);
+                if (!video_frame)
+                    return S_OK;
+
+                for (int y = 0; y < height; ++y) {
+                    const uint8_t *src = (const uint8_t *)frame_bytes + stride * y;
+                    uint8_t *dst = video_frame->p_buffer + pitch * y;
+                    memcpy(dst, src, pitch);
+                }
+            }
+        }
+
         BMDTimeValue stream_time, frame_duration;
         videoFrame->GetStreamTime(&stream_time, &frame_duration, CLOCK_FREQ);
         video_frame->i_flags = BLOCK_FLAG_TYPE_I | sys->dominance_flags;
         video_frame->i_pts = video_frame->i_dts = VLC_TS_0 + stream_time;
 
         if (sys->tenbits) {
-            v210_convert((uint16_t*)video_frame->p_buffer, frame_bytes, width, height);
             IDeckLinkVideoFrameAncillary *vanc;
             if (videoFrame->GetAncillaryData(&vanc) == S_OK) {
+                /* SD multiplexes ancillary data over all samples,
+                 * HD carries it in the luma samples */
+                enum vanc_stream stream = width > 720 ? VANC_LUMA : VANC_COMPOSITE;
+                sys->vanc_pts = VLC_TS_0 + stream_time;
                 for (int i = 1; i < 21; i++) {
                     uint32_t *buf;
                     if (vanc->GetBufferForVerticalBlankingLine(i, (void**)&buf) != S_OK)
                         break;
-                    uint16_t dec[width * 2];
-                    v210_convert(&dec[0], buf, width, 1);
-                    block_t *cc = vanc_to_cc(demux_, dec, width * 2);
-                    if (!cc)
-                        continue;
-                    cc->i_pts = cc->i_dts = VLC_TS_0 + stream_time;
-
-                    if (!sys->cc_es) {
-                        es_format_t fmt;
-
-                        es_format_Init( &fmt, SPU_ES, VLC_FOURCC('c', 'c', '1' , ' ') );
-                        fmt.psz_description = strdup(N_("Closed captions 1"));
-                        if (fmt.psz_description) {
-                            sys->cc_es = es_out_Add(demux_->out, &fmt);
-                            msg_Dbg(demux_, "Adding Closed captions stream");
-                        }
-                    }
-                    if (sys->cc_es)
-                        es_out_Send(demux_->out, sys->cc_es, cc);
-                    else
-                        block_Release(cc);
-                    break; // we found the line with Closed Caption data
+                    vanc_parse_line(buf, width, stream, vanc_handlers, demux_,
+                                    &sys->vanc_stats);
                 }
                 vanc->Release();
             }
-        } else {
-            for (int y = 0; y < height; ++y) {
-                const uint8_t *src = (const uint8_t *)frame_bytes + stride * y;
-                uint8_t *dst = video_frame->p_buffer + width * 2 * y;
-                memcpy(dst, src, width * 2);
-            }
         }
 
         vlc_mutex_lock(&sys->pts_lock);
@@ -463,8 +618,16 @@ static int Open(vlc_object_t *p_this)
         return VLC_ENOMEM;
 
     vlc_mutex_init(&sys->pts_lock);
+    sys->afd = -1;
+    var_Create(demux, "decklink-afd", VLC_VAR_INTEGER);
+    var_Create(demux, "decklink-timecode", VLC_VAR_STRING);
 
     sys->tenbits = var_InheritBool(p_this, "decklink-tenbits");
+    sys->native = var_InheritBool(p_this, "decklink-native");
+    if (sys->tenbits) {
+        sys->v210_unpack = v210_GetUnpackLine(vlc_CPU());
+        msg_Dbg(demux, "Using %s v210 unpacking", v210_GetName(vlc_CPU()));
+    }
 
     IDeckLinkIterator *decklink_iterator = CreateDeckLinkIteratorInstance();
     if (!decklink_iterator) {
@@ -624,6 +787,11 @@ static int Open(vlc_object_t *p_this)
         }
     }
 
+    /* Up to a few frames in reserve for jitter downstream */
+    sys->frames = sdi_pool_New(demux, 8);
+    if (!sys->frames)
+        goto finish;
+
     sys->delegate = new DeckLinkCaptureDelegate(demux);
     sys->input->SetCallback(sys->delegate);
 
@@ -684,6 +852,20 @@ static void Close(vlc_object_t *p_this)
     if (sys->delegate)
         sys->delegate->Release();
 
+    if (sys->frames)
+        sdi_pool_Delete(sys->frames);
+
+    if (sys->scte104)
+        block_Release(sys->scte104);
+
+    if (sys->tenbits)
+        msg_Dbg(demux, "VANC: %u packets (%u unhandled), dropped %u on parity, "
+                "%u on checksum, %u truncated", sys->vanc_stats.packets,
+                sys->vanc_stats.unhandled, sys->vanc_stats.parity,
+                sys->vanc_stats.checksum, sys->vanc_stats.truncated);
+
+    var_Destroy(demux, "decklink-afd");
+    var_Destroy(demux, "decklink-timecode");
     vlc_mutex_destroy(&sys->pts_lock);
     free(sys);
 }
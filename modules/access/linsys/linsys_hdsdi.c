@@ -47,6 +47,7 @@
 
 #include "linsys_sdivideo.h"
 #include "linsys_sdiaudio.h"
+#include "../sdi_pool.h"
 
 #undef HAVE_MMAP_SDIVIDEO
 #undef HAVE_MMAP_SDIAUDIO
@@ -147,6 +148,7 @@ struct demux_sys_t
     unsigned int i_frame_rate, i_frame_rate_base;
     unsigned int i_width, i_height, i_aspect, i_forced_aspect;
     unsigned int i_vblock_size, i_ablock_size;
+    sdi_pool_t   *p_frames;
     mtime_t      i_next_vdate, i_next_adate;
     int          i_incr, i_aincr;
 
@@ -247,6 +249,10 @@ static int Open( vlc_object_t *p_this )
 
     p_sys->i_link = var_InheritInteger( p_demux, "linsys-hdsdi-link" );
 
+    p_sys->p_frames = sdi_pool_New( p_demux, 8 );
+    if( unlikely(p_sys->p_frames == NULL) )
+        goto error;
+
     p_sys->evfd = eventfd( 0, EFD_CLOEXEC );
     if( p_sys->evfd == -1 )
         goto error;
@@ -261,6 +267,8 @@ static int Open( vlc_object_t *p_this )
     p_demux->pf_control = Control;
     return VLC_SUCCESS;
 error:
+    if( p_sys->p_frames != NULL )
+        sdi_pool_Delete( p_sys->p_frames );
     free( p_sys );
     return VLC_EGENERIC;
 }
@@ -276,6 +284,7 @@ static void Close( vlc_object_t *p_this )
     write( p_sys->evfd, &(uint64_t){ 1 }, sizeof (uint64_t));
     pthread_join( p_sys->thread, NULL );
     close( p_sys->evfd );
+    sdi_pool_Delete( p_sys->p_frames );
     free( p_sys );
 }
 
@@ -559,7 +568,8 @@ static int InitAudio( demux_t *p_demux )
 static int HandleVideo( demux_t *p_demux, const uint8_t *p_buffer )
 {
     demux_sys_t *p_sys = p_demux->p_sys;
-    block_t *p_current_picture = block_Alloc( p_sys->i_vblock_size );
+    block_t *p_current_picture = sdi_pool_Alloc( p_sys->p_frames,
+                                                 p_sys->i_vblock_size );
     if( unlikely( !p_current_picture ) )
         return VLC_ENOMEM;
     uint8_t *p_y = p_current_picture->p_buffer;
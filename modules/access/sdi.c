@@ -2,8 +2,6 @@
  * sdi.c: SDI helpers
  *****************************************************************************
  * Copyright (C) 2014 Rafaël Carré
- * Copyright (C) 2009 Michael Niedermayer <michaelni@gmx.at>
- * Copyright (c) 2009 Baptiste Coudurier <baptiste dot coudurier at gmail dot com>
  *
  * This program is free software; you can redistribute it and/or modify it
  * under the terms of the GNU Lesser General Public License as published by
@@ -22,115 +20,137 @@
 
 #include "sdi.h"
 
-static inline uint32_t av_le2ne32(uint32_t val)
+#define P(x) (((x) ^ (x) >> 1 ^ (x) >> 2 ^ (x) >> 3 ^ (x) >> 4 ^ (x) >> 5 ^ \
+               (x) >> 6 ^ (x) >> 7) & 1)
+#define W(x) ((x) | P(x) << 8 | !P(x) << 9)
+#define W4(x) W(x), W(x + 1), W(x + 2), W(x + 3)
+#define W16(x) W4(x), W4(x + 4), W4(x + 8), W4(x + 12)
+#define W64(x) W16(x), W16(x + 16), W16(x + 32), W16(x + 48)
+
+/* 10 bits word for each 8 bits value: b8 is even parity, b9 = !b8 */
+static const uint16_t vanc_parity[256] = {
+    W64(0), W64(64), W64(128), W64(192)
+};
+
+#undef W64
+#undef W16
+#undef W4
+#undef W
+#undef P
+
+/* Sample n of the interleaved C/Y stream of a v210 line */
+static inline unsigned vanc_sample(const uint32_t *line, size_t n)
 {
-    union {
-        uint32_t v;
-        uint8_t b[4];
-    } u;
-    u.v = val;
-    return (u.b[0] << 0) | (u.b[1] << 8) | (u.b[2] << 16) | (u.b[3] << 24);
+    return (GetDWLE(&line[n / 3]) >> (10 * (n % 3))) & 0x3ff;
 }
 
-void v210_convert(uint16_t *dst, const uint32_t *bytes, const int width, const int height)
+unsigned vanc_parse_line(const uint32_t *line, unsigned width,
+                         enum vanc_stream stream,
+                         const vanc_handler_t *handlers, void *opaque,
+                         vanc_stats_t *stats)
 {
-    const int stride = ((width + 47) / 48) * 48 * 8 / 3 / 4;
-    uint16_t *y = &dst[0];
-    uint16_t *u = &dst[width * height * 2 / 2];
-    uint16_t *v = &dst[width * height * 3 / 2];
-
-#define READ_PIXELS(a, b, c)         \
-    do {                             \
-        val  = av_le2ne32(*src++);   \
-        *a++ =  val & 0x3FF;         \
-        *b++ = (val >> 10) & 0x3FF;  \
-        *c++ = (val >> 20) & 0x3FF;  \
-    } while (0)
-
-    for (int h = 0; h < height; h++) {
-        const uint32_t *src = bytes;
-        uint32_t val = 0;
-        int w;
-        for (w = 0; w < width - 5; w += 6) {
-            READ_PIXELS(u, y, v);
-            READ_PIXELS(y, u, y);
-            READ_PIXELS(v, y, u);
-            READ_PIXELS(y, v, y);
-        }
-        if (w < width - 1) {
-            READ_PIXELS(u, y, v);
+    vanc_stats_t dummy;
+    if (stats == NULL)
+        stats = &dummy;
 
-            val  = av_le2ne32(*src++);
-            *y++ =  val & 0x3FF;
-        }
-        if (w < width - 3) {
-            *u++ = (val >> 10) & 0x3FF;
-            *y++ = (val >> 20) & 0x3FF;
+    /* position in the interleaved stream of word i is first + i * step */
+    const size_t first = stream == VANC_LUMA ? 1 : 0;
+    const size_t step = stream == VANC_COMPOSITE ? 1 : 2;
+    const size_t words = stream == VANC_COMPOSITE ? 2 * width : width;
+#define WORD(i) vanc_sample(line, first + (i) * step)
+
+    unsigned found = 0;
+    size_t i = 0;
 
-            val  = av_le2ne32(*src++);
-            *v++ =  val & 0x3FF;
-            *y++ = (val >> 10) & 0x3FF;
+    while (i + 6 < words) { /* ADF + DID + SDID + DC + CS */
+        /* Ancillary Data Flag: 0x000 0x3FF 0x3FF */
+        unsigned w = WORD(i + 2);
+        if (w != 0x3ff) {
+            /* no ADF can start at i or i + 1, nor at i + 2 unless w is 0 */
+            i += (w == 0x000) ? 2 : 3;
+            continue;
+        }
+        if (WORD(i) != 0x000 || WORD(i + 1) != 0x3ff) {
+            i++;
+            continue;
         }
 
-        bytes += stride;
-    }
-}
+        vanc_packet_t pkt;
+        unsigned sum = 0;
+        size_t pos = i + 3;
 
-#undef vanc_to_cc
-block_t *vanc_to_cc(vlc_object_t *obj, uint16_t *buf, size_t words)
-{
-    if (words < 3) {
-        msg_Err(obj, "VANC line too small (%zu words)", words);
-        return NULL;
-    }
+        /* DID, SDID/DBN, DC */
+        unsigned hdr[3];
+        bool bad = false;
+        for (unsigned j = 0; j < 3; j++) {
+            hdr[j] = WORD(pos + j);
+            bad |= vanc_parity[hdr[j] & 0xff] != hdr[j];
+            sum += hdr[j];
+        }
+        if (bad) {
+            stats->parity++;
+            i += 3;
+            continue;
+        }
+        pos += 3;
 
-    static const uint8_t vanc_header[6] = { 0x00, 0x00, 0xff, 0x03, 0xff, 0x03 };
-    if (memcmp(vanc_header, buf, 3*2)) {
-        /* Does not start with the VANC header */
-        return NULL;
-    }
+        pkt.did = hdr[0];
+        pkt.sdid = hdr[1];
+        pkt.dc = hdr[2];
+        if (pos + pkt.dc + 1 > words) {
+            stats->truncated++;
+            break;
+        }
 
-    size_t len = (buf[5] & 0xff) + 6 + 1;
-    if (len > words) {
-        msg_Err(obj, "Data Count (%zu) > line length (%zu)", len, words);
-        return NULL;
-    }
+        for (unsigned j = 0; j < pkt.dc; j++) {
+            unsigned w = WORD(pos + j);
+            bad |= vanc_parity[w & 0xff] != w;
+            sum += w;
+            pkt.udw[j] = w;
+        }
+        pos += pkt.dc;
 
-    uint16_t vanc_sum = 0;
-    for (size_t i = 3; i < len - 1; i++) {
-        uint16_t v = buf[i];
-        int np = v >> 8;
-        int p = parity(v & 0xff);
-        if ((!!p ^ !!(v & 0x100)) || (np != 1 && np != 2)) {
-            msg_Err(obj, "Parity incorrect for word %zu", i);
-            return NULL;
+        sum &= 0x1ff;
+        sum |= (~sum & 0x100) << 1;
+        if (bad)
+            stats->parity++;
+        else if (WORD(pos) != sum)
+            stats->checksum++;
+        else {
+            const vanc_handler_t *h = handlers;
+            while (h->handle != NULL
+                && (h->did != pkt.did || h->sdid != pkt.sdid))
+                h++;
+
+            stats->packets++;
+            found++;
+            if (h->handle != NULL)
+                h->handle(opaque, &pkt);
+            else
+                stats->unhandled++;
         }
-        vanc_sum += v;
-        vanc_sum &= 0x1ff;
-        buf[i] &= 0xff;
+        i = pos + 1;
     }
+#undef WORD
+    return found;
+}
 
-    vanc_sum |= ((~vanc_sum & 0x100) << 1);
-    if (buf[len - 1] != vanc_sum) {
-        msg_Err(obj, "VANC checksum incorrect: 0x%.4x != 0x%.4x", vanc_sum, buf[len-1]);
-        return NULL;
-    }
+#undef vanc_to_cc
+block_t *vanc_to_cc(vlc_object_t *obj, const vanc_packet_t *pkt)
+{
+    const uint8_t *cdp = pkt->udw;
+    size_t len = pkt->dc;
 
-    if (buf[3] != 0x61 /* DID */ || buf[4] != 0x01 /* SDID = CEA-708 */) {
-        //msg_Err(obj, "Not a CEA-708 packet: DID = 0x%.2x SDID = 0x%.2x", buf[3], buf[4]);
-        // XXX : what is Not a CEA-708 packet: DID = 0x61 SDID = 0x02 ?
+    if (len < 13) {
+        msg_Err(obj, "CDP too small (%zu)", len);
         return NULL;
     }
 
-    /* CDP follows */
-    uint16_t *cdp = &buf[6];
     if (cdp[0] != 0x96 || cdp[1] != 0x69) {
         msg_Err(obj, "Invalid CDP header 0x%.2x 0x%.2x", cdp[0], cdp[1]);
         return NULL;
     }
 
-    len -= 7; // remove VANC header and checksum
-
     if (cdp[2] != len) {
         msg_Err(obj, "CDP len %d != %zu", cdp[2], len);
         return NULL;
@@ -191,6 +211,8 @@ block_t *vanc_to_cc(vlc_object_t *obj, uint16_t *buf, size_t words)
     }
 
     block_t *cc = block_Alloc(cc_count * 3);
+    if (unlikely(cc == NULL))
+        return NULL;
 
     for (size_t i = 0; i < cc_count; i++) {
         cc->p_buffer[3*i+0] = cdp[9 + 3*i+0] /* & 3 */;
@@ -200,3 +222,86 @@ block_t *vanc_to_cc(vlc_object_t *obj, uint16_t *buf, size_t words)
 
     return cc;
 }
+
+block_t *vanc_to_scte104(block_t **partial, const vanc_packet_t *pkt)
+{
+    if (pkt->dc < 2)
+        return NULL;
+
+    /* payload descriptor */
+    const uint8_t desc = pkt->udw[0];
+    const bool duplicate = desc & 0x01;
+    const bool following = desc & 0x02;
+    const bool continued = desc & 0x04;
+
+    if (duplicate)
+        return NULL;
+
+    if (!continued && *partial != NULL) {
+        /* the end of the previous message was lost */
+        block_Release(*partial);
+        *partial = NULL;
+    }
+    if (continued && *partial == NULL)
+        return NULL; /* missed the beginning */
+
+    size_t size = pkt->dc - 1;
+    size_t offset = 0;
+    block_t *msg = *partial;
+    if (msg == NULL)
+        msg = block_Alloc(size);
+    else {
+        offset = msg->i_buffer;
+        msg = block_Realloc(msg, 0, offset + size);
+    }
+    *partial = NULL;
+    if (unlikely(msg == NULL))
+        return NULL;
+    memcpy(msg->p_buffer + offset, &pkt->udw[1], size);
+
+    if (following) {
+        *partial = msg;
+        return NULL;
+    }
+    return msg;
+}
+
+int vanc_to_afd(vanc_afd_t *afd, const vanc_packet_t *pkt)
+{
+    if (pkt->dc != 8)
+        return VLC_EGENERIC;
+
+    afd->afd = (pkt->udw[0] >> 3) & 0x0f;
+    afd->wide = (pkt->udw[0] >> 2) & 1;
+    afd->bar_flags = pkt->udw[3] >> 4;
+    afd->bar[0] = (pkt->udw[4] << 8) | pkt->udw[5];
+    afd->bar[1] = (pkt->udw[6] << 8) | pkt->udw[7];
+    return VLC_SUCCESS;
+}
+
+int vanc_to_timecode(vanc_timecode_t *tc, const vanc_packet_t *pkt)
+{
+    if (pkt->dc != 16)
+        return VLC_EGENERIC;
+
+    /* each word carries 4 bits of the time code in b7-b4, and one
+     * distributed binary bit in b3 */
+    uint8_t n[8];
+    for (unsigned i = 0; i < 8; i++)
+        n[i] = pkt->udw[2 * i] >> 4; /* skip the binary groups */
+
+    tc->frames  = (n[1] & 0x3) * 10 + n[0];
+    tc->seconds = (n[3] & 0x7) * 10 + n[2];
+    tc->minutes = (n[5] & 0x7) * 10 + n[4];
+    tc->hours   = (n[7] & 0x3) * 10 + n[6];
+    tc->drop_frame = (n[1] >> 2) & 1;
+
+    tc->dbb1 = 0;
+    for (unsigned i = 0; i < 8; i++)
+        tc->dbb1 |= ((pkt->udw[i] >> 3) & 1) << i;
+
+    if (n[0] > 9 || n[2] > 9 || n[4] > 9 || n[6] > 9
+     || tc->seconds > 59 || tc->minutes > 59 || tc->hours > 23)
+        return VLC_EGENERIC;
+    return VLC_SUCCESS;
+}
@@ -27,10 +27,101 @@ extern "C" {
 
 #include <inttypes.h>
 
-void v210_convert(uint16_t *dst, const uint32_t *bytes, const int width, const int height);
+/**
+ * Ancillary data packet (SMPTE 291), parity bits stripped.
+ * For type 1 packets, sdid holds the Data Block Number.
+ */
+typedef struct
+{
+    uint8_t did;
+    uint8_t sdid;
+    uint8_t dc;         /* Data Count */
+    uint8_t udw[255];   /* User Data Words */
+} vanc_packet_t;
 
-block_t *vanc_to_cc(vlc_object_t *, uint16_t *, size_t);
-#define vanc_to_cc(obj, buf, words) vanc_to_cc(VLC_OBJECT(obj), buf, words)
+typedef void (*vanc_handler_cb)(void *opaque, const vanc_packet_t *);
+
+typedef struct
+{
+    uint8_t did;
+    uint8_t sdid;
+    vanc_handler_cb handle;
+} vanc_handler_t;
+
+typedef struct
+{
+    unsigned packets;   /* well-formed packets */
+    unsigned unhandled; /* well-formed packets without handler */
+    unsigned parity;    /* packets dropped on a parity error */
+    unsigned checksum;  /* packets dropped on a checksum error */
+    unsigned truncated; /* packets running past the end of the line */
+} vanc_stats_t;
+
+/* Which samples of a v210 line carry the ancillary data */
+enum vanc_stream
+{
+    VANC_LUMA,      /* HD: Y samples */
+    VANC_CHROMA,    /* HD: C samples */
+    VANC_COMPOSITE, /* SD: all samples */
+};
+
+/**
+ * Finds the ancillary data packets of a v210 line, without unpacking it,
+ * and dispatches them to the handler matching their DID and SDID.
+ * \param line v210 line
+ * \param width width of the line in pixels
+ * \param handlers handler table, terminated by a NULL handle
+ * \param stats statistics, updated (can be NULL)
+ * \return the number of packets found
+ */
+unsigned vanc_parse_line(const uint32_t *line, unsigned width,
+                         enum vanc_stream stream,
+                         const vanc_handler_t *handlers, void *opaque,
+                         vanc_stats_t *stats);
+
+/* DID / SDID of the packets decoded below */
+#define VANC_DID_CEA708     0x61
+#define VANC_SDID_CEA708    0x01
+#define VANC_DID_SCTE104    0x41
+#define VANC_SDID_SCTE104   0x07
+#define VANC_DID_AFD        0x41
+#define VANC_SDID_AFD       0x05
+#define VANC_DID_RP188      0x60
+#define VANC_SDID_RP188     0x60
+
+/**
+ * Extracts cc_data triplets from a CEA-708 Caption Distribution Packet.
+ */
+block_t *vanc_to_cc(vlc_object_t *, const vanc_packet_t *);
+#define vanc_to_cc(obj, pkt) vanc_to_cc(VLC_OBJECT(obj), pkt)
+
+/**
+ * SCTE-104 messages (SMPTE 2010) may span several packets:
+ * returns a complete message, or NULL while more packets are needed.
+ * \param partial reassembly state, NULL initially
+ */
+block_t *vanc_to_scte104(block_t **partial, const vanc_packet_t *);
+
+/** Active Format Description and bar data (SMPTE 2016-3) */
+typedef struct
+{
+    uint8_t afd;        /* 4 bits active format code */
+    bool    wide;       /* 16:9 coded frame */
+    uint8_t bar_flags;  /* top, bottom, left, right bar present */
+    uint16_t bar[2];    /* top/left then bottom/right bar value */
+} vanc_afd_t;
+
+int vanc_to_afd(vanc_afd_t *, const vanc_packet_t *);
+
+/** Ancillary time code (SMPTE 12-2, RP 188) */
+typedef struct
+{
+    uint8_t hours, minutes, seconds, frames;
+    bool drop_frame;
+    uint8_t dbb1;       /* Distributed Binary Bits 1: payload type */
+} vanc_timecode_t;
+
+int vanc_to_timecode(vanc_timecode_t *, const vanc_packet_t *);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,319 @@
+/*****************************************************************************
+ * sdi_pool.c: raw video frame pool for SDI capture
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#ifdef __linux__
+# include <sys/syscall.h>
+#endif
+
+#include <vlc_common.h>
+#include <vlc_block.h>
+
+#include "sdi_pool.h"
+
+/** Size of the huge pages, buffers are rounded up to */
+#define SDI_POOL_HUGE_PAGE (2 << 20)
+/** Bytes reserved before and after the payload */
+#define SDI_POOL_PADDING 64
+
+typedef struct sdi_frame_t
+{
+    block_t self;
+    sdi_pool_t *pool;
+    struct sdi_frame_t *next;
+    uint8_t *base;
+    size_t length; /**< mapped bytes */
+    size_t size;   /**< payload size the frame was mapped for */
+} sdi_frame_t;
+
+struct sdi_pool_t
+{
+    vlc_object_t *obj;
+    vlc_mutex_t lock;
+    unsigned refs;      /**< owner and frames in flight */
+    bool closed;
+
+    sdi_frame_t *idle;
+    unsigned idle_count;
+    unsigned max_idle;
+    size_t size;        /**< current payload size */
+
+    bool hugetlb;       /**< explicit huge pages may still be available */
+    uint64_t last_faults;
+    sdi_pool_stats_t stats;
+};
+
+static uint64_t GetFaults(void)
+{
+    struct rusage ru;
+
+#ifdef RUSAGE_THREAD
+    if (getrusage(RUSAGE_THREAD, &ru))
+#else
+    if (getrusage(RUSAGE_SELF, &ru))
+#endif
+        return 0;
+    return ru.ru_minflt + ru.ru_majflt;
+}
+
+static int GetNode(void)
+{
+#if defined (__linux__) && defined (SYS_getcpu)
+    unsigned cpu, node;
+
+    if (syscall(SYS_getcpu, &cpu, &node, NULL) == 0)
+        return node;
+#endif
+    return -1;
+}
+
+/* Maps and faults in a buffer of at least *length bytes */
+static uint8_t *Map(sdi_pool_t *pool, size_t *length, bool *huge)
+{
+    size_t len = (*length + SDI_POOL_HUGE_PAGE - 1)
+               & ~(size_t)(SDI_POOL_HUGE_PAGE - 1);
+    uint8_t *p;
+
+    *length = len;
+    *huge = false;
+
+#if defined (MAP_HUGETLB) && defined (MAP_POPULATE)
+    if (pool->hugetlb)
+    {
+        p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE,
+                 -1, 0);
+        if (p != MAP_FAILED)
+        {
+            *huge = true;
+            return p;
+        }
+        msg_Dbg(pool->obj, "no huge pages available (%s)",
+                vlc_strerror_c(errno));
+        pool->hugetlb = false;
+    }
+#endif
+
+    /* Over-map, to align on a huge page boundary */
+    p = mmap(NULL, len + SDI_POOL_HUGE_PAGE, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED)
+        return NULL;
+
+    size_t head = -(uintptr_t)p & (SDI_POOL_HUGE_PAGE - 1);
+    if (head > 0)
+        munmap(p, head);
+    munmap(p + head + len, SDI_POOL_HUGE_PAGE - head);
+    p += head;
+
+#ifdef MADV_HUGEPAGE
+    madvise(p, len, MADV_HUGEPAGE);
+#endif
+    /* Fault the pages in now, on the node of the calling thread */
+    const size_t page = sysconf(_SC_PAGESIZE);
+    for (size_t i = 0; i < len; i += page)
+        p[i] = 0;
+    return p;
+}
+
+static void FrameDelete(sdi_frame_t *frame)
+{
+    munmap(frame->base, frame->length);
+    free(frame);
+}
+
+static void PoolDestroy(sdi_pool_t *pool)
+{
+    vlc_mutex_destroy(&pool->lock);
+    free(pool);
+}
+
+static void FrameRelease(block_t *block)
+{
+    sdi_frame_t *frame = (sdi_frame_t *)block;
+    sdi_pool_t *pool = frame->pool;
+    bool destroy;
+
+    vlc_mutex_lock(&pool->lock);
+    if (!pool->closed && frame->size == pool->size
+     && pool->idle_count < pool->max_idle)
+    {
+        frame->next = pool->idle;
+        pool->idle = frame;
+        pool->idle_count++;
+        frame = NULL;
+    }
+    destroy = --pool->refs == 0;
+    vlc_mutex_unlock(&pool->lock);
+
+    if (frame != NULL)
+        FrameDelete(frame);
+    if (destroy)
+        PoolDestroy(pool);
+}
+
+static sdi_frame_t *FrameNew(sdi_pool_t *pool, size_t size)
+{
+    sdi_frame_t *frame = malloc(sizeof (*frame));
+    if (unlikely(frame == NULL))
+        return NULL;
+
+    bool huge;
+    frame->pool = pool;
+    frame->size = size;
+    frame->length = size + 2 * SDI_POOL_PADDING;
+    frame->base = Map(pool, &frame->length, &huge);
+    if (frame->base == NULL)
+    {
+        free(frame);
+        return NULL;
+    }
+
+    vlc_mutex_lock(&pool->lock);
+    if (pool->stats.allocs == 0)
+        msg_Dbg(pool->obj, "mapping %zu bytes frames on %s huge pages"
+                " (NUMA node %d)", size, huge ? "explicit" : "transparent",
+                GetNode());
+    pool->stats.allocs++;
+    if (huge)
+        pool->stats.huge++;
+    pool->stats.bytes += frame->length;
+    vlc_mutex_unlock(&pool->lock);
+    return frame;
+}
+
+#undef sdi_pool_New
+sdi_pool_t *sdi_pool_New(vlc_object_t *obj, unsigned max_idle)
+{
+    sdi_pool_t *pool = malloc(sizeof (*pool));
+    if (unlikely(pool == NULL))
+        return NULL;
+
+    pool->obj = obj;
+    vlc_mutex_init(&pool->lock);
+    pool->refs = 1;
+    pool->closed = false;
+    pool->idle = NULL;
+    pool->idle_count = 0;
+    pool->max_idle = max_idle;
+    pool->size = 0;
+    pool->hugetlb = true;
+    pool->last_faults = UINT64_MAX;
+    memset(&pool->stats, 0, sizeof (pool->stats));
+    return pool;
+}
+
+void sdi_pool_Delete(sdi_pool_t *pool)
+{
+    sdi_frame_t *idle;
+    bool destroy;
+
+    vlc_mutex_lock(&pool->lock);
+    msg_Dbg(pool->obj, "frame pool: %u buffers mapped (%u on explicit huge "
+            "pages, %"PRIu64" MiB), %u frames recycled, %"PRIu64" page faults",
+            pool->stats.allocs, pool->stats.huge, pool->stats.bytes >> 20,
+            pool->stats.recycled, pool->stats.faults);
+    pool->closed = true;
+    idle = pool->idle;
+    pool->idle = NULL;
+    pool->idle_count = 0;
+    destroy = --pool->refs == 0;
+    vlc_mutex_unlock(&pool->lock);
+
+    while (idle != NULL)
+    {
+        sdi_frame_t *next = idle->next;
+        FrameDelete(idle);
+        idle = next;
+    }
+    if (destroy)
+        PoolDestroy(pool);
+}
+
+block_t *sdi_pool_Alloc(sdi_pool_t *pool, size_t size)
+{
+    sdi_frame_t *frame = NULL, *stale = NULL;
+    uint64_t faults = GetFaults();
+
+    vlc_mutex_lock(&pool->lock);
+    if (pool->last_faults != UINT64_MAX)
+        pool->stats.faults += faults - pool->last_faults;
+    pool->last_faults = faults;
+
+    if (size != pool->size)
+    {   /* Format change: drop the frames of the former size */
+        stale = pool->idle;
+        pool->idle = NULL;
+        pool->idle_count = 0;
+        pool->size = size;
+    }
+    else if (pool->idle != NULL)
+    {
+        frame = pool->idle;
+        pool->idle = frame->next;
+        pool->idle_count--;
+        pool->stats.recycled++;
+    }
+    pool->refs++; /* the frame holds a reference */
+    vlc_mutex_unlock(&pool->lock);
+
+    while (stale != NULL)
+    {
+        sdi_frame_t *next = stale->next;
+        FrameDelete(stale);
+        stale = next;
+    }
+
+    if (frame == NULL)
+    {
+        frame = FrameNew(pool, size);
+        if (unlikely(frame == NULL))
+        {
+            vlc_mutex_lock(&pool->lock);
+            pool->refs--; /* the owner still holds its reference */
+            vlc_mutex_unlock(&pool->lock);
+            return NULL;
+        }
+    }
+
+    block_Init(&frame->self, frame->base, frame->length);
+    frame->self.p_buffer += SDI_POOL_PADDING;
+    frame->self.i_buffer = size;
+    frame->self.pf_release = FrameRelease;
+    return &frame->self;
+}
+
+void sdi_pool_GetStats(sdi_pool_t *pool, sdi_pool_stats_t *stats)
+{
+    vlc_mutex_lock(&pool->lock);
+    *stats = pool->stats;
+    vlc_mutex_unlock(&pool->lock);
+}
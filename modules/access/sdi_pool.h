@@ -0,0 +1,71 @@
+/*****************************************************************************
+ * sdi_pool.h: raw video frame pool for SDI capture
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef VLC_SDI_POOL_H
+#define VLC_SDI_POOL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <vlc_common.h>
+#include <vlc_block.h>
+
+/**
+ * Pool of large frame buffers, backed by huge pages where possible.
+ *
+ * Buffers are faulted in as soon as they are mapped, by the thread calling
+ * sdi_pool_Alloc(). With the default first-touch policy, they thus live on
+ * the NUMA node of the capture thread. Released blocks go back to the pool
+ * from any thread, and the pool outlives its owner until they are all back.
+ */
+typedef struct sdi_pool_t sdi_pool_t;
+
+typedef struct
+{
+    unsigned allocs;    /* buffers mapped */
+    unsigned huge;      /* ... of which on explicit huge pages */
+    unsigned recycled;  /* frames served from the pool */
+    uint64_t bytes;     /* bytes mapped */
+    uint64_t faults;    /* page faults of the capture thread */
+} sdi_pool_stats_t;
+
+sdi_pool_t *sdi_pool_New(vlc_object_t *, unsigned max_idle);
+#define sdi_pool_New(obj, max) sdi_pool_New(VLC_OBJECT(obj), max)
+
+/**
+ * Releases the pool owner reference, logging the statistics.
+ * Must be called from the owner object, which must still be alive.
+ */
+void sdi_pool_Delete(sdi_pool_t *);
+
+/**
+ * Gets a frame of the given payload size. Frames of another size are
+ * dropped from the pool. Must be called from the capture thread.
+ */
+block_t *sdi_pool_Alloc(sdi_pool_t *, size_t size);
+
+void sdi_pool_GetStats(sdi_pool_t *, sdi_pool_stats_t *);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
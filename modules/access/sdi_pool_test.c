@@ -0,0 +1,171 @@
+/*****************************************************************************
+ * sdi_pool_test.c: SDI frame pool test and benchmark
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/* Usage: sdi_pool_test [frames]
+ * Checks frame recycling, then compares the capture of 1080p v210 frames
+ * into heap blocks and into pooled frames. */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#undef NDEBUG
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+
+#include <vlc_common.h>
+#include <vlc_block.h>
+
+#include "sdi_pool.h"
+
+static vlc_object_t quiet = { .i_flags = OBJECT_FLAGS_QUIET };
+
+#define V210_1080 (1280 * 4 * 1080) /* 1920 pixels per 128 bytes */
+
+static void check_frame(block_t *frame, size_t size)
+{
+    assert(frame != NULL);
+    assert(frame->i_buffer == size);
+    assert(((uintptr_t)frame->p_buffer % 64) == 0);
+    assert(frame->p_buffer >= frame->p_start + 64);
+    assert(frame->p_buffer + size + 64 <= frame->p_start + frame->i_size);
+    memset(frame->p_buffer, 0x5a, size);
+}
+
+static void *release_frame(void *data)
+{
+    block_Release(data);
+    return NULL;
+}
+
+static void test_recycling(void)
+{
+    sdi_pool_t *pool = sdi_pool_New(&quiet, 2);
+    sdi_pool_stats_t stats;
+    block_t *frames[3];
+
+    assert(pool != NULL);
+
+    frames[0] = sdi_pool_Alloc(pool, V210_1080);
+    check_frame(frames[0], V210_1080);
+    uint8_t *buf = frames[0]->p_buffer;
+    block_Release(frames[0]);
+
+    frames[0] = sdi_pool_Alloc(pool, V210_1080);
+    check_frame(frames[0], V210_1080);
+    assert(frames[0]->p_buffer == buf);
+    assert(frames[0]->i_flags == 0 && frames[0]->i_pts == VLC_TS_INVALID);
+
+    /* beyond the idle limit, frames are unmapped */
+    for (unsigned i = 1; i < 3; i++)
+    {
+        frames[i] = sdi_pool_Alloc(pool, V210_1080);
+        check_frame(frames[i], V210_1080);
+    }
+    for (unsigned i = 0; i < 3; i++)
+        block_Release(frames[i]);
+
+    sdi_pool_GetStats(pool, &stats);
+    assert(stats.allocs == 3 && stats.recycled == 1);
+
+    /* a format change drops the frames of the former size */
+    frames[0] = sdi_pool_Alloc(pool, 1920 * 1080 * 2);
+    check_frame(frames[0], 1920 * 1080 * 2);
+    sdi_pool_GetStats(pool, &stats);
+    assert(stats.allocs == 4 && stats.recycled == 1);
+
+    /* frames released by another thread */
+    vlc_thread_t th;
+    assert(vlc_clone(&th, release_frame, frames[0],
+                     VLC_THREAD_PRIORITY_LOW) == 0);
+    vlc_join(th, NULL);
+
+    frames[0] = sdi_pool_Alloc(pool, 1920 * 1080 * 2);
+    check_frame(frames[0], 1920 * 1080 * 2);
+    sdi_pool_GetStats(pool, &stats);
+    assert(stats.recycled == 2);
+
+    /* frames in flight outlive the pool */
+    sdi_pool_Delete(pool);
+    memset(frames[0]->p_buffer, 0, frames[0]->i_buffer);
+    block_Release(frames[0]);
+}
+
+static uint64_t get_faults(void)
+{
+    struct rusage ru;
+
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_minflt + ru.ru_majflt;
+}
+
+/* Captures frames, with a few in flight downstream */
+static void bench(sdi_pool_t *pool, unsigned count)
+{
+    block_t *inflight[4] = { NULL };
+    uint64_t faults = get_faults();
+    mtime_t start = mdate();
+
+    for (unsigned i = 0; i < count; i++)
+    {
+        block_t **slot = &inflight[i % ARRAY_SIZE(inflight)];
+
+        if (*slot != NULL)
+            block_Release(*slot);
+        *slot = pool ? sdi_pool_Alloc(pool, V210_1080)
+                     : block_Alloc(V210_1080);
+        assert(*slot != NULL);
+        memset((*slot)->p_buffer, i, V210_1080);
+    }
+    for (unsigned i = 0; i < ARRAY_SIZE(inflight); i++)
+        if (inflight[i] != NULL)
+            block_Release(inflight[i]);
+
+    mtime_t spent = mdate() - start;
+    faults = get_faults() - faults;
+
+    printf("%-5s %7.1f frames/s, %6.1f page faults per frame\n",
+           pool ? "pool" : "heap",
+           (double)count * CLOCK_FREQ / (spent ? spent : 1),
+           (double)faults / count);
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned count = (argc > 1) ? strtoul(argv[1], NULL, 0) : 200;
+
+    test_recycling();
+
+    sdi_pool_t *pool = sdi_pool_New(&quiet, 8);
+    assert(pool != NULL);
+
+    bench(NULL, count);
+    bench(pool, count);
+
+    sdi_pool_stats_t stats;
+    sdi_pool_GetStats(pool, &stats);
+    printf("pool: %u buffers mapped (%u on explicit huge pages), "
+           "%u frames recycled\n", stats.allocs, stats.huge, stats.recycled);
+    sdi_pool_Delete(pool);
+    return 0;
+}
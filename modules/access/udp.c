@@ -44,6 +44,10 @@
 #include <vlc_block.h>
 #include <vlc_interrupt.h>
 #include <fcntl.h>
+#include <assert.h>
+#ifdef HAVE_RECVMMSG
+# include <sys/socket.h>
+#endif
 
 #define MTU 65535
 
@@ -55,6 +59,13 @@ static void Close( vlc_object_t * );
 
 #define BUFFER_TEXT N_("Receive buffer")
 #define BUFFER_LONGTEXT N_("UDP receive buffer size (bytes)" )
+#define BATCH_TEXT N_("Receive batch")
+#define BATCH_LONGTEXT N_("Maximum number of datagrams read from the " \
+    "socket at once." )
+#define PACKET_TEXT N_("Maximum datagram size")
+#define PACKET_LONGTEXT N_("Size of the receive packet buffers (bytes). " \
+    "Longer datagrams are truncated. Lower this (e.g. to 1500) to save " \
+    "memory when receiving many streams." )
 
 vlc_module_begin ()
     set_shortname( N_("UDP" ) )
@@ -64,6 +75,10 @@ vlc_module_begin ()
 
     add_obsolete_integer( "server-port" ) /* since 2.0.0 */
     add_integer( "udp-buffer", 0x400000, BUFFER_TEXT, BUFFER_LONGTEXT, true )
+    add_integer_with_range( "udp-batch", 32, 1, 1024,
+                            BATCH_TEXT, BATCH_LONGTEXT, true )
+    add_integer_with_range( "udp-packet-size", MTU, 188, MTU,
+                            PACKET_TEXT, PACKET_LONGTEXT, true )
 
     set_capability( "access", 0 )
     add_shortcut( "udp", "udpstream", "udp4", "udp6" )
@@ -71,6 +86,127 @@ vlc_module_begin ()
     set_callbacks( Open, Close )
 vlc_module_end ()
 
+/*****************************************************************************
+ * Packet pool: fixed-size blocks recycled on release
+ *****************************************************************************/
+typedef struct udp_pool
+{
+    vlc_mutex_t lock;
+    block_t *free; /* linked through p_next */
+    unsigned free_count;
+    unsigned free_max;
+    unsigned refs; /* one for the access, one per allocated block */
+    size_t size;
+} udp_pool_t;
+
+struct udp_block
+{
+    block_t self;
+    udp_pool_t *pool;
+};
+
+static void udp_pool_Destroy( udp_pool_t *pool )
+{
+    assert( pool->free == NULL );
+    vlc_mutex_destroy( &pool->lock );
+    free( pool );
+}
+
+static void udp_block_Release( block_t *block )
+{
+    udp_pool_t *pool = ((struct udp_block *)block)->pool;
+
+    vlc_mutex_lock( &pool->lock );
+    if( pool->free_count < pool->free_max )
+    {
+        block->p_next = pool->free;
+        pool->free = block;
+        pool->free_count++;
+        vlc_mutex_unlock( &pool->lock );
+        return;
+    }
+
+    bool last = --pool->refs == 0;
+    vlc_mutex_unlock( &pool->lock );
+
+    free( block );
+    if( last )
+        udp_pool_Destroy( pool );
+}
+
+static udp_pool_t *udp_pool_New( size_t size, unsigned free_max )
+{
+    udp_pool_t *pool = malloc( sizeof( *pool ) );
+    if( unlikely( pool == NULL ) )
+        return NULL;
+
+    vlc_mutex_init( &pool->lock );
+    pool->free = NULL;
+    pool->free_count = 0;
+    pool->free_max = free_max;
+    pool->refs = 1;
+    pool->size = size;
+    return pool;
+}
+
+static block_t *udp_pool_Alloc( udp_pool_t *pool )
+{
+    block_t *block;
+
+    vlc_mutex_lock( &pool->lock );
+    block = pool->free;
+    if( block != NULL )
+    {
+        pool->free = block->p_next;
+        pool->free_count--;
+    }
+    else
+        pool->refs++;
+    vlc_mutex_unlock( &pool->lock );
+
+    if( block == NULL )
+    {
+        struct udp_block *ub = malloc( sizeof( *ub ) + pool->size );
+        if( unlikely( ub == NULL ) )
+        {
+            vlc_mutex_lock( &pool->lock );
+            pool->refs--;
+            vlc_mutex_unlock( &pool->lock );
+            return NULL;
+        }
+        ub->pool = pool;
+        block = &ub->self;
+    }
+
+    block_Init( block, (struct udp_block *)block + 1, pool->size );
+    block->pf_release = udp_block_Release;
+    return block;
+}
+
+/* Drops the access reference; blocks still in flight keep the pool alive. */
+static void udp_pool_Release( udp_pool_t *pool )
+{
+    vlc_mutex_lock( &pool->lock );
+    block_t *list = pool->free;
+
+    pool->free = NULL;
+    pool->refs -= pool->free_count;
+    pool->free_count = 0;
+    pool->free_max = 0;
+
+    bool last = --pool->refs == 0;
+    vlc_mutex_unlock( &pool->lock );
+
+    while( list != NULL )
+    {
+        block_t *next = list->p_next;
+        free( list );
+        list = next;
+    }
+    if( last )
+        udp_pool_Destroy( pool );
+}
+
 struct access_sys_t
 {
     int fd;
@@ -78,6 +214,23 @@ struct access_sys_t
     block_fifo_t *fifo;
     vlc_sem_t semaphore;
     vlc_thread_t thread;
+
+    udp_pool_t *pool;
+    unsigned batch;
+    block_t **slots; /* receive buffers, NULL once queued */
+#ifdef HAVE_RECVMMSG
+    struct mmsghdr *msgs;
+    struct iovec *iovs;
+    char (*cmsgs)[CMSG_SPACE(sizeof (uint32_t))];
+#endif
+
+    /* Statistics, owned by the reader thread */
+    uint64_t datagrams;
+    uint64_t syscalls;
+    uint64_t fifo_drops;
+    uint64_t kernel_drops;
+    uint64_t truncated;
+    mtime_t stats_date;
 };
 
 /*****************************************************************************
@@ -179,12 +332,56 @@ static int Open( vlc_object_t *p_this )
     }
 
     sys->fifo_size = var_InheritInteger( p_access, "udp-buffer");
+#ifdef HAVE_RECVMMSG
+    sys->batch = var_InheritInteger( p_access, "udp-batch" );
+#else
+    sys->batch = 1;
+#endif
+    sys->pool = udp_pool_New( var_InheritInteger( p_access, "udp-packet-size" ),
+                              4 * sys->batch );
+    sys->slots = calloc( sys->batch, sizeof( *sys->slots ) );
+#ifdef HAVE_RECVMMSG
+    sys->msgs = calloc( sys->batch, sizeof( *sys->msgs ) );
+    sys->iovs = calloc( sys->batch, sizeof( *sys->iovs ) );
+    sys->cmsgs = calloc( sys->batch, sizeof( *sys->cmsgs ) );
+    if( unlikely( sys->msgs == NULL || sys->iovs == NULL
+               || sys->cmsgs == NULL ) )
+        goto error_alloc;
+#endif
+    if( unlikely( sys->pool == NULL || sys->slots == NULL ) )
+        goto error_alloc;
+
+#ifdef SO_RXQ_OVFL
+    /* Have the kernel report its socket buffer drop counter */
+    if( setsockopt( sys->fd, SOL_SOCKET, SO_RXQ_OVFL, &(int){ 1 },
+                    sizeof (int) ) )
+        msg_Dbg( p_access, "kernel drop counter not available: %s",
+                 vlc_strerror_c( errno ) );
+#endif
+
+    sys->datagrams = sys->syscalls = 0;
+    sys->fifo_drops = sys->kernel_drops = sys->truncated = 0;
+    sys->stats_date = 0;
+    var_Create( p_access, "udp-datagrams", VLC_VAR_INTEGER );
+    var_Create( p_access, "udp-syscalls", VLC_VAR_INTEGER );
+    var_Create( p_access, "udp-fifo-drops", VLC_VAR_INTEGER );
+    var_Create( p_access, "udp-kernel-drops", VLC_VAR_INTEGER );
+
     vlc_sem_init( &sys->semaphore, 0 );
 
     if( vlc_clone( &sys->thread, ThreadRead, p_access,
                    VLC_THREAD_PRIORITY_INPUT ) )
     {
         vlc_sem_destroy( &sys->semaphore );
+error_alloc:
+#ifdef HAVE_RECVMMSG
+        free( sys->cmsgs );
+        free( sys->iovs );
+        free( sys->msgs );
+#endif
+        free( sys->slots );
+        if( sys->pool != NULL )
+            udp_pool_Release( sys->pool );
         block_FifoRelease( sys->fifo );
         net_Close( sys->fd );
 error:
@@ -205,9 +402,26 @@ static void Close( vlc_object_t *p_this )
 
     vlc_cancel( sys->thread );
     vlc_join( sys->thread, NULL );
+
+    msg_Dbg( p_access, "received %"PRIu64" datagrams in %"PRIu64" calls, "
+             "dropped %"PRIu64" (FIFO) %"PRIu64" (kernel), "
+             "truncated %"PRIu64, sys->datagrams, sys->syscalls,
+             sys->fifo_drops, sys->kernel_drops, sys->truncated );
+
     vlc_sem_destroy( &sys->semaphore );
     block_FifoRelease( sys->fifo );
     net_Close( sys->fd );
+
+    for( unsigned i = 0; i < sys->batch; i++ )
+        if( sys->slots[i] != NULL )
+            block_Release( sys->slots[i] );
+#ifdef HAVE_RECVMMSG
+    free( sys->cmsgs );
+    free( sys->iovs );
+    free( sys->msgs );
+#endif
+    free( sys->slots );
+    udp_pool_Release( sys->pool );
     free( sys );
 }
 
@@ -260,6 +474,104 @@ static block_t *BlockUDP( access_t *p_access )
     return block;
 }
 
+/*****************************************************************************
+ * Recv: wait for and read up to count datagrams into sys->slots
+ *****************************************************************************/
+#ifdef HAVE_RECVMMSG
+static int Recv( access_t *access, unsigned count )
+{
+    access_sys_t *sys = access->p_sys;
+    int n;
+
+    for( unsigned i = 0; i < count; i++ )
+    {
+        struct msghdr *msg = &sys->msgs[i].msg_hdr;
+
+        sys->iovs[i].iov_base = sys->slots[i]->p_buffer;
+        sys->iovs[i].iov_len = sys->pool->size;
+        msg->msg_name = NULL;
+        msg->msg_namelen = 0;
+        msg->msg_iov = &sys->iovs[i];
+        msg->msg_iovlen = 1;
+        msg->msg_control = sys->cmsgs[i];
+        msg->msg_controllen = sizeof( sys->cmsgs[i] );
+        msg->msg_flags = 0;
+    }
+
+    do
+        /* cancellation point */
+        n = recvmmsg( sys->fd, sys->msgs, count, MSG_WAITFORONE, NULL );
+    while( n == -1 );
+
+    for( int i = 0; i < n; i++ )
+    {
+        struct msghdr *msg = &sys->msgs[i].msg_hdr;
+
+        sys->slots[i]->i_buffer = sys->msgs[i].msg_len;
+        if( msg->msg_flags & MSG_TRUNC )
+            sys->truncated++;
+# ifdef SO_RXQ_OVFL
+        for( struct cmsghdr *cmsg = CMSG_FIRSTHDR( msg ); cmsg != NULL;
+             cmsg = CMSG_NXTHDR( msg, cmsg ) )
+            if( cmsg->cmsg_level == SOL_SOCKET
+             && cmsg->cmsg_type == SO_RXQ_OVFL )
+            {
+                uint32_t drops;
+
+                /* The kernel reports a running total */
+                memcpy( &drops, CMSG_DATA( cmsg ), sizeof( drops ) );
+                sys->kernel_drops = drops;
+            }
+# endif
+    }
+    return n;
+}
+#else
+static int Recv( access_t *access, unsigned count )
+{
+    access_sys_t *sys = access->p_sys;
+    block_t *pkt = sys->slots[0];
+    ssize_t len;
+
+    assert( count == 1 );
+    VLC_UNUSED( count );
+    do
+    {
+# ifndef LIBVLC_USE_PTHREAD
+        struct pollfd ufd = { .fd = sys->fd, .events = POLLIN };
+        while (poll(&ufd, 1, -1) <= 0); /* cancellation point */
+# endif
+        len = recv( sys->fd, pkt->p_buffer, sys->pool->size, 0 );
+    }
+    while( len == -1 );
+
+    if( (size_t)len > sys->pool->size )
+    {   /* Only reported by some stacks (MSG_TRUNC semantics) */
+        len = sys->pool->size;
+        sys->truncated++;
+    }
+    pkt->i_buffer = len;
+    return 1;
+}
+#endif
+
+static void UpdateStats( access_t *access )
+{
+    access_sys_t *sys = access->p_sys;
+    mtime_t now = mdate();
+
+    if( now < sys->stats_date )
+        return;
+    sys->stats_date = now + CLOCK_FREQ;
+
+    int canc = vlc_savecancel();
+    var_SetInteger( access, "udp-datagrams", sys->datagrams );
+    var_SetInteger( access, "udp-syscalls", sys->syscalls );
+    var_SetInteger( access, "udp-fifo-drops", sys->fifo_drops );
+    var_SetInteger( access, "udp-kernel-drops", sys->kernel_drops );
+    vlc_restorecancel( canc );
+}
+
 /*****************************************************************************
  * ThreadRead: Pull packets from socket as soon as possible.
  *****************************************************************************/
@@ -270,42 +582,60 @@ static void* ThreadRead( void *data )
 
     for(;;)
     {
-        block_t *pkt = block_Alloc(MTU);
-        if (unlikely(pkt == NULL))
+        unsigned count = 0;
+
+        /* Refill the receive slots from the pool */
+        while( count < sys->batch )
+        {
+            if( sys->slots[count] == NULL )
+            {
+                sys->slots[count] = udp_pool_Alloc( sys->pool );
+                if( unlikely( sys->slots[count] == NULL ) )
+                    break;
+            }
+            count++;
+        }
+
+        if (unlikely(count == 0))
         {   /* OOM - dequeue and discard one packet */
             char dummy;
             recv(sys->fd, &dummy, 1, 0);
             continue;
         }
 
-        ssize_t len;
+        int n = Recv( access, count );
 
-        block_cleanup_push(pkt);
-        do
-        {
-#ifndef LIBVLC_USE_PTHREAD
-            struct pollfd ufd = { .fd = sys->fd, .events = POLLIN };
-            while (poll(&ufd, 1, -1) <= 0); /* cancellation point */
-#endif
-            len = recv(sys->fd, pkt->p_buffer, MTU, 0);
-        }
-        while (len == -1);
-        vlc_cleanup_pop();
-
-        pkt->i_buffer = len;
+        sys->syscalls++;
+        sys->datagrams += n;
 
         vlc_fifo_Lock(sys->fifo);
-        /* Discard old buffers on overflow */
-        while (vlc_fifo_GetBytes(sys->fifo) + len > sys->fifo_size)
+        for( int i = 0; i < n; i++ )
         {
-            int canc = vlc_savecancel();
-            block_Release(vlc_fifo_DequeueUnlocked(sys->fifo));
-            vlc_restorecancel(canc);
-        }
+            block_t *pkt = sys->slots[i];
+
+            sys->slots[i] = NULL;
 
-        vlc_fifo_QueueUnlocked(sys->fifo, pkt);
+            /* Discard old buffers on overflow */
+            while (vlc_fifo_GetBytes(sys->fifo) + pkt->i_buffer
+                    > sys->fifo_size)
+            {
+                block_t *old = vlc_fifo_DequeueUnlocked(sys->fifo);
+                if (old == NULL)
+                    break;
+                int canc = vlc_savecancel();
+                block_Release(old);
+                vlc_restorecancel(canc);
+                sys->fifo_drops++;
+            }
+
+            vlc_fifo_QueueUnlocked(sys->fifo, pkt);
+        }
         vlc_fifo_Unlock(sys->fifo);
-        vlc_sem_post(&sys->semaphore);
+
+        for( int i = 0; i < n; i++ )
+            vlc_sem_post(&sys->semaphore);
+
+        UpdateStats( access );
     }
 
     return NULL;
@@ -0,0 +1,434 @@
+/*****************************************************************************
+ * vanc_test.c: VANC parser test, fuzzer and benchmark
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/* Usage: vanc_test [width file...]
+ * Without arguments, runs on synthetic lines. Otherwise each file is read as
+ * a sequence of v210 VANC lines of the given width (e.g. dumped from a
+ * capture), parsed as is, then used as fuzzing seeds. */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#undef NDEBUG
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vlc_common.h>
+#include <vlc_block.h>
+
+#include "sdi.h"
+#include "../video_chroma/v210.h"
+
+/* messages from the parser are not interesting here */
+static vlc_object_t quiet = { .i_flags = OBJECT_FLAGS_QUIET };
+
+static void put_sample(uint32_t *line, size_t n, unsigned v)
+{
+    uint32_t *w = &line[n / 3];
+    unsigned shift = 10 * (n % 3);
+    *w = (*w & ~(0x3ffu << shift)) | (v & 0x3ff) << shift;
+}
+
+static unsigned with_parity(uint8_t v)
+{
+    unsigned p = parity(v);
+    return v | p << 8 | !p << 9;
+}
+
+static void blank_line(uint32_t *line, unsigned width)
+{
+    memset(line, 0, v210_GetStride(width));
+    for (size_t n = 0; n < 2 * width; n++)
+        put_sample(line, n, (n & 1) ? 0x040 : 0x200);
+}
+
+/* Writes an ancillary data packet at word pos of the stream,
+ * returns the position following it */
+static size_t put_packet(uint32_t *line, enum vanc_stream stream, size_t pos,
+                         uint8_t did, uint8_t sdid, const uint8_t *udw,
+                         uint8_t dc)
+{
+    const size_t first = stream == VANC_LUMA ? 1 : 0;
+    const size_t step = stream == VANC_COMPOSITE ? 1 : 2;
+#define PUT(v) put_sample(line, first + (pos++) * step, v)
+    unsigned sum = 0, w;
+
+    PUT(0x000);
+    PUT(0x3ff);
+    PUT(0x3ff);
+    w = with_parity(did);  sum += w; PUT(w);
+    w = with_parity(sdid); sum += w; PUT(w);
+    w = with_parity(dc);   sum += w; PUT(w);
+    for (unsigned i = 0; i < dc; i++) {
+        w = with_parity(udw[i]);
+        sum += w;
+        PUT(w);
+    }
+    sum &= 0x1ff;
+    sum |= (~sum & 0x100) << 1;
+    PUT(sum);
+#undef PUT
+    return pos;
+}
+
+static size_t make_cdp(uint8_t *cdp, unsigned cc_count, uint8_t seq)
+{
+    size_t len = 0;
+
+    cdp[len++] = 0x96;
+    cdp[len++] = 0x69;
+    cdp[len++] = 0; /* length, below */
+    cdp[len++] = 0x4f; /* 29.97 */
+    cdp[len++] = 0x43;
+    cdp[len++] = 0;
+    cdp[len++] = seq;
+    cdp[len++] = 0x72;
+    cdp[len++] = 0xe0 | cc_count;
+    for (unsigned i = 0; i < cc_count; i++) {
+        cdp[len++] = 0xfc;
+        cdp[len++] = 0x80 + i;
+        cdp[len++] = 0x80 + i;
+    }
+    cdp[len++] = 0x74;
+    cdp[len++] = 0;
+    cdp[len++] = seq;
+    len++; /* checksum */
+    cdp[2] = len;
+
+    uint8_t sum = 0;
+    for (size_t i = 0; i < len - 1; i++)
+        sum += cdp[i];
+    cdp[len - 1] = sum ? 256 - sum : 0;
+    return len;
+}
+
+struct results
+{
+    unsigned cc, scte104, afd, timecode;
+    block_t *scte104_partial;
+    size_t scte104_size;
+    vanc_afd_t last_afd;
+    vanc_timecode_t last_timecode;
+};
+
+static void on_cc(void *opaque, const vanc_packet_t *pkt)
+{
+    struct results *r = opaque;
+    block_t *cc = vanc_to_cc(&quiet, pkt);
+    if (cc != NULL) {
+        for (size_t i = 0; i < cc->i_buffer / 3; i++)
+            assert(cc->p_buffer[3 * i] == 0xfc);
+        r->cc++;
+        block_Release(cc);
+    }
+}
+
+static void on_scte104(void *opaque, const vanc_packet_t *pkt)
+{
+    struct results *r = opaque;
+    block_t *msg = vanc_to_scte104(&r->scte104_partial, pkt);
+    if (msg != NULL) {
+        r->scte104++;
+        r->scte104_size = msg->i_buffer;
+        block_Release(msg);
+    }
+}
+
+static void on_afd(void *opaque, const vanc_packet_t *pkt)
+{
+    struct results *r = opaque;
+    if (vanc_to_afd(&r->last_afd, pkt) == VLC_SUCCESS)
+        r->afd++;
+}
+
+static void on_timecode(void *opaque, const vanc_packet_t *pkt)
+{
+    struct results *r = opaque;
+    if (vanc_to_timecode(&r->last_timecode, pkt) == VLC_SUCCESS)
+        r->timecode++;
+}
+
+static const vanc_handler_t handlers[] = {
+    { VANC_DID_CEA708,  VANC_SDID_CEA708,  on_cc },
+    { VANC_DID_SCTE104, VANC_SDID_SCTE104, on_scte104 },
+    { VANC_DID_AFD,     VANC_SDID_AFD,     on_afd },
+    { VANC_DID_RP188,   VANC_SDID_RP188,   on_timecode },
+    { 0, 0, NULL },
+};
+
+/* Builds a line with one packet of each type, plus an unknown one */
+static void make_line(uint32_t *line, unsigned width, enum vanc_stream stream)
+{
+    uint8_t udw[255];
+    size_t pos = 4;
+
+    blank_line(line, width);
+
+    pos = put_packet(line, stream, pos, VANC_DID_CEA708, VANC_SDID_CEA708,
+                     udw, make_cdp(udw, 20, 0x42));
+
+    /* SCTE-104 message of 300 bytes, in two packets */
+    udw[0] = 0x02; /* following */
+    for (unsigned i = 1; i < 200; i++)
+        udw[i] = i;
+    pos = put_packet(line, stream, pos, VANC_DID_SCTE104, VANC_SDID_SCTE104,
+                     udw, 200);
+    udw[0] = 0x04; /* continued */
+    pos = put_packet(line, stream, pos, VANC_DID_SCTE104, VANC_SDID_SCTE104,
+                     udw, 102);
+
+    /* AFD 10 (16:9), letterbox bars of 132 lines */
+    memset(udw, 0, 8);
+    udw[0] = 10 << 3 | 1 << 2;
+    udw[3] = 0xc0;
+    udw[5] = 132;
+    udw[7] = 132;
+    pos = put_packet(line, stream, pos, VANC_DID_AFD, VANC_SDID_AFD, udw, 8);
+
+    /* 12:34:56;29 */
+    static const uint8_t tc[8] = { 9, 2 | 4, 6, 5, 4, 3, 2, 1 };
+    for (unsigned i = 0; i < 8; i++) {
+        udw[2 * i] = tc[i] << 4;
+        udw[2 * i + 1] = 0;
+    }
+    for (unsigned i = 0; i < 8; i++) /* DBB1 */
+        udw[i] |= ((0xaa >> i) & 1) << 3;
+    pos = put_packet(line, stream, pos, VANC_DID_RP188, VANC_SDID_RP188,
+                     udw, 16);
+
+    memset(udw, 0x55, 8);
+    pos = put_packet(line, stream, pos, 0x51, 0x01, udw, 8);
+
+    assert(pos <= (stream == VANC_COMPOSITE ? 2 * width : width));
+}
+
+static void test_line(unsigned width, enum vanc_stream stream)
+{
+    uint32_t *line = malloc(v210_GetStride(width));
+    struct results r;
+    vanc_stats_t stats;
+
+    assert(line != NULL);
+    make_line(line, width, stream);
+    memset(&r, 0, sizeof(r));
+    memset(&stats, 0, sizeof(stats));
+
+    assert(vanc_parse_line(line, width, stream, handlers, &r, &stats) == 6);
+    assert(stats.packets == 6 && stats.unhandled == 1);
+    assert(stats.parity == 0 && stats.checksum == 0 && stats.truncated == 0);
+
+    assert(r.cc == 1);
+    assert(r.scte104 == 1 && r.scte104_size == 300);
+    assert(r.scte104_partial == NULL);
+    assert(r.afd == 1);
+    assert(r.last_afd.afd == 10 && r.last_afd.wide);
+    assert(r.last_afd.bar_flags == 0xc);
+    assert(r.last_afd.bar[0] == 132 && r.last_afd.bar[1] == 132);
+    assert(r.timecode == 1);
+    assert(r.last_timecode.hours == 12 && r.last_timecode.minutes == 34);
+    assert(r.last_timecode.seconds == 56 && r.last_timecode.frames == 29);
+    assert(r.last_timecode.drop_frame);
+    assert(r.last_timecode.dbb1 == 0xaa);
+
+    /* the other stream must not see anything */
+    if (stream != VANC_COMPOSITE) {
+        memset(&stats, 0, sizeof(stats));
+        assert(vanc_parse_line(line, width,
+                               stream == VANC_LUMA ? VANC_CHROMA : VANC_LUMA,
+                               handlers, &r, &stats) == 0);
+    }
+
+    /* parity error in the first packet header */
+    const size_t first = stream == VANC_LUMA ? 1 : 0;
+    const size_t step = stream == VANC_COMPOSITE ? 1 : 2;
+    uint32_t *bad = malloc(v210_GetStride(width));
+    assert(bad != NULL);
+    memcpy(bad, line, v210_GetStride(width));
+    put_sample(bad, first + (4 + 3) * step, 0x261); /* DID 0x61, bad parity */
+    memset(&stats, 0, sizeof(stats));
+    assert(vanc_parse_line(bad, width, stream, handlers, &r, &stats) == 5);
+    assert(stats.parity == 1);
+
+    /* corrupted user data word, with valid parity */
+    memcpy(bad, line, v210_GetStride(width));
+    put_sample(bad, first + (4 + 10) * step, with_parity(0x12));
+    memset(&stats, 0, sizeof(stats));
+    assert(vanc_parse_line(bad, width, stream, handlers, &r, &stats) == 5);
+    assert(stats.checksum == 1);
+
+    free(bad);
+    free(line);
+}
+
+static void parse_quiet(const uint32_t *line, unsigned width,
+                        vanc_stats_t *stats)
+{
+    struct results r;
+
+    memset(&r, 0, sizeof(r));
+    for (int s = VANC_LUMA; s <= VANC_COMPOSITE; s++)
+        vanc_parse_line(line, width, s, handlers, &r, stats);
+    if (r.scte104_partial != NULL)
+        block_Release(r.scte104_partial);
+}
+
+/* Random bit flips, sample substitutions and ADF insertions */
+static void fuzz(const uint32_t *seed, unsigned width, unsigned iterations)
+{
+    const size_t stride = v210_GetStride(width);
+    uint32_t *line = malloc(stride);
+    vanc_stats_t stats;
+
+    assert(line != NULL);
+    memset(&stats, 0, sizeof(stats));
+
+    for (unsigned i = 0; i < iterations; i++) {
+        memcpy(line, seed, stride);
+        unsigned mutations = 1 + rand() % 8;
+        for (unsigned m = 0; m < mutations; m++) {
+            size_t n = rand() % (2 * width);
+            switch (rand() % 4) {
+            case 0:
+                line[n / 3] ^= 1u << (rand() % 32);
+                break;
+            case 1:
+                put_sample(line, n, rand());
+                break;
+            case 2:
+                put_sample(line, n, with_parity(rand()));
+                break;
+            case 3:
+                /* ADF with a random header, possibly near the end */
+                if (n + 6 < 2 * width) {
+                    put_sample(line, n, 0);
+                    put_sample(line, n + 1, 0x3ff);
+                    put_sample(line, n + 2, 0x3ff);
+                    put_sample(line, n + 5, with_parity(rand()));
+                }
+                break;
+            }
+        }
+        parse_quiet(line, width, &stats);
+    }
+
+    printf("fuzz: %u lines, %u packets, %u parity, %u checksum, "
+           "%u truncated\n", iterations, stats.packets, stats.parity,
+           stats.checksum, stats.truncated);
+    free(line);
+}
+
+static void bench(unsigned width, unsigned frames)
+{
+    uint32_t *lines[20];
+
+    for (unsigned i = 0; i < 20; i++) {
+        lines[i] = malloc(v210_GetStride(width));
+        assert(lines[i] != NULL);
+        blank_line(lines[i], width);
+    }
+    make_line(lines[9], width, VANC_LUMA);
+
+    struct results r;
+    memset(&r, 0, sizeof(r));
+
+    mtime_t start = mdate();
+    for (unsigned f = 0; f < frames; f++)
+        for (unsigned i = 0; i < 20; i++)
+            vanc_parse_line(lines[i], width, VANC_LUMA, handlers, &r, NULL);
+    mtime_t elapsed = mdate() - start;
+
+    assert(r.cc == frames);
+    printf("bench: %ux20 VANC lines in %"PRId64" us (%.1f us per frame)\n",
+           frames, elapsed, (double)elapsed / frames);
+
+    for (unsigned i = 0; i < 20; i++)
+        free(lines[i]);
+}
+
+static int run_file(const char *path, unsigned width)
+{
+    const size_t stride = v210_GetStride(width);
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        perror(path);
+        return -1;
+    }
+
+    uint32_t *line = malloc(stride);
+    vanc_stats_t stats;
+    unsigned count = 0;
+
+    assert(line != NULL);
+    memset(&stats, 0, sizeof(stats));
+    while (fread(line, stride, 1, file) == 1) {
+        struct results r;
+
+        memset(&r, 0, sizeof(r));
+        vanc_parse_line(line, width, width > 720 ? VANC_LUMA : VANC_COMPOSITE,
+                        handlers, &r, &stats);
+        if (r.scte104_partial != NULL)
+            block_Release(r.scte104_partial);
+        fuzz(line, width, 1000);
+        count++;
+    }
+    fclose(file);
+    free(line);
+
+    printf("%s: %u lines, %u packets (%u unhandled), %u parity, "
+           "%u checksum, %u truncated\n", path, count, stats.packets,
+           stats.unhandled, stats.parity, stats.checksum, stats.truncated);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    srand(0);
+
+    if (argc > 2) {
+        unsigned width = strtoul(argv[1], NULL, 0);
+        int ret = 0;
+
+        if (width == 0 || width > 8192)
+            return 1;
+        for (int i = 2; i < argc; i++)
+            if (run_file(argv[i], width))
+                ret = 1;
+        return ret;
+    }
+
+    test_line(1920, VANC_LUMA);
+    test_line(1920, VANC_CHROMA);
+    test_line(1280, VANC_LUMA);
+    test_line(720, VANC_COMPOSITE);
+
+    uint32_t *seed = malloc(v210_GetStride(1920));
+    assert(seed != NULL);
+    make_line(seed, 1920, VANC_LUMA);
+    fuzz(seed, 1920, 100000);
+    make_line(seed, 720, VANC_COMPOSITE);
+    fuzz(seed, 720, 100000);
+    free(seed);
+
+    bench(1920, 1000);
+    return 0;
+}
@@ -49,7 +49,18 @@
 
 #include <vlc_network.h>
 
+#if defined (HAVE_SENDMMSG) && defined (SO_TXTIME)
+#   include <time.h>
+#   include <linux/net_tstamp.h>
+#   define USE_TXTIME 1
+#endif
+
 #define MAX_EMPTY_BLOCKS 200
+#define BATCH_MAX 64         /* packets per sendmmsg() */
+#define GATHER_MAX 16        /* blocks per packet */
+#define TXTIME_LEAD 2000     /* hand packets to the kernel 2 ms ahead */
+#define JITTER_BUCKETS 16    /* powers of two microseconds */
+#define STATS_PERIOD (10 * CLOCK_FREQ)
 
 /*****************************************************************************
  * Module descriptor
@@ -70,6 +81,17 @@ static void Close( vlc_object_t * );
                           "of packets that will be sent at a time. It " \
                           "helps reducing the scheduling load on " \
                           "heavily-loaded systems." )
+#define WINDOW_TEXT N_("Batching window (microseconds)")
+#define WINDOW_LONGTEXT N_("All packets due within this window after the " \
+                           "first one are sent together in one system call. " \
+                           "Zero disables time-based batching." )
+#define GATHER_TEXT N_("Gather blocks")
+#define GATHER_LONGTEXT N_("Send the muxer blocks (e.g. TS packets) as " \
+                           "parts of the UDP packets, without copying them." )
+#define TXTIME_TEXT N_("Kernel launch times")
+#define TXTIME_LONGTEXT N_("Let the kernel (SO_TXTIME, e.g. with the ETF " \
+                           "queuing discipline) send each packet at its due " \
+                           "time instead of waking up the sending thread." )
 
 vlc_module_begin ()
     set_description( N_("UDP stream output") )
@@ -79,6 +101,12 @@ vlc_module_begin ()
     add_integer( SOUT_CFG_PREFIX "caching", DEFAULT_PTS_DELAY / 1000, CACHING_TEXT, CACHING_LONGTEXT, true )
     add_integer( SOUT_CFG_PREFIX "group", 1, GROUP_TEXT, GROUP_LONGTEXT,
                                  true )
+    add_integer( SOUT_CFG_PREFIX "window", 0, WINDOW_TEXT, WINDOW_LONGTEXT,
+                 true )
+    add_bool( SOUT_CFG_PREFIX "txtime", false, TXTIME_TEXT, TXTIME_LONGTEXT,
+              true )
+    add_bool( SOUT_CFG_PREFIX "gather", true, GATHER_TEXT, GATHER_LONGTEXT,
+              true )
 
     set_capability( "sout access", 0 )
     add_shortcut( "udp" )
@@ -92,6 +120,9 @@ vlc_module_end ()
 static const char *const ppsz_sout_options[] = {
     "caching",
     "group",
+    "window",
+    "txtime",
+    "gather",
     NULL
 };
 
@@ -108,20 +139,65 @@ static int  Seek    ( sout_access_out_t *, off_t  );
 static int Control( sout_access_out_t *, int, va_list );
 
 static void* ThreadWrite( void * );
-static block_t *NewUDPPacket( sout_access_out_t *, mtime_t );
+
+/* A UDP packet refers to the blocks it is made of, or to its own copy
+ * buffer when blocks had to be split. */
+typedef struct
+{
+    block_t   self; /* no buffer, i_buffer is the datagram size */
+    block_t  *p_copy;
+    unsigned  i_frags;
+    block_t  *pp_frags[GATHER_MAX];
+} udp_packet_t;
+
+static udp_packet_t *NewUDPPacket( sout_access_out_t *, const block_t * );
+static void ReportStats( sout_access_out_t * );
 
 struct sout_access_out_sys_t
 {
     mtime_t       i_caching;
+    bool          b_low_latency;
     int           i_handle;
     bool          b_mtu_warning;
+    bool          b_gather;
     size_t        i_mtu;
+    uint64_t      i_copied;
 
     block_fifo_t *p_fifo;
     block_fifo_t *p_empty_blocks;
-    block_t      *p_buffer;
+    udp_packet_t *p_buffer;
 
     vlc_thread_t  thread;
+
+    /* Owned by the sending thread */
+    mtime_t       i_window;
+    unsigned      i_group;
+    bool          b_txtime;
+    block_t      *p_pending; /* first packet of the next batch */
+    udp_packet_t *pp_batch[BATCH_MAX];
+    unsigned      i_batch;
+#ifdef HAVE_SENDMMSG
+    struct mmsghdr msgs[BATCH_MAX];
+#endif
+    struct iovec   iovs[BATCH_MAX * GATHER_MAX];
+#ifdef USE_TXTIME
+    char          cmsgs[BATCH_MAX][CMSG_SPACE(sizeof (uint64_t))];
+#endif
+
+    struct
+    {
+        uint64_t  i_packets;
+        uint64_t  i_batches;
+        uint64_t  i_late;
+        mtime_t   i_max;
+        uint64_t  hist[JITTER_BUCKETS];
+        mtime_t   i_next_report;
+    } stats;
+
+    /* Lag of the data behind the input clock, on the wire (low latency),
+     * as dated by the muxer */
+    sout_lag_t    lag;
+    mtime_t       i_lag_report;
 };
 
 #define DEFAULT_PORT 1234
@@ -207,13 +283,56 @@ static int Open( vlc_object_t *p_this )
 
     p_sys->i_caching = UINT64_C(1000)
                      * var_GetInteger( p_access, SOUT_CFG_PREFIX "caching");
+    /* Low latency: packets leave as soon as the muxer outputs them */
+    p_sys->b_low_latency = var_InheritBool( p_access, "sout-low-latency" );
+    if( p_sys->b_low_latency )
+        p_sys->i_caching = 0;
     p_sys->i_handle = i_handle;
     p_sys->i_mtu = var_CreateGetInteger( p_this, "mtu" );
     p_sys->b_mtu_warning = false;
-    p_sys->p_fifo = block_FifoNew();
-    p_sys->p_empty_blocks = block_FifoNew();
+    p_sys->b_gather = var_GetBool( p_access, SOUT_CFG_PREFIX "gather" );
+    p_sys->i_copied = 0;
+    var_Create( p_access, "sout-udp-copied", VLC_VAR_INTEGER );
+    /* the sending thread and ThreadWrite each feed one FIFO */
+    p_sys->p_fifo = block_FifoNewSPSC();
+    p_sys->p_empty_blocks = block_FifoNewSPSC();
     p_sys->p_buffer = NULL;
 
+    p_sys->i_window = var_GetInteger( p_access, SOUT_CFG_PREFIX "window" );
+    p_sys->i_group = var_GetInteger( p_access, SOUT_CFG_PREFIX "group" );
+    p_sys->b_txtime = var_GetBool( p_access, SOUT_CFG_PREFIX "txtime" );
+    p_sys->p_pending = NULL;
+    p_sys->i_batch = 0;
+    memset( &p_sys->stats, 0, sizeof( p_sys->stats ) );
+    sout_LagReset( &p_sys->lag );
+    p_sys->i_lag_report = 0;
+    if( p_sys->i_window < 0 )
+        p_sys->i_window = 0;
+    if( p_sys->i_group < 1 )
+        p_sys->i_group = 1;
+
+    if( p_sys->b_txtime && p_sys->b_low_latency )
+    {
+        msg_Warn( p_access, "kernel launch times disabled for low latency" );
+        p_sys->b_txtime = false;
+    }
+    if( p_sys->b_txtime )
+    {
+#ifdef USE_TXTIME
+        struct sock_txtime cfg = { .clockid = CLOCK_TAI, .flags = 0 };
+
+        if( setsockopt( i_handle, SOL_SOCKET, SO_TXTIME, &cfg, sizeof(cfg) ) )
+        {
+            msg_Warn( p_access, "kernel launch times not available: %s",
+                      vlc_strerror_c(errno) );
+            p_sys->b_txtime = false;
+        }
+#else
+        msg_Warn( p_access, "kernel launch times not supported" );
+        p_sys->b_txtime = false;
+#endif
+    }
+
     if( vlc_clone( &p_sys->thread, ThreadWrite, p_access,
                            VLC_THREAD_PRIORITY_HIGHEST ) )
     {
@@ -242,10 +361,18 @@ static void Close( vlc_object_t * p_this )
 
     vlc_cancel( p_sys->thread );
     vlc_join( p_sys->thread, NULL );
+
+    ReportStats( p_access );
+    msg_Dbg( p_access, "copied %"PRIu64" bytes", p_sys->i_copied );
+    for( unsigned i = 0; i < p_sys->i_batch; i++ )
+        block_Release( &p_sys->pp_batch[i]->self );
+    if( p_sys->p_pending )
+        block_Release( p_sys->p_pending );
+
     block_FifoRelease( p_sys->p_fifo );
     block_FifoRelease( p_sys->p_empty_blocks );
 
-    if( p_sys->p_buffer ) block_Release( p_sys->p_buffer );
+    if( p_sys->p_buffer ) block_Release( &p_sys->p_buffer->self );
 
     net_Close( p_sys->i_handle );
     free( p_sys );
@@ -267,6 +394,96 @@ static int Control( sout_access_out_t *p_access, int i_query, va_list args )
     return VLC_SUCCESS;
 }
 
+/*****************************************************************************
+ * UDP packets handling
+ *****************************************************************************/
+static void PacketClear( udp_packet_t *p_pk )
+{
+    for( unsigned i = 0; i < p_pk->i_frags; i++ )
+        if( p_pk->pp_frags[i] != p_pk->p_copy )
+            block_Release( p_pk->pp_frags[i] );
+    if( p_pk->p_copy != NULL )
+        p_pk->p_copy->i_buffer = 0;
+    p_pk->i_frags = 0;
+    p_pk->self.i_buffer = 0;
+    p_pk->self.i_flags = 0;
+}
+
+static void PacketRelease( block_t *p_block )
+{
+    udp_packet_t *p_pk = (udp_packet_t *)p_block;
+
+    PacketClear( p_pk );
+    if( p_pk->p_copy != NULL )
+        block_Release( p_pk->p_copy );
+    free( p_pk );
+}
+
+/* Takes ownership of the block */
+static void PacketAppend( udp_packet_t *p_pk, block_t *p_block )
+{
+    assert( p_pk->i_frags < GATHER_MAX );
+    p_pk->pp_frags[p_pk->i_frags++] = p_block;
+    p_pk->self.i_buffer += p_block->i_buffer;
+}
+
+static bool PacketCopy( udp_packet_t *p_pk, const uint8_t *p_data,
+                        size_t i_size, size_t i_mtu )
+{
+    block_t *p_copy = p_pk->p_copy;
+
+    if( p_copy == NULL )
+    {
+        p_copy = block_Alloc( i_mtu );
+        if( unlikely(p_copy == NULL) )
+            return false;
+        p_copy->i_buffer = 0;
+        p_pk->p_copy = p_copy;
+    }
+
+    if( p_pk->i_frags == 0 || p_pk->pp_frags[p_pk->i_frags - 1] != p_copy )
+    {
+        assert( p_pk->i_frags == 0 );
+        p_pk->pp_frags[p_pk->i_frags++] = p_copy;
+    }
+
+    memcpy( p_copy->p_buffer + p_copy->i_buffer, p_data, i_size );
+    p_copy->i_buffer += i_size;
+    p_pk->self.i_buffer += i_size;
+    return true;
+}
+
+static void RecyclePacket( sout_access_out_sys_t *p_sys, udp_packet_t *p_pk )
+{
+    PacketClear( p_pk );
+    block_FifoPut( p_sys->p_empty_blocks, &p_pk->self );
+}
+
+static void FlushPacket( sout_access_out_t *p_access, mtime_t now )
+{
+    sout_access_out_sys_t *p_sys = p_access->p_sys;
+
+    if( !p_sys->b_low_latency
+     && p_sys->p_buffer->self.i_dts + p_sys->i_caching < now )
+    {
+        msg_Dbg( p_access, "late packet for UDP input (%"PRId64 ")",
+                 now - p_sys->p_buffer->self.i_dts - p_sys->i_caching );
+    }
+    block_FifoPut( p_sys->p_fifo, &p_sys->p_buffer->self );
+    p_sys->p_buffer = NULL;
+}
+
+static void SetClock( sout_access_out_t *p_access, udp_packet_t *p_pk,
+                      const block_t *p_block )
+{
+    if ( p_block->i_flags & BLOCK_FLAG_CLOCK )
+    {
+        if ( p_pk->self.i_flags & BLOCK_FLAG_CLOCK )
+            msg_Warn( p_access, "putting two PCRs at once" );
+        p_pk->self.i_flags |= BLOCK_FLAG_CLOCK;
+    }
+}
+
 /*****************************************************************************
  * Write: standard write on a file descriptor.
  *****************************************************************************/
@@ -274,13 +491,16 @@ static ssize_t Write( sout_access_out_t *p_access, block_t *p_buffer )
 {
     sout_access_out_sys_t *p_sys = p_access->p_sys;
     int i_len = 0;
+    size_t i_copied = 0;
 
     while( p_buffer )
     {
-        block_t *p_next;
+        block_t *p_next = p_buffer->p_next;
         int i_packets = 0;
         mtime_t now = mdate();
 
+        p_buffer->p_next = NULL;
+
         if( !p_sys->b_mtu_warning && p_buffer->i_buffer > p_sys->i_mtu )
         {
             msg_Warn( p_access, "packet size > MTU, you should probably "
@@ -290,19 +510,36 @@ static ssize_t Write( sout_access_out_t *p_access, block_t *p_buffer )
 
         /* Check if there is enough space in the buffer */
         if( p_sys->p_buffer &&
-            p_sys->p_buffer->i_buffer + p_buffer->i_buffer > p_sys->i_mtu )
+            ( p_sys->p_buffer->self.i_buffer + p_buffer->i_buffer > p_sys->i_mtu
+           || p_sys->p_buffer->i_frags == GATHER_MAX ) )
+            FlushPacket( p_access, now );
+
+        i_len += p_buffer->i_buffer;
+
+        /* Blocks fitting in a packet are sent as they are */
+        if( p_sys->b_gather && p_buffer->i_buffer > 0
+         && p_buffer->i_buffer <= p_sys->i_mtu )
         {
-            if( p_sys->p_buffer->i_dts + p_sys->i_caching < now )
+            if( !p_sys->p_buffer )
             {
-                msg_Dbg( p_access, "late packet for UDP input (%"PRId64 ")",
-                         now - p_sys->p_buffer->i_dts
-                          - p_sys->i_caching );
+                p_sys->p_buffer = NewUDPPacket( p_access, p_buffer );
+                if( !p_sys->p_buffer )
+                {
+                    block_Release( p_buffer );
+                    p_buffer = p_next;
+                    continue;
+                }
             }
-            block_FifoPut( p_sys->p_fifo, p_sys->p_buffer );
-            p_sys->p_buffer = NULL;
+
+            SetClock( p_access, p_sys->p_buffer, p_buffer );
+            PacketAppend( p_sys->p_buffer, p_buffer );
+            if( p_sys->p_buffer->self.i_buffer == p_sys->i_mtu )
+                FlushPacket( p_access, now );
+
+            p_buffer = p_next;
+            continue;
         }
 
-        i_len += p_buffer->i_buffer;
         while( p_buffer->i_buffer )
         {
             size_t i_payload_size = p_sys->i_mtu;
@@ -312,42 +549,32 @@ static ssize_t Write( sout_access_out_t *p_access, block_t *p_buffer )
 
             if( !p_sys->p_buffer )
             {
-                p_sys->p_buffer = NewUDPPacket( p_access, p_buffer->i_dts );
+                p_sys->p_buffer = NewUDPPacket( p_access, p_buffer );
                 if( !p_sys->p_buffer ) break;
             }
 
-            memcpy( p_sys->p_buffer->p_buffer + p_sys->p_buffer->i_buffer,
-                    p_buffer->p_buffer, i_write );
+            if( !PacketCopy( p_sys->p_buffer, p_buffer->p_buffer, i_write,
+                             p_sys->i_mtu ) )
+                break;
+            i_copied += i_write;
 
-            p_sys->p_buffer->i_buffer += i_write;
             p_buffer->p_buffer += i_write;
             p_buffer->i_buffer -= i_write;
-            if ( p_buffer->i_flags & BLOCK_FLAG_CLOCK )
-            {
-                if ( p_sys->p_buffer->i_flags & BLOCK_FLAG_CLOCK )
-                    msg_Warn( p_access, "putting two PCRs at once" );
-                p_sys->p_buffer->i_flags |= BLOCK_FLAG_CLOCK;
-            }
+            SetClock( p_access, p_sys->p_buffer, p_buffer );
 
-            if( p_sys->p_buffer->i_buffer == p_sys->i_mtu || i_packets > 1 )
-            {
-                /* Flush */
-                if( p_sys->p_buffer->i_dts + p_sys->i_caching < now )
-                {
-                    msg_Dbg( p_access, "late packet for udp input (%"PRId64 ")",
-                             mdate() - p_sys->p_buffer->i_dts
-                              - p_sys->i_caching );
-                }
-                block_FifoPut( p_sys->p_fifo, p_sys->p_buffer );
-                p_sys->p_buffer = NULL;
-            }
+            if( p_sys->p_buffer->self.i_buffer == p_sys->i_mtu || i_packets > 1 )
+                FlushPacket( p_access, now );
         }
 
-        p_next = p_buffer->p_next;
         block_Release( p_buffer );
         p_buffer = p_next;
     }
 
+    if( i_copied )
+    {
+        p_sys->i_copied += i_copied;
+        var_SetInteger( p_access, "sout-udp-copied", p_sys->i_copied );
+    }
     return i_len;
 }
 
@@ -362,34 +589,220 @@ static int Seek( sout_access_out_t *p_access, off_t i_pos )
 }
 
 /*****************************************************************************
- * NewUDPPacket: allocate a new UDP packet of size p_sys->i_mtu
+ * NewUDPPacket: get an empty UDP packet
  *****************************************************************************/
-static block_t *NewUDPPacket( sout_access_out_t *p_access, mtime_t i_dts)
+static udp_packet_t *NewUDPPacket( sout_access_out_t *p_access,
+                                   const block_t *p_first )
 {
     sout_access_out_sys_t *p_sys = p_access->p_sys;
-    block_t *p_buffer;
+    udp_packet_t *p_pk;
 
     while ( block_FifoCount( p_sys->p_empty_blocks ) > MAX_EMPTY_BLOCKS )
-    {
-        p_buffer = block_FifoGet( p_sys->p_empty_blocks );
-        block_Release( p_buffer );
-    }
+        block_Release( block_FifoGet( p_sys->p_empty_blocks ) );
 
     if( block_FifoCount( p_sys->p_empty_blocks ) == 0 )
     {
-        p_buffer = block_Alloc( p_sys->i_mtu );
+        p_pk = malloc( sizeof( *p_pk ) );
+        if( unlikely(p_pk == NULL) )
+            return NULL;
+        block_Init( &p_pk->self, NULL, 0 );
+        p_pk->self.pf_release = PacketRelease;
+        p_pk->p_copy = NULL;
+        p_pk->i_frags = 0;
     }
     else
+        p_pk = (udp_packet_t *)block_FifoGet( p_sys->p_empty_blocks );
+
+    p_pk->self.i_dts = p_first->i_dts;
+    p_pk->self.i_pts = p_first->i_pts; /* date of the data, if known */
+    return p_pk;
+}
+
+/*****************************************************************************
+ * ReportStats: print the inter-packet jitter histogram
+ *****************************************************************************/
+static void ReportStats( sout_access_out_t *p_access )
+{
+    sout_access_out_sys_t *p_sys = p_access->p_sys;
+    char psz_hist[JITTER_BUCKETS * 32], *psz = psz_hist;
+
+    if( p_sys->stats.i_packets == 0 )
+        return;
+
+    /* Packets leave at their launch time, after sendmmsg() returned: the
+     * send date tells nothing about the wire */
+    if( p_sys->b_txtime )
     {
-        p_buffer = block_FifoGet(p_sys->p_empty_blocks );
-        p_buffer->i_flags = 0;
-        p_buffer = block_Realloc( p_buffer, 0, p_sys->i_mtu );
+        msg_Dbg( p_access, "sent %"PRIu64" packets in %"PRIu64" batches, "
+                 "jitter not measured with kernel launch times",
+                 p_sys->stats.i_packets, p_sys->stats.i_batches );
+        return;
     }
 
-    p_buffer->i_dts = i_dts;
-    p_buffer->i_buffer = 0;
+    *psz = '\0';
+    for( unsigned i = 0; i < JITTER_BUCKETS; i++ )
+    {
+        if( p_sys->stats.hist[i] == 0 )
+            continue;
+        psz += sprintf( psz, " %s%u:%"PRIu64, i + 1 < JITTER_BUCKETS ? "<" : ">=",
+                        1u << (i + 1 < JITTER_BUCKETS ? i : i - 1),
+                        p_sys->stats.hist[i] );
+    }
+
+    msg_Dbg( p_access, "sent %"PRIu64" packets in %"PRIu64" batches, "
+             "%"PRIu64" late, max jitter %"PRId64" us, jitter (us):%s",
+             p_sys->stats.i_packets, p_sys->stats.i_batches,
+             p_sys->stats.i_late, p_sys->stats.i_max, psz_hist );
+}
+
+static void AddJitter( sout_access_out_sys_t *p_sys, mtime_t i_jitter )
+{
+    unsigned i = 0;
+
+    if( i_jitter < 0 )
+        i_jitter = -i_jitter;
+    if( i_jitter > p_sys->stats.i_max )
+        p_sys->stats.i_max = i_jitter;
+
+    /* bucket i counts jitters below 2^i us, the last one the rest */
+    while( i + 1 < JITTER_BUCKETS && i_jitter >= ((mtime_t)1 << i) )
+        i++;
+    p_sys->stats.hist[i]++;
+}
+
+/*****************************************************************************
+ * CheckDate: drop packets after a hole in the timeline
+ *****************************************************************************/
+static bool CheckDate( sout_access_out_t *p_access, block_t *p_pk,
+                       mtime_t *pi_date_last, unsigned *pi_dropped )
+{
+    sout_access_out_sys_t *p_sys = p_access->p_sys;
+    mtime_t i_date = p_sys->i_caching + p_pk->i_dts;
+    mtime_t i_date_last = *pi_date_last;
+
+    *pi_date_last = i_date;
+    if( i_date_last > 0 )
+    {
+        if( i_date - i_date_last > 2000000 )
+        {
+            if( !*pi_dropped )
+                msg_Dbg( p_access, "mmh, hole (%"PRId64" > 2s) -> drop",
+                         i_date - i_date_last );
 
-    return p_buffer;
+            RecyclePacket( p_sys, (udp_packet_t *)p_pk );
+            (*pi_dropped)++;
+            return false;
+        }
+        else if( i_date - i_date_last < -1000 )
+        {
+            if( !*pi_dropped )
+                msg_Dbg( p_access, "mmh, packets in the past (%"PRId64")",
+                         i_date_last - i_date );
+        }
+    }
+    return true;
+}
+
+/*****************************************************************************
+ * SendBatch: send all the packets of the batch at once
+ *****************************************************************************/
+static void SendBatch( sout_access_out_t *p_access )
+{
+    sout_access_out_sys_t *p_sys = p_access->p_sys;
+    unsigned n = p_sys->i_batch;
+
+#ifdef HAVE_SENDMMSG
+# ifdef USE_TXTIME
+    int64_t i_tai_offset = 0;
+
+    if( p_sys->b_txtime )
+    {
+        struct timespec ts;
+
+        /* mdate() is not on the TAI time scale, convert at every batch */
+        clock_gettime( CLOCK_TAI, &ts );
+        i_tai_offset = INT64_C(1000000000) * ts.tv_sec + ts.tv_nsec
+                     - INT64_C(1000) * mdate();
+    }
+# endif
+
+    for( unsigned i = 0; i < n; i++ )
+    {
+        udp_packet_t *p_pk = p_sys->pp_batch[i];
+        struct msghdr *msg = &p_sys->msgs[i].msg_hdr;
+
+        memset( msg, 0, sizeof( *msg ) );
+        msg->msg_iov = &p_sys->iovs[i * GATHER_MAX];
+        msg->msg_iovlen = p_pk->i_frags;
+        for( unsigned j = 0; j < p_pk->i_frags; j++ )
+        {
+            msg->msg_iov[j].iov_base = p_pk->pp_frags[j]->p_buffer;
+            msg->msg_iov[j].iov_len = p_pk->pp_frags[j]->i_buffer;
+        }
+# ifdef USE_TXTIME
+        if( p_sys->b_txtime )
+        {
+            uint64_t i_launch = i_tai_offset
+                + INT64_C(1000) * (p_sys->i_caching + p_pk->self.i_dts);
+            struct cmsghdr *cmsg;
+
+            msg->msg_control = p_sys->cmsgs[i];
+            msg->msg_controllen = sizeof( p_sys->cmsgs[i] );
+            cmsg = CMSG_FIRSTHDR( msg );
+            cmsg->cmsg_level = SOL_SOCKET;
+            cmsg->cmsg_type = SCM_TXTIME;
+            cmsg->cmsg_len = CMSG_LEN( sizeof( i_launch ) );
+            memcpy( CMSG_DATA( cmsg ), &i_launch, sizeof( i_launch ) );
+        }
+# endif
+    }
+
+    for( unsigned i = 0; i < n; )
+    {
+        int val = sendmmsg( p_sys->i_handle, p_sys->msgs + i, n - i, 0 );
+        if( val == -1 )
+        {   /* the first remaining packet failed, skip it */
+            msg_Warn( p_access, "send error: %s", vlc_strerror_c(errno) );
+            val = 1;
+        }
+        i += val;
+    }
+#else
+    for( unsigned i = 0; i < n; i++ )
+    {
+        udp_packet_t *p_pk = p_sys->pp_batch[i];
+        struct iovec *iov = p_sys->iovs;
+        int val;
+
+        for( unsigned j = 0; j < p_pk->i_frags; j++ )
+        {
+            iov[j].iov_base = p_pk->pp_frags[j]->p_buffer;
+            iov[j].iov_len = p_pk->pp_frags[j]->i_buffer;
+        }
+# ifdef _WIN32
+        WSABUF buf[GATHER_MAX];
+        DWORD sent;
+
+        for( unsigned j = 0; j < p_pk->i_frags; j++ )
+        {
+            buf[j].buf = iov[j].iov_base;
+            buf[j].len = iov[j].iov_len;
+        }
+        val = WSASend( p_sys->i_handle, buf, p_pk->i_frags, &sent, 0,
+                       NULL, NULL );
+# else
+        struct msghdr msg = {
+            .msg_iov = iov,
+            .msg_iovlen = p_pk->i_frags,
+        };
+
+        val = sendmsg( p_sys->i_handle, &msg, 0 );
+# endif
+        if( val == -1 )
+            msg_Warn( p_access, "send error: %s", vlc_strerror_c(errno) );
+    }
+#endif
+    p_sys->stats.i_batches++;
 }
 
 /*****************************************************************************
@@ -400,49 +813,52 @@ static void* ThreadWrite( void *data )
     sout_access_out_t *p_access = data;
     sout_access_out_sys_t *p_sys = p_access->p_sys;
     mtime_t i_date_last = -1;
-    const unsigned i_group = var_GetInteger( p_access,
-                                             SOUT_CFG_PREFIX "group" );
-    mtime_t i_to_send = i_group;
+    mtime_t i_late_last = 0;
     unsigned i_dropped_packets = 0;
 
     for (;;)
     {
-        block_t *p_pk = block_FifoGet( p_sys->p_fifo );
-        mtime_t       i_date, i_sent;
+        block_t *p_pk = p_sys->p_pending;
+        mtime_t i_first;
 
-        i_date = p_sys->i_caching + p_pk->i_dts;
-        if( i_date_last > 0 )
-        {
-            if( i_date - i_date_last > 2000000 )
-            {
-                if( !i_dropped_packets )
-                    msg_Dbg( p_access, "mmh, hole (%"PRId64" > 2s) -> drop",
-                             i_date - i_date_last );
+        if( p_pk != NULL )
+            p_sys->p_pending = NULL;
+        else
+            p_pk = block_FifoGet( p_sys->p_fifo );
 
-                block_FifoPut( p_sys->p_empty_blocks, p_pk );
+        if( !CheckDate( p_access, p_pk, &i_date_last, &i_dropped_packets ) )
+            continue;
 
-                i_date_last = i_date;
-                i_dropped_packets++;
-                continue;
-            }
-            else if( i_date - i_date_last < -1000 )
+        i_first = p_sys->i_caching + p_pk->i_dts;
+        p_sys->pp_batch[0] = (udp_packet_t *)p_pk;
+        p_sys->i_batch = 1;
+
+        /* Gather the packets already queued and due within the window.
+         * Without kernel launch times, a PCR packet always opens a new
+         * batch so that it is sent on time. */
+        while( p_sys->i_batch < BATCH_MAX )
+        {
+            vlc_fifo_Lock( p_sys->p_fifo );
+            p_pk = vlc_fifo_DequeueUnlocked( p_sys->p_fifo );
+            vlc_fifo_Unlock( p_sys->p_fifo );
+            if( p_pk == NULL )
+                break;
+
+            if( ( !p_sys->b_txtime && (p_pk->i_flags & BLOCK_FLAG_CLOCK) )
+             || ( p_sys->i_caching + p_pk->i_dts > i_first + p_sys->i_window
+               && p_sys->i_batch >= p_sys->i_group ) )
             {
-                if( !i_dropped_packets )
-                    msg_Dbg( p_access, "mmh, packets in the past (%"PRId64")",
-                             i_date_last - i_date );
+                p_sys->p_pending = p_pk;
+                break;
             }
-        }
 
-        block_cleanup_push( p_pk );
-        i_to_send--;
-        if( !i_to_send || (p_pk->i_flags & BLOCK_FLAG_CLOCK) )
-        {
-            mwait( i_date );
-            i_to_send = i_group;
+            if( CheckDate( p_access, p_pk, &i_date_last, &i_dropped_packets ) )
+                p_sys->pp_batch[p_sys->i_batch++] = (udp_packet_t *)p_pk;
         }
-        if ( send( p_sys->i_handle, p_pk->p_buffer, p_pk->i_buffer, 0 ) == -1 )
-            msg_Warn( p_access, "send error: %s", vlc_strerror_c(errno) );
-        vlc_cleanup_pop();
+
+        if( !p_sys->b_low_latency )
+            mwait( p_sys->b_txtime ? i_first - TXTIME_LEAD : i_first );
+        SendBatch( p_access );
 
         if( i_dropped_packets )
         {
@@ -450,18 +866,49 @@ static void* ThreadWrite( void *data )
             i_dropped_packets = 0;
         }
 
-#if 1
-        i_sent = mdate();
-        if ( i_sent > i_date + 20000 )
+        /* Without kernel launch times, the whole batch leaves now */
+        mtime_t i_sent = mdate();
+        for( unsigned i = 0; i < p_sys->i_batch; i++ )
         {
-            msg_Dbg( p_access, "packet has been sent too late (%"PRId64 ")",
-                     i_sent - i_date );
+            mtime_t i_date = p_sys->i_caching + p_sys->pp_batch[i]->self.i_dts;
+            mtime_t i_late = i_sent - i_date;
+
+            if( !p_sys->b_txtime )
+            {
+                if( i_late > 20000 )
+                    p_sys->stats.i_late++;
+                AddJitter( p_sys, i_late - i_late_last );
+                i_late_last = i_late;
+            }
+            if( p_sys->b_low_latency )
+                sout_LagAdd( &p_sys->lag, p_sys->pp_batch[i]->self.i_pts,
+                             i_sent );
+            RecyclePacket( p_sys, p_sys->pp_batch[i] );
         }
-#endif
+        p_sys->stats.i_packets += p_sys->i_batch;
+        p_sys->i_batch = 0;
+
+        if( i_late_last > 20000 && !p_sys->b_low_latency )
+            msg_Dbg( p_access, "packet has been sent too late (%"PRId64 ")",
+                     i_late_last );
 
-        block_FifoPut( p_sys->p_empty_blocks, p_pk );
+        if( p_sys->b_low_latency && i_sent >= p_sys->i_lag_report )
+        {
+            if( p_sys->lag.i_count > 0 )
+                msg_Info( p_access, "latency: on the wire %"PRId64" ms "
+                          "(max %"PRId64" ms)",
+                          sout_LagAverage( &p_sys->lag ) / 1000,
+                          p_sys->lag.i_max / 1000 );
+            sout_LagReset( &p_sys->lag );
+            p_sys->i_lag_report = i_sent + SOUT_LAG_REPORT_PERIOD;
+        }
 
-        i_date_last = i_date;
+        if( i_sent >= p_sys->stats.i_next_report )
+        {
+            if( p_sys->stats.i_next_report != 0 )
+                ReportStats( p_access );
+            p_sys->stats.i_next_report = i_sent + STATS_PERIOD;
+        }
     }
     return NULL;
 }
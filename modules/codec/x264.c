@@ -791,8 +791,29 @@ struct encoder_sys_t
     char            *psz_stat_name;
     int             i_sei_size;
     uint32_t         i_colorspace;
+    uint32_t         i_picture_csp; /* layout of the planes read */
     uint8_t         *p_sei;
+
+    /* copies made by the encoder, for the statistics */
+    uint64_t        i_frames;
+    uint64_t        i_copied;
+};
+
+#if X264_BUILD >= 118
+/* Layouts x264 reads from the picture planes as they are, besides the planar
+ * one of the colorspace encoded, so that no conversion filter is needed */
+static const struct
+{
+    vlc_fourcc_t i_codec;
+    uint32_t     i_picture_csp;
+    uint32_t     i_colorspace;
+} x264_chromas[] =
+{
+    { VLC_CODEC_NV12, X264_CSP_NV12, X264_CSP_I420 },
+    { VLC_CODEC_YV12, X264_CSP_YV12, X264_CSP_I420 },
+    { VLC_CODEC_NV16, X264_CSP_NV16, X264_CSP_I422 },
 };
+#endif
 
 #ifdef PTW32_STATIC_LIB
 static vlc_mutex_t pthread_win32_mutex = VLC_STATIC_MUTEX;
@@ -812,6 +833,7 @@ static int  Open ( vlc_object_t *p_this )
     x264_nal_t    *nal;
     int i, i_nal;
     bool fullrange = false;
+    const vlc_fourcc_t i_chroma = p_enc->fmt_in.i_codec;
 
 #ifdef MODULE_NAME_IS_x262
     if( p_enc->fmt_out.i_codec != VLC_CODEC_MP2V &&
@@ -893,12 +915,30 @@ static int  Open ( vlc_object_t *p_this )
     free( psz_profile );
 #endif //X264_BUILD
 
+    p_sys->i_picture_csp = p_sys->i_colorspace;
+#if X264_BUILD >= 118
+    /* Take the pictures as they come, if x264 can read them */
+    for( size_t j = 0; j < sizeof(x264_chromas) / sizeof(x264_chromas[0]); j++ )
+    {
+        if( x264_chromas[j].i_codec == i_chroma &&
+            x264_chromas[j].i_colorspace == p_sys->i_colorspace )
+        {
+            p_enc->fmt_in.i_codec = i_chroma;
+            p_sys->i_picture_csp = x264_chromas[j].i_picture_csp;
+            break;
+        }
+    }
+#endif
+    msg_Dbg( p_enc, "reading %4.4s pictures", (char *)&p_enc->fmt_in.i_codec );
+
     p_enc->pf_encode_video = Encode;
     p_enc->pf_encode_audio = NULL;
     p_sys->i_initial_delay = 0;
     p_sys->psz_stat_name = NULL;
     p_sys->i_sei_size = 0;
     p_sys->p_sei = NULL;
+    p_sys->i_frames = 0;
+    p_sys->i_copied = 0;
 
     char *psz_preset = var_GetString( p_enc, SOUT_CFG_PREFIX  "preset" );
     char *psz_tune = var_GetString( p_enc, SOUT_CFG_PREFIX  "tune" );
@@ -1376,6 +1416,21 @@ static int  Open ( vlc_object_t *p_this )
     /* We don't want repeated headers, we repeat p_extra ourself if needed */
     p_sys->param.b_repeat_headers = 0;
 
+    if( var_InheritBool( p_enc, "sout-low-latency" ) )
+    {
+        /* As the zerolatency tune, and with a gradual refresh rather than
+         * large key frames. Receivers may join anytime: repeat the headers */
+        p_sys->param.rc.i_lookahead = 0;
+        p_sys->param.i_sync_lookahead = 0;
+        p_sys->param.i_bframe = 0;
+        p_sys->param.b_sliced_threads = 1;
+        p_sys->param.b_vfr_input = 0;
+        p_sys->param.rc.b_mb_tree = 0;
+        p_sys->param.b_intra_refresh = 1;
+        p_sys->param.b_repeat_headers = 1;
+        msg_Dbg( p_enc, "low latency: sliced threads and intra refresh" );
+    }
+
     char *psz_opts = var_InheritString( p_enc, SOUT_CFG_PREFIX "options" );
     if (psz_opts && *psz_opts) {
         config_chain_t *cfg = NULL;
@@ -1494,7 +1549,7 @@ static block_t *Encode( encoder_t *p_enc, picture_t *p_pict )
 #endif
     if( likely(p_pict) ) {
        pic.i_pts = p_pict->date;
-       pic.img.i_csp = p_sys->i_colorspace;
+       pic.img.i_csp = p_sys->i_picture_csp;
        pic.img.i_plane = p_pict->i_planes;
        for( i = 0; i < p_pict->i_planes; i++ )
        {
@@ -1531,6 +1586,8 @@ static block_t *Encode( encoder_t *p_enc, picture_t *p_pict )
     }
     /* copy encoded data directly to block */
     memcpy( p_block->p_buffer + i_offset, nal[0].p_payload, i_out );
+    p_sys->i_frames++;
+    p_sys->i_copied += p_block->i_buffer;
 
     if( pic.b_keyframe )
         p_block->i_flags |= BLOCK_FLAG_TYPE_I;
@@ -1564,6 +1621,10 @@ static void Close( vlc_object_t *p_this )
     free( p_sys->psz_stat_name );
     free( p_sys->p_sei );
 
+    if( p_sys->i_frames > 0 )
+        msg_Dbg( p_enc, "%"PRIu64" frames, %"PRIu64" bytes copied per frame",
+                 p_sys->i_frames, p_sys->i_copied / p_sys->i_frames );
+
     if( p_sys->h )
     {
         msg_Dbg( p_enc, "framecount still in libx264 buffer: %d", x264_encoder_delayed_frames( p_sys->h ) );
@@ -1763,6 +1763,16 @@ static int updateStatistics( intf_thread_t *p_intf, input_item_t *p_item )
     msg_rc(_("| sending bitrate  :   %6.0f kb/s"),
             (float)(p_item->p_stats->f_send_bitrate*8)*1000 );
     msg_rc("|");
+    /* Block pool */
+    int64_t i_pool_allocs = p_item->p_stats->i_block_pool_hits
+                          + p_item->p_stats->i_block_pool_misses;
+    msg_rc("%s", _("+-[Block pool]"));
+    msg_rc(_("| hit rate         :    %5.1f %%"),
+           i_pool_allocs ? p_item->p_stats->i_block_pool_hits * 100.
+                           / i_pool_allocs : 0. );
+    msg_rc(_("| bytes cached     : %8.0f KiB"),
+            (float)(p_item->p_stats->i_block_pool_cached)/1024 );
+    msg_rc("|");
     msg_rc( "+----[ end of statistical info ]" );
     vlc_mutex_unlock( &p_item->p_stats->lock );
     vlc_mutex_unlock( &p_item->lock );
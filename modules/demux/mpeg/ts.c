@@ -35,6 +35,9 @@
 
 #include <assert.h>
 #include <time.h>
+#ifdef HAVE_SEARCH_H
+# include <search.h>
+#endif
 
 #include <vlc_access.h>    /* DVB-specific things */
 #include <vlc_demux.h>
@@ -42,6 +45,8 @@
 #include <vlc_epg.h>
 #include <vlc_charset.h>   /* FromCharset, for EIT */
 #include <vlc_bits.h>
+#include <vlc_atomic.h>
+#include <vlc_cpu.h>
 
 #include "../../mux/mpeg/csa.h"
 
@@ -72,6 +77,9 @@
 
 #include "pes.h"
 #include "mpeg4_iod.h"
+#include "ts_sync.h"
+#include "ts_monitor.h"
+#include "ts_psi_cache.h"
 
 #ifdef HAVE_ARIBB24
  #include <aribb24/aribb24.h>
@@ -137,6 +145,17 @@ static void Close ( vlc_object_t * );
 #define PCR_TEXT N_("Trust in-stream PCR")
 #define PCR_LONGTEXT N_("Use the stream PCR as a reference.")
 
+#define THREADS_TEXT N_("PES threads")
+#define THREADS_LONGTEXT N_( \
+    "Number of threads reassembling and sending the elementary streams, " \
+    "the programs being spread over them. This helps with high bitrate " \
+    "multiple programs streams. 0 demuxes everything in the input thread." )
+
+#define MONITOR_TEXT N_("Monitor the transport stream")
+#define MONITOR_LONGTEXT N_( \
+    "Keep per-PID bitrate, continuity and PCR timing statistics, along the " \
+    "lines of ETSI TR 101 290, and publish them every second." )
+
 static const int const arib_mode_list[] =
   { ARIBMODE_AUTO, ARIBMODE_ENABLED, ARIBMODE_DISABLED };
 static const char *const arib_mode_list_text[] =
@@ -169,6 +188,8 @@ vlc_module_begin ()
 
     add_bool( "ts-split-es", true, SPLIT_ES_TEXT, SPLIT_ES_LONGTEXT, false )
     add_bool( "ts-seek-percent", false, SEEK_PERCENT_TEXT, SEEK_PERCENT_LONGTEXT, true )
+    add_integer_with_range( "ts-threads", 0, 0, 32, THREADS_TEXT, THREADS_LONGTEXT, true )
+    add_bool( "ts-monitor", false, MONITOR_TEXT, MONITOR_LONGTEXT, true )
 
     add_integer( "ts-arib", ARIBMODE_AUTO, SUPPORT_ARIB_TEXT, SUPPORT_ARIB_LONGTEXT, false )
         change_integer_list( arib_mode_list, arib_mode_list_text )
@@ -199,6 +220,7 @@ typedef struct
     int             i_version;
     int             i_ts_id;
     dvbpsi_t       *handle;
+    ts_psi_cache_t *cache;
     DECL_ARRAY(ts_pid_t *) programs;
 
 } ts_pat_t;
@@ -206,6 +228,7 @@ typedef struct
 typedef struct
 {
     dvbpsi_t       *handle;
+    ts_psi_cache_t *cache;
     int             i_version;
     int             i_number;
     int             i_pid_pcr;
@@ -272,8 +295,11 @@ typedef struct
 {
     /* for special PAT/SDT case */
     dvbpsi_t       *handle; /* PAT/SDT/EIT */
+    ts_psi_cache_t *cache;
     int             i_version;
 
+    void           *p_eit_tables; /* decoded events, by service and table */
+
 } ts_psi_t;
 
 typedef enum
@@ -306,15 +332,15 @@ enum
 
 struct ts_pid_t
 {
+    /* fields used for every packet first */
     uint16_t    i_pid;
 
     uint8_t     i_flags;
     uint8_t     i_cc;   /* countinuity counter */
     uint8_t     type;
 
-    /* PSI owner (ie PMT -> PAT, ES -> PMT */
     uint8_t     i_refcount;
-    ts_pid_t   *p_parent;
+    uint8_t     i_worker; /* 1 + index of the worker handling it, or 0 */
 
     /* */
     union
@@ -325,11 +351,14 @@ struct ts_pid_t
         ts_psi_t    *p_psi;
     } u;
 
+    /* PSI owner (ie PMT -> PAT, ES -> PMT */
+    ts_pid_t   *p_parent;
+
     struct
     {
         vlc_fourcc_t i_fourcc;
         int i_type;
-        int i_pcr_count;
+        atomic_uint i_pcr_count; /* also counted by the PES threads */
     } probed;
 
 };
@@ -339,11 +368,61 @@ typedef struct
     int i_service;
 } vdr_info_t;
 
+/* TS packets are read by chunks and walked in place. Only the packets
+ * gathered into PES are turned into blocks, referencing their chunk. */
+typedef struct ts_chunk_t ts_chunk_t;
+
+typedef struct
+{
+    block_t     self;
+    ts_chunk_t *p_chunk;
+    bool        b_descrambled; /* was scrambled when read, with csa */
+} ts_slice_t;
+
+struct ts_chunk_t
+{
+    block_t     *p_block;
+    atomic_uint  i_refs;
+    ts_slice_t   slices[]; /* one per packet */
+};
+
+/* With PES workers, the input thread reads the packets and handles the PSI.
+ * Each worker gathers and sends the PES, and applies the PCR, of the
+ * programs assigned to it, in packet order. */
+typedef struct
+{
+    demux_t      *p_demux;
+    vlc_thread_t  thread;
+    vlc_mutex_t   lock;
+    vlc_cond_t    wait;   /* packets queued, or end */
+    vlc_cond_t    done;   /* queue taken, or processed */
+    block_t      *p_queue;
+    block_t     **pp_queue_last;
+    size_t        i_queue;
+    bool          b_busy;
+    bool          b_end;
+    atomic_bool   b_idle; /* waiting for packets */
+
+    /* packets of the current Demux() call, only used by the input thread */
+    block_t      *p_batch;
+    block_t     **pp_batch_last;
+    size_t        i_batch;
+} ts_worker_t;
+
+#define TS_WORKER_QUEUE_MAX 1000 /* packets waiting for a worker */
+#define TS_WORKER_BATCH     128  /* packets handed over at once to a busy worker */
+#define TS_LIVE_CHUNK_PACKETS 7 /* packets read at once from live input */
+#define TS_PACKET_PCR_ONLY  (1 << BLOCK_FLAG_PRIVATE_SHIFT)
+
 #define MIN_ES_PID 4    /* Should be 32.. broken muxers */
 #define MAX_ES_PID 8190
 #define MIN_PAT_INTERVAL CLOCK_FREQ // DVB is 500ms
+#define MONITOR_PERIOD CLOCK_FREQ
 
-#define PID_ALLOC_CHUNK 16
+/* PIDs are allocated by blocks of consecutive ones, on first use */
+#define PID_BLOCK_BITS  7
+#define PID_BLOCK_SIZE  (1 << PID_BLOCK_BITS)
+#define PID_BLOCK_COUNT (8192 >> PID_BLOCK_BITS)
 
 struct demux_sys_t
 {
@@ -361,6 +440,29 @@ struct demux_sys_t
     /* how many TS packet we read at once */
     unsigned    i_ts_read;
 
+    /* synchronization search, and losses */
+    struct
+    {
+        ts_sync_find_t pf_find;
+        uint64_t       i_resyncs;
+        uint64_t       i_skipped; /* bytes */
+    } sync;
+
+    /* transport stream monitoring, if enabled */
+    struct
+    {
+        ts_monitor_t  *p_monitor;
+        mtime_t        i_next; /* next publication */
+    } monitor;
+
+    /* last chunk read, and position of its next packet */
+    struct
+    {
+        ts_chunk_t *p_current;
+        size_t      i_offset;
+        unsigned    i_packets; /* TS packets per read */
+    } chunk;
+
     bool        b_force_seek_per_percent;
 
     struct
@@ -377,15 +479,18 @@ struct demux_sys_t
     {
         ts_pid_t pat;
         ts_pid_t dummy;
-        /* all non commons ones, dynamically allocated */
-        ts_pid_t **pp_all;
-        int        i_all;
-        int        i_all_alloc;
-        /* last recently used */
-        uint16_t   i_last_pid;
-        ts_pid_t  *p_last;
+        /* all non commons ones, directly indexed by PID */
+        ts_pid_t  *pp_blocks[PID_BLOCK_COUNT];
     } pids;
 
+    /* PES workers, none if everything is done by the input thread */
+    struct
+    {
+        ts_worker_t *p_elems;
+        unsigned     i_count;
+        atomic_bool  b_update_filters; /* requested by a worker */
+    } workers;
+
     bool        b_user_pmt;
     int         i_pmt_es;
     bool        b_es_all; /* If we need to return all es/programs */
@@ -463,6 +568,7 @@ static void ts_psi_Del( demux_t *, ts_psi_t * );
 
 /* Helpers */
 static ts_pid_t *GetPID( demux_sys_t *, uint16_t i_pid );
+static ts_pid_t *GetNextPID( demux_sys_t *, ts_pid_t * );
 static ts_pmt_t * GetProgramByID( demux_sys_t *, int i_program );
 static bool ProgramIsSelected( demux_sys_t *, uint16_t i_pgrm );
 static void UpdatePESFilters( demux_t *p_demux, bool b_all );
@@ -478,10 +584,26 @@ static void AddAndCreateES( demux_t *p_demux, ts_pid_t *pid, bool );
 static void ProgramSetPCR( demux_t *p_demux, ts_pmt_t *p_prg, mtime_t i_pcr );
 
 static block_t* ReadTSPacket( demux_t *p_demux );
+static const uint8_t *NextTSPacket( demux_t *p_demux );
+static block_t *SliceTSPacket( demux_sys_t *, const uint8_t * );
+static bool ScrambledTSPacket( const demux_sys_t *, const uint8_t * );
+static void DropTSChunk( demux_sys_t * );
+static void ResyncStats( demux_t * );
+static void MonitorPublish( demux_t * );
+static size_t PendingTSChunk( const demux_sys_t * );
+static void WorkersStart( demux_t *, unsigned );
+static void WorkersStop( demux_t * );
+static void WorkersFlush( demux_sys_t *, bool );
+static void WorkersDrain( demux_sys_t * );
+static void WorkerQueue( demux_sys_t *, ts_pid_t *, block_t * );
+static void DispatchPCR( demux_t *, ts_pid_t *, block_t * );
+static void AssignWorkers( demux_t * );
+static void RequestPESFiltersUpdate( demux_t * );
 static int ProbeStart( demux_t *p_demux, int i_program );
 static int ProbeEnd( demux_t *p_demux, int i_program );
 static int SeekToTime( demux_t *p_demux, ts_pmt_t *, int64_t time );
 static void ReadyQueuesPostSeek( demux_t *p_demux );
+static mtime_t GetPCR( block_t * );
 static void PCRHandle( demux_t *p_demux, ts_pid_t *, block_t * );
 static void PCRFixHandle( demux_t *, ts_pmt_t *, block_t * );
 static int64_t TimeStampWrapAround( ts_pmt_t *, int64_t );
@@ -502,49 +624,33 @@ static int  SetPIDFilter( demux_sys_t *, ts_pid_t *, bool b_selected );
 #define TS_PACKET_SIZE_204 204
 #define TS_PACKET_SIZE_MAX 204
 #define TS_HEADER_SIZE 4
+#define TS_SYNC_CONFIRM 4 /* packets confirming a re-synchronization */
 
 static int DetectPacketSize( demux_t *p_demux, unsigned *pi_header_size, int i_offset )
 {
+    static const unsigned pi_sizes[] = {
+        TS_PACKET_SIZE_188, TS_PACKET_SIZE_192, TS_PACKET_SIZE_204,
+    };
     const uint8_t *p_peek;
 
-    if( stream_Peek( p_demux->s,
-                     &p_peek, i_offset + TS_PACKET_SIZE_MAX ) < i_offset + TS_PACKET_SIZE_MAX )
+    /* Look for a sync byte within the first TS_PACKET_SIZE_MAX bytes,
+     * followed by 3 others */
+    ssize_t i_peek = stream_Peek( p_demux->s, &p_peek,
+                                  i_offset + 4 * TS_PACKET_SIZE_MAX );
+    if( i_peek < i_offset + TS_PACKET_SIZE_MAX )
         return -1;
 
-    for( int i_sync = 0; i_sync < TS_PACKET_SIZE_MAX; i_sync++ )
+    size_t i_sync;
+    unsigned i_packet_size;
+    if( ts_sync_GetFind( vlc_CPU() )( p_peek + i_offset, i_peek - i_offset,
+                                      pi_sizes, ARRAY_SIZE(pi_sizes), 3,
+                                      &i_sync, &i_packet_size ) )
     {
-        if( p_peek[i_offset + i_sync] != 0x47 )
-            continue;
-
-        /* Check next 3 sync bytes */
-        int i_peek = i_offset + TS_PACKET_SIZE_MAX * 3 + i_sync + 1;
-        if( ( stream_Peek( p_demux->s, &p_peek, i_peek ) ) < i_peek )
-        {
-            msg_Err( p_demux, "cannot peek" );
-            return -1;
-        }
-        if( p_peek[i_offset + i_sync + 1 * TS_PACKET_SIZE_188] == 0x47 &&
-            p_peek[i_offset + i_sync + 2 * TS_PACKET_SIZE_188] == 0x47 &&
-            p_peek[i_offset + i_sync + 3 * TS_PACKET_SIZE_188] == 0x47 )
-        {
-            return TS_PACKET_SIZE_188;
-        }
-        else if( p_peek[i_offset + i_sync + 1 * TS_PACKET_SIZE_192] == 0x47 &&
-                 p_peek[i_offset + i_sync + 2 * TS_PACKET_SIZE_192] == 0x47 &&
-                 p_peek[i_offset + i_sync + 3 * TS_PACKET_SIZE_192] == 0x47 )
-        {
-            if( i_sync == 4 )
-            {
-                *pi_header_size = 4; /* BluRay TS packets have 4-byte header */
-            }
-            return TS_PACKET_SIZE_192;
-        }
-        else if( p_peek[i_offset + i_sync + 1 * TS_PACKET_SIZE_204] == 0x47 &&
-                 p_peek[i_offset + i_sync + 2 * TS_PACKET_SIZE_204] == 0x47 &&
-                 p_peek[i_offset + i_sync + 3 * TS_PACKET_SIZE_204] == 0x47 )
+        if( i_packet_size == TS_PACKET_SIZE_192 && i_sync == 4 )
         {
-            return TS_PACKET_SIZE_204;
+            *pi_header_size = 4; /* BluRay TS packets have 4-byte header */
         }
+        return i_packet_size;
     }
 
     if( p_demux->b_force )
@@ -673,7 +779,7 @@ static void ProbePES( demux_t *p_demux, ts_pid_t *pid, const uint8_t *p_pesstart
             if( i_data < len )
                 return;
             if( len >= 7 && (p_pes[1] & 0x10) )
-                pid->probed.i_pcr_count++;
+                atomic_fetch_add( &pid->probed.i_pcr_count, 1 );
             p_pes += len;
             i_data -= len;
         }
@@ -837,7 +943,7 @@ static void ProbePES( demux_t *p_demux, ts_pid_t *pid, const uint8_t *p_pesstart
 static void BuildPATCallback( void *p_opaque, block_t *p_block )
 {
     ts_pid_t *pat_pid = (ts_pid_t *) p_opaque;
-    dvbpsi_packet_push( pat_pid->u.p_pat->handle, p_block->p_buffer );
+    ts_psi_cache_Push( pat_pid->u.p_pat->cache, p_block->p_buffer );
 }
 
 static void BuildPMTCallback( void *p_opaque, block_t *p_block )
@@ -846,8 +952,7 @@ static void BuildPMTCallback( void *p_opaque, block_t *p_block )
     assert(program_pid->type == TYPE_PMT);
     while( p_block )
     {
-        dvbpsi_packet_push( program_pid->u.p_pmt->handle,
-                            p_block->p_buffer );
+        ts_psi_cache_Push( program_pid->u.p_pmt->cache, p_block->p_buffer );
         p_block = p_block->p_next;
     }
 }
@@ -872,15 +977,15 @@ static void MissingPATPMTFixup( demux_t *p_demux )
         }
     }
 
-    for( int i=0; i<p_sys->pids.i_all; i++ )
+    for( const ts_pid_t *p_pid = GetNextPID( p_sys, NULL ); p_pid;
+         p_pid = GetNextPID( p_sys, (ts_pid_t *) p_pid ) )
     {
-        const ts_pid_t *p_pid = p_sys->pids.pp_all[i];
         if( !SEEN(p_pid) ||
             p_pid->probed.i_type == -1 )
             continue;
 
         if( i_pcr_pid == 0x1FFF && ( p_pid->probed.i_type == 0x03 ||
-                                     p_pid->probed.i_pcr_count ) )
+                                     atomic_load( &p_pid->probed.i_pcr_count ) ) )
             i_pcr_pid = p_pid->i_pid;
 
         i_num_pes++;
@@ -927,10 +1032,9 @@ static void MissingPATPMTFixup( demux_t *p_demux )
     if( esstreams && mapped )
     {
         int j=0;
-        for( int i=0; i<p_sys->pids.i_all; i++ )
+        for( const ts_pid_t *p_pid = GetNextPID( p_sys, NULL ); p_pid;
+             p_pid = GetNextPID( p_sys, (ts_pid_t *) p_pid ) )
         {
-            const ts_pid_t *p_pid = p_sys->pids.pp_all[i];
-
             if( !SEEN(p_pid) ||
                 p_pid->probed.i_type == -1 )
                 continue;
@@ -1007,6 +1111,17 @@ static int Open( vlc_object_t *p_this )
     p_sys->i_packet_size = i_packet_size;
     p_sys->i_packet_header_size = i_packet_header_size;
     p_sys->i_ts_read = 50;
+    p_sys->sync.pf_find = ts_sync_GetFind( vlc_CPU() );
+    var_Create( p_demux, "ts-resyncs", VLC_VAR_INTEGER );
+    var_Create( p_demux, "ts-resync-bytes", VLC_VAR_INTEGER );
+    if( var_InheritBool( p_demux, "ts-monitor" ) )
+    {
+        p_sys->monitor.p_monitor = ts_monitor_New( i_packet_size );
+        p_sys->monitor.i_next = mdate() + MONITOR_PERIOD;
+        var_Create( p_demux, "ts-monitor-report", VLC_VAR_STRING );
+        var_Create( p_demux, "ts-cc-errors", VLC_VAR_INTEGER );
+        var_Create( p_demux, "ts-pcr-errors", VLC_VAR_INTEGER );
+    }
     p_sys->csa = NULL;
     p_sys->b_start_record = false;
 
@@ -1139,6 +1254,11 @@ static int Open( vlc_object_t *p_this )
     stream_Control( p_sys->stream, STREAM_CAN_SEEK, &p_sys->b_canseek );
     stream_Control( p_sys->stream, STREAM_CAN_FASTSEEK, &p_sys->b_canfastseek );
 
+    /* stream_Block() waits for the whole chunk: on live input, do not wait
+     * for more than the packets of one datagram */
+    p_sys->chunk.i_packets = p_sys->b_canseek ? p_sys->i_ts_read
+                                              : TS_LIVE_CHUNK_PACKETS;
+
     /* Preparse time */
     if( p_sys->b_canseek )
     {
@@ -1151,6 +1271,8 @@ static int Open( vlc_object_t *p_this )
     else
         p_sys->es_creation = ( p_sys->b_access_control ? CREATE_ES : DELAY_ES );
 
+    WorkersStart( p_demux, var_InheritInteger( p_demux, "ts-threads" ) );
+
     return VLC_SUCCESS;
 }
 
@@ -1162,6 +1284,8 @@ static void Close( vlc_object_t *p_this )
     demux_t     *p_demux = (demux_t*)p_this;
     demux_sys_t *p_sys = p_demux->p_sys;
 
+    WorkersStop( p_demux );
+
     PIDRelease( p_demux, GetPID(p_sys, 0) );
 
     if( p_sys->b_dvb_meta )
@@ -1195,17 +1319,43 @@ static void Close( vlc_object_t *p_this )
 
     vlc_mutex_destroy( &p_sys->csa_lock );
 
-    /* Release all non default pids */
-    for( int i = 0; i < p_sys->pids.i_all; i++ )
+    DropTSChunk( p_sys );
+
+    if( p_sys->sync.i_resyncs )
+        msg_Dbg( p_demux, "lost synchronization %"PRIu64" times, "
+                 "%"PRIu64" bytes skipped", p_sys->sync.i_resyncs,
+                 p_sys->sync.i_skipped );
+    var_Destroy( p_demux, "ts-resync-bytes" );
+    var_Destroy( p_demux, "ts-resyncs" );
+
+    if( p_sys->monitor.p_monitor )
     {
-        ts_pid_t *pid = p_sys->pids.pp_all[i];
+        ts_monitor_Period( p_sys->monitor.p_monitor );
+        char *psz_report = ts_monitor_Report( p_sys->monitor.p_monitor );
+        if( psz_report )
+        {
+            for( char *psz_save, *psz_line = strtok_r( psz_report, "\n", &psz_save );
+                 psz_line; psz_line = strtok_r( NULL, "\n", &psz_save ) )
+                msg_Dbg( p_demux, "%s", psz_line );
+            free( psz_report );
+        }
+        ts_monitor_Delete( p_sys->monitor.p_monitor );
+        var_Destroy( p_demux, "ts-monitor-report" );
+        var_Destroy( p_demux, "ts-cc-errors" );
+        var_Destroy( p_demux, "ts-pcr-errors" );
+    }
+
+    /* Release all non default pids */
 #ifndef NDEBUG
+    for( ts_pid_t *pid = GetNextPID( p_sys, NULL ); pid;
+         pid = GetNextPID( p_sys, pid ) )
+    {
         if( pid->type != TYPE_FREE )
             msg_Err( p_demux, "PID %d type %d not freed", pid->i_pid, pid->type );
-#endif
-        free( pid );
     }
-    free( p_sys->pids.pp_all );
+#endif
+    for( int i = 0; i < PID_BLOCK_COUNT; i++ )
+        free( p_sys->pids.pp_blocks[i] );
 
     free( p_sys );
 }
@@ -1243,20 +1393,35 @@ static int Demux( demux_t *p_demux )
     /* If we had no PAT within MIN_PAT_INTERVAL, create PAT/PMT from probed streams */
     if( p_sys->i_pmt_es == 0 && !SEEN(GetPID(p_sys, 0)) && p_sys->patfix.status == PAT_MISSING )
     {
+        WorkersDrain( p_sys );
         MissingPATPMTFixup( p_demux );
         p_sys->patfix.status = PAT_FIXTRIED;
     }
 
+    if( p_sys->workers.i_count &&
+        atomic_exchange( &p_sys->workers.b_update_filters, false ) )
+        UpdatePESFilters( p_demux, p_sys->b_es_all );
+
     /* We read at most 100 TS packet or until a frame is completed */
     for( unsigned i_pkt = 0; i_pkt < p_sys->i_ts_read; i_pkt++ )
     {
         bool         b_frame = false;
-        block_t     *p_pkt;
-        if( !(p_pkt = ReadTSPacket( p_demux )) )
+        const uint8_t *p_data;
+        if( !(p_data = NextTSPacket( p_demux )) )
         {
+            /* Everything must be out when reporting the end */
+            WorkersDrain( p_sys );
             return VLC_DEMUXER_EOF;
         }
 
+        /* Packet still in the chunk, only valid within this iteration */
+        block_t      pkt, *p_pkt = &pkt;
+        block_Init( &pkt, (uint8_t *)p_data,
+                    p_sys->i_packet_size - p_sys->i_packet_header_size );
+
+        if( p_sys->monitor.p_monitor )
+            ts_monitor_Packet( p_sys->monitor.p_monitor, p_data );
+
         if( p_sys->b_start_record )
         {
             /* Enable recording once synchronized */
@@ -1268,22 +1433,23 @@ static int Demux( demux_t *p_demux )
         ts_pid_t *p_pid = GetPID( p_sys, PIDGet( p_pkt ) );
 
         if( (p_pkt->p_buffer[1] & 0x40) && (p_pkt->p_buffer[3] & 0x10) &&
-            !SCRAMBLED(*p_pid) != !(p_pkt->p_buffer[3] & 0x80) )
+            !SCRAMBLED(*p_pid) != !ScrambledTSPacket( p_sys, p_data ) )
         {
-            UpdateScrambledState( p_demux, p_pid, p_pkt->p_buffer[3] & 0x80 );
+            UpdateScrambledState( p_demux, p_pid, ScrambledTSPacket( p_sys, p_data ) );
         }
 
         if( !SEEN(p_pid) )
         {
             if( p_pid->type == TYPE_FREE )
                 msg_Dbg( p_demux, "pid[%d] unknown", p_pid->i_pid );
+            if( p_pid->i_worker ) /* its worker reads the flags */
+                WorkersDrain( p_sys );
             p_pid->i_flags |= FLAG_SEEN;
         }
 
         if ( SCRAMBLED(*p_pid) && !p_demux->p_sys->csa )
         {
-            PCRHandle( p_demux, p_pid, p_pkt );
-            block_Release( p_pkt );
+            DispatchPCR( p_demux, p_pid, p_pkt );
             continue;
         }
 
@@ -1300,13 +1466,11 @@ static int Demux( demux_t *p_demux )
         switch( p_pid->type )
         {
         case TYPE_PAT:
-            dvbpsi_packet_push( p_pid->u.p_pat->handle, p_pkt->p_buffer );
-            block_Release( p_pkt );
+            ts_psi_cache_Push( p_pid->u.p_pat->cache, p_pkt->p_buffer );
             break;
 
         case TYPE_PMT:
-            dvbpsi_packet_push( p_pid->u.p_pmt->handle, p_pkt->p_buffer );
-            block_Release( p_pkt );
+            ts_psi_cache_Push( p_pid->u.p_pmt->cache, p_pkt->p_buffer );
             break;
 
         case TYPE_PES:
@@ -1315,31 +1479,35 @@ static int Demux( demux_t *p_demux )
             if( p_sys->es_creation == DELAY_ES ) /* No longer delay ES since that pid's program sends data */
             {
                 msg_Dbg( p_demux, "Creating delayed ES" );
+                WorkersDrain( p_sys );
                 AddAndCreateES( p_demux, p_pid, true );
             }
 
             if( !p_sys->b_access_control && !(p_pid->i_flags & FLAG_FILTERED) )
             {
                 /* That packet is for an unselected ES, don't waste time/memory gathering its data */
-                block_Release( p_pkt );
                 continue;
             }
 
-            b_frame = GatherData( p_demux, p_pid, p_pkt );
+            p_pkt = SliceTSPacket( p_sys, p_data );
+            if( unlikely(p_pkt == NULL) )
+                break;
+            if( p_pid->i_worker )
+                WorkerQueue( p_sys, p_pid, p_pkt );
+            else
+                b_frame = GatherData( p_demux, p_pid, p_pkt );
             break;
 
         case TYPE_SDT:
         case TYPE_TDT:
         case TYPE_EIT:
             if( p_sys->b_dvb_meta )
-                dvbpsi_packet_push( p_pid->u.p_psi->handle, p_pkt->p_buffer );
-            block_Release( p_pkt );
+                ts_psi_cache_Push( p_pid->u.p_psi->cache, p_pkt->p_buffer );
             break;
 
         default:
             /* We have to handle PCR if present */
-            PCRHandle( p_demux, p_pid, p_pkt );
-            block_Release( p_pkt );
+            DispatchPCR( p_demux, p_pid, p_pkt );
             break;
         }
 
@@ -1347,6 +1515,11 @@ static int Demux( demux_t *p_demux )
             break;
     }
 
+    WorkersFlush( p_sys, false );
+
+    if( p_sys->monitor.p_monitor && mdate() >= p_sys->monitor.i_next )
+        MonitorPublish( p_demux );
+
     demux_UpdateTitleFromStream( p_demux );
     return VLC_DEMUXER_SUCCESS;
 }
@@ -1378,9 +1551,30 @@ static int DVBEventInformation( demux_t *p_demux, int64_t *pi_time, int64_t *pi_
     return VLC_EGENERIC;
 }
 
+/* Queries reading the programs clock, or changing the PID filters */
+static bool ControlUsesWorkers( int i_query )
+{
+    switch( i_query )
+    {
+        case DEMUX_GET_POSITION:
+        case DEMUX_SET_POSITION:
+        case DEMUX_GET_TIME:
+        case DEMUX_SET_TIME:
+        case DEMUX_GET_LENGTH:
+        case DEMUX_SET_GROUP:
+        case DEMUX_SET_ES:
+            return true;
+        default:
+            return false;
+    }
+}
+
 static void UpdatePESFilters( demux_t *p_demux, bool b_all )
 {
     demux_sys_t *p_sys = p_demux->p_sys;
+
+    WorkersDrain( p_sys );
+
     ts_pat_t *p_pat = GetPID(p_sys, 0)->u.p_pat;
     for( int i=0; i< p_pat->programs.i_size; i++ )
     {
@@ -1435,6 +1629,8 @@ static void UpdatePESFilters( demux_t *p_demux, bool b_all )
                 msg_Dbg( p_demux, "enabling pcr pid %d from program %d", p_pmt->i_pid_pcr, p_pmt->i_number );
         }
     }
+
+    AssignWorkers( p_demux );
 }
 
 static int Control( demux_t *p_demux, int i_query, va_list args )
@@ -1447,8 +1643,14 @@ static int Control( demux_t *p_demux, int i_query, va_list args )
     int i_int;
     ts_pmt_t *p_pmt;
     int i_first_program = ( p_sys->programs.i_size ) ? p_sys->programs.p_elems[0] : 0;
+    const bool b_workers = ControlUsesWorkers( i_query );
+
+    /* Only wait for the workers when their state is read or changed */
+    if( b_workers )
+        WorkersDrain( p_sys );
 
-    if( PREPARSING || !i_first_program || p_sys->b_default_selection )
+    if( b_workers &&
+        ( PREPARSING || !i_first_program || p_sys->b_default_selection ) )
     {
         if( likely(GetPID(p_sys, 0)->type == TYPE_PAT) )
         {
@@ -1502,7 +1704,7 @@ static int Control( demux_t *p_demux, int i_query, va_list args )
 
         if( (i64 = stream_Size( p_sys->stream) ) > 0 )
         {
-            int64_t offset = stream_Tell( p_sys->stream );
+            int64_t offset = stream_Tell( p_sys->stream ) - PendingTSChunk( p_sys );
             *pf = (double)offset / (double)i64;
             return VLC_SUCCESS;
         }
@@ -2464,7 +2666,7 @@ static void ParseTableSection( demux_t *p_demux, ts_pid_t *pid, block_t *p_data
             }
 
             if( b_changed )
-                UpdatePESFilters( p_demux, p_demux->p_sys->b_es_all );
+                RequestPESFiltersUpdate( p_demux );
 
             p_ods->i_version = i_version;
         }
@@ -2536,7 +2738,7 @@ static block_t* ReadTSPacket( demux_t *p_demux )
     p_pkt->i_buffer -= p_sys->i_packet_header_size;
 
     /* Check sync byte and re-sync if needed */
-    if( p_pkt->p_buffer[0] != 0x47 )
+    if( p_pkt->p_buffer[0] != TS_SYNC_BYTE )
     {
         msg_Warn( p_demux, "lost synchro" );
         block_Release( p_pkt );
@@ -2544,7 +2746,9 @@ static block_t* ReadTSPacket( demux_t *p_demux )
         {
             const uint8_t *p_peek;
             int i_peek = 0;
-            unsigned i_skip = 0;
+            size_t i_skip;
+            const unsigned i_stride = p_sys->i_packet_size;
+            unsigned i_unused;
 
             i_peek = stream_Peek( p_sys->stream, &p_peek,
                     p_sys->i_packet_size * 10 );
@@ -2554,21 +2758,17 @@ static block_t* ReadTSPacket( demux_t *p_demux )
                 return NULL;
             }
 
-            while( i_skip < i_peek - p_sys->i_packet_size )
-            {
-                if( p_peek[i_skip + p_sys->i_packet_header_size] == 0x47 &&
-                        p_peek[i_skip + p_sys->i_packet_header_size + p_sys->i_packet_size] == 0x47 )
-                {
-                    break;
-                }
-                i_skip++;
-            }
-            msg_Dbg( p_demux, "skipping %d bytes of garbage", i_skip );
-            if (stream_Read( p_sys->stream, NULL, i_skip ) != i_skip)
+            bool b_found = p_sys->sync.pf_find( p_peek + p_sys->i_packet_header_size,
+                                                i_peek - p_sys->i_packet_header_size,
+                                                &i_stride, 1, 1, &i_skip, &i_unused );
+            msg_Dbg( p_demux, "skipping %zu bytes of garbage", i_skip );
+            if( stream_Read( p_sys->stream, NULL, i_skip ) != (ssize_t)i_skip )
                 return NULL;
+            p_sys->sync.i_skipped += i_skip;
 
-            if( i_skip < i_peek - p_sys->i_packet_size )
+            if( b_found )
             {
+                ResyncStats( p_demux );
                 break;
             }
         }
@@ -2581,6 +2781,270 @@ static block_t* ReadTSPacket( demux_t *p_demux )
     return p_pkt;
 }
 
+static void ChunkRelease( ts_chunk_t *p_chunk )
+{
+    if( atomic_fetch_sub( &p_chunk->i_refs, 1 ) == 1 )
+    {
+        block_Release( p_chunk->p_block );
+        free( p_chunk );
+    }
+}
+
+static void SliceRelease( block_t *p_block )
+{
+    ChunkRelease( ((ts_slice_t *)p_block)->p_chunk );
+}
+
+/* Makes a block out of the last packet returned by NextTSPacket() */
+static block_t *SliceTSPacket( demux_sys_t *p_sys, const uint8_t *p_data )
+{
+    ts_chunk_t *p_chunk = p_sys->chunk.p_current;
+    /* packets never overlap, so their slots are distinct even after
+     * a re-synchronization */
+    size_t i_slot = (p_data - p_chunk->p_block->p_buffer) / p_sys->i_packet_size;
+    ts_slice_t *p_slice = &p_chunk->slices[i_slot];
+
+    block_Init( &p_slice->self, (uint8_t *)p_data,
+                p_sys->i_packet_size - p_sys->i_packet_header_size );
+    p_slice->self.pf_release = SliceRelease;
+    p_slice->p_chunk = p_chunk;
+    atomic_fetch_add( &p_chunk->i_refs, 1 );
+    return &p_slice->self;
+}
+
+static void DropTSChunk( demux_sys_t *p_sys )
+{
+    if( p_sys->chunk.p_current )
+        ChunkRelease( p_sys->chunk.p_current );
+    p_sys->chunk.p_current = NULL;
+    p_sys->chunk.i_offset = 0;
+}
+
+/* Bytes read from the stream but not yet demuxed */
+static size_t PendingTSChunk( const demux_sys_t *p_sys )
+{
+    if( p_sys->chunk.p_current == NULL )
+        return 0;
+    return p_sys->chunk.p_current->p_block->i_buffer - p_sys->chunk.i_offset;
+}
+
+/* Whether the packet was scrambled, even if descrambled since */
+static bool ScrambledTSPacket( const demux_sys_t *p_sys, const uint8_t *p_data )
+{
+    if( p_data[3] & 0x80 )
+        return true;
+    if( p_sys->csa == NULL )
+        return false;
+
+    const ts_chunk_t *p_chunk = p_sys->chunk.p_current;
+    size_t i_slot = (p_data - p_chunk->p_block->p_buffer) / p_sys->i_packet_size;
+    return p_chunk->slices[i_slot].b_descrambled;
+}
+
+/* Descrambles the packets of the gathered PES in one batch, as far as the
+ * chunk is in sync. GatherData() descrambles the others one by one. */
+static void DescrambleTSChunk( demux_sys_t *p_sys, ts_chunk_t *p_chunk,
+                               size_t i_slots )
+{
+    const block_t *p_block = p_chunk->p_block;
+    const size_t i_size = p_sys->i_packet_size;
+    const size_t i_header = p_sys->i_packet_header_size;
+    uint8_t *pp_pkts[64];
+    size_t i_pkts = 0;
+    bool b_sync = true;
+
+    vlc_mutex_lock( &p_sys->csa_lock );
+    for( size_t i_slot = 0; i_slot < i_slots; i_slot++ )
+    {
+        size_t i_offset = i_slot * i_size;
+        uint8_t *p = p_block->p_buffer + i_offset + i_header;
+
+        p_chunk->slices[i_slot].b_descrambled = false;
+        if( !b_sync || i_offset + i_size > p_block->i_buffer ||
+            p[0] != TS_SYNC_BYTE )
+        {
+            b_sync = false;
+            continue;
+        }
+        if( (p[3] & 0x80) == 0 )
+            continue;
+
+        const ts_pid_t *p_pid = GetPID( p_sys, ((p[1] & 0x1f) << 8) | p[2] );
+        if( p_pid->type != TYPE_PES ||
+            ( !p_sys->b_access_control && !(p_pid->i_flags & FLAG_FILTERED) ) )
+            continue;
+
+        p_chunk->slices[i_slot].b_descrambled = true;
+        pp_pkts[i_pkts++] = p;
+        if( i_pkts == ARRAY_SIZE(pp_pkts) )
+        {
+            csa_DecryptBatch( p_sys->csa, pp_pkts, i_pkts, p_sys->i_csa_pkt_size );
+            i_pkts = 0;
+        }
+    }
+    if( i_pkts > 0 )
+        csa_DecryptBatch( p_sys->csa, pp_pkts, i_pkts, p_sys->i_csa_pkt_size );
+    vlc_mutex_unlock( &p_sys->csa_lock );
+}
+
+/* Reads the next chunk, starting with the i_carry unused bytes of the
+ * current one */
+static int ReadTSChunk( demux_t *p_demux, size_t i_carry )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+
+    block_t *p_block = stream_Block( p_sys->stream,
+                                     p_sys->i_packet_size * p_sys->chunk.i_packets );
+    if( p_block == NULL || p_block->i_buffer == 0 )
+    {
+        int64_t size = stream_Size( p_sys->stream );
+        if( size >= 0 && (uint64_t)size == stream_Tell( p_sys->stream ) )
+            msg_Dbg( p_demux, "EOF at %"PRId64, stream_Tell( p_sys->stream ) );
+        else
+            msg_Dbg( p_demux, "Can't read TS packet at %"PRId64, stream_Tell(p_sys->stream) );
+        if( p_block )
+            block_Release( p_block );
+        return VLC_EGENERIC;
+    }
+
+    if( i_carry > 0 )
+    {
+        p_block = block_Realloc( p_block, i_carry, p_block->i_buffer );
+        if( unlikely(p_block == NULL) )
+            return VLC_ENOMEM;
+        memcpy( p_block->p_buffer, p_sys->chunk.p_current->p_block->p_buffer
+                                   + p_sys->chunk.i_offset, i_carry );
+    }
+
+    size_t i_slots = p_block->i_buffer / p_sys->i_packet_size + 1;
+    ts_chunk_t *p_chunk = malloc( sizeof(*p_chunk)
+                                  + i_slots * sizeof(p_chunk->slices[0]) );
+    if( unlikely(p_chunk == NULL) )
+    {
+        block_Release( p_block );
+        return VLC_ENOMEM;
+    }
+    p_chunk->p_block = p_block;
+    atomic_init( &p_chunk->i_refs, 1 );
+
+    DropTSChunk( p_sys );
+    p_sys->chunk.p_current = p_chunk;
+
+    if( p_sys->csa )
+        DescrambleTSChunk( p_sys, p_chunk, i_slots );
+    return VLC_SUCCESS;
+}
+
+static void ResyncStats( demux_t *p_demux )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+
+    p_sys->sync.i_resyncs++;
+    msg_Dbg( p_demux, "resynchronized, %"PRIu64" bytes skipped in %"PRIu64
+             " losses so far", p_sys->sync.i_skipped, p_sys->sync.i_resyncs );
+    var_SetInteger( p_demux, "ts-resyncs", p_sys->sync.i_resyncs );
+    var_SetInteger( p_demux, "ts-resync-bytes", p_sys->sync.i_skipped );
+}
+
+/* Updates the monitoring variables, from all the PIDs statistics */
+static void MonitorPublish( demux_t *p_demux )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+    ts_monitor_t *p_monitor = p_sys->monitor.p_monitor;
+    uint64_t i_cc_errors = 0, i_pcr_errors = 0;
+
+    ts_monitor_Period( p_monitor );
+    p_sys->monitor.i_next = mdate() + MONITOR_PERIOD;
+
+    for( unsigned i_pid = 0; i_pid < 0x1FFF; i_pid++ )
+    {
+        const ts_monitor_pid_t *p_stats = ts_monitor_GetPID( p_monitor, i_pid );
+        if( !p_stats )
+            continue;
+        i_cc_errors += p_stats->i_cc_errors;
+        i_pcr_errors += p_stats->i_pcr_repetition + p_stats->i_pcr_discontinuity +
+                        p_stats->i_pcr_accuracy;
+    }
+
+    char *psz_report = ts_monitor_Report( p_monitor );
+    if( psz_report )
+    {
+        var_SetString( p_demux, "ts-monitor-report", psz_report );
+        free( psz_report );
+    }
+    var_SetInteger( p_demux, "ts-cc-errors", i_cc_errors );
+    var_SetInteger( p_demux, "ts-pcr-errors", i_pcr_errors );
+}
+
+/* Returns the next packet, past its extra header if any, from the current
+ * chunk. It remains valid until the next call, or SliceTSPacket() can be
+ * used to keep it. */
+static const uint8_t *NextTSPacket( demux_t *p_demux )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+    const size_t i_size = p_sys->i_packet_size;
+    const size_t i_header = p_sys->i_packet_header_size;
+    bool b_lost = false;
+
+    for( ;; )
+    {
+        size_t i_pending = PendingTSChunk( p_sys );
+
+        if( i_pending >= i_size )
+        {
+            const block_t *p_block = p_sys->chunk.p_current->p_block;
+            const uint8_t *p = p_block->p_buffer + p_sys->chunk.i_offset;
+
+            if( likely(p[i_header] == TS_SYNC_BYTE) && !b_lost )
+            {
+                p_sys->chunk.i_offset += i_size;
+                return p + i_header;
+            }
+
+            if( !b_lost )
+                msg_Warn( p_demux, "lost synchro" );
+            b_lost = true;
+
+            /* Re-sync on two consecutive sync bytes, confirmed by the
+             * following packets of the chunk */
+            const unsigned i_stride = i_size;
+            size_t i_skip = 0;
+            for( ;; )
+            {
+                size_t i_found;
+                unsigned i_unused;
+                bool b_found = p_sys->sync.pf_find( p + i_header + i_skip,
+                                                    i_pending - i_header - i_skip,
+                                                    &i_stride, 1, 1,
+                                                    &i_found, &i_unused );
+                i_skip += i_found;
+                if( !b_found )
+                    break;
+
+                const uint8_t *p_sync = p + i_header + i_skip;
+                size_t i_left = i_pending - i_header - i_skip;
+                size_t i_confirm = __MIN( i_left / i_size, TS_SYNC_CONFIRM );
+                if( ts_sync_Count( p_sync, i_left, i_size ) >= i_confirm )
+                    break;
+                i_skip++;
+            }
+
+            p_sys->chunk.i_offset += i_skip;
+            p_sys->sync.i_skipped += i_skip;
+            if( i_skip + i_header + i_size < i_pending )
+            {
+                ResyncStats( p_demux );
+                p_sys->chunk.i_offset += i_size;
+                return p + i_skip + i_header;
+            }
+            i_pending -= i_skip;
+        }
+
+        if( ReadTSChunk( p_demux, i_pending ) )
+            return NULL;
+    }
+}
+
 static int64_t TimeStampWrapAround( ts_pmt_t *p_pmt, int64_t i_time )
 {
     int64_t i_adjust = 0;
@@ -2590,6 +3054,276 @@ static int64_t TimeStampWrapAround( ts_pmt_t *p_pmt, int64_t i_time )
     return i_time + i_adjust;
 }
 
+static void *WorkerThread( void *data )
+{
+    ts_worker_t *p_worker = data;
+    demux_t *p_demux = p_worker->p_demux;
+    demux_sys_t *p_sys = p_demux->p_sys;
+
+    vlc_mutex_lock( &p_worker->lock );
+    for( ;; )
+    {
+        while( p_worker->p_queue == NULL && !p_worker->b_end )
+        {
+            atomic_store( &p_worker->b_idle, true );
+            vlc_cond_wait( &p_worker->wait, &p_worker->lock );
+        }
+        atomic_store( &p_worker->b_idle, false );
+        if( p_worker->p_queue == NULL )
+            break;
+
+        block_t *p_pkt = p_worker->p_queue;
+        p_worker->p_queue = NULL;
+        p_worker->pp_queue_last = &p_worker->p_queue;
+        p_worker->i_queue = 0;
+        p_worker->b_busy = true;
+        vlc_cond_signal( &p_worker->done );
+        vlc_mutex_unlock( &p_worker->lock );
+
+        while( p_pkt )
+        {
+            block_t *p_next = p_pkt->p_next;
+            ts_pid_t *p_pid = GetPID( p_sys, PIDGet( p_pkt ) );
+
+            p_pkt->p_next = NULL;
+            if( p_pkt->i_flags & TS_PACKET_PCR_ONLY )
+            {
+                PCRHandle( p_demux, p_pid, p_pkt );
+                block_Release( p_pkt );
+            }
+            else
+                GatherData( p_demux, p_pid, p_pkt );
+            p_pkt = p_next;
+        }
+
+        vlc_mutex_lock( &p_worker->lock );
+        p_worker->b_busy = false;
+        vlc_cond_signal( &p_worker->done );
+    }
+    vlc_mutex_unlock( &p_worker->lock );
+    return NULL;
+}
+
+static void WorkersStart( demux_t *p_demux, unsigned i_count )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+
+    atomic_init( &p_sys->workers.b_update_filters, false );
+    if( i_count == 0 )
+        return;
+
+    p_sys->workers.p_elems = calloc( i_count, sizeof(ts_worker_t) );
+    if( !p_sys->workers.p_elems )
+        return;
+
+    for( unsigned i = 0; i < i_count; i++ )
+    {
+        ts_worker_t *p_worker = &p_sys->workers.p_elems[i];
+
+        p_worker->p_demux = p_demux;
+        vlc_mutex_init( &p_worker->lock );
+        vlc_cond_init( &p_worker->wait );
+        vlc_cond_init( &p_worker->done );
+        p_worker->pp_queue_last = &p_worker->p_queue;
+        p_worker->pp_batch_last = &p_worker->p_batch;
+        atomic_init( &p_worker->b_idle, false );
+
+        if( vlc_clone( &p_worker->thread, WorkerThread, p_worker,
+                       VLC_THREAD_PRIORITY_INPUT ) )
+        {
+            vlc_cond_destroy( &p_worker->done );
+            vlc_cond_destroy( &p_worker->wait );
+            vlc_mutex_destroy( &p_worker->lock );
+            break;
+        }
+        p_sys->workers.i_count++;
+    }
+
+    if( p_sys->workers.i_count == 0 )
+    {
+        msg_Warn( p_demux, "cannot start PES threads" );
+        FREENULL( p_sys->workers.p_elems );
+        return;
+    }
+
+    msg_Dbg( p_demux, "using %u PES threads", p_sys->workers.i_count );
+    if( GetPID(p_sys, 0)->type == TYPE_PAT )
+        AssignWorkers( p_demux );
+}
+
+static void WorkersStop( demux_t *p_demux )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+
+    WorkersDrain( p_sys );
+
+    for( unsigned i = 0; i < p_sys->workers.i_count; i++ )
+    {
+        ts_worker_t *p_worker = &p_sys->workers.p_elems[i];
+
+        vlc_mutex_lock( &p_worker->lock );
+        p_worker->b_end = true;
+        vlc_cond_signal( &p_worker->wait );
+        vlc_mutex_unlock( &p_worker->lock );
+
+        vlc_join( p_worker->thread, NULL );
+        vlc_cond_destroy( &p_worker->done );
+        vlc_cond_destroy( &p_worker->wait );
+        vlc_mutex_destroy( &p_worker->lock );
+    }
+    free( p_sys->workers.p_elems );
+    p_sys->workers.p_elems = NULL;
+    p_sys->workers.i_count = 0;
+
+    /* Nothing is assigned anymore */
+    for( ts_pid_t *p_pid = GetNextPID( p_sys, NULL ); p_pid;
+         p_pid = GetNextPID( p_sys, p_pid ) )
+        p_pid->i_worker = 0;
+}
+
+/* Appends a packet of a PID handled by a worker to the current batch */
+static void WorkerQueue( demux_sys_t *p_sys, ts_pid_t *p_pid, block_t *p_pkt )
+{
+    ts_worker_t *p_worker = &p_sys->workers.p_elems[p_pid->i_worker - 1];
+
+    *p_worker->pp_batch_last = p_pkt;
+    p_worker->pp_batch_last = &p_pkt->p_next;
+    p_worker->i_batch++;
+}
+
+/* Handles the PCR of a packet not gathered, in order with the PES of its
+ * program. p_pkt may be a view of the packet within its chunk. */
+static void DispatchPCR( demux_t *p_demux, ts_pid_t *p_pid, block_t *p_pkt )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+
+    if( p_pid->i_worker == 0 )
+        PCRHandle( p_demux, p_pid, p_pkt );
+    else if( GetPCR( p_pkt ) >= 0 )
+    {
+        p_pkt = SliceTSPacket( p_sys, p_pkt->p_buffer );
+        if( unlikely(p_pkt == NULL) )
+            return;
+        p_pkt->i_flags |= TS_PACKET_PCR_ONLY;
+        WorkerQueue( p_sys, p_pid, p_pkt );
+    }
+}
+
+/* Hands the current batches over to the workers, once they have room.
+ * Unless forced, busy workers only get full batches, which saves wake ups
+ * under load without delaying packets otherwise. */
+static void WorkersFlush( demux_sys_t *p_sys, bool b_force )
+{
+    for( unsigned i = 0; i < p_sys->workers.i_count; i++ )
+    {
+        ts_worker_t *p_worker = &p_sys->workers.p_elems[i];
+
+        if( p_worker->p_batch == NULL )
+            continue;
+        if( !b_force && p_worker->i_batch < TS_WORKER_BATCH &&
+            !atomic_load( &p_worker->b_idle ) )
+            continue;
+
+        vlc_mutex_lock( &p_worker->lock );
+        while( p_worker->i_queue >= TS_WORKER_QUEUE_MAX )
+            vlc_cond_wait( &p_worker->done, &p_worker->lock );
+        *p_worker->pp_queue_last = p_worker->p_batch;
+        p_worker->pp_queue_last = p_worker->pp_batch_last;
+        p_worker->i_queue += p_worker->i_batch;
+        vlc_cond_signal( &p_worker->wait );
+        vlc_mutex_unlock( &p_worker->lock );
+
+        p_worker->p_batch = NULL;
+        p_worker->pp_batch_last = &p_worker->p_batch;
+        p_worker->i_batch = 0;
+    }
+}
+
+/* Waits for all the packets demuxed so far to be processed. Afterwards,
+ * and until the next packet is queued, the input thread owns everything. */
+static void WorkersDrain( demux_sys_t *p_sys )
+{
+    WorkersFlush( p_sys, true );
+
+    for( unsigned i = 0; i < p_sys->workers.i_count; i++ )
+    {
+        ts_worker_t *p_worker = &p_sys->workers.p_elems[i];
+
+        vlc_mutex_lock( &p_worker->lock );
+        while( p_worker->p_queue != NULL || p_worker->b_busy )
+            vlc_cond_wait( &p_worker->done, &p_worker->lock );
+        vlc_mutex_unlock( &p_worker->lock );
+    }
+}
+
+static void SetPIDWorker( ts_pid_t *p_pid, uint8_t i_worker, bool *pb_conflict )
+{
+    if( p_pid->i_worker && p_pid->i_worker != i_worker )
+        *pb_conflict = true;
+    p_pid->i_worker = i_worker;
+}
+
+/* Spreads the programs over the workers. Programs sharing a PID, including
+ * their PCR one, must share a worker to keep the packets ordered. */
+static void AssignWorkers( demux_t *p_demux )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+
+    if( p_sys->workers.i_count == 0 )
+        return;
+
+    for( ts_pid_t *p_pid = GetNextPID( p_sys, NULL ); p_pid;
+         p_pid = GetNextPID( p_sys, p_pid ) )
+        p_pid->i_worker = 0;
+
+    ts_pat_t *p_pat = GetPID(p_sys, 0)->u.p_pat;
+    unsigned i_next = 0;
+    bool b_conflict = false;
+
+    for( int i = 0; i < p_pat->programs.i_size; i++ )
+    {
+        ts_pmt_t *p_pmt = p_pat->programs.p_elems[i]->u.p_pmt;
+        ts_pid_t *p_pcr = NULL;
+        uint8_t i_worker = 0;
+
+        if( p_pmt->i_pid_pcr > 0 && p_pmt->i_pid_pcr < 0x1FFF )
+        {
+            p_pcr = GetPID( p_sys, p_pmt->i_pid_pcr );
+            i_worker = p_pcr->i_worker;
+        }
+        for( int j = 0; j < p_pmt->e_streams.i_size && !i_worker; j++ )
+            i_worker = p_pmt->e_streams.p_elems[j]->i_worker;
+        if( !i_worker )
+            i_worker = 1 + i_next++ % p_sys->workers.i_count;
+
+        if( p_pcr )
+            SetPIDWorker( p_pcr, i_worker, &b_conflict );
+        for( int j = 0; j < p_pmt->e_streams.i_size; j++ )
+            SetPIDWorker( p_pmt->e_streams.p_elems[j], i_worker, &b_conflict );
+    }
+
+    if( b_conflict )
+    {
+        msg_Dbg( p_demux, "programs sharing PIDs, using a single PES thread" );
+        for( ts_pid_t *p_pid = GetNextPID( p_sys, NULL ); p_pid;
+             p_pid = GetNextPID( p_sys, p_pid ) )
+            if( p_pid->i_worker )
+                p_pid->i_worker = 1;
+    }
+}
+
+/* PID filters are only changed by the input thread, once the workers are
+ * idle */
+static void RequestPESFiltersUpdate( demux_t *p_demux )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+
+    if( p_sys->workers.i_count )
+        atomic_store( &p_sys->workers.b_update_filters, true );
+    else
+        UpdatePESFilters( p_demux, p_sys->b_es_all );
+}
+
 static mtime_t GetPCR( block_t *p_pkt )
 {
     const uint8_t *p = p_pkt->p_buffer;
@@ -2618,6 +3352,10 @@ static void UpdateScrambledState( demux_t *p_demux, ts_pid_t *p_pid, bool b_scra
     msg_Warn( p_demux, "scrambled state changed on pid %d (%d->%d)",
               p_pid->i_pid, !!SCRAMBLED(*p_pid), b_scrambled );
 
+    /* The packets queued so far were sent in the previous state */
+    if( p_pid->i_worker )
+        WorkersDrain( p_demux->p_sys );
+
     if( b_scrambled )
         p_pid->i_flags |= FLAG_SCRAMBLED;
     else
@@ -2658,6 +3396,10 @@ static void ReadyQueuesPostSeek( demux_t *p_demux )
 {
     demux_sys_t *p_sys = p_demux->p_sys;
 
+    DropTSChunk( p_sys );
+    if( p_sys->monitor.p_monitor )
+        ts_monitor_Reset( p_sys->monitor.p_monitor );
+
     ts_pat_t *p_pat = GetPID(p_sys, 0)->u.p_pat;
     for( int i=0; i< p_pat->programs.i_size; i++ )
     {
@@ -2804,45 +3546,41 @@ static ts_pid_t *GetPID( demux_sys_t *p_sys, uint16_t i_pid )
         case 0x1FFF:
             return &p_sys->pids.dummy;
         default:
-            if( p_sys->pids.i_last_pid == i_pid )
-                return p_sys->pids.p_last;
         break;
     }
 
-    for( int i=0; i < p_sys->pids.i_all; i++ )
-    {
-        if( p_sys->pids.pp_all[i]->i_pid == i_pid )
-        {
-            p_sys->pids.p_last = p_sys->pids.pp_all[i];
-            p_sys->pids.i_last_pid = i_pid;
-            return p_sys->pids.p_last;
-        }
-    }
+    assert( i_pid < 0x1FFF );
 
-    if( p_sys->pids.i_all >= p_sys->pids.i_all_alloc )
+    ts_pid_t **pp_block = &p_sys->pids.pp_blocks[i_pid >> PID_BLOCK_BITS];
+    if( unlikely(*pp_block == NULL) )
     {
-        ts_pid_t **p_realloc = realloc( p_sys->pids.pp_all,
-                                       (p_sys->pids.i_all_alloc + PID_ALLOC_CHUNK) * sizeof(ts_pid_t *) );
-        if( !p_realloc )
-            return NULL;
-        p_sys->pids.pp_all = p_realloc;
-        p_sys->pids.i_all_alloc += PID_ALLOC_CHUNK;
-    }
+        /* callers expect a PID in any case */
+        ts_pid_t *p_block = calloc( PID_BLOCK_SIZE, sizeof(*p_block) );
+        if( unlikely(p_block == NULL) )
+            abort();
 
-    ts_pid_t *p_pid = calloc( 1, sizeof(*p_pid) );
-    if( !p_pid )
-    {
-        abort();
-        //return NULL;
+        const uint16_t i_first = i_pid & ~(PID_BLOCK_SIZE - 1);
+        for( int i = 0; i < PID_BLOCK_SIZE; i++ )
+            p_block[i].i_pid = i_first + i;
+        *pp_block = p_block;
     }
 
-    p_pid->i_pid = i_pid;
-    p_sys->pids.pp_all[p_sys->pids.i_all++] = p_pid;
-
-    p_sys->pids.p_last = p_pid;
-    p_sys->pids.i_last_pid = i_pid;
+    return &(*pp_block)[i_pid & (PID_BLOCK_SIZE - 1)];
+}
 
-    return p_pid;
+/* Iterates over the allocated non common pids, in increasing order,
+ * starting after p_pid or from the first one if NULL */
+static ts_pid_t *GetNextPID( demux_sys_t *p_sys, ts_pid_t *p_pid )
+{
+    for( unsigned i_pid = p_pid ? p_pid->i_pid + 1 : 1; i_pid < 0x1FFF; i_pid++ )
+    {
+        ts_pid_t *p_block = p_sys->pids.pp_blocks[i_pid >> PID_BLOCK_BITS];
+        if( p_block == NULL )
+            i_pid |= PID_BLOCK_SIZE - 1; /* skip the whole block */
+        else
+            return &p_block[i_pid & (PID_BLOCK_SIZE - 1)];
+    }
+    return NULL;
 }
 
 static ts_pmt_t * GetProgramByID( demux_sys_t *p_sys, int i_program )
@@ -3028,6 +3766,11 @@ static void ProgramSetPCR( demux_t *p_demux, ts_pmt_t *p_pmt, mtime_t i_pcr )
         ts_pat_t *p_pat = GetPID(p_sys, 0)->u.p_pat;
         for( int i=0; i< p_pat->programs.i_size; i++ )
         {
+            /* other programs may belong to other workers */
+            if( p_sys->workers.i_count &&
+                p_pat->programs.p_elems[i]->u.p_pmt != p_pmt )
+                continue;
+
             ts_pmt_t *p_pmt = p_pat->programs.p_elems[i]->u.p_pmt;
             for( int j=0; j<p_pmt->e_streams.i_size; j++ )
             {
@@ -3106,7 +3849,7 @@ static void PCRHandle( demux_t *p_demux, ts_pid_t *pid, block_t *p_bk )
     if( i_pcr < 0 )
         return;
 
-    pid->probed.i_pcr_count++;
+    atomic_fetch_add( &pid->probed.i_pcr_count, 1 );
 
     if( p_sys->i_pmt_es <= 0 )
         return;
@@ -3119,14 +3862,15 @@ static void PCRHandle( demux_t *p_demux, ts_pid_t *pid, block_t *p_bk )
     for( int i = 0; i < p_pat->programs.i_size; i++ )
     {
         ts_pmt_t *p_pmt = p_pat->programs.p_elems[i]->u.p_pmt;
-        mtime_t i_program_pcr = TimeStampWrapAround( p_pmt, i_pcr );
 
+        /* Only the programs clocked by that pid are touched, others may be
+         * handled by other PES threads */
         if( p_pmt->i_pid_pcr == 0x1FFF ) /* That program has no dedicated PCR pid ISO/IEC 13818-1 2.4.4.9 */
         {
             if( pid->p_parent == p_pat->programs.p_elems[i] ) /* PCR shall be on pid itself */
             {
                 /* ? update PCR for the whole group program ? */
-                ProgramSetPCR( p_demux, p_pmt, i_program_pcr );
+                ProgramSetPCR( p_demux, p_pmt, TimeStampWrapAround( p_pmt, i_pcr ) );
             }
         }
         else /* set PCR provided by current pid to program(s) referencing it */
@@ -3136,7 +3880,7 @@ static void PCRHandle( demux_t *p_demux, ts_pid_t *pid, block_t *p_bk )
             {
                 /* We've found a target group for update */
                 PCRCheckDTS( p_demux, p_pmt, i_pcr );
-                ProgramSetPCR( p_demux, p_pmt, i_program_pcr );
+                ProgramSetPCR( p_demux, p_pmt, TimeStampWrapAround( p_pmt, i_pcr ) );
             }
         }
 
@@ -3154,9 +3898,10 @@ static int FindPCRCandidate( ts_pmt_t *p_pmt )
         if( SEEN(p_pid) &&
             (!p_cand || p_cand->i_pid != i_previous) )
         {
-            if( p_pid->probed.i_pcr_count ) /* check PCR frequency first */
+            unsigned i_count = atomic_load( &p_pid->probed.i_pcr_count );
+            if( i_count ) /* check PCR frequency first */
             {
-                if( !p_cand || p_pid->probed.i_pcr_count > p_cand->probed.i_pcr_count )
+                if( !p_cand || i_count > atomic_load( &p_cand->probed.i_pcr_count ) )
                 {
                     p_cand = p_pid;
                     continue;
@@ -3197,15 +3942,15 @@ static void PCRFixHandle( demux_t *p_demux, ts_pmt_t *p_pmt, block_t *p_block )
     else if( p_block->i_dts - p_pmt->pcr.i_first_dts > CLOCK_FREQ / 2 ) /* "PCR repeat rate shall not exceed 100ms" */
     {
         if( p_pmt->pcr.i_current < 0 &&
-            GetPID( p_demux->p_sys, p_pmt->i_pid_pcr )->probed.i_pcr_count == 0 )
+            atomic_load( &GetPID( p_demux->p_sys, p_pmt->i_pid_pcr )->probed.i_pcr_count ) == 0 )
         {
             int i_cand = FindPCRCandidate( p_pmt );
             p_pmt->i_pid_pcr = i_cand;
-            if ( GetPID( p_demux->p_sys, p_pmt->i_pid_pcr )->probed.i_pcr_count == 0 )
+            if ( atomic_load( &GetPID( p_demux->p_sys, p_pmt->i_pid_pcr )->probed.i_pcr_count ) == 0 )
                 p_pmt->pcr.b_disable = true;
             msg_Warn( p_demux, "No PCR received for program %d, set up workaround using pid %d",
                       p_pmt->i_number, i_cand );
-            UpdatePESFilters( p_demux, p_demux->p_sys->b_es_all );
+            RequestPESFiltersUpdate( p_demux );
         }
         p_pmt->pcr.b_fix_done = true;
     }
@@ -3242,7 +3987,8 @@ static bool GatherData( demux_t *p_demux, ts_pid_t *pid, block_t *p_bk )
             pid->u.p_pes->p_data->i_flags |= BLOCK_FLAG_CORRUPTED;
     }
 
-    if( p_demux->p_sys->csa )
+    /* Mostly descrambled with its chunk already, see DescrambleTSChunk() */
+    if( p_demux->p_sys->csa && (p[3]&0x80) )
     {
         vlc_mutex_lock( &p_demux->p_sys->csa_lock );
         csa_Decrypt( p_demux->p_sys->csa, p_bk->p_buffer, p_demux->p_sys->i_csa_pkt_size );
@@ -3745,6 +4491,225 @@ static void TDTCallBack( demux_t *p_demux, dvbpsi_tot_t *p_tdt )
 }
 
 
+/* Event fields coming from its descriptors, that is the strings to convert.
+ * They are kept from a table version to the next, for the unchanged
+ * events. */
+typedef struct
+{
+    uint16_t i_id;
+    bool     b_taken; /* moved to the new version of the table */
+    uint64_t i_hash;  /* of the descriptors */
+    char    *psz_name;
+    char    *psz_text;
+    char    *psz_extra;
+    int      i_min_age;
+} ts_eit_event_t;
+
+typedef struct
+{
+    uint32_t        i_key; /* service_id and table_id */
+    size_t          i_events;
+    ts_eit_event_t *p_events; /* by event_id */
+} ts_eit_table_t;
+
+static int EITTableCmp( const void *a, const void *b )
+{
+    const ts_eit_table_t *ta = a, *tb = b;
+    return ( ta->i_key > tb->i_key ) - ( ta->i_key < tb->i_key );
+}
+
+static int EITEventCmp( const void *a, const void *b )
+{
+    const ts_eit_event_t *ea = a, *eb = b;
+    return (int)ea->i_id - (int)eb->i_id;
+}
+
+static void EITEventsClean( ts_eit_event_t *p_events, size_t i_events )
+{
+    for( size_t i = 0; i < i_events; i++ )
+    {
+        free( p_events[i].psz_name );
+        free( p_events[i].psz_text );
+        free( p_events[i].psz_extra );
+    }
+    free( p_events );
+}
+
+static void EITTableDelete( void *p_node )
+{
+    ts_eit_table_t *p_table = p_node;
+    EITEventsClean( p_table->p_events, p_table->i_events );
+    free( p_table );
+}
+
+/* FNV-1a over the descriptors, and the charset they are converted from */
+static uint64_t EITEventHash( const dvbpsi_eit_event_t *p_evt, bool b_broken )
+{
+    uint64_t i_hash = UINT64_C(0xcbf29ce484222325) ^ b_broken;
+
+    for( const dvbpsi_descriptor_t *p_dr = p_evt->p_first_descriptor;
+         p_dr; p_dr = p_dr->p_next )
+    {
+        i_hash = ( i_hash ^ p_dr->i_tag ) * UINT64_C(0x100000001b3);
+        i_hash = ( i_hash ^ p_dr->i_length ) * UINT64_C(0x100000001b3);
+        for( unsigned i = 0; i < p_dr->i_length; i++ )
+            i_hash = ( i_hash ^ p_dr->p_data[i] ) * UINT64_C(0x100000001b3);
+    }
+    return i_hash;
+}
+
+static void EITDecodeEvent( demux_t *p_demux, dvbpsi_eit_event_t *p_evt,
+                            ts_eit_event_t *p_event )
+{
+    demux_sys_t         *p_sys = p_demux->p_sys;
+    dvbpsi_descriptor_t *p_dr;
+    char                *psz_name = NULL;
+    char                *psz_text = NULL;
+    char                *psz_extra = strdup("");
+    int                  i_min_age = 0;
+
+    for( p_dr = p_evt->p_first_descriptor; p_dr; p_dr = p_dr->p_next )
+    {
+        switch(p_dr->i_tag)
+        {
+        case 0x4d:
+        {
+            dvbpsi_short_event_dr_t *pE = dvbpsi_DecodeShortEventDr( p_dr );
+
+            /* Only take first description, as we don't handle language-info
+               for epg atm*/
+            if( pE && psz_name == NULL )
+            {
+                psz_name = EITConvertToUTF8( p_demux,
+                                             pE->i_event_name, pE->i_event_name_length,
+                                             p_sys->b_broken_charset );
+                free( psz_text );
+                psz_text = EITConvertToUTF8( p_demux,
+                                             pE->i_text, pE->i_text_length,
+                                             p_sys->b_broken_charset );
+                msg_Dbg( p_demux, "    - short event lang=%3.3s '%s' : '%s'",
+                         pE->i_iso_639_code, psz_name, psz_text );
+            }
+        }
+            break;
+
+        case 0x4e:
+        {
+            dvbpsi_extended_event_dr_t *pE = dvbpsi_DecodeExtendedEventDr( p_dr );
+            if( pE )
+            {
+                msg_Dbg( p_demux, "    - extended event lang=%3.3s [%d/%d]",
+                         pE->i_iso_639_code,
+                         pE->i_descriptor_number, pE->i_last_descriptor_number );
+
+                if( pE->i_text_length > 0 )
+                {
+                    char *psz_text = EITConvertToUTF8( p_demux,
+                                                       pE->i_text, pE->i_text_length,
+                                                       p_sys->b_broken_charset );
+                    if( psz_text )
+                    {
+                        msg_Dbg( p_demux, "       - text='%s'", psz_text );
+
+                        psz_extra = xrealloc( psz_extra,
+                               strlen(psz_extra) + strlen(psz_text) + 1 );
+                        strcat( psz_extra, psz_text );
+                        free( psz_text );
+                    }
+                }
+
+                for( int i = 0; i < pE->i_entry_count; i++ )
+                {
+                    char *psz_dsc = EITConvertToUTF8( p_demux,
+                                                      pE->i_item_description[i],
+                                                      pE->i_item_description_length[i],
+                                                      p_sys->b_broken_charset );
+                    char *psz_itm = EITConvertToUTF8( p_demux,
+                                                      pE->i_item[i], pE->i_item_length[i],
+                                                      p_sys->b_broken_charset );
+
+                    if( psz_dsc && psz_itm )
+                    {
+                        msg_Dbg( p_demux, "       - desc='%s' item='%s'", psz_dsc, psz_itm );
+#if 0
+                        psz_extra = xrealloc( psz_extra,
+                                     strlen(psz_extra) + strlen(psz_dsc) +
+                                     strlen(psz_itm) + 3 + 1 );
+                        strcat( psz_extra, "(" );
+                        strcat( psz_extra, psz_dsc );
+                        strcat( psz_extra, " " );
+                        strcat( psz_extra, psz_itm );
+                        strcat( psz_extra, ")" );
+#endif
+                    }
+                    free( psz_dsc );
+                    free( psz_itm );
+                }
+            }
+        }
+            break;
+
+        case 0x55:
+        {
+            dvbpsi_parental_rating_dr_t *pR = dvbpsi_DecodeParentalRatingDr( p_dr );
+            if ( pR )
+            {
+                for ( int i = 0; i < pR->i_ratings_number; i++ )
+                {
+                    const dvbpsi_parental_rating_t *p_rating = & pR->p_parental_rating[ i ];
+                    if ( p_rating->i_rating > 0x00 && p_rating->i_rating <= 0x0F )
+                    {
+                        if ( p_rating->i_rating + 3 > i_min_age )
+                            i_min_age = p_rating->i_rating + 3;
+                        msg_Dbg( p_demux, "    - parental control set to %d years",
+                                 i_min_age );
+                    }
+                }
+            }
+        }
+            break;
+
+        default:
+            msg_Dbg( p_demux, "    - event unknown dr 0x%x(%d)", p_dr->i_tag, p_dr->i_tag );
+            break;
+        }
+    }
+
+    p_event->psz_name = psz_name;
+    p_event->psz_text = psz_text;
+    p_event->psz_extra = psz_extra;
+    p_event->i_min_age = i_min_age;
+}
+
+/* Returns the events previously decoded for that table, if any */
+static ts_eit_table_t *EITGetTable( demux_t *p_demux, const dvbpsi_eit_t *p_eit )
+{
+    ts_pid_t *eit = GetPID( p_demux->p_sys, 0x12 );
+    if( eit->type != TYPE_EIT )
+        return NULL;
+
+    ts_eit_table_t key = { .i_key = ( p_eit->i_extension << 8 ) | p_eit->i_table_id };
+    ts_eit_table_t **pp_table = tsearch( &key, &eit->u.p_psi->p_eit_tables,
+                                         EITTableCmp );
+    if( !pp_table )
+        return NULL;
+
+    if( *pp_table == &key )
+    {
+        ts_eit_table_t *p_table = malloc( sizeof(*p_table) );
+        if( !p_table )
+        {
+            tdelete( &key, &eit->u.p_psi->p_eit_tables, EITTableCmp );
+            return NULL;
+        }
+        p_table->i_key = key.i_key;
+        p_table->i_events = 0;
+        p_table->p_events = NULL;
+        *pp_table = p_table;
+    }
+    return *pp_table;
+}
+
 static void EITCallBack( demux_t *p_demux,
                          dvbpsi_eit_t *p_eit, bool b_current_following )
 {
@@ -3767,16 +4732,25 @@ static void EITCallBack( demux_t *p_demux,
              p_eit->i_ts_id, p_eit->i_network_id,
              p_eit->i_segment_last_section_number, p_eit->i_last_table_id );
 
-    p_epg = vlc_epg_New( NULL );
+    /* Only the events new to that table are decoded, the others come from
+     * its previous version */
+    ts_eit_table_t *p_table = EITGetTable( p_demux, p_eit );
+    size_t i_events = 0, i_reused = 0;
     for( p_evt = p_eit->p_first_event; p_evt; p_evt = p_evt->p_next )
+        i_events++;
+    ts_eit_event_t *p_events = calloc( i_events ? i_events : 1, sizeof(*p_events) );
+    if( !p_events )
+    {
+        dvbpsi_eit_delete( p_eit );
+        return;
+    }
+
+    p_epg = vlc_epg_New( NULL );
+    ts_eit_event_t *p_event = p_events;
+    for( p_evt = p_eit->p_first_event; p_evt; p_evt = p_evt->p_next, p_event++ )
     {
-        dvbpsi_descriptor_t *p_dr;
-        char                *psz_name = NULL;
-        char                *psz_text = NULL;
-        char                *psz_extra = strdup("");
         int64_t i_start;
         int i_duration;
-        int i_min_age = 0;
         int64_t i_tot_time = 0;
 
         i_start = EITConvertStartTime( p_evt->i_start_time );
@@ -3807,127 +4781,52 @@ static void EITCallBack( demux_t *p_demux,
                  p_evt->i_event_id, (int)i_start, (int)i_duration,
                  p_evt->i_running_status, p_evt->b_free_ca );
 
-        for( p_dr = p_evt->p_first_descriptor; p_dr; p_dr = p_dr->p_next )
-        {
-            switch(p_dr->i_tag)
-            {
-            case 0x4d:
-            {
-                dvbpsi_short_event_dr_t *pE = dvbpsi_DecodeShortEventDr( p_dr );
-
-                /* Only take first description, as we don't handle language-info
-                   for epg atm*/
-                if( pE && psz_name == NULL )
-                {
-                    psz_name = EITConvertToUTF8( p_demux,
-                                                 pE->i_event_name, pE->i_event_name_length,
-                                                 p_sys->b_broken_charset );
-                    free( psz_text );
-                    psz_text = EITConvertToUTF8( p_demux,
-                                                 pE->i_text, pE->i_text_length,
-                                                 p_sys->b_broken_charset );
-                    msg_Dbg( p_demux, "    - short event lang=%3.3s '%s' : '%s'",
-                             pE->i_iso_639_code, psz_name, psz_text );
-                }
-            }
-                break;
-
-            case 0x4e:
-            {
-                dvbpsi_extended_event_dr_t *pE = dvbpsi_DecodeExtendedEventDr( p_dr );
-                if( pE )
-                {
-                    msg_Dbg( p_demux, "    - extended event lang=%3.3s [%d/%d]",
-                             pE->i_iso_639_code,
-                             pE->i_descriptor_number, pE->i_last_descriptor_number );
-
-                    if( pE->i_text_length > 0 )
-                    {
-                        char *psz_text = EITConvertToUTF8( p_demux,
-                                                           pE->i_text, pE->i_text_length,
-                                                           p_sys->b_broken_charset );
-                        if( psz_text )
-                        {
-                            msg_Dbg( p_demux, "       - text='%s'", psz_text );
-
-                            psz_extra = xrealloc( psz_extra,
-                                   strlen(psz_extra) + strlen(psz_text) + 1 );
-                            strcat( psz_extra, psz_text );
-                            free( psz_text );
-                        }
-                    }
+        p_event->i_id = p_evt->i_event_id;
+        p_event->i_hash = EITEventHash( p_evt, p_sys->b_broken_charset );
 
-                    for( int i = 0; i < pE->i_entry_count; i++ )
-                    {
-                        char *psz_dsc = EITConvertToUTF8( p_demux,
-                                                          pE->i_item_description[i],
-                                                          pE->i_item_description_length[i],
-                                                          p_sys->b_broken_charset );
-                        char *psz_itm = EITConvertToUTF8( p_demux,
-                                                          pE->i_item[i], pE->i_item_length[i],
-                                                          p_sys->b_broken_charset );
-
-                        if( psz_dsc && psz_itm )
-                        {
-                            msg_Dbg( p_demux, "       - desc='%s' item='%s'", psz_dsc, psz_itm );
-#if 0
-                            psz_extra = xrealloc( psz_extra,
-                                         strlen(psz_extra) + strlen(psz_dsc) +
-                                         strlen(psz_itm) + 3 + 1 );
-                            strcat( psz_extra, "(" );
-                            strcat( psz_extra, psz_dsc );
-                            strcat( psz_extra, " " );
-                            strcat( psz_extra, psz_itm );
-                            strcat( psz_extra, ")" );
-#endif
-                        }
-                        free( psz_dsc );
-                        free( psz_itm );
-                    }
-                }
-            }
-                break;
-
-            case 0x55:
-            {
-                dvbpsi_parental_rating_dr_t *pR = dvbpsi_DecodeParentalRatingDr( p_dr );
-                if ( pR )
-                {
-                    for ( int i = 0; i < pR->i_ratings_number; i++ )
-                    {
-                        const dvbpsi_parental_rating_t *p_rating = & pR->p_parental_rating[ i ];
-                        if ( p_rating->i_rating > 0x00 && p_rating->i_rating <= 0x0F )
-                        {
-                            if ( p_rating->i_rating + 3 > i_min_age )
-                                i_min_age = p_rating->i_rating + 3;
-                            msg_Dbg( p_demux, "    - parental control set to %d years",
-                                     i_min_age );
-                        }
-                    }
-                }
-            }
-                break;
-
-            default:
-                msg_Dbg( p_demux, "    - event unknown dr 0x%x(%d)", p_dr->i_tag, p_dr->i_tag );
-                break;
-            }
+        ts_eit_event_t *p_old = NULL;
+        if( p_table && p_table->i_events )
+            p_old = bsearch( p_event, p_table->p_events, p_table->i_events,
+                             sizeof(*p_event), EITEventCmp );
+        if( p_old && !p_old->b_taken && p_old->i_hash == p_event->i_hash )
+        {
+            p_event->psz_name = p_old->psz_name;
+            p_event->psz_text = p_old->psz_text;
+            p_event->psz_extra = p_old->psz_extra;
+            p_event->i_min_age = p_old->i_min_age;
+            p_old->psz_name = p_old->psz_text = p_old->psz_extra = NULL;
+            p_old->b_taken = true;
+            i_reused++;
         }
+        else
+            EITDecodeEvent( p_demux, p_evt, p_event );
+
+        const char *psz_name = p_event->psz_name;
+        const char *psz_text = p_event->psz_text;
+        const char *psz_extra = p_event->psz_extra;
 
         /* */
         if( i_start > 0 && psz_name && psz_text)
             vlc_epg_AddEvent( p_epg, i_start, i_duration, psz_name, psz_text,
-                              *psz_extra ? psz_extra : NULL, i_min_age );
+                              psz_extra && *psz_extra ? psz_extra : NULL,
+                              p_event->i_min_age );
 
         /* Update "now playing" field */
         if( p_evt->i_running_status == 0x04 && i_start > 0  && psz_name && psz_text )
             vlc_epg_SetCurrent( p_epg, i_start );
+    }
 
-        free( psz_name );
-        free( psz_text );
-
-        free( psz_extra );
+    if( p_table )
+    {
+        msg_Dbg( p_demux, "  %zu events, %zu unchanged", i_events, i_reused );
+        qsort( p_events, i_events, sizeof(*p_events), EITEventCmp );
+        EITEventsClean( p_table->p_events, p_table->i_events );
+        p_table->p_events = p_events;
+        p_table->i_events = i_events;
     }
+    else
+        EITEventsClean( p_events, i_events );
+
     if( p_epg->i_event > 0 )
     {
         if( b_current_following &&
@@ -3962,6 +4861,19 @@ static void EITCallBackSchedule( demux_t *p_demux, dvbpsi_eit_t *p_eit )
     EITCallBack( p_demux, p_eit, false );
 }
 
+static void PSICacheReject( demux_sys_t *p_sys, dvbpsi_t *h )
+{
+    static const uint16_t pi_pids[] = { 0x11, 0x12, 0x14 };
+
+    for( size_t i = 0; i < ARRAY_SIZE(pi_pids); i++ )
+    {
+        ts_pid_t *pid = GetPID( p_sys, pi_pids[i] );
+        if( ( pid->type == TYPE_SDT || pid->type == TYPE_EIT ||
+              pid->type == TYPE_TDT ) && pid->u.p_psi->handle == h )
+            ts_psi_cache_Reject( pid->u.p_psi->cache );
+    }
+}
+
 static void PSINewTableCallBack( dvbpsi_t *h, uint8_t i_table_id,
                                  uint16_t i_extension, demux_t *p_demux )
 {
@@ -4002,6 +4914,13 @@ static void PSINewTableCallBack( dvbpsi_t *h, uint8_t i_table_id,
         if( !dvbpsi_tot_attach( h, i_table_id, i_extension, (dvbpsi_tot_callback)TDTCallBack, p_demux ) )
             msg_Err( p_demux, "PSINewTableCallback: failed attaching TDTCallback" );
     }
+    else if( i_table_id == 0x42 || i_table_id == 0x4e ||
+             (i_table_id >= 0x50 && i_table_id <= 0x5f) ||
+             i_table_id == 0x70 || i_table_id == 0x73 )
+    {
+        /* Not handled yet, that section shall come through again */
+        PSICacheReject( p_sys, h );
+    }
 }
 
 /*****************************************************************************
@@ -5044,6 +5963,8 @@ static void PMTCallBack( void *data, dvbpsi_pmt_t *p_dvbpsipmt )
 
     msg_Dbg( p_demux, "PMTCallBack called" );
 
+    WorkersDrain( p_sys );
+
     if (unlikely(GetPID(p_sys, 0)->type != TYPE_PAT))
     {
         assert(GetPID(p_sys, 0)->type == TYPE_PAT);
@@ -5490,6 +6411,8 @@ static void PATCallBack( void *data, dvbpsi_pat_t *p_dvbpsipat )
     ts_pid_t             *patpid = GetPID(p_sys, 0);
     ts_pat_t             *p_pat = GetPID(p_sys, 0)->u.p_pat;
 
+    WorkersDrain( p_sys );
+
     patpid->i_flags |= FLAG_SEEN;
 
     msg_Dbg( p_demux, "PATCallBack called" );
@@ -5545,7 +6468,11 @@ static void PATCallBack( void *data, dvbpsi_pat_t *p_dvbpsipat )
         if( !b_existing || pmtpid->u.p_pmt->i_number != p_program->i_number )
         {
             if( b_existing && pmtpid->u.p_pmt->i_number != p_program->i_number )
+            {
                 dvbpsi_pmt_detach(pmtpid->u.p_pmt->handle);
+                /* the new decoder needs all the sections again */
+                ts_psi_cache_Reset( pmtpid->u.p_pmt->cache );
+            }
 
             if( !dvbpsi_pmt_attach( pmtpid->u.p_pmt->handle, p_program->i_number, PMTCallBack, p_demux ) )
                 msg_Err( p_demux, "PATCallback failed attaching PMTCallback to program %d",
@@ -5586,22 +6513,49 @@ static void PATCallBack( void *data, dvbpsi_pat_t *p_dvbpsipat )
     dvbpsi_pat_delete( p_dvbpsipat );
 }
 
-static inline bool handle_Init( demux_t *p_demux, dvbpsi_t **handle )
+static void handle_Push( void *handle, const uint8_t *p_packet )
+{
+    dvbpsi_packet_push( handle, (uint8_t *) p_packet );
+}
+
+static inline bool handle_Init( demux_t *p_demux, dvbpsi_t **handle,
+                                ts_psi_cache_t **cache )
 {
     *handle = dvbpsi_new( &dvbpsi_messages, DVBPSI_MSG_DEBUG );
     if( !*handle )
         return false;
     (*handle)->p_sys = (void *) p_demux;
+
+    /* Unchanged sections stop there, before being decoded again */
+    *cache = ts_psi_cache_New( handle_Push, *handle );
+    if( !*cache )
+    {
+        dvbpsi_delete( *handle );
+        return false;
+    }
     return true;
 }
 
+static void handle_Clean( demux_t *p_demux, dvbpsi_t *handle,
+                          ts_psi_cache_t *cache )
+{
+    uint64_t i_sections, i_skipped;
+
+    ts_psi_cache_GetStats( cache, &i_sections, &i_skipped );
+    if( i_sections )
+        msg_Dbg( p_demux, "%"PRIu64" sections received, %"PRIu64" unchanged "
+                 "ones skipped", i_sections, i_skipped );
+    dvbpsi_delete( handle );
+    ts_psi_cache_Delete( cache );
+}
+
 static ts_pat_t *ts_pat_New( demux_t *p_demux )
 {
     ts_pat_t *pat = malloc( sizeof( ts_pat_t ) );
     if( !pat )
         return NULL;
 
-    if( !handle_Init( p_demux, &pat->handle ) )
+    if( !handle_Init( p_demux, &pat->handle, &pat->cache ) )
     {
         free( pat );
         return NULL;
@@ -5618,7 +6572,7 @@ static void ts_pat_Del( demux_t *p_demux, ts_pat_t *pat )
 {
     if( dvbpsi_decoder_present( pat->handle ) )
         dvbpsi_pat_detach( pat->handle );
-    dvbpsi_delete( pat->handle );
+    handle_Clean( p_demux, pat->handle, pat->cache );
     for( int i=0; i<pat->programs.i_size; i++ )
         PIDRelease( p_demux, pat->programs.p_elems[i] );
     ARRAY_RESET( pat->programs );
@@ -5631,7 +6585,7 @@ static ts_pmt_t *ts_pmt_New( demux_t *p_demux )
     if( !pmt )
         return NULL;
 
-    if( !handle_Init( p_demux, &pmt->handle ) )
+    if( !handle_Init( p_demux, &pmt->handle, &pmt->cache ) )
     {
         free( pmt );
         return NULL;
@@ -5663,7 +6617,7 @@ static void ts_pmt_Del( demux_t *p_demux, ts_pmt_t *pmt )
 {
     if( dvbpsi_decoder_present( pmt->handle ) )
         dvbpsi_pmt_detach( pmt->handle );
-    dvbpsi_delete( pmt->handle );
+    handle_Clean( p_demux, pmt->handle, pmt->cache );
     for( int i=0; i<pmt->e_streams.i_size; i++ )
         PIDRelease( p_demux, pmt->e_streams.p_elems[i] );
     ARRAY_RESET( pmt->e_streams );
@@ -5740,22 +6694,23 @@ static ts_psi_t *ts_psi_New( demux_t *p_demux )
     if( !psi )
         return NULL;
 
-    if( !handle_Init( p_demux, &psi->handle ) )
+    if( !handle_Init( p_demux, &psi->handle, &psi->cache ) )
     {
         free( psi );
         return NULL;
     }
 
     psi->i_version  = -1;
+    psi->p_eit_tables = NULL;
 
     return psi;
 }
 
 static void ts_psi_Del( demux_t *p_demux, ts_psi_t *psi )
 {
-    VLC_UNUSED(p_demux);
     if( dvbpsi_decoder_present( psi->handle ) )
         dvbpsi_DetachDemux( psi->handle );
-    dvbpsi_delete( psi->handle );
+    handle_Clean( p_demux, psi->handle, psi->cache );
+    tdestroy( psi->p_eit_tables, EITTableDelete );
     free( psi );
 }
@@ -0,0 +1,359 @@
+/*****************************************************************************
+ * ts_monitor.c: MPEG Transport Stream monitoring (ETSI TR 101 290 subset)
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vlc_common.h>
+
+#include "ts_monitor.h"
+
+#define PCR_FREQ     INT64_C(27000000)
+#define PCR_WRAP     (INT64_C(300) << 33)
+/* The transport rate is measured over 5 to 10 seconds of PCRs */
+#define PCR_BASELINE (5 * PCR_FREQ)
+/* and PCR accuracy checked once it is measured over one second at least */
+#define PCR_BASELINE_MIN PCR_FREQ
+
+typedef struct
+{
+    int64_t  i_pcr;
+    uint64_t i_packet;
+} ts_monitor_mark_t;
+
+typedef struct
+{
+    ts_monitor_pid_t stats;
+    uint64_t i_period_packets; /* packet count at the start of the period */
+
+    uint8_t  i_cc;             /* 0xff if unknown */
+    uint8_t  i_dups;
+
+    bool     b_pcr;            /* a PCR was received */
+    ts_monitor_mark_t last;    /* last PCR */
+    ts_monitor_mark_t anchors[2]; /* transport rate baseline, oldest first */
+} ts_monitor_entry_t;
+
+struct ts_monitor_t
+{
+    unsigned i_packet_size;
+    uint64_t i_packets;        /* all PIDs */
+    uint64_t i_period_packets;
+    uint64_t i_bitrate;
+    ts_monitor_entry_t *pp_pids[8192];
+};
+
+static const unsigned accuracy_bounds[] = TS_MONITOR_ACCURACY_BOUNDS;
+
+ts_monitor_t *ts_monitor_New(unsigned i_packet_size)
+{
+    ts_monitor_t *p_mon = calloc(1, sizeof (*p_mon));
+    if (unlikely(p_mon == NULL))
+        return NULL;
+
+    p_mon->i_packet_size = i_packet_size;
+    return p_mon;
+}
+
+void ts_monitor_Delete(ts_monitor_t *p_mon)
+{
+    for (unsigned i = 0; i < ARRAY_SIZE(p_mon->pp_pids); i++)
+        free(p_mon->pp_pids[i]);
+    free(p_mon);
+}
+
+void ts_monitor_Reset(ts_monitor_t *p_mon)
+{
+    for (unsigned i = 0; i < ARRAY_SIZE(p_mon->pp_pids); i++)
+    {
+        ts_monitor_entry_t *p_entry = p_mon->pp_pids[i];
+        if (p_entry == NULL)
+            continue;
+        p_entry->i_cc = 0xff;
+        p_entry->b_pcr = false;
+    }
+}
+
+/* PCR difference, in 27 MHz ticks, across a wrap around if needed */
+static int64_t PCRDiff(int64_t i_to, int64_t i_from)
+{
+    int64_t i_diff = (i_to - i_from) % PCR_WRAP;
+
+    if (i_diff < 0)
+        i_diff += PCR_WRAP;
+    if (i_diff >= PCR_WRAP / 2)
+        i_diff -= PCR_WRAP;
+    return i_diff;
+}
+
+static void CheckCC(ts_monitor_entry_t *p_entry, const uint8_t *p,
+                    bool b_discontinuity)
+{
+    const uint8_t i_cc = p[3] & 0x0f;
+    const bool b_payload = p[3] & 0x10;
+
+    if (p_entry->i_cc == 0xff || b_discontinuity)
+    {
+        p_entry->i_cc = i_cc;
+        p_entry->i_dups = 0;
+        return;
+    }
+
+    const uint8_t i_diff = (i_cc - p_entry->i_cc) & 0x0f;
+    if (!b_payload)
+    {   /* the counter shall not increment without payload */
+        if (i_diff != 0)
+            p_entry->stats.i_cc_errors++;
+    }
+    else if (i_diff == 1)
+        p_entry->i_dups = 0;
+    else if (i_diff == 0)
+    {   /* a packet may be sent twice, but not more */
+        if (++p_entry->i_dups > 1)
+            p_entry->stats.i_cc_errors++;
+    }
+    else
+    {   /* lost or out of order */
+        p_entry->stats.i_cc_errors++;
+        p_entry->i_dups = 0;
+    }
+    p_entry->i_cc = i_cc;
+}
+
+static void CheckPCR(ts_monitor_t *p_mon, ts_monitor_entry_t *p_entry,
+                     int64_t i_pcr, bool b_discontinuity)
+{
+    ts_monitor_pid_t *p_stats = &p_entry->stats;
+    const ts_monitor_mark_t mark = { i_pcr, p_mon->i_packets };
+
+    p_stats->i_pcrs++;
+
+    if (p_entry->b_pcr && !b_discontinuity)
+    {
+        const ts_monitor_mark_t *p_last = &p_entry->last;
+        const int64_t i_interval = PCRDiff(i_pcr, p_last->i_pcr);
+
+        if (i_interval > 0)
+        {
+            unsigned i_bin = i_interval / (PCR_FREQ / 100);
+            if (i_bin >= TS_MONITOR_INTERVAL_BINS)
+                i_bin = TS_MONITOR_INTERVAL_BINS - 1;
+            p_stats->pi_pcr_interval[i_bin]++;
+            if ((uint64_t)i_interval > p_stats->i_pcr_interval_max)
+                p_stats->i_pcr_interval_max = i_interval;
+            if (i_interval > TS_MONITOR_PCR_REPETITION)
+                p_stats->i_pcr_repetition++;
+        }
+
+        if (i_interval <= 0 || i_interval > TS_MONITOR_PCR_GAP)
+        {   /* Not signaled: the timing state is lost anyway */
+            p_stats->i_pcr_discontinuity++;
+            b_discontinuity = true;
+        }
+        else
+        {
+            /* Expected PCR, from the position of the packet and the
+             * transport rate up to the last PCR */
+            const ts_monitor_mark_t *p_base = &p_entry->anchors[0];
+            const int64_t i_span = PCRDiff(p_last->i_pcr, p_base->i_pcr);
+            const uint64_t i_span_packets = p_last->i_packet - p_base->i_packet;
+
+            if (i_span >= PCR_BASELINE_MIN && i_span_packets > 0)
+            {
+                int64_t i_error = i_interval
+                    - (int64_t)(mark.i_packet - p_last->i_packet) * i_span
+                      / (int64_t)i_span_packets;
+                uint64_t i_ns = (uint64_t)llabs(i_error) * 1000 / 27;
+
+                unsigned i_bin = 0;
+                while (i_bin < ARRAY_SIZE(accuracy_bounds)
+                    && i_ns >= accuracy_bounds[i_bin])
+                    i_bin++;
+                p_stats->pi_pcr_accuracy[i_bin]++;
+                if (i_ns > p_stats->i_pcr_accuracy_max)
+                    p_stats->i_pcr_accuracy_max = __MIN(i_ns, UINT32_MAX);
+                if (i_ns > TS_MONITOR_PCR_ACCURACY)
+                    p_stats->i_pcr_accuracy++;
+
+                p_mon->i_bitrate = i_span_packets * p_mon->i_packet_size * 8
+                                 * PCR_FREQ / i_span;
+            }
+
+            if (PCRDiff(i_pcr, p_entry->anchors[1].i_pcr) >= PCR_BASELINE)
+            {
+                p_entry->anchors[0] = p_entry->anchors[1];
+                p_entry->anchors[1] = mark;
+            }
+        }
+    }
+    else
+        b_discontinuity = true;
+
+    if (b_discontinuity)
+        p_entry->anchors[0] = p_entry->anchors[1] = mark;
+    p_entry->last = mark;
+    p_entry->b_pcr = true;
+}
+
+void ts_monitor_Packet(ts_monitor_t *p_mon, const uint8_t *p)
+{
+    const uint16_t i_pid = ((p[1] & 0x1f) << 8) | p[2];
+    ts_monitor_entry_t *p_entry = p_mon->pp_pids[i_pid];
+
+    if (unlikely(p_entry == NULL))
+    {
+        p_entry = calloc(1, sizeof (*p_entry));
+        if (unlikely(p_entry == NULL))
+            return;
+        p_entry->i_cc = 0xff;
+        p_mon->pp_pids[i_pid] = p_entry;
+    }
+
+    p_mon->i_packets++;
+    p_entry->stats.i_packets++;
+
+    if (p[1] & 0x80)
+    {   /* nothing else in the packet can be trusted */
+        p_entry->stats.i_tei++;
+        return;
+    }
+    if (p[3] & 0xc0)
+        p_entry->stats.i_scrambled++;
+    if (i_pid == 0x1fff || !(p[3] & 0x30))
+        return; /* null packet, or reserved adaptation field control */
+
+    bool b_discontinuity = false;
+    int64_t i_pcr = -1;
+
+    if ((p[3] & 0x20) && p[4] > 0)
+    {
+        b_discontinuity = p[5] & 0x80;
+        if ((p[5] & 0x10) && p[4] >= 7)
+            i_pcr = (((int64_t)p[6] << 25) | (p[7] << 17) | (p[8] << 9)
+                  | (p[9] << 1) | (p[10] >> 7)) * 300
+                  + (((p[10] & 0x01) << 8) | p[11]);
+    }
+
+    CheckCC(p_entry, p, b_discontinuity);
+    if (i_pcr >= 0)
+        CheckPCR(p_mon, p_entry, i_pcr, b_discontinuity);
+}
+
+void ts_monitor_Period(ts_monitor_t *p_mon)
+{
+    const uint64_t i_packets = p_mon->i_packets - p_mon->i_period_packets;
+
+    for (unsigned i = 0; i < ARRAY_SIZE(p_mon->pp_pids); i++)
+    {
+        ts_monitor_entry_t *p_entry = p_mon->pp_pids[i];
+        if (p_entry == NULL)
+            continue;
+
+        uint64_t i_count = p_entry->stats.i_packets - p_entry->i_period_packets;
+        p_entry->stats.i_bitrate = i_packets ? i_count * p_mon->i_bitrate
+                                               / i_packets : 0;
+        p_entry->i_period_packets = p_entry->stats.i_packets;
+    }
+    p_mon->i_period_packets = p_mon->i_packets;
+}
+
+const ts_monitor_pid_t *ts_monitor_GetPID(const ts_monitor_t *p_mon,
+                                          uint16_t i_pid)
+{
+    const ts_monitor_entry_t *p_entry = p_mon->pp_pids[i_pid & 0x1fff];
+    return p_entry ? &p_entry->stats : NULL;
+}
+
+uint64_t ts_monitor_GetBitrate(const ts_monitor_t *p_mon)
+{
+    return p_mon->i_bitrate;
+}
+
+static int Histogram(char *psz, size_t i_size, const unsigned *pi_bins,
+                     unsigned i_bins)
+{
+    int i_len = 0;
+
+    for (unsigned i = 0; i < i_bins; i++)
+        i_len += snprintf(psz + i_len, i_size - i_len, "%s%u",
+                          i ? "/" : "", pi_bins[i]);
+    return i_len;
+}
+
+char *ts_monitor_Report(const ts_monitor_t *p_mon)
+{
+    size_t i_size = 1, i_len = 0;
+    char *psz = NULL;
+
+    for (unsigned i = 0; i < ARRAY_SIZE(p_mon->pp_pids); i++)
+    {
+        const ts_monitor_entry_t *p_entry = p_mon->pp_pids[i];
+        if (p_entry == NULL)
+            continue;
+
+        const ts_monitor_pid_t *p_stats = &p_entry->stats;
+        char line[1024];
+        int n = snprintf(line, sizeof (line), "pid %4u: %"PRIu64" kb/s, "
+                         "%"PRIu64" packets, %"PRIu64" cc errors, "
+                         "%"PRIu64" transport errors", i,
+                         p_stats->i_bitrate / 1000, p_stats->i_packets,
+                         p_stats->i_cc_errors, p_stats->i_tei);
+        if (p_stats->i_pcrs > 0)
+        {
+            n += snprintf(line + n, sizeof (line) - n, ", %"PRIu64" pcr "
+                          "(max interval %"PRIu64" us, %"PRIu64" repetition"
+                          " and %"PRIu64" discontinuity errors, intervals ",
+                          p_stats->i_pcrs, p_stats->i_pcr_interval_max / 27,
+                          p_stats->i_pcr_repetition,
+                          p_stats->i_pcr_discontinuity);
+            n += Histogram(line + n, sizeof (line) - n,
+                           p_stats->pi_pcr_interval, TS_MONITOR_INTERVAL_BINS);
+            n += snprintf(line + n, sizeof (line) - n, "; max inaccuracy "
+                          "%"PRIu32" ns, %"PRIu64" errors, inaccuracies ",
+                          p_stats->i_pcr_accuracy_max,
+                          p_stats->i_pcr_accuracy);
+            n += Histogram(line + n, sizeof (line) - n,
+                           p_stats->pi_pcr_accuracy, TS_MONITOR_ACCURACY_BINS);
+            n += snprintf(line + n, sizeof (line) - n, ")");
+        }
+
+        char *psz_new = realloc(psz, i_size + n + 1);
+        if (unlikely(psz_new == NULL))
+        {
+            free(psz);
+            return NULL;
+        }
+        psz = psz_new;
+        memcpy(psz + i_len, line, n);
+        psz[i_len + n] = '\n';
+        i_len += n + 1;
+        i_size += n + 1;
+    }
+
+    if (psz == NULL)
+        return strdup("");
+    psz[i_len] = '\0';
+    return psz;
+}
@@ -0,0 +1,103 @@
+/*****************************************************************************
+ * ts_monitor.h: MPEG Transport Stream monitoring (ETSI TR 101 290 subset)
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef VLC_TS_MONITOR_H
+#define VLC_TS_MONITOR_H 1
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/* TR 101 290 limits, in 27 MHz ticks for the PCR ones */
+#define TS_MONITOR_PCR_REPETITION (27000000 / 25)  /* 40 ms */
+#define TS_MONITOR_PCR_GAP        (27000000 / 10)  /* 100 ms */
+#define TS_MONITOR_PCR_ACCURACY   500              /* ns */
+
+/* PCR interval histogram: 10 ms wide bins, the last one is 100 ms and up */
+#define TS_MONITOR_INTERVAL_BINS 11
+/* PCR accuracy histogram: upper bounds of the bins, in ns, and overflow */
+#define TS_MONITOR_ACCURACY_BOUNDS { 50, 100, 200, 500, 1000, 10000 }
+#define TS_MONITOR_ACCURACY_BINS 7
+
+typedef struct
+{
+    uint64_t i_packets;
+    uint64_t i_cc_errors;     /* Continuity_count_error (1.4) */
+    uint64_t i_tei;           /* Transport_error (2.1) */
+    uint64_t i_scrambled;     /* packets with scrambling control set */
+
+    uint64_t i_pcrs;
+    uint64_t i_pcr_repetition;    /* PCR_repetition_error (2.3a) */
+    uint64_t i_pcr_discontinuity; /* PCR_discontinuity_indicator_error (2.3b) */
+    uint64_t i_pcr_accuracy;      /* PCR_accuracy_error (2.4) */
+    uint64_t i_pcr_interval_max;  /* 27 MHz ticks */
+    uint32_t i_pcr_accuracy_max;  /* ns */
+    unsigned pi_pcr_interval[TS_MONITOR_INTERVAL_BINS];
+    unsigned pi_pcr_accuracy[TS_MONITOR_ACCURACY_BINS];
+
+    uint64_t i_bitrate;       /* bits per second over the last period */
+} ts_monitor_pid_t;
+
+typedef struct ts_monitor_t ts_monitor_t;
+
+/**
+ * Creates a monitor.
+ * \param i_packet_size transport packet size (188, 192 or 204), that byte
+ * counts and bitrates are based on
+ */
+ts_monitor_t *ts_monitor_New(unsigned i_packet_size);
+void ts_monitor_Delete(ts_monitor_t *);
+
+/**
+ * Accounts for one transport packet.
+ * \param p the 188 bytes of the packet, from its sync byte
+ */
+void ts_monitor_Packet(ts_monitor_t *, const uint8_t *p);
+
+/**
+ * Forgets the continuity and timing state, after a seek for instance.
+ * Counters are kept.
+ */
+void ts_monitor_Reset(ts_monitor_t *);
+
+/**
+ * Ends the current period: updates the bitrates from the packets received
+ * since the previous call.
+ */
+void ts_monitor_Period(ts_monitor_t *);
+
+/**
+ * Returns the statistics of a PID, or NULL if it was never seen.
+ */
+const ts_monitor_pid_t *ts_monitor_GetPID(const ts_monitor_t *, uint16_t i_pid);
+
+/**
+ * Returns the transport stream bitrate, as estimated from the PCRs, or 0 if
+ * unknown yet.
+ */
+uint64_t ts_monitor_GetBitrate(const ts_monitor_t *);
+
+/**
+ * Formats the statistics of all seen PIDs, one line each, into a heap
+ * allocated string.
+ */
+char *ts_monitor_Report(const ts_monitor_t *);
+
+#endif
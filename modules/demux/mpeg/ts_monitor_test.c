@@ -0,0 +1,314 @@
+/*****************************************************************************
+ * ts_monitor_test.c: MPEG-TS monitoring test and benchmark
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#undef NDEBUG
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vlc_common.h>
+
+#include "ts_monitor.h"
+
+#define BITRATE  4000000
+#define PCR_PID  0x100
+#define DATA_PID 0x101
+
+/* Constant bitrate multiplex of a PCR PID and a data PID */
+struct mux
+{
+    ts_monitor_t *mon;
+    uint64_t packet;      /* index of the next packet */
+    int64_t  pcr_offset;  /* 27 MHz ticks */
+    unsigned pcr_period;  /* packets */
+    uint8_t  cc[2];
+};
+
+static void Build(uint8_t *p, uint16_t pid, uint8_t cc, int64_t pcr,
+                  bool discontinuity)
+{
+    memset(p, 0xff, 188);
+    p[0] = 0x47;
+    p[1] = pid >> 8;
+    p[2] = pid;
+    p[3] = 0x10 | cc;
+    if (pcr >= 0 || discontinuity)
+    {
+        int64_t base = pcr / 300, ext = pcr % 300;
+
+        p[3] |= 0x20;
+        p[4] = 7;
+        p[5] = (discontinuity ? 0x80 : 0) | (pcr >= 0 ? 0x10 : 0);
+        p[6] = base >> 25;
+        p[7] = base >> 17;
+        p[8] = base >> 9;
+        p[9] = base >> 1;
+        p[10] = (base << 7) | 0x7e | (ext >> 8);
+        p[11] = ext;
+    }
+}
+
+static int64_t MuxPCR(const struct mux *mux)
+{
+    int64_t pcr = mux->packet * 188 * 8 * INT64_C(27000000) / BITRATE
+                + mux->pcr_offset;
+    return pcr % (INT64_C(300) << 33);
+}
+
+/* Sends the next packet, with the given PCR error in 27 MHz ticks */
+static void Send(struct mux *mux, int64_t jitter)
+{
+    uint8_t p[188];
+
+    if ((mux->packet % mux->pcr_period) == 0)
+        Build(p, PCR_PID, mux->cc[0]++ & 0xf, MuxPCR(mux) + jitter, false);
+    else
+        Build(p, DATA_PID, mux->cc[1]++ & 0xf, -1, false);
+    ts_monitor_Packet(mux->mon, p);
+    mux->packet++;
+}
+
+static void Run(struct mux *mux, unsigned count)
+{
+    for (unsigned i = 0; i < count; i++)
+        Send(mux, 0);
+}
+
+/* Sends data packets only, the PCRs due meanwhile are missing */
+static void Gap(struct mux *mux, unsigned count)
+{
+    uint8_t p[188];
+
+    for (unsigned i = 0; i < count; i++)
+    {
+        Build(p, DATA_PID, mux->cc[1]++ & 0xf, -1, false);
+        ts_monitor_Packet(mux->mon, p);
+        mux->packet++;
+    }
+}
+
+/* Runs up to the next PCR */
+static void Align(struct mux *mux)
+{
+    while ((mux->packet % mux->pcr_period) != 0)
+        Send(mux, 0);
+}
+
+static void MuxInit(struct mux *mux, int64_t pcr_offset)
+{
+    mux->mon = ts_monitor_New(188);
+    assert(mux->mon != NULL);
+    mux->packet = 0;
+    mux->pcr_offset = pcr_offset;
+    mux->pcr_period = 80; /* 30 ms at 4 Mb/s */
+    mux->cc[0] = mux->cc[1] = 0;
+}
+
+static unsigned Sum(const unsigned *bins, unsigned count)
+{
+    unsigned sum = 0;
+    for (unsigned i = 0; i < count; i++)
+        sum += bins[i];
+    return sum;
+}
+
+static void test_clean(int64_t pcr_offset)
+{
+    struct mux mux;
+    MuxInit(&mux, pcr_offset);
+    Run(&mux, 20 * BITRATE / (188 * 8)); /* 20 seconds */
+    ts_monitor_Period(mux.mon);
+
+    const ts_monitor_pid_t *pcr = ts_monitor_GetPID(mux.mon, PCR_PID);
+    const ts_monitor_pid_t *data = ts_monitor_GetPID(mux.mon, DATA_PID);
+    assert(pcr != NULL && data != NULL);
+    assert(ts_monitor_GetPID(mux.mon, 0) == NULL);
+
+    assert(pcr->i_cc_errors == 0 && data->i_cc_errors == 0);
+    assert(pcr->i_pcr_repetition == 0 && pcr->i_pcr_discontinuity == 0);
+    assert(pcr->i_pcr_accuracy == 0 && pcr->i_pcr_accuracy_max < 100);
+    assert(pcr->pi_pcr_interval[3] == pcr->i_pcrs - 1);
+    /* accuracy is checked once the rate is known over one second */
+    assert(Sum(pcr->pi_pcr_accuracy, TS_MONITOR_ACCURACY_BINS)
+           >= pcr->i_pcrs - 40);
+    assert(data->i_pcrs == 0);
+
+    uint64_t bitrate = ts_monitor_GetBitrate(mux.mon);
+    assert(bitrate > BITRATE - 1000 && bitrate < BITRATE + 1000);
+    assert(pcr->i_bitrate + data->i_bitrate > BITRATE - 1000);
+    assert(data->i_bitrate > pcr->i_bitrate * 70);
+
+    char *report = ts_monitor_Report(mux.mon);
+    assert(report != NULL && strstr(report, "pid  256: ") != NULL);
+    free(report);
+    ts_monitor_Delete(mux.mon);
+}
+
+static void test_continuity(void)
+{
+    struct mux mux;
+    uint8_t p[188];
+
+    MuxInit(&mux, 0);
+    mux.pcr_period = 1000000; /* only the first packet carries a PCR */
+    Run(&mux, 100);
+
+    /* lost packet */
+    mux.cc[1]++;
+    Run(&mux, 100);
+    assert(ts_monitor_GetPID(mux.mon, DATA_PID)->i_cc_errors == 1);
+
+    /* duplicated packet */
+    Build(p, DATA_PID, (mux.cc[1] - 1) & 0xf, -1, false);
+    ts_monitor_Packet(mux.mon, p);
+    Run(&mux, 10);
+    assert(ts_monitor_GetPID(mux.mon, DATA_PID)->i_cc_errors == 1);
+
+    /* former packet, out of order, and again when the sequence resumes */
+    ts_monitor_Packet(mux.mon, p);
+    assert(ts_monitor_GetPID(mux.mon, DATA_PID)->i_cc_errors == 2);
+    Run(&mux, 10);
+    assert(ts_monitor_GetPID(mux.mon, DATA_PID)->i_cc_errors == 3);
+
+    /* packet sent a third time */
+    Build(p, DATA_PID, (mux.cc[1] - 1) & 0xf, -1, false);
+    ts_monitor_Packet(mux.mon, p);
+    ts_monitor_Packet(mux.mon, p);
+    assert(ts_monitor_GetPID(mux.mon, DATA_PID)->i_cc_errors == 4);
+
+    /* signaled discontinuity */
+    mux.cc[1] += 5;
+    Build(p, DATA_PID, mux.cc[1]++ & 0xf, -1, true);
+    ts_monitor_Packet(mux.mon, p);
+    Run(&mux, 10);
+    assert(ts_monitor_GetPID(mux.mon, DATA_PID)->i_cc_errors == 4);
+
+    /* the counter does not increment without payload */
+    Build(p, DATA_PID, (mux.cc[1] - 1) & 0xf, -1, false);
+    p[3] = (p[3] & ~0x10) | 0x20;
+    p[4] = 0;
+    ts_monitor_Packet(mux.mon, p);
+    Run(&mux, 10);
+    assert(ts_monitor_GetPID(mux.mon, DATA_PID)->i_cc_errors == 4);
+
+    /* transport errors are counted, and not checked any further */
+    Build(p, DATA_PID, 0, -1, false);
+    p[1] |= 0x80;
+    ts_monitor_Packet(mux.mon, p);
+    Run(&mux, 10);
+    const ts_monitor_pid_t *data = ts_monitor_GetPID(mux.mon, DATA_PID);
+    assert(data->i_cc_errors == 4 && data->i_tei == 1);
+
+    /* null packets are not checked */
+    for (unsigned i = 0; i < 10; i++)
+    {
+        Build(p, 0x1fff, 0, -1, false);
+        ts_monitor_Packet(mux.mon, p);
+    }
+    assert(ts_monitor_GetPID(mux.mon, 0x1fff)->i_cc_errors == 0);
+    assert(ts_monitor_GetPID(mux.mon, 0x1fff)->i_packets == 10);
+
+    /* state lost after a seek */
+    ts_monitor_Reset(mux.mon);
+    mux.cc[1] += 3;
+    Run(&mux, 10);
+    assert(ts_monitor_GetPID(mux.mon, DATA_PID)->i_cc_errors == 4);
+    ts_monitor_Delete(mux.mon);
+}
+
+static void test_timing(void)
+{
+    struct mux mux;
+
+    MuxInit(&mux, 0);
+    Run(&mux, 2 * BITRATE / (188 * 8));
+    const ts_monitor_pid_t *pcr = ts_monitor_GetPID(mux.mon, PCR_PID);
+    assert(pcr->i_pcr_accuracy == 0);
+
+    /* a 740 ns jitter breaks the 500 ns limit, both ways */
+    Align(&mux);
+    Send(&mux, 20);
+    Run(&mux, 10 * mux.pcr_period);
+    assert(pcr->i_pcr_accuracy == 2);
+    assert(pcr->pi_pcr_accuracy[4] == 2); /* [500;1000[ ns */
+    assert(pcr->i_pcr_accuracy_max >= 700 && pcr->i_pcr_accuracy_max < 800);
+
+    /* 60 ms without PCR */
+    Align(&mux);
+    Gap(&mux, mux.pcr_period);
+    Run(&mux, 10 * mux.pcr_period);
+    assert(pcr->i_pcr_repetition == 1 && pcr->i_pcr_discontinuity == 0);
+    assert(pcr->pi_pcr_interval[6] == 1);
+
+    /* 150 ms without PCR */
+    Align(&mux);
+    Gap(&mux, 4 * mux.pcr_period);
+    Run(&mux, 10 * mux.pcr_period);
+    assert(pcr->i_pcr_repetition == 2 && pcr->i_pcr_discontinuity == 1);
+    assert(pcr->pi_pcr_interval[TS_MONITOR_INTERVAL_BINS - 1] == 1);
+    assert(pcr->i_pcr_interval_max >= 27000 * 150);
+
+    /* backwards PCR */
+    mux.pcr_offset -= 27000000;
+    Run(&mux, 10 * mux.pcr_period);
+    assert(pcr->i_pcr_discontinuity == 2);
+    assert(pcr->i_pcr_accuracy == 2 && pcr->i_cc_errors == 0);
+    ts_monitor_Delete(mux.mon);
+}
+
+static void bench(unsigned count)
+{
+    struct mux mux;
+
+    MuxInit(&mux, 0);
+    mtime_t start = mdate();
+    Run(&mux, count);
+    mtime_t spent = mdate() - start;
+
+    ts_monitor_Period(mux.mon);
+    char *report = ts_monitor_Report(mux.mon);
+    assert(report != NULL);
+    fputs(report, stdout);
+    free(report);
+
+    /* packet generation included */
+    printf("%.1f Mpackets/s, %.0f Mb/s of 188 bytes packets\n",
+           (double)count / (spent ? spent : 1),
+           (double)count * 188 * 8 / (spent ? spent : 1));
+    ts_monitor_Delete(mux.mon);
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned count = (argc > 1) ? strtoul(argv[1], NULL, 0) : 2000000;
+
+    test_clean(0);
+    /* across the PCR wrap around */
+    test_clean((INT64_C(300) << 33) - 10 * INT64_C(27000000));
+    test_continuity();
+    test_timing();
+    bench(count);
+    return 0;
+}
@@ -0,0 +1,380 @@
+/*****************************************************************************
+ * ts_psi_cache.c: MPEG Transport Stream PSI/SI sections cache
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <vlc_common.h>
+
+#include "ts_psi_cache.h"
+
+#define SECTION_MAX_SIZE 4096
+/* table_id, extension, version, number and CRC, that is a minimal long
+ * form section */
+#define SECTION_LONG_MIN 12
+#define CACHE_MIN_BITS   6
+/* EIT schedules of a whole multiplex fit in, otherwise start over */
+#define CACHE_MAX_BITS   18
+
+enum
+{
+    ENTRY_FREE = 0,
+    ENTRY_VALID,
+    ENTRY_STALE, /* still occupies its slot, for the lookups */
+};
+
+typedef struct
+{
+    uint32_t i_key;     /* table_id, extension, section_number */
+    uint32_t i_crc;     /* CRC field, as found in the section */
+    uint8_t  i_version; /* version and current_next byte */
+    uint8_t  i_state;
+} ts_psi_cache_entry_t;
+
+struct ts_psi_cache_t
+{
+    ts_psi_cache_cb pf_push;
+    void           *opaque;
+
+    /* reassembly */
+    uint8_t  i_cc;        /* 0xff if unknown */
+    bool     b_gathering;
+    size_t   i_gathered;
+    uint8_t  p_section[SECTION_MAX_SIZE];
+
+    /* forwarding */
+    uint8_t  i_out_cc;
+    bool     b_rejected;
+
+    /* seen sections, open addressing */
+    ts_psi_cache_entry_t *p_entries;
+    unsigned i_bits;
+    unsigned i_used;      /* valid and stale slots */
+
+    uint64_t i_sections;
+    uint64_t i_skipped;
+
+    uint32_t crc32_table[256];
+};
+
+ts_psi_cache_t *ts_psi_cache_New(ts_psi_cache_cb pf_push, void *opaque)
+{
+    ts_psi_cache_t *p_cache = malloc(sizeof (*p_cache));
+    if (unlikely(p_cache == NULL))
+        return NULL;
+
+    p_cache->p_entries = calloc(1u << CACHE_MIN_BITS,
+                                sizeof (*p_cache->p_entries));
+    if (unlikely(p_cache->p_entries == NULL))
+    {
+        free(p_cache);
+        return NULL;
+    }
+
+    p_cache->pf_push = pf_push;
+    p_cache->opaque = opaque;
+    p_cache->i_cc = 0xff;
+    p_cache->b_gathering = false;
+    p_cache->i_gathered = 0;
+    p_cache->i_out_cc = 0;
+    p_cache->b_rejected = false;
+    p_cache->i_bits = CACHE_MIN_BITS;
+    p_cache->i_used = 0;
+    p_cache->i_sections = 0;
+    p_cache->i_skipped = 0;
+
+    for (uint32_t i = 0; i < 256; i++)
+    {
+        uint32_t k = i << 24;
+        for (unsigned j = 0; j < 8; j++)
+            k = (k << 1) ^ ((k & 0x80000000) ? 0x04c11db7 : 0);
+        p_cache->crc32_table[i] = k;
+    }
+    return p_cache;
+}
+
+void ts_psi_cache_Delete(ts_psi_cache_t *p_cache)
+{
+    free(p_cache->p_entries);
+    free(p_cache);
+}
+
+void ts_psi_cache_Reset(ts_psi_cache_t *p_cache)
+{
+    memset(p_cache->p_entries, 0,
+           sizeof (*p_cache->p_entries) << p_cache->i_bits);
+    p_cache->i_used = 0;
+}
+
+void ts_psi_cache_Reject(ts_psi_cache_t *p_cache)
+{
+    p_cache->b_rejected = true;
+}
+
+void ts_psi_cache_GetStats(const ts_psi_cache_t *p_cache,
+                           uint64_t *pi_sections, uint64_t *pi_skipped)
+{
+    *pi_sections = p_cache->i_sections;
+    *pi_skipped = p_cache->i_skipped;
+}
+
+static ts_psi_cache_entry_t *Lookup(ts_psi_cache_entry_t *p_entries,
+                                    unsigned i_bits, uint32_t i_key)
+{
+    const unsigned i_mask = (1u << i_bits) - 1;
+    unsigned i = (i_key * UINT32_C(0x9E3779B1)) >> (32 - i_bits);
+
+    while (p_entries[i].i_state != ENTRY_FREE && p_entries[i].i_key != i_key)
+        i = (i + 1) & i_mask;
+    return &p_entries[i];
+}
+
+/* Keeps the table at most half full, by growing it or starting over */
+static void Grow(ts_psi_cache_t *p_cache)
+{
+    if (2 * (p_cache->i_used + 1) <= (1u << p_cache->i_bits))
+        return;
+
+    ts_psi_cache_entry_t *p_entries = NULL;
+    if (p_cache->i_bits < CACHE_MAX_BITS)
+        p_entries = calloc(2u << p_cache->i_bits, sizeof (*p_entries));
+    if (p_entries == NULL)
+    {
+        ts_psi_cache_Reset(p_cache);
+        return;
+    }
+
+    unsigned i_used = 0;
+    for (unsigned i = 0; i < (1u << p_cache->i_bits); i++)
+    {
+        const ts_psi_cache_entry_t *p_old = &p_cache->p_entries[i];
+        if (p_old->i_state != ENTRY_VALID)
+            continue; /* stale entries are dropped on the way */
+        *Lookup(p_entries, p_cache->i_bits + 1, p_old->i_key) = *p_old;
+        i_used++;
+    }
+    free(p_cache->p_entries);
+    p_cache->p_entries = p_entries;
+    p_cache->i_bits++;
+    p_cache->i_used = i_used;
+}
+
+/* MPEG-2 CRC32 of a whole section, CRC field included, is 0 if intact */
+static bool CheckCRC(const ts_psi_cache_t *p_cache,
+                     const uint8_t *p_section, size_t i_size)
+{
+    uint32_t i_crc = 0xffffffff;
+
+    for (size_t i = 0; i < i_size; i++)
+        i_crc = (i_crc << 8)
+              ^ p_cache->crc32_table[(i_crc >> 24) ^ p_section[i]];
+    return i_crc == 0;
+}
+
+/* Packetizes a section again, for the decoder */
+static void Forward(ts_psi_cache_t *p_cache, uint16_t i_pid,
+                    const uint8_t *p_section, size_t i_size)
+{
+    uint8_t p[188];
+    bool b_first = true;
+
+    while (i_size > 0)
+    {
+        size_t i_payload = 184;
+        uint8_t *p_payload = p + 4;
+
+        p[0] = 0x47;
+        p[1] = (b_first ? 0x40 : 0x00) | (i_pid >> 8);
+        p[2] = i_pid;
+        p[3] = 0x10 | (p_cache->i_out_cc++ & 0x0f);
+        if (b_first)
+        {
+            *(p_payload++) = 0; /* pointer_field */
+            i_payload--;
+            b_first = false;
+        }
+
+        size_t i_copy = __MIN(i_size, i_payload);
+        memcpy(p_payload, p_section, i_copy);
+        memset(p_payload + i_copy, 0xff, i_payload - i_copy);
+        p_section += i_copy;
+        i_size -= i_copy;
+
+        p_cache->pf_push(p_cache->opaque, p);
+    }
+}
+
+static void Section(ts_psi_cache_t *p_cache, uint16_t i_pid,
+                    const uint8_t *p_section, size_t i_size)
+{
+    p_cache->i_sections++;
+
+    /* Short form sections have no version, nor always a CRC */
+    if (!(p_section[1] & 0x80) || i_size < SECTION_LONG_MIN)
+    {
+        Forward(p_cache, i_pid, p_section, i_size);
+        return;
+    }
+
+    const uint32_t i_key = ((uint32_t)p_section[0] << 24)
+                         | (p_section[3] << 16) | (p_section[4] << 8)
+                         | p_section[6];
+    const uint32_t i_crc = GetDWBE(&p_section[i_size - 4]);
+    const uint8_t i_version = p_section[5];
+
+    ts_psi_cache_entry_t *p_entry = Lookup(p_cache->p_entries,
+                                           p_cache->i_bits, i_key);
+    if (p_entry->i_state == ENTRY_VALID && p_entry->i_crc == i_crc
+     && p_entry->i_version == i_version)
+    {
+        p_cache->i_skipped++;
+        return;
+    }
+
+    /* A corrupted copy is left to the decoder, which drops it, but is not
+     * recorded: that would skip the good copies carrying the same CRC */
+    const bool b_intact = CheckCRC(p_cache, p_section, i_size);
+
+    p_cache->b_rejected = false;
+    Forward(p_cache, i_pid, p_section, i_size);
+    if (!b_intact)
+        return;
+    if (p_cache->b_rejected)
+    {   /* the decoder wants it again */
+        p_entry = Lookup(p_cache->p_entries, p_cache->i_bits, i_key);
+        if (p_entry->i_state == ENTRY_VALID)
+            p_entry->i_state = ENTRY_STALE;
+        return;
+    }
+
+    /* The callbacks may have reset the cache meanwhile */
+    Grow(p_cache);
+    p_entry = Lookup(p_cache->p_entries, p_cache->i_bits, i_key);
+    if (p_entry->i_state == ENTRY_FREE)
+        p_cache->i_used++;
+    p_entry->i_key = i_key;
+    p_entry->i_crc = i_crc;
+    p_entry->i_version = i_version;
+    p_entry->i_state = ENTRY_VALID;
+}
+
+/* Gathers section bytes, returns the number used */
+static size_t Gather(ts_psi_cache_t *p_cache, uint16_t i_pid,
+                     const uint8_t *p, size_t i_size)
+{
+    size_t i_used = 0;
+
+    /* section header first, for its length */
+    while (p_cache->i_gathered < 3 && i_used < i_size)
+        p_cache->p_section[p_cache->i_gathered++] = p[i_used++];
+    if (p_cache->i_gathered < 3)
+        return i_used;
+
+    const size_t i_length = 3 + (((p_cache->p_section[1] & 0x0f) << 8)
+                                 | p_cache->p_section[2]);
+    if (i_length > SECTION_MAX_SIZE)
+    {
+        p_cache->b_gathering = false;
+        return i_size;
+    }
+
+    size_t i_copy = __MIN(i_length - p_cache->i_gathered, i_size - i_used);
+    memcpy(&p_cache->p_section[p_cache->i_gathered], &p[i_used], i_copy);
+    p_cache->i_gathered += i_copy;
+    i_used += i_copy;
+
+    if (p_cache->i_gathered == i_length)
+    {
+        p_cache->b_gathering = false;
+        Section(p_cache, i_pid, p_cache->p_section, i_length);
+    }
+    return i_used;
+}
+
+void ts_psi_cache_Push(ts_psi_cache_t *p_cache, const uint8_t *p)
+{
+    const uint16_t i_pid = ((p[1] & 0x1f) << 8) | p[2];
+    const uint8_t i_cc = p[3] & 0x0f;
+
+    if (p[1] & 0x80)
+    {   /* transport_error_indicator */
+        p_cache->b_gathering = false;
+        return;
+    }
+    if (!(p[3] & 0x10))
+        return; /* no payload */
+
+    if (p_cache->i_cc != 0xff)
+    {
+        if (i_cc == p_cache->i_cc)
+            return; /* duplicate */
+        if (i_cc != ((p_cache->i_cc + 1) & 0x0f))
+            p_cache->b_gathering = false;
+    }
+    p_cache->i_cc = i_cc;
+
+    size_t i_skip = 4;
+    if (p[3] & 0x20)
+        i_skip += 1 + p[4];
+    if (i_skip >= 188)
+        return;
+
+    const uint8_t *p_payload = p + i_skip;
+    size_t i_payload = 188 - i_skip;
+
+    if (p[1] & 0x40)
+    {
+        size_t i_pointer = *(p_payload++);
+        i_payload--;
+        if (i_pointer > i_payload)
+        {
+            p_cache->b_gathering = false;
+            return;
+        }
+
+        /* end of the previous section */
+        if (p_cache->b_gathering)
+        {
+            Gather(p_cache, i_pid, p_payload, i_pointer);
+            p_cache->b_gathering = false;
+        }
+        p_payload += i_pointer;
+        i_payload -= i_pointer;
+
+        /* new sections, until stuffing */
+        while (i_payload > 0 && *p_payload != 0xff)
+        {
+            p_cache->b_gathering = true;
+            p_cache->i_gathered = 0;
+
+            size_t i_used = Gather(p_cache, i_pid, p_payload, i_payload);
+            p_payload += i_used;
+            i_payload -= i_used;
+            if (p_cache->b_gathering)
+                break; /* continued in the next packets */
+        }
+    }
+    else if (p_cache->b_gathering)
+        Gather(p_cache, i_pid, p_payload, i_payload);
+}
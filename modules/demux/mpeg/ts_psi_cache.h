@@ -0,0 +1,75 @@
+/*****************************************************************************
+ * ts_psi_cache.h: MPEG Transport Stream PSI/SI sections cache
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef VLC_TS_PSI_CACHE_H
+#define VLC_TS_PSI_CACHE_H 1
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * Sections filter, in front of a PSI decoder.
+ *
+ * The packets of a PID are reassembled into sections. Long form sections
+ * already seen, with the same table id, extension, section number, version
+ * and CRC field, are dropped without further processing. The others are
+ * packetized again, one section per packet run with a continuous counter of
+ * its own, and handed over to the decoder, which thus sees every changed
+ * section, and only those. The CRC of a long form section is checked before
+ * it is recorded: a corrupted copy is still handed over, for the decoder to
+ * drop, but does not cause the good copies to be skipped.
+ */
+typedef struct ts_psi_cache_t ts_psi_cache_t;
+
+/**
+ * Receives the packets of the forwarded sections.
+ * \param p_packet a 188 bytes transport packet
+ */
+typedef void (*ts_psi_cache_cb)(void *opaque, const uint8_t *p_packet);
+
+ts_psi_cache_t *ts_psi_cache_New(ts_psi_cache_cb pf_push, void *opaque);
+void ts_psi_cache_Delete(ts_psi_cache_t *);
+
+/**
+ * Processes one transport packet of the PID.
+ * \param p the 188 bytes of the packet, from its sync byte
+ */
+void ts_psi_cache_Push(ts_psi_cache_t *, const uint8_t *p);
+
+/**
+ * Forgets all the sections seen so far, so that they are forwarded again.
+ * To be called whenever the decoder loses its state.
+ */
+void ts_psi_cache_Reset(ts_psi_cache_t *);
+
+/**
+ * Marks the section being forwarded as not handled, so that it is
+ * forwarded again the next time. Only valid from the push callback.
+ */
+void ts_psi_cache_Reject(ts_psi_cache_t *);
+
+/**
+ * Gets the number of complete sections received, and of those dropped.
+ */
+void ts_psi_cache_GetStats(const ts_psi_cache_t *, uint64_t *pi_sections,
+                           uint64_t *pi_skipped);
+
+#endif
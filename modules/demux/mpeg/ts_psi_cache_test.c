@@ -0,0 +1,351 @@
+/*****************************************************************************
+ * ts_psi_cache_test.c: MPEG-TS PSI/SI sections cache test and benchmark
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#undef NDEBUG
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vlc_common.h>
+
+#include "ts_psi_cache.h"
+
+#define PID 0x12
+
+/* Reassembles the forwarded sections, and keeps the last one */
+struct sink
+{
+    ts_psi_cache_t *cache;
+    unsigned packets;
+    unsigned sections;
+    uint8_t  cc;
+    bool     reject;
+    size_t   size;
+    uint8_t  section[4096];
+    uint8_t  buf[4096 + 184];
+    size_t   got;
+};
+
+static void Receive(void *opaque, const uint8_t *p)
+{
+    struct sink *sink = opaque;
+
+    assert(p[0] == 0x47 && (((p[1] & 0x1f) << 8) | p[2]) == PID);
+    assert((p[3] & 0x30) == 0x10);
+    assert((p[3] & 0x0f) == (sink->cc++ & 0x0f));
+    sink->packets++;
+
+    if (p[1] & 0x40)
+    {
+        assert(p[4] == 0);
+        memcpy(sink->buf, p + 5, 183);
+        sink->got = 183;
+    }
+    else
+    {
+        assert(sink->got > 0);
+        memcpy(sink->buf + sink->got, p + 4, 184);
+        sink->got += 184;
+    }
+
+    size_t length = 3 + (((sink->buf[1] & 0x0f) << 8) | sink->buf[2]);
+    if (sink->got >= length)
+    {
+        for (size_t i = length; i < sink->got; i++)
+            assert(sink->buf[i] == 0xff);
+        memcpy(sink->section, sink->buf, length);
+        sink->size = length;
+        sink->sections++;
+        sink->got = 0;
+        if (sink->reject)
+            ts_psi_cache_Reject(sink->cache);
+    }
+}
+
+static uint32_t Crc32(const uint8_t *p, size_t size)
+{
+    uint32_t crc = 0xffffffff;
+
+    while (size-- > 0)
+    {
+        crc ^= (uint32_t)*(p++) << 24;
+        for (unsigned i = 0; i < 8; i++)
+            crc = (crc << 1) ^ ((crc & 0x80000000) ? 0x04c11db7 : 0);
+    }
+    return crc;
+}
+
+static size_t Section(uint8_t *s, uint8_t table_id, uint16_t ext,
+                      uint8_t version, uint8_t number, size_t size)
+{
+    assert(size >= 12 && size <= 4096);
+    s[0] = table_id;
+    s[1] = 0xb0 | ((size - 3) >> 8);
+    s[2] = size - 3;
+    s[3] = ext >> 8;
+    s[4] = ext;
+    s[5] = 0xc1 | (version << 1);
+    s[6] = number;
+    s[7] = 0xff;
+    for (size_t i = 8; i < size - 4; i++)
+        s[i] = i * 7 + number;
+    SetDWBE(&s[size - 4], Crc32(s, size - 4));
+    return size;
+}
+
+/* Packetizes sections, back to back */
+struct source
+{
+    ts_psi_cache_t *cache;
+    uint8_t cc;
+    uint8_t pkt[188];
+    size_t  used;   /* payload bytes in the packet being filled */
+    bool    start;  /* a section starts in the packet being filled */
+};
+
+static void SourceFlush(struct source *src)
+{
+    if (src->used == 0)
+        return;
+    memset(src->pkt + 4 + src->used, 0xff, 184 - src->used);
+    ts_psi_cache_Push(src->cache, src->pkt);
+    src->used = 0;
+    src->start = false;
+}
+
+static void SourceSend(struct source *src, const uint8_t *s, size_t size)
+{
+    bool first = true;
+
+    while (size > 0)
+    {
+        if (src->used == 0)
+        {
+            src->pkt[0] = 0x47;
+            src->pkt[1] = PID >> 8;
+            src->pkt[2] = PID & 0xff;
+            src->pkt[3] = 0x10 | (src->cc++ & 0x0f);
+        }
+        if (first && !src->start)
+        {
+            /* pointer_field, in front of the payload */
+            if (src->used + 1 >= 184)
+            {
+                SourceFlush(src);
+                continue;
+            }
+            memmove(src->pkt + 5, src->pkt + 4, src->used);
+            src->pkt[4] = src->used;
+            src->pkt[1] |= 0x40;
+            src->used++;
+            src->start = true;
+        }
+        first = false;
+
+        size_t copy = __MIN(size, 184 - src->used);
+        memcpy(src->pkt + 4 + src->used, s, copy);
+        src->used += copy;
+        s += copy;
+        size -= copy;
+        if (src->used == 184)
+            SourceFlush(src);
+    }
+}
+
+static void test_sections(void)
+{
+    struct sink sink = { .cc = 0 };
+    struct source src = { .cc = 5 };
+    uint8_t s[4096];
+    size_t size;
+
+    sink.cache = src.cache = ts_psi_cache_New(Receive, &sink);
+    assert(sink.cache != NULL);
+
+    /* small sections, several per packet, then large ones */
+    static const size_t sizes[] = { 12, 40, 100, 183, 184, 185, 1000, 4096 };
+    for (unsigned pass = 0; pass < 3; pass++)
+    {
+        for (unsigned i = 0; i < ARRAY_SIZE(sizes); i++)
+        {
+            size = Section(s, 0x50, 1000 + i, 3, i, sizes[i]);
+            SourceSend(&src, s, size);
+            SourceFlush(&src);
+            if (pass == 0)
+            {
+                assert(sink.sections == i + 1);
+                assert(sink.size == size && !memcmp(sink.section, s, size));
+            }
+        }
+        for (unsigned i = 0; i < 20; i++)
+        {
+            size = Section(s, 0x4e, 1, 0, i, 12 + i * 30);
+            SourceSend(&src, s, size);
+        }
+        SourceFlush(&src);
+        assert(sink.sections == ARRAY_SIZE(sizes) + 20);
+    }
+
+    uint64_t sections, skipped;
+    ts_psi_cache_GetStats(sink.cache, &sections, &skipped);
+    assert(sections == 3 * (ARRAY_SIZE(sizes) + 20));
+    assert(skipped == 2 * (ARRAY_SIZE(sizes) + 20));
+
+    /* new version, and same version with another CRC */
+    size = Section(s, 0x4e, 1, 1, 0, 100);
+    SourceSend(&src, s, size);
+    SourceFlush(&src);
+    assert(sink.sections == ARRAY_SIZE(sizes) + 21);
+    s[8] ^= 0xff;
+    SetDWBE(&s[size - 4], Crc32(s, size - 4));
+    SourceSend(&src, s, size);
+    SourceSend(&src, s, size);
+    SourceFlush(&src);
+    assert(sink.sections == ARRAY_SIZE(sizes) + 22);
+
+    /* corrupted payload with the CRC field of the good copy, as on a lossy
+     * feed: forwarded every time, and the good copy not skipped after it */
+    size = Section(s, 0x42, 2, 0, 0, 300);
+    s[100] ^= 0x01;
+    SourceSend(&src, s, size);
+    SourceSend(&src, s, size);
+    s[100] ^= 0x01;
+    SourceSend(&src, s, size);
+    SourceSend(&src, s, size);
+    SourceFlush(&src);
+    assert(sink.sections == ARRAY_SIZE(sizes) + 25);
+    assert(sink.size == size && !memcmp(sink.section, s, size));
+
+    /* rejected by the decoder */
+    sink.reject = true;
+    size = Section(s, 0x42, 1, 0, 0, 50);
+    SourceSend(&src, s, size);
+    SourceSend(&src, s, size);
+    SourceFlush(&src);
+    assert(sink.sections == ARRAY_SIZE(sizes) + 27);
+    sink.reject = false;
+    SourceSend(&src, s, size);
+    SourceSend(&src, s, size);
+    SourceFlush(&src);
+    assert(sink.sections == ARRAY_SIZE(sizes) + 28);
+
+    /* short form sections are always forwarded */
+    uint8_t tdt[8] = { 0x70, 0x70, 0x05, 0xe0, 0x00, 0x12, 0x34, 0x56 };
+    SourceSend(&src, tdt, sizeof (tdt));
+    SourceSend(&src, tdt, sizeof (tdt));
+    SourceFlush(&src);
+    assert(sink.sections == ARRAY_SIZE(sizes) + 30);
+    assert(sink.size == sizeof (tdt) && !memcmp(sink.section, tdt, 8));
+
+    /* decoder state lost */
+    ts_psi_cache_Reset(sink.cache);
+    SourceSend(&src, s, size);
+    SourceFlush(&src);
+    assert(sink.sections == ARRAY_SIZE(sizes) + 31);
+
+    /* lost packet within a section */
+    size = Section(s, 0x50, 2, 0, 0, 1000);
+    src.cc++;
+    SourceSend(&src, s, 500);
+    src.cc++;
+    SourceSend(&src, s + 500, 500);
+    SourceFlush(&src);
+    assert(sink.sections == ARRAY_SIZE(sizes) + 31);
+
+    /* duplicate packet, and transport errors */
+    SourceSend(&src, s, size);
+    memset(src.pkt + 4 + src.used, 0xff, 184 - src.used);
+    ts_psi_cache_Push(sink.cache, src.pkt); /* last packet, sent twice */
+    SourceFlush(&src);
+    assert(sink.sections == ARRAY_SIZE(sizes) + 32);
+
+    size = Section(s, 0x50, 3, 0, 0, 100);
+    SourceSend(&src, s, size);
+    src.pkt[1] |= 0x80;
+    SourceFlush(&src);
+    assert(sink.sections == ARRAY_SIZE(sizes) + 32);
+
+    ts_psi_cache_Delete(sink.cache);
+}
+
+/* Many sections, for the cache to grow */
+static void test_growth(void)
+{
+    struct sink sink = { .cc = 0 };
+    struct source src = { .cc = 0 };
+    uint8_t s[64];
+
+    sink.cache = src.cache = ts_psi_cache_New(Receive, &sink);
+    assert(sink.cache != NULL);
+
+    for (unsigned pass = 0; pass < 2; pass++)
+    {
+        for (unsigned i = 0; i < 20000; i++)
+            SourceSend(&src, s, Section(s, 0x50 + i % 16, i / 256, 0,
+                                        i % 256, 20 + i % 40));
+        SourceFlush(&src);
+        assert(sink.sections == 20000);
+    }
+    ts_psi_cache_Delete(sink.cache);
+}
+
+static void Drop(void *opaque, const uint8_t *p)
+{
+    (void) opaque; (void) p;
+}
+
+/* EIT schedule carousel, of the given sections */
+static void bench(unsigned sections, unsigned rounds)
+{
+    struct source src = { .cc = 0 };
+    uint8_t s[1024];
+
+    src.cache = ts_psi_cache_New(Drop, NULL);
+    assert(src.cache != NULL);
+
+    mtime_t start = mdate();
+    for (unsigned r = 0; r < rounds; r++)
+        for (unsigned i = 0; i < sections; i++)
+            SourceSend(&src, s, Section(s, 0x50 + i % 16, i / 256, 0,
+                                        i % 256, 200 + i % 800));
+    SourceFlush(&src);
+    mtime_t spent = mdate() - start;
+
+    uint64_t total, skipped;
+    ts_psi_cache_GetStats(src.cache, &total, &skipped);
+    printf("%"PRIu64" sections, %"PRIu64" skipped: %.0f ksections/s\n",
+           total, skipped, (double)total * 1000 / (spent ? spent : 1));
+    ts_psi_cache_Delete(src.cache);
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned rounds = (argc > 1) ? strtoul(argv[1], NULL, 0) : 20;
+
+    test_sections();
+    test_growth();
+    bench(5000, rounds);
+    return 0;
+}
@@ -0,0 +1,181 @@
+/*****************************************************************************
+ * ts_sync.c: MPEG Transport Stream synchronization
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <assert.h>
+
+#include <vlc_common.h>
+#include <vlc_cpu.h>
+
+#include "ts_sync.h"
+
+#define TS_SYNC_MAX_STRIDES 4
+
+static unsigned MaxStride(const unsigned *pi_strides, unsigned i_strides)
+{
+    unsigned i_max = 0;
+
+    assert(i_strides > 0 && i_strides <= TS_SYNC_MAX_STRIDES);
+    for (unsigned i = 0; i < i_strides; i++)
+        if (pi_strides[i] > i_max)
+            i_max = pi_strides[i];
+    return i_max;
+}
+
+/* Searches offsets [i_start;i_end[, the buffer must extend past i_end by
+ * i_count times the largest stride */
+static bool FindRange(const uint8_t *p, size_t i_start, size_t i_end,
+                      const unsigned *pi_strides, unsigned i_strides,
+                      unsigned i_count, size_t *pi_offset, unsigned *pi_stride)
+{
+    for (size_t i = i_start; i < i_end; i++)
+    {
+        if (p[i] != TS_SYNC_BYTE)
+            continue;
+
+        for (unsigned j = 0; j < i_strides; j++)
+        {
+            unsigned k = 1;
+
+            while (k <= i_count && p[i + k * pi_strides[j]] == TS_SYNC_BYTE)
+                k++;
+            if (k > i_count)
+            {
+                *pi_offset = i;
+                *pi_stride = pi_strides[j];
+                return true;
+            }
+        }
+    }
+    *pi_offset = i_end;
+    return false;
+}
+
+static bool FindC(const uint8_t *p, size_t i_size,
+                  const unsigned *pi_strides, unsigned i_strides,
+                  unsigned i_count, size_t *pi_offset, unsigned *pi_stride)
+{
+    size_t i_span = (size_t)MaxStride(pi_strides, i_strides) * i_count;
+    size_t i_end = (i_size > i_span) ? i_size - i_span : 0;
+
+    return FindRange(p, 0, i_end, pi_strides, i_strides, i_count,
+                     pi_offset, pi_stride);
+}
+
+#if (defined(__i386__) || defined(__x86_64__)) && \
+    defined(HAVE_SSE2_INTRINSICS) && (VLC_GCC_VERSION(4, 9) || defined(__clang__))
+# define TS_SYNC_X86 1
+# include <emmintrin.h>
+
+# define TS_SYNC_SSE2 __attribute__ ((__target__ ("sse2")))
+
+/* Checks 16 offsets at once: the sync bytes of the first packets are
+ * compared together, and only when one is found, the following ones are
+ * compared at every candidate stride. */
+TS_SYNC_SSE2
+static bool FindSSE2(const uint8_t *p, size_t i_size,
+                     const unsigned *pi_strides, unsigned i_strides,
+                     unsigned i_count, size_t *pi_offset, unsigned *pi_stride)
+{
+    size_t i_span = (size_t)MaxStride(pi_strides, i_strides) * i_count;
+    const size_t i_end = (i_size > i_span) ? i_size - i_span : 0;
+    const __m128i sync = _mm_set1_epi8(TS_SYNC_BYTE);
+    size_t i = 0;
+
+    for (; i + 16 <= i_end; i += 16)
+    {
+        __m128i first = _mm_cmpeq_epi8(
+                            _mm_loadu_si128((const __m128i *)(p + i)), sync);
+        if (_mm_movemask_epi8(first) == 0)
+            continue;
+
+        unsigned masks[TS_SYNC_MAX_STRIDES], any = 0;
+        for (unsigned j = 0; j < i_strides; j++)
+        {
+            __m128i m = first;
+
+            for (unsigned k = 1; k <= i_count; k++)
+            {
+                const uint8_t *next = p + i + k * pi_strides[j];
+                m = _mm_and_si128(m, _mm_cmpeq_epi8(
+                            _mm_loadu_si128((const __m128i *)next), sync));
+            }
+            masks[j] = _mm_movemask_epi8(m);
+            any |= masks[j];
+        }
+
+        if (any)
+        {
+            unsigned offset = ctz(any);
+
+            for (unsigned j = 0; j < i_strides; j++)
+                if (masks[j] & (1u << offset))
+                {
+                    *pi_offset = i + offset;
+                    *pi_stride = pi_strides[j];
+                    return true;
+                }
+        }
+    }
+    return FindRange(p, i, i_end, pi_strides, i_strides, i_count,
+                     pi_offset, pi_stride);
+}
+#endif
+
+ts_sync_find_t ts_sync_GetFind(unsigned cpu)
+{
+#ifdef TS_SYNC_X86
+    if (cpu & VLC_CPU_SSE2)
+        return FindSSE2;
+#endif
+    VLC_UNUSED(cpu);
+    return FindC;
+}
+
+const char *ts_sync_GetName(unsigned cpu)
+{
+#ifdef TS_SYNC_X86
+    if (cpu & VLC_CPU_SSE2)
+        return "SSE2";
+#endif
+    VLC_UNUSED(cpu);
+    return "C";
+}
+
+size_t ts_sync_Count(const uint8_t *p, size_t i_size, unsigned i_stride)
+{
+    size_t i = 0;
+
+    /* 4 packets per branch, as synchronization is seldom lost */
+    for (; i + 4 * i_stride <= i_size; i += 4 * i_stride)
+        if ((p[i] ^ TS_SYNC_BYTE) | (p[i + i_stride] ^ TS_SYNC_BYTE) |
+            (p[i + 2 * i_stride] ^ TS_SYNC_BYTE) |
+            (p[i + 3 * i_stride] ^ TS_SYNC_BYTE))
+            break;
+
+    for (; i + i_stride <= i_size; i += i_stride)
+        if (p[i] != TS_SYNC_BYTE)
+            break;
+
+    return i / i_stride;
+}
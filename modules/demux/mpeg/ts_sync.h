@@ -0,0 +1,70 @@
+/*****************************************************************************
+ * ts_sync.h: MPEG Transport Stream synchronization
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef VLC_TS_SYNC_H
+#define VLC_TS_SYNC_H 1
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#define TS_SYNC_BYTE 0x47
+
+/**
+ * Finds the first offset in a buffer where a sync byte is followed by
+ * i_count other ones, spaced by one of the given packet sizes. Sizes are
+ * tried in order at each offset.
+ * \param p buffer to search
+ * \param i_size size of the buffer in bytes
+ * \param pi_strides candidate packet sizes
+ * \param i_strides number of candidate packet sizes, at most 4
+ * \param i_count number of sync bytes to confirm after the first one
+ * \param pi_offset [OUT] offset of the match if found. Otherwise, number
+ * of bytes ruled out, that is where to resume once more data is available.
+ * \param pi_stride [OUT] matching packet size, if found
+ * \return true if found
+ */
+typedef bool (*ts_sync_find_t)(const uint8_t *p, size_t i_size,
+                               const unsigned *pi_strides, unsigned i_strides,
+                               unsigned i_count, size_t *pi_offset,
+                               unsigned *pi_stride);
+
+/**
+ * Returns the fastest sync search routine usable with the given CPU flags.
+ * \param cpu CPU capabilities, usually vlc_CPU()
+ */
+ts_sync_find_t ts_sync_GetFind(unsigned cpu);
+
+/**
+ * Returns the name of the implementation selected for the given CPU flags.
+ */
+const char *ts_sync_GetName(unsigned cpu);
+
+/**
+ * Counts the consecutive packets starting with a sync byte.
+ * \param p first packet sync byte position
+ * \param i_size size of the buffer from p
+ * \param i_stride packet size
+ * \return the number of whole packets, from the first one, that start with
+ * a sync byte
+ */
+size_t ts_sync_Count(const uint8_t *p, size_t i_size, unsigned i_stride);
+
+#endif
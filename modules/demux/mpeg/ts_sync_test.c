@@ -0,0 +1,151 @@
+/*****************************************************************************
+ * ts_sync_test.c: MPEG-TS synchronization search test and benchmark
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#undef NDEBUG
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vlc_common.h>
+#include <vlc_cpu.h>
+
+#include "ts_sync.h"
+
+static const unsigned sizes[] = { 188, 192, 204 };
+
+static const unsigned variants[] = {
+    0,
+#if defined (__i386__) || defined (__x86_64__)
+    VLC_CPU_SSE2,
+#endif
+};
+
+/* Random garbage, then packets of the given size from offset */
+static void Fill(uint8_t *buf, size_t size, size_t offset, unsigned stride)
+{
+    for (size_t i = 0; i < size; i++)
+        buf[i] = rand();
+    for (size_t i = offset; i < size; i += stride)
+        buf[i] = TS_SYNC_BYTE;
+}
+
+static void test_find(unsigned cpu, size_t size, unsigned count)
+{
+    ts_sync_find_t ref = ts_sync_GetFind(0);
+    ts_sync_find_t find = ts_sync_GetFind(cpu);
+    uint8_t *buf = malloc(size);
+    assert(buf != NULL);
+
+    size_t offset = rand() % size;
+    unsigned stride = sizes[rand() % ARRAY_SIZE(sizes)];
+    Fill(buf, size, offset, stride);
+
+    for (unsigned n = 1; n <= ARRAY_SIZE(sizes); n++)
+    {
+        size_t ref_offset, offset;
+        unsigned ref_stride = 0, stride = 0;
+        bool ref_found = ref(buf, size, sizes, n, count, &ref_offset,
+                             &ref_stride);
+        bool found = find(buf, size, sizes, n, count, &offset, &stride);
+
+        if (found != ref_found || offset != ref_offset ||
+            (found && stride != ref_stride))
+        {
+            fprintf(stderr, "%s mismatch (size %zu, count %u, strides %u): "
+                    "%d/%zu/%u instead of %d/%zu/%u\n", ts_sync_GetName(cpu),
+                    size, count, n, found, offset, stride,
+                    ref_found, ref_offset, ref_stride);
+            abort();
+        }
+    }
+    free(buf);
+}
+
+static void test_count(void)
+{
+    uint8_t buf[188 * 16];
+
+    for (unsigned bad = 0; bad <= 16; bad++)
+    {
+        Fill(buf, sizeof (buf), 0, 188);
+        if (bad < 16)
+            buf[bad * 188] = 0;
+        assert(ts_sync_Count(buf, sizeof (buf), 188) == bad);
+        /* incomplete last packet */
+        assert(ts_sync_Count(buf, sizeof (buf) - 1, 188) == __MIN(bad, 15));
+    }
+}
+
+static void bench(unsigned cpu, size_t size, unsigned loops)
+{
+    ts_sync_find_t find = ts_sync_GetFind(cpu);
+    uint8_t *buf = malloc(size);
+    assert(buf != NULL);
+
+    /* garbage only, the worst case */
+    for (size_t i = 0; i < size; i++)
+        buf[i] = rand();
+
+    uint64_t scanned = 0;
+    mtime_t start = mdate();
+    for (unsigned i = 0; i < loops; i++)
+    {
+        size_t offset;
+        unsigned stride;
+
+        /* stops early on a (rare) fake match */
+        find(buf, size, sizes, ARRAY_SIZE(sizes), 3, &offset, &stride);
+        scanned += offset;
+    }
+    mtime_t spent = mdate() - start;
+
+    printf("%-5s search %8.1f MB/s in garbage\n", ts_sync_GetName(cpu),
+           (double)scanned * CLOCK_FREQ / (spent ? spent : 1) / 1000000.);
+    free(buf);
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned cpu = vlc_CPU();
+    unsigned loops = (argc > 1) ? strtoul(argv[1], NULL, 0) : 100;
+
+    srand(0);
+    test_count();
+
+    for (size_t i = 0; i < ARRAY_SIZE(variants); i++)
+    {
+        if (variants[i] & ~cpu)
+            continue;
+
+        for (unsigned k = 0; k < 4096; k++)
+            test_find(variants[i], 1 + rand() % 4096, rand() % 4);
+    }
+
+    for (size_t i = 0; i < ARRAY_SIZE(variants); i++)
+        if (!(variants[i] & ~cpu))
+            bench(variants[i], 1 << 20, loops);
+
+    return 0;
+}
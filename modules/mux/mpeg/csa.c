@@ -26,10 +26,27 @@
 # include "config.h"
 #endif
 
+#include <assert.h>
+
 #include <vlc_common.h>
+#include <vlc_cpu.h>
 
 #include "csa.h"
 
+typedef struct
+{
+    const uint8_t *p_init;  /* first 8 bytes, fed to the stream cypher */
+    uint8_t       *p_data;  /* bytes to xor with the key stream */
+    unsigned       i_data;
+    bool           b_odd;
+
+    uint8_t       *p_block; /* blocks for the block cypher */
+    unsigned       i_blocks;
+} csa_lane_t;
+
+typedef void (*csa_stream_t)( const csa_lane_t *, unsigned,
+                              const uint8_t o_ck[8], const uint8_t e_ck[8] );
+
 struct csa_t
 {
     /* odd and even keys */
@@ -47,6 +64,15 @@ struct csa_t
     int     p, q, r;
 
     bool    use_odd;
+
+    /* bitsliced stream cypher, for batches */
+    csa_stream_t pf_stream;
+    unsigned     i_lanes;
+    const char  *psz_name;
+
+    /* block cypher round contributions, indexed by the s-box input */
+    uint64_t     block_dec[256];
+    uint64_t     block_enc[256];
 };
 
 static void csa_ComputeKey( uint8_t kk[57], uint8_t ck[8] );
@@ -56,12 +82,105 @@ static void csa_StreamCypher( csa_t *c, int b_init, uint8_t *ck, uint8_t *sb, ui
 static void csa_BlockDecypher( uint8_t kk[57], uint8_t ib[8], uint8_t bd[8] );
 static void csa_BlockCypher( uint8_t kk[57], uint8_t bd[8], uint8_t ib[8] );
 
+static void csa_BlockInit( csa_t *c );
+static void csa_BlockDecypherN( const csa_t *c, const uint8_t kk[57],
+                                uint64_t *r, unsigned n );
+static void csa_BlockCypherN( const csa_t *c, const uint8_t kk[57],
+                              uint64_t *r, unsigned n );
+
+/* Transposes a 8x8 bit matrix: bit c of byte k becomes bit k of byte c */
+static inline uint64_t csa_Transpose8( uint64_t x )
+{
+    uint64_t t;
+
+    t = (x ^ (x >> 7)) & UINT64_C(0x00AA00AA00AA00AA);
+    x ^= t ^ (t << 7);
+    t = (x ^ (x >> 14)) & UINT64_C(0x0000CCCC0000CCCC);
+    x ^= t ^ (t << 14);
+    t = (x ^ (x >> 28)) & UINT64_C(0x00000000F0F0F0F0);
+    x ^= t ^ (t << 28);
+    return x;
+}
+
+#define word_t uint64_t
+#define CSA_BS(name) name##C
+#define CSA_BS_TARGET
+#include "csa_bs.h"
+#undef CSA_BS_TARGET
+#undef CSA_BS
+#undef word_t
+
+#if (defined(__i386__) || defined(__x86_64__)) && \
+    defined(HAVE_SSE2_INTRINSICS) && (VLC_GCC_VERSION(4, 9) || defined(__clang__))
+# define CSA_X86 1
+# include <immintrin.h>
+
+# define word_t __m128i
+# define CSA_BS(name) name##SSE2
+# define CSA_BS_TARGET __attribute__ ((__target__ ("sse2")))
+# include "csa_bs.h"
+# undef CSA_BS_TARGET
+# undef CSA_BS
+# undef word_t
+
+# define word_t __m256i
+# define CSA_BS(name) name##AVX2
+# define CSA_BS_TARGET __attribute__ ((__target__ ("avx2")))
+# include "csa_bs.h"
+# undef CSA_BS_TARGET
+# undef CSA_BS
+# undef word_t
+#endif
+
+#define CSA_LANES_MAX 256
+
 /*****************************************************************************
  * csa_New:
  *****************************************************************************/
 csa_t *csa_New( void )
 {
-    return calloc( 1, sizeof( csa_t ) );
+    return csa_NewCPU( vlc_CPU() );
+}
+
+/*****************************************************************************
+ * csa_NewCPU:
+ *****************************************************************************/
+csa_t *csa_NewCPU( unsigned cpu )
+{
+    csa_t *c = calloc( 1, sizeof( csa_t ) );
+    if( !c )
+        return NULL;
+    csa_BlockInit( c );
+
+#ifdef CSA_X86
+    if( cpu & VLC_CPU_AVX2 )
+    {
+        c->pf_stream = StreamAVX2;
+        c->i_lanes   = 256;
+        c->psz_name  = "AVX2";
+        return c;
+    }
+    if( cpu & VLC_CPU_SSE2 )
+    {
+        c->pf_stream = StreamSSE2;
+        c->i_lanes   = 128;
+        c->psz_name  = "SSE2";
+        return c;
+    }
+#endif
+    VLC_UNUSED(cpu);
+    c->pf_stream = StreamC;
+    c->i_lanes   = 64;
+    c->psz_name  = "C";
+    return c;
+}
+
+/*****************************************************************************
+ * csa_GetName:
+ *****************************************************************************/
+const char *csa_GetName( csa_t *c )
+{
+    return c->psz_name;
 }
 
 /*****************************************************************************
@@ -131,6 +250,8 @@ int csa_UseKey( vlc_object_t *p_caller, csa_t *c, bool use_odd )
 #ifndef TS_NO_CSA_CK_MSG
         msg_Dbg( p_caller, "using the %s key for scrambling",
                  use_odd ? "odd" : "even" );
+#else
+    VLC_UNUSED(p_caller);
 #endif
     return VLC_SUCCESS;
 }
@@ -307,6 +428,179 @@ void csa_Encrypt( csa_t *c, uint8_t *pkt, int i_pkt_size )
     }
 }
 
+/*****************************************************************************
+ * csa_DecryptBatch:
+ *****************************************************************************
+ * Each packet is a lane of the bitsliced stream cypher: the key stream is
+ * xored first, then the blocks, which no longer depend on each other, are
+ * decyphered.
+ *****************************************************************************/
+static void csa_DecryptLanes( csa_t *c, csa_lane_t *lanes, unsigned n )
+{
+    c->pf_stream( lanes, n, c->o_ck, c->e_ck );
+
+    for( unsigned i = 0; i < n; i++ )
+    {
+        uint8_t *p = lanes[i].p_block;
+        const unsigned i_blocks = lanes[i].i_blocks;
+        uint64_t r[184/8];
+
+        for( unsigned j = 0; j < i_blocks; j++ )
+            r[j] = GetQWLE( &p[8*j] );
+
+        csa_BlockDecypherN( c, lanes[i].b_odd ? c->o_kk : c->e_kk, r,
+                            i_blocks );
+
+        /* the last block is xored with 0 */
+        for( unsigned j = 0; j + 1 < i_blocks; j++ )
+            SetQWLE( &p[8*j], r[j] ^ GetQWLE( &p[8*(j+1)] ) );
+        if( i_blocks > 0 )
+            SetQWLE( &p[8*(i_blocks-1)], r[i_blocks-1] );
+    }
+}
+
+void csa_DecryptBatch( csa_t *c, uint8_t **pp_pkts, size_t i_pkts,
+                       int i_pkt_size )
+{
+    csa_lane_t lanes[CSA_LANES_MAX];
+    unsigned n = 0;
+
+    assert( i_pkt_size <= 188 );
+    for( size_t i = 0; i < i_pkts; i++ )
+    {
+        uint8_t *pkt = pp_pkts[i];
+
+        /* transport scrambling control */
+        if( (pkt[3]&0x80) == 0 )
+            continue;
+
+        const bool b_odd = pkt[3]&0x40;
+        pkt[3] &= 0x3f;
+
+        int i_hdr = 4;
+        if( pkt[3]&0x20 )
+            i_hdr += pkt[4] + 1;
+
+        if( 188 - i_hdr < 8 || i_pkt_size - i_hdr <= 0 )
+            continue;
+
+        /* without a whole block, the residue is xored from the start */
+        const int i_blocks = (i_pkt_size - i_hdr) / 8;
+        const int i_skip = i_blocks > 0 ? 8 : 0;
+        csa_lane_t *lane = &lanes[n++];
+
+        lane->p_init   = &pkt[i_hdr];
+        lane->p_data   = &pkt[i_hdr + i_skip];
+        lane->i_data   = i_pkt_size - i_hdr - i_skip;
+        lane->b_odd    = b_odd;
+        lane->p_block  = &pkt[i_hdr];
+        lane->i_blocks = i_blocks;
+
+        if( n == c->i_lanes )
+        {
+            csa_DecryptLanes( c, lanes, n );
+            n = 0;
+        }
+    }
+    if( n > 0 )
+        csa_DecryptLanes( c, lanes, n );
+}
+
+/*****************************************************************************
+ * csa_EncryptBatch:
+ *****************************************************************************
+ * The block chains of all the packets are cyphered in lockstep, from their
+ * last block, then their first blocks initialise the stream cyphers.
+ *****************************************************************************/
+static void csa_EncryptLanes( csa_t *c, csa_lane_t *lanes, unsigned n )
+{
+    const uint8_t *kk = c->use_odd ? c->o_kk : c->e_kk;
+    uint64_t chain[CSA_LANES_MAX], r[CSA_LANES_MAX];
+    uint8_t *blocks[CSA_LANES_MAX];
+    unsigned i_max = 0;
+
+    for( unsigned i = 0; i < n; i++ )
+    {
+        chain[i] = 0;
+        if( lanes[i].i_blocks > i_max )
+            i_max = lanes[i].i_blocks;
+    }
+
+    for( unsigned j = 0; j < i_max; j++ )
+    {
+        unsigned m = 0;
+
+        for( unsigned i = 0; i < n; i++ )
+        {
+            if( lanes[i].i_blocks <= j )
+                continue;
+            blocks[m] = &lanes[i].p_block[8*(lanes[i].i_blocks - 1 - j)];
+            r[m] = GetQWLE( blocks[m] ) ^ chain[i];
+            m++;
+        }
+
+        csa_BlockCypherN( c, kk, r, m );
+
+        m = 0;
+        for( unsigned i = 0; i < n; i++ )
+        {
+            if( lanes[i].i_blocks <= j )
+                continue;
+            chain[i] = r[m];
+            SetQWLE( blocks[m], r[m] );
+            m++;
+        }
+    }
+
+    c->pf_stream( lanes, n, c->o_ck, c->e_ck );
+}
+
+void csa_EncryptBatch( csa_t *c, uint8_t **pp_pkts, size_t i_pkts,
+                       int i_pkt_size )
+{
+    csa_lane_t lanes[CSA_LANES_MAX];
+    unsigned n = 0;
+
+    assert( i_pkt_size <= 188 );
+    for( size_t i = 0; i < i_pkts; i++ )
+    {
+        uint8_t *pkt = pp_pkts[i];
+
+        /* set transport scrambling control */
+        pkt[3] |= 0x80;
+        if( c->use_odd )
+            pkt[3] |= 0x40;
+
+        int i_hdr = 4;
+        if( pkt[3]&0x20 )
+            i_hdr += pkt[4] + 1;
+
+        const int i_blocks = (i_pkt_size - i_hdr) / 8;
+        if( i_blocks <= 0 )
+        {
+            pkt[3] &= 0x3f;
+            continue;
+        }
+
+        csa_lane_t *lane = &lanes[n++];
+
+        lane->p_init   = &pkt[i_hdr];
+        lane->p_data   = &pkt[i_hdr + 8];
+        lane->i_data   = i_pkt_size - i_hdr - 8;
+        lane->b_odd    = c->use_odd;
+        lane->p_block  = &pkt[i_hdr];
+        lane->i_blocks = i_blocks;
+
+        if( n == c->i_lanes )
+        {
+            csa_EncryptLanes( c, lanes, n );
+            n = 0;
+        }
+    }
+    if( n > 0 )
+        csa_EncryptLanes( c, lanes, n );
+}
+
 /*****************************************************************************
  * Divers
  *****************************************************************************/
@@ -610,3 +904,57 @@ static void csa_BlockCypher( uint8_t kk[57], uint8_t bd[8], uint8_t ib[8] )
     }
 }
 
+/* The batch block cyphers store the 8 bytes of a block as a little endian
+ * word, so that a round is a rotation, the xor of the first byte into 3
+ * others, and the xor of the s-box and permutation outputs, looked up at
+ * once. */
+static void csa_BlockInit( csa_t *c )
+{
+    for( unsigned i = 0; i < 256; i++ )
+    {
+        const uint64_t sbox_out = block_sbox[i];
+        const uint64_t perm_out = block_perm[sbox_out];
+
+        /* R1 ^= s, R3..R5 ^= s, R7 ^= perm */
+        c->block_dec[i] = sbox_out * UINT64_C(0x0000000101010001)
+                        ^ (perm_out << 48);
+        /* R6 ^= perm, R8 ^= s */
+        c->block_enc[i] = (perm_out << 40) ^ (sbox_out << 56);
+    }
+}
+
+/* Same as csa_BlockDecypher on n independent blocks */
+static void csa_BlockDecypherN( const csa_t *c, const uint8_t kk[57],
+                                uint64_t *r, unsigned n )
+{
+    for( int i = 56; i > 0; i-- )
+    {
+        for( unsigned j = 0; j < n; j++ )
+        {
+            const uint64_t R = r[j];
+            const uint64_t rot = (R << 8) | (R >> 56);
+
+            /* R1 = R8^s, R3 = R2^R8^s, R4 = R3^R8^s, R5 = R4^R8^s */
+            r[j] = rot ^ ((R >> 56) * UINT64_C(0x0000000101010000))
+                 ^ c->block_dec[ kk[i]^((R >> 48)&0xff) ];
+        }
+    }
+}
+
+/* Same as csa_BlockCypher on n independent blocks */
+static void csa_BlockCypherN( const csa_t *c, const uint8_t kk[57],
+                              uint64_t *r, unsigned n )
+{
+    for( int i = 1; i <= 56; i++ )
+    {
+        for( unsigned j = 0; j < n; j++ )
+        {
+            const uint64_t R = r[j];
+            const uint64_t rot = (R >> 8) | (R << 56);
+
+            /* R2 = R3^R1, R3 = R4^R1, R4 = R5^R1 */
+            r[j] = rot ^ ((R & 0xff) * UINT64_C(0x01010100))
+                 ^ c->block_enc[ kk[i]^(R >> 56) ];
+        }
+    }
+}
@@ -26,13 +26,21 @@
 
 typedef struct csa_t csa_t;
 #define csa_New     __csa_New
+#define csa_NewCPU  __csa_NewCPU
+#define csa_GetName __csa_GetName
 #define csa_Delete  __csa_Delete
 #define csa_SetCW  __csa_SetCW
 #define csa_UseKey  __csa_UseKey
 #define csa_Decrypt __csa_decrypt
 #define csa_Encrypt __csa_encrypt
+#define csa_DecryptBatch __csa_decrypt_batch
+#define csa_EncryptBatch __csa_encrypt_batch
 
 csa_t *csa_New( void );
+/* csa_New() with the batch implementation for the given CPU flags */
+csa_t *csa_NewCPU( unsigned cpu );
+/* name of the batch implementation */
+const char *csa_GetName( csa_t * );
 void   csa_Delete( csa_t * );
 
 int    csa_SetCW( vlc_object_t *p_caller, csa_t *c, char *psz_ck, bool odd );
@@ -41,4 +49,11 @@ int    csa_UseKey( vlc_object_t *p_caller, csa_t *, bool use_odd );
 void   csa_Decrypt( csa_t *, uint8_t *pkt, int i_pkt_size );
 void   csa_Encrypt( csa_t *, uint8_t *pkt, int i_pkt_size );
 
+/* Same as csa_Decrypt/csa_Encrypt on each packet, running the stream cypher
+ * on 64 to 256 packets at once. Packets are at most 188 bytes long. */
+void   csa_DecryptBatch( csa_t *, uint8_t **pp_pkts, size_t i_pkts,
+                         int i_pkt_size );
+void   csa_EncryptBatch( csa_t *, uint8_t **pp_pkts, size_t i_pkts,
+                         int i_pkt_size );
+
 #endif /* _CSA_H */
@@ -0,0 +1,362 @@
+/*****************************************************************************
+ * csa_bs.h: bitsliced CSA stream cypher
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/* This file is included by csa.c once per word type, with word_t, CSA_BS()
+ * and CSA_BS_TARGET defined. Each bit of a word belongs to a different
+ * packet: a step of the stream cypher runs on as many packets as the word
+ * has bits, and the 4-bit registers are stored as 4 words, lsb first.
+ *
+ * The s-boxes are in algebraic normal form, split on one input:
+ * out = g ^ (in & h), where g and h only depend on the 4 other inputs. */
+
+CSA_BS_TARGET
+static inline void CSA_BS(Sbox1)(word_t *o1, word_t *o0, word_t i4,
+                                 word_t i3, word_t i2, word_t i1, word_t i0)
+{
+    const word_t i0i1 = i0 & i1;
+    const word_t i0i2 = i0 & i2;
+    const word_t i1i2 = i1 & i2;
+    const word_t i0i4 = i0 & i4;
+    const word_t i1i4 = i1 & i4;
+    const word_t i2i4 = i2 & i4;
+    const word_t i0i1i4 = i0i1 & i4;
+    const word_t i0i2i4 = i0i2 & i4;
+    const word_t i1i2i4 = i1i2 & i4;
+    const word_t g1 = ~(i0 ^ i1 ^ i0i1 ^ i0i2 ^ i1i2 ^ i4 ^ i0i1i4 ^ i2i4 ^
+                        i1i2i4);
+    const word_t h1 = i0 ^ i1 ^ i2 ^ i0i2 ^ i1i2 ^ i4 ^ i1i4 ^ i0i1i4 ^ i2i4 ^
+                      i1i2i4;
+    *o1 = g1 ^ (i3 & h1);
+    const word_t g0 = i1 ^ i0i2 ^ i0i4;
+    const word_t h0 = ~(i0 ^ i0i1 ^ i4 ^ i1i4 ^ i2i4 ^ i0i2i4);
+    *o0 = g0 ^ (i3 & h0);
+}
+
+CSA_BS_TARGET
+static inline void CSA_BS(Sbox2)(word_t *o1, word_t *o0, word_t i4,
+                                 word_t i3, word_t i2, word_t i1, word_t i0)
+{
+    const word_t i1i2 = i1 & i2;
+    const word_t i1i3 = i1 & i3;
+    const word_t i2i3 = i2 & i3;
+    const word_t i1i4 = i1 & i4;
+    const word_t i2i4 = i2 & i4;
+    const word_t i3i4 = i3 & i4;
+    const word_t i1i2i4 = i1i2 & i4;
+    const word_t i1i3i4 = i1i3 & i4;
+    const word_t i2i3i4 = i2i3 & i4;
+    const word_t g1 = ~(i1 ^ i1i2 ^ i3 ^ i1i2i4 ^ i1i3i4 ^ i2i3i4);
+    const word_t h1 = ~(i2 ^ i1i2 ^ i3i4 ^ i1i3i4);
+    *o1 = g1 ^ (i0 & h1);
+    const word_t g0 = ~(i1 ^ i2 ^ i2i4 ^ i3i4);
+    const word_t h0 = i2 ^ i1i3 ^ i2i3 ^ i1i4 ^ i1i3i4 ^ i2i3i4;
+    *o0 = g0 ^ (i0 & h0);
+}
+
+CSA_BS_TARGET
+static inline void CSA_BS(Sbox3)(word_t *o1, word_t *o0, word_t i4,
+                                 word_t i3, word_t i2, word_t i1, word_t i0)
+{
+    const word_t i0i2 = i0 & i2;
+    const word_t i0i3 = i0 & i3;
+    const word_t i2i3 = i2 & i3;
+    const word_t i0i4 = i0 & i4;
+    const word_t i2i4 = i2 & i4;
+    const word_t i0i2i4 = i0i2 & i4;
+    const word_t i0i3i4 = i0i3 & i4;
+    const word_t i2i3i4 = i2i3 & i4;
+    const word_t g1 = ~(i0 ^ i0i2 ^ i3 ^ i0i3 ^ i2i3 ^ i4 ^ i2i4 ^ i0i2i4 ^
+                        i0i3i4 ^ i2i3i4);
+    const word_t h1 = ~(i2 ^ i0i2 ^ i3 ^ i0i3 ^ i2i3 ^ i4 ^ i0i4 ^ i2i4 ^
+                        i0i2i4 ^ i2i3i4);
+    *o1 = g1 ^ (i1 & h1);
+    const word_t g0 = i0i2 ^ i3 ^ i4;
+    const word_t h0 = ~i0;
+    *o0 = g0 ^ (i1 & h0);
+}
+
+CSA_BS_TARGET
+static inline void CSA_BS(Sbox4)(word_t *o1, word_t *o0, word_t i4,
+                                 word_t i3, word_t i2, word_t i1, word_t i0)
+{
+    const word_t i0i1 = i0 & i1;
+    const word_t i1i2 = i1 & i2;
+    const word_t i0i3 = i0 & i3;
+    const word_t i2i3 = i2 & i3;
+    const word_t i0i1i2 = i0i1 & i2;
+    const word_t i0i1i3 = i0i1 & i3;
+    const word_t i1i2i3 = i1i2 & i3;
+    const word_t g1 = ~(i0 ^ i0i1 ^ i2 ^ i0i1i2 ^ i3 ^ i1i2i3);
+    const word_t h1 = ~(i0 ^ i1 ^ i0i1i2 ^ i3 ^ i0i3 ^ i0i1i3 ^ i2i3 ^ i1i2i3);
+    *o1 = g1 ^ (i4 & h1);
+    const word_t g0 = ~(i1 ^ i0i1 ^ i2 ^ i0i3 ^ i0i1i3 ^ i2i3);
+    const word_t h0 = i0 ^ i1 ^ i0i1i2 ^ i3 ^ i0i3 ^ i0i1i3 ^ i2i3 ^ i1i2i3;
+    *o0 = g0 ^ (i4 & h0);
+}
+
+CSA_BS_TARGET
+static inline void CSA_BS(Sbox5)(word_t *o1, word_t *o0, word_t i4,
+                                 word_t i3, word_t i2, word_t i1, word_t i0)
+{
+    const word_t i0i1 = i0 & i1;
+    const word_t i0i2 = i0 & i2;
+    const word_t i1i2 = i1 & i2;
+    const word_t i0i3 = i0 & i3;
+    const word_t i1i3 = i1 & i3;
+    const word_t i0i1i2 = i0i1 & i2;
+    const word_t i0i1i3 = i0i1 & i3;
+    const word_t i0i2i3 = i0i2 & i3;
+    const word_t i1i2i3 = i1i2 & i3;
+    const word_t g1 = ~(i0 ^ i1 ^ i0i1 ^ i0i2 ^ i1i2 ^ i0i1i2 ^ i3 ^ i0i3 ^
+                        i0i1i3 ^ i0i2i3 ^ i1i2i3);
+    const word_t h1 = i0 ^ i1 ^ i2 ^ i1i2 ^ i0i1i2 ^ i0i3 ^ i1i3 ^ i0i2i3 ^
+                      i1i2i3;
+    *o1 = g1 ^ (i4 & h1);
+    const word_t g0 = i0i1 ^ i2 ^ i0i2 ^ i0i1i2 ^ i0i3 ^ i1i3 ^ i0i2i3;
+    const word_t h0 = i0 ^ i2 ^ i0i2 ^ i1i2 ^ i0i1i2 ^ i3 ^ i0i3 ^ i1i3 ^
+                      i0i1i3;
+    *o0 = g0 ^ (i4 & h0);
+}
+
+CSA_BS_TARGET
+static inline void CSA_BS(Sbox6)(word_t *o1, word_t *o0, word_t i4,
+                                 word_t i3, word_t i2, word_t i1, word_t i0)
+{
+    const word_t i0i1 = i0 & i1;
+    const word_t i0i2 = i0 & i2;
+    const word_t i1i2 = i1 & i2;
+    const word_t i0i4 = i0 & i4;
+    const word_t i0i1i2 = i0i1 & i2;
+    const word_t i0i1i4 = i0i1 & i4;
+    const word_t i1i2i4 = i1i2 & i4;
+    const word_t i0i1i2i4 = i0i1i2 & i4;
+    const word_t g1 = i1 ^ i0i2 ^ i4 ^ i0i1i4;
+    const word_t h1 = i0i1 ^ i2 ^ i0i2 ^ i0i4;
+    *o1 = g1 ^ (i3 & h1);
+    const word_t g0 = i0 ^ i2 ^ i1i2 ^ i0i1i2 ^ i0i1i4 ^ i1i2i4 ^ i0i1i2i4;
+    const word_t h0 = i1 ^ i2 ^ i1i2 ^ i0i1i4 ^ i1i2i4;
+    *o0 = g0 ^ (i3 & h0);
+}
+
+CSA_BS_TARGET
+static inline void CSA_BS(Sbox7)(word_t *o1, word_t *o0, word_t i4,
+                                 word_t i3, word_t i2, word_t i1, word_t i0)
+{
+    const word_t i0i1 = i0 & i1;
+    const word_t i1i2 = i1 & i2;
+    const word_t i1i3 = i1 & i3;
+    const word_t i2i3 = i2 & i3;
+    const word_t i0i1i2 = i0i1 & i2;
+    const word_t i0i1i3 = i0i1 & i3;
+    const word_t i1i2i3 = i1i2 & i3;
+    const word_t g1 = i0 ^ i1 ^ i0i1 ^ i2 ^ i3 ^ i0i1i3;
+    const word_t h1 = i0 ^ i0i1 ^ i2 ^ i1i2 ^ i0i1i2 ^ i0i1i3 ^ i1i2i3;
+    *o1 = g1 ^ (i4 & h1);
+    const word_t g0 = i0 ^ i0i1 ^ i2 ^ i1i2 ^ i0i1i2 ^ i3 ^ i2i3;
+    const word_t h0 = ~(i1i3 ^ i0i1i3);
+    *o0 = g0 ^ (i4 & h0);
+}
+typedef struct
+{
+    word_t a[16][4]; /* A[1..10], as a ring indexed from t */
+    word_t b[16][4]; /* B[1..10] */
+    word_t x[4], y[4], z[4];
+    word_t d[4], e[4], f[4];
+    word_t p, q, r;
+    unsigned t;
+} CSA_BS(state_t);
+
+#define A(k, i) s->a[(s->t + (k)) & 15][i]
+#define B(k, i) s->b[(s->t + (k)) & 15][i]
+
+/* Runs one step, producing 2 bits of key stream (msb in out[1]). During
+ * initialisation, in_a and in_b are the nibbles fed into T1 and T2. */
+CSA_BS_TARGET
+static inline void CSA_BS(Step)(CSA_BS(state_t) *s, const word_t *in_a,
+                                const word_t *in_b, word_t out[2])
+{
+    word_t s1[2], s2[2], s3[2], s4[2], s5[2], s6[2], s7[2];
+
+    CSA_BS(Sbox1)(&s1[1], &s1[0], A(4,0), A(1,2), A(6,1), A(7,3), A(9,0));
+    CSA_BS(Sbox2)(&s2[1], &s2[0], A(2,1), A(3,2), A(6,3), A(7,0), A(9,1));
+    CSA_BS(Sbox3)(&s3[1], &s3[0], A(1,3), A(2,0), A(5,1), A(5,3), A(6,2));
+    CSA_BS(Sbox4)(&s4[1], &s4[0], A(3,3), A(1,1), A(2,3), A(4,2), A(8,0));
+    CSA_BS(Sbox5)(&s5[1], &s5[0], A(5,2), A(4,3), A(6,0), A(8,1), A(9,2));
+    CSA_BS(Sbox6)(&s6[1], &s6[0], A(3,1), A(4,1), A(5,0), A(7,2), A(9,3));
+    CSA_BS(Sbox7)(&s7[1], &s7[0], A(2,2), A(3,0), A(7,1), A(8,2), A(8,3));
+
+    /* 4x4 xor for T3 */
+    const word_t extra_b[4] = {
+        B(9,2) ^ B(6,3) ^ B(3,1) ^ B(8,0),
+        B(5,3) ^ B(8,2) ^ B(4,0) ^ B(5,1),
+        B(6,0) ^ B(8,1) ^ B(3,3) ^ B(4,2),
+        B(3,0) ^ B(6,1) ^ B(7,2) ^ B(9,3),
+    };
+    word_t next_a[4], next_b[4], rot_b[4];
+
+    for (unsigned i = 0; i < 4; i++)
+    {
+        next_a[i] = A(10,i) ^ s->x[i];
+        next_b[i] = B(7,i) ^ B(10,i) ^ s->y[i];
+        if (in_a != NULL)
+        {
+            next_a[i] ^= s->d[i] ^ in_a[i];
+            next_b[i] ^= in_b[i];
+        }
+    }
+    /* T2 is rotated left where p is set */
+    for (unsigned i = 0; i < 4; i++)
+        rot_b[i] = next_b[(i + 3) & 3];
+    for (unsigned i = 0; i < 4; i++)
+        next_b[i] ^= s->p & (next_b[i] ^ rot_b[i]);
+
+    /* T3, and T4: F = Z + E + r where q is set, F = E elsewhere */
+    word_t carry = s->r;
+
+    for (unsigned i = 0; i < 4; i++)
+    {
+        const word_t ze = s->z[i] ^ s->e[i];
+        const word_t sum = ze ^ carry;
+        const word_t next_f = s->e[i] ^ (s->q & (sum ^ s->e[i]));
+
+        carry = (s->z[i] & s->e[i]) | (carry & ze);
+        s->d[i] = ze ^ extra_b[i];
+        s->e[i] = s->f[i];
+        s->f[i] = next_f;
+    }
+    s->r ^= s->q & (carry ^ s->r);
+
+    s->t = (s->t - 1) & 15;
+    for (unsigned i = 0; i < 4; i++)
+    {
+        A(1,i) = next_a[i];
+        B(1,i) = next_b[i];
+    }
+
+    s->x[0] = s1[1]; s->x[1] = s2[1]; s->x[2] = s3[0]; s->x[3] = s4[0];
+    s->y[0] = s3[1]; s->y[1] = s4[1]; s->y[2] = s5[0]; s->y[3] = s6[0];
+    s->z[0] = s5[1]; s->z[1] = s6[1]; s->z[2] = s1[0]; s->z[3] = s2[0];
+    s->p = s7[1];
+    s->q = s7[0];
+
+    out[1] = s->d[3] ^ s->d[2];
+    out[0] = s->d[1] ^ s->d[0];
+}
+
+#undef B
+#undef A
+
+/* Loads a key bit into the lanes, odd has the bits of the odd key lanes */
+CSA_BS_TARGET
+static inline word_t CSA_BS(KeyBit)(word_t odd, uint8_t o_ck, uint8_t e_ck,
+                                    unsigned bit)
+{
+    word_t v = odd ^ odd;
+
+    if ((o_ck >> bit) & 1)
+        v |= odd;
+    if ((e_ck >> bit) & 1)
+        v |= ~odd;
+    return v;
+}
+
+/* Initialises the stream cypher of each lane with its first 8 bytes, then
+ * xors the key stream into its data. */
+CSA_BS_TARGET
+static void CSA_BS(Stream)(const csa_lane_t *lanes, unsigned n,
+                           const uint8_t o_ck[8], const uint8_t e_ck[8])
+{
+    const unsigned groups = (n + 7) / 8;
+    uint8_t planes[8][8][sizeof (word_t)];
+    CSA_BS(state_t) state, *s = &state;
+    word_t odd, in[8][8];
+    unsigned i_max = 0;
+
+    assert(n <= 8 * sizeof (word_t));
+    memset(planes, 0, sizeof (planes));
+    for (unsigned i = 0; i < n; i++)
+    {
+        planes[0][0][i / 8] |= lanes[i].b_odd << (i % 8);
+        if (lanes[i].i_data > i_max)
+            i_max = lanes[i].i_data;
+    }
+    memcpy(&odd, planes[0][0], sizeof (odd));
+
+    /* A[1..8] and B[1..8] are the key nibbles, other registers are 0 */
+    memset(s, 0, sizeof (*s));
+    for (unsigned i = 0; i < 4; i++)
+        for (unsigned j = 0; j < 4; j++)
+        {
+            s->a[1 + 2 * i][j] = CSA_BS(KeyBit)(odd, o_ck[i], e_ck[i], 4 + j);
+            s->a[2 + 2 * i][j] = CSA_BS(KeyBit)(odd, o_ck[i], e_ck[i], j);
+            s->b[1 + 2 * i][j] = CSA_BS(KeyBit)(odd, o_ck[4 + i],
+                                                e_ck[4 + i], 4 + j);
+            s->b[2 + 2 * i][j] = CSA_BS(KeyBit)(odd, o_ck[4 + i],
+                                                e_ck[4 + i], j);
+        }
+
+    /* bit c of byte i of every lane, in[i][c] */
+    for (unsigned m = 0; m < groups; m++)
+        for (unsigned i = 0; i < 8; i++)
+        {
+            uint64_t x = 0;
+
+            for (unsigned k = 0; k < 8 && 8 * m + k < n; k++)
+                x |= (uint64_t)lanes[8 * m + k].p_init[i] << (8 * k);
+            x = csa_Transpose8(x);
+            for (unsigned c = 0; c < 8; c++)
+                planes[i][c][m] = x >> (8 * c);
+        }
+    memcpy(in, planes, sizeof (in));
+
+    for (unsigned i = 0; i < 8; i++)
+    {
+        const word_t *in1 = &in[i][4], *in2 = &in[i][0];
+        word_t out[2];
+
+        for (unsigned j = 0; j < 4; j++)
+            CSA_BS(Step)(s, (j & 1) ? in2 : in1, (j & 1) ? in1 : in2, out);
+    }
+
+    for (unsigned i = 0; i < i_max; i++)
+    {
+        word_t out[8];
+
+        for (unsigned j = 0; j < 4; j++)
+            CSA_BS(Step)(s, NULL, NULL, &out[6 - 2 * j]);
+        memcpy(planes[0], out, sizeof (out));
+
+        for (unsigned m = 0; m < groups; m++)
+        {
+            uint64_t x = 0;
+
+            for (unsigned c = 0; c < 8; c++)
+                x |= (uint64_t)planes[0][c][m] << (8 * c);
+            x = csa_Transpose8(x);
+            for (unsigned k = 0; k < 8 && 8 * m + k < n; k++)
+            {
+                const csa_lane_t *lane = &lanes[8 * m + k];
+
+                if (i < lane->i_data)
+                    lane->p_data[i] ^= x >> (8 * k);
+            }
+        }
+    }
+}
@@ -0,0 +1,199 @@
+/*****************************************************************************
+ * csa_test.c: CSA batch scrambling test and benchmark
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#undef NDEBUG
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vlc_common.h>
+#include <vlc_cpu.h>
+
+#include "csa.h"
+
+#define MAX_PACKETS 600
+
+static const unsigned variants[] = {
+    0,
+#if defined (__i386__) || defined (__x86_64__)
+    VLC_CPU_SSE2,
+    VLC_CPU_AVX2,
+#endif
+};
+
+static void SetKeys(csa_t *c, unsigned seed)
+{
+    char ck[19];
+
+    srand(seed);
+    for (int odd = 0; odd < 2; odd++)
+    {
+        snprintf(ck, sizeof (ck), "0x%08x%08x", (unsigned)rand(),
+                 (unsigned)rand());
+        assert(csa_SetCW(NULL, c, ck, odd) == VLC_SUCCESS);
+    }
+}
+
+/* Random payloads, with or without adaptation field (possibly too long) */
+static void Fill(uint8_t *pkts, size_t count)
+{
+    for (size_t i = 0; i < count * 188; i++)
+        pkts[i] = rand();
+    for (size_t i = 0; i < count; i++)
+    {
+        uint8_t *p = &pkts[188 * i];
+
+        p[0] = 0x47;
+        p[3] = (p[3] & 0xef) | 0x10;
+        if (p[3] & 0x20)
+            p[4] %= (rand() % 8) ? 184 : 256;
+    }
+}
+
+static void test(unsigned cpu, size_t count, int size, bool odd)
+{
+    uint8_t *ref = malloc(count * 188), *pkts = malloc(count * 188);
+    uint8_t *pp_pkts[MAX_PACKETS];
+    csa_t *c = csa_NewCPU(cpu);
+    assert(ref != NULL && pkts != NULL && c != NULL);
+
+    unsigned seed = rand();
+    SetKeys(c, seed);
+    csa_UseKey(NULL, c, odd);
+    srand(seed);
+
+    Fill(pkts, count);
+    memcpy(ref, pkts, count * 188);
+    for (size_t i = 0; i < count; i++)
+    {
+        csa_Encrypt(c, &ref[188 * i], size);
+        pp_pkts[i] = &pkts[188 * i];
+    }
+    csa_EncryptBatch(c, pp_pkts, count, size);
+    if (memcmp(ref, pkts, count * 188))
+    {
+        fprintf(stderr, "%s encryption mismatch (%zu packets of %d)\n",
+                csa_GetName(c), count, size);
+        abort();
+    }
+
+    /* decrypt a mix of odd, even and clear packets */
+    Fill(pkts, count);
+    for (size_t i = 0; i < count; i++)
+        pkts[188 * i + 3] = (pkts[188 * i + 3] & 0x3f) | ((rand() % 3) << 6);
+    memcpy(ref, pkts, count * 188);
+    for (size_t i = 0; i < count; i++)
+        csa_Decrypt(c, &ref[188 * i], size);
+    csa_DecryptBatch(c, pp_pkts, count, size);
+    if (memcmp(ref, pkts, count * 188))
+    {
+        fprintf(stderr, "%s decryption mismatch (%zu packets of %d)\n",
+                csa_GetName(c), count, size);
+        abort();
+    }
+
+    csa_Delete(c);
+    free(pkts);
+    free(ref);
+}
+
+static void bench(csa_t *c, bool batch, bool encrypt, unsigned loops)
+{
+    uint8_t *pkts = malloc(MAX_PACKETS * 188);
+    uint8_t *pp_pkts[MAX_PACKETS];
+    assert(pkts != NULL);
+
+    for (size_t i = 0; i < MAX_PACKETS * 188; i++)
+        pkts[i] = rand();
+    for (size_t i = 0; i < MAX_PACKETS; i++)
+    {
+        pp_pkts[i] = &pkts[188 * i];
+        pp_pkts[i][0] = 0x47;
+        pp_pkts[i][3] = 0x10;
+    }
+
+    mtime_t start = mdate();
+    for (unsigned i = 0; i < loops; i++)
+    {
+        /* decryption clears the scrambling control bits */
+        for (size_t j = 0; !encrypt && j < MAX_PACKETS; j++)
+            pp_pkts[j][3] = 0x90;
+
+        if (batch && encrypt)
+            csa_EncryptBatch(c, pp_pkts, MAX_PACKETS, 188);
+        else if (batch)
+            csa_DecryptBatch(c, pp_pkts, MAX_PACKETS, 188);
+        else
+            for (size_t j = 0; j < MAX_PACKETS; j++)
+                (encrypt ? csa_Encrypt : csa_Decrypt)(c, pp_pkts[j], 188);
+    }
+    mtime_t spent = mdate() - start;
+
+    printf("%-6s %s %8.1f Mbit/s\n", batch ? csa_GetName(c) : "scalar",
+           encrypt ? "encrypt" : "decrypt",
+           (double)loops * MAX_PACKETS * 188 * 8 / (spent ? spent : 1));
+    free(pkts);
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned cpu = vlc_CPU();
+    unsigned loops = (argc > 1) ? strtoul(argv[1], NULL, 0) : 20;
+
+    srand(0);
+    for (size_t i = 0; i < ARRAY_SIZE(variants); i++)
+    {
+        if (variants[i] & ~cpu)
+            continue;
+
+        for (unsigned k = 0; k < 200; k++)
+        {
+            size_t count = 1 + rand() % MAX_PACKETS;
+            int size = (rand() % 4) ? 188 : 4 + rand() % 185;
+
+            test(variants[i], count, size, rand() & 1);
+        }
+    }
+
+    /* a single core, whole packets */
+    csa_t *c = csa_New();
+    assert(c != NULL);
+    SetKeys(c, 0);
+    for (int encrypt = 0; encrypt < 2; encrypt++)
+    {
+        bench(c, false, encrypt, __MAX(loops / 10, 1));
+        for (size_t i = 0; i < ARRAY_SIZE(variants); i++)
+            if (!(variants[i] & ~cpu))
+            {
+                csa_t *v = csa_NewCPU(variants[i]);
+                assert(v != NULL);
+                SetKeys(v, 0);
+                bench(v, true, encrypt, loops);
+                csa_Delete(v);
+            }
+    }
+    csa_Delete(c);
+    return 0;
+}
@@ -0,0 +1,218 @@
+/*****************************************************************************
+ * scte35.c: SCTE-104 to SCTE-35 conversion
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <vlc_common.h>
+#include <vlc_block.h>
+
+#include "scte35.h"
+
+/* SCTE-104 operations */
+#define OP_SPLICE_REQUEST       0x0101
+#define OP_SPLICE_NULL          0x0102
+
+/* SCTE-104 splice_insert_type */
+#define SPLICE_START_NORMAL     1
+#define SPLICE_START_IMMEDIATE  2
+#define SPLICE_END_NORMAL       3
+#define SPLICE_END_IMMEDIATE    4
+#define SPLICE_CANCEL           5
+
+/* SCTE-35 splice_command_type */
+#define CMD_SPLICE_NULL         0x00
+#define CMD_SPLICE_INSERT       0x05
+
+static uint32_t Crc32( const uint8_t *p, size_t i_size )
+{
+    uint32_t i_crc = 0xffffffff;
+
+    while( i_size-- > 0 )
+    {
+        i_crc ^= (uint32_t)*(p++) << 24;
+        for( unsigned i = 0; i < 8; i++ )
+            i_crc = (i_crc << 1) ^ ((i_crc & 0x80000000) ? 0x04c11db7 : 0);
+    }
+    return i_crc;
+}
+
+static void Write33( uint8_t *p, uint8_t i_flags, uint64_t i_value )
+{
+    p[0] = i_flags | 0x7e | ((i_value >> 32) & 0x01);
+    SetDWBE( &p[1], i_value );
+}
+
+/* Wraps a splice command into a splice_info_section, after a pointer_field */
+static block_t *Section( uint8_t i_type, const uint8_t *p_cmd, size_t i_cmd )
+{
+    const size_t i_section = 14 + i_cmd + 2 + 4;
+    block_t *p_block = block_Alloc( 1 + i_section );
+    if( unlikely(p_block == NULL) )
+        return NULL;
+
+    uint8_t *p = p_block->p_buffer;
+    *(p++) = 0x00; /* pointer_field */
+
+    p[0] = 0xfc; /* table_id */
+    /* no section syntax, not private, SAP type not specified */
+    p[1] = 0x30 | ((i_section - 3) >> 8);
+    p[2] = i_section - 3;
+    p[3] = 0x00; /* protocol_version */
+    memset( &p[4], 0, 5 ); /* not encrypted, no pts_adjustment */
+    p[9] = 0x00; /* cw_index */
+    p[10] = 0xff; /* tier 0xfff, then splice_command_length */
+    p[11] = 0xf0 | (i_cmd >> 8);
+    p[12] = i_cmd;
+    p[13] = i_type;
+    if( i_cmd > 0 )
+        memcpy( &p[14], p_cmd, i_cmd );
+    SetWBE( &p[14 + i_cmd], 0 ); /* descriptor_loop_length */
+    SetDWBE( &p[i_section - 4], Crc32( p, i_section - 4 ) );
+    return p_block;
+}
+
+static block_t *SpliceInsert( vlc_object_t *p_obj, const uint8_t *p,
+                              mtime_t i_date, mtime_t ts_offset )
+{
+    const uint8_t i_insert_type = p[0];
+    const uint32_t i_event_id = GetDWBE( &p[1] );
+    const uint16_t i_program_id = GetWBE( &p[5] );
+    const uint16_t i_pre_roll = GetWBE( &p[7] );      /* ms */
+    const uint16_t i_break = GetWBE( &p[9] );         /* 1/10 s */
+    uint8_t cmd[20];
+    size_t i_cmd = 0;
+
+    SetDWBE( &cmd[0], i_event_id );
+    i_cmd = 4;
+
+    if( i_insert_type == SPLICE_CANCEL )
+    {
+        cmd[i_cmd++] = 0xff;
+        return Section( CMD_SPLICE_INSERT, cmd, i_cmd );
+    }
+    if( i_insert_type < SPLICE_START_NORMAL || i_insert_type > SPLICE_END_IMMEDIATE )
+    {
+        msg_Warn( p_obj, "unknown SCTE-104 splice_insert_type %u", i_insert_type );
+        return NULL;
+    }
+
+    const bool b_out = i_insert_type == SPLICE_START_NORMAL ||
+                       i_insert_type == SPLICE_START_IMMEDIATE;
+    const bool b_immediate = i_insert_type == SPLICE_START_IMMEDIATE ||
+                             i_insert_type == SPLICE_END_IMMEDIATE;
+    const bool b_duration = b_out && i_break > 0;
+
+    cmd[i_cmd++] = 0x7f; /* not cancelled */
+    cmd[i_cmd++] = (b_out ? 0x80 : 0) | 0x40 /* program splice */
+                 | (b_duration ? 0x20 : 0) | (b_immediate ? 0x10 : 0) | 0x0f;
+    if( !b_immediate )
+    {
+        mtime_t i_pts = (i_date + i_pre_roll * INT64_C(1000) - ts_offset)
+                      * 9 / 100;
+        Write33( &cmd[i_cmd], 0x80 /* time_specified */, i_pts );
+        i_cmd += 5;
+    }
+    if( b_duration )
+    {
+        const bool b_auto_return = p[13];
+        Write33( &cmd[i_cmd], b_auto_return ? 0x80 : 0, i_break * 9000 );
+        i_cmd += 5;
+    }
+    SetWBE( &cmd[i_cmd], i_program_id );
+    cmd[i_cmd + 2] = p[11]; /* avail_num */
+    cmd[i_cmd + 3] = p[12]; /* avails_expected */
+    i_cmd += 4;
+
+    return Section( CMD_SPLICE_INSERT, cmd, i_cmd );
+}
+
+block_t *SCTE104ToSCTE35( vlc_object_t *p_obj, block_t *p_msg,
+                          mtime_t ts_offset )
+{
+    const uint8_t *p = p_msg->p_buffer;
+    size_t i_size = p_msg->i_buffer;
+    block_t *p_chain = NULL;
+
+    /* only multiple_operation_message carries splices */
+    if( i_size < 11 || GetWBE( p ) != 0xffff )
+        goto out;
+    if( GetWBE( &p[2] ) < i_size )
+        i_size = GetWBE( &p[2] );
+
+    /* timestamp(), after the fixed header */
+    size_t i_offset = 10;
+    if( i_offset >= i_size )
+        goto out;
+    switch( p[i_offset] )
+    {
+    case 0: i_offset += 1; break;
+    case 1: i_offset += 7; break;
+    case 2: i_offset += 5; break;
+    case 3: i_offset += 3; break;
+    default:
+        msg_Warn( p_obj, "unknown SCTE-104 time_type %u", p[i_offset] );
+        goto out;
+    }
+    if( i_offset >= i_size )
+        goto out;
+
+    unsigned i_ops = p[i_offset++];
+    for( unsigned i = 0; i < i_ops && i_offset + 4 <= i_size; i++ )
+    {
+        const uint16_t i_op = GetWBE( &p[i_offset] );
+        const size_t i_length = GetWBE( &p[i_offset + 2] );
+        const uint8_t *p_data = &p[i_offset + 4];
+
+        i_offset += 4 + i_length;
+        if( i_offset > i_size )
+            break;
+
+        block_t *p_section = NULL;
+        switch( i_op )
+        {
+        case OP_SPLICE_REQUEST:
+            if( i_length >= 14 )
+                p_section = SpliceInsert( p_obj, p_data, p_msg->i_pts,
+                                          ts_offset );
+            break;
+        case OP_SPLICE_NULL:
+            p_section = Section( CMD_SPLICE_NULL, NULL, 0 );
+            break;
+        default:
+            msg_Dbg( p_obj, "ignoring SCTE-104 operation 0x%04x", i_op );
+            break;
+        }
+        if( p_section )
+            block_ChainAppend( &p_chain, p_section );
+    }
+
+    if( p_chain )
+    {
+        p_chain->i_dts = p_msg->i_dts;
+        p_chain->i_pts = p_msg->i_pts;
+        p_chain->i_length = p_msg->i_length;
+        for( block_t *p_next = p_chain->p_next; p_next; p_next = p_next->p_next )
+            p_next->i_dts = p_next->i_pts = p_next->i_length = 0;
+    }
+out:
+    block_Release( p_msg );
+    return p_chain;
+}
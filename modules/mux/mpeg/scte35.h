@@ -0,0 +1,35 @@
+/*****************************************************************************
+ * scte35.h: SCTE-104 to SCTE-35 conversion
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+#ifndef _SCTE35_H
+#define _SCTE35_H 1
+
+#define SCTE35_STREAM_TYPE 0x86
+
+/* Converts the splice_request and splice_null operations of a SCTE-104
+ * multiple_operation_message into SCTE-35 splice_info_sections, each in a
+ * block starting with a pointer_field, ready to be split into TS packets.
+ * Splice times are the message date plus the pre-roll, on the 90 kHz PES
+ * time base starting at ts_offset.
+ * Returns the chain of sections, or NULL if there is none. The message is
+ * released in any case. */
+block_t *SCTE104ToSCTE35( vlc_object_t *p_obj, block_t *p_msg,
+                          mtime_t ts_offset );
+
+#endif
@@ -0,0 +1,162 @@
+/*****************************************************************************
+ * scte35_test.c: SCTE-104 to SCTE-35 conversion test
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#undef NDEBUG
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vlc_common.h>
+#include <vlc_block.h>
+
+#include "scte35.h"
+
+#define OFFSET INT64_C(10000000)
+
+/* multiple_operation_message, with a VITC timestamp */
+static block_t *Message( const uint8_t *p_ops, size_t i_ops_size,
+                         unsigned i_ops, mtime_t i_date )
+{
+    static const uint8_t header[] = {
+        0xff, 0xff, 0x00, 0x00, /* reserved, messageSize */
+        0x00, 0x00, 0x01,       /* protocol_version, AS_index, number */
+        0x00, 0x00, 0x00,       /* DPI_PID_index, SCTE35_protocol_version */
+        0x02, 0x01, 0x02, 0x03, 0x04, /* VITC */
+    };
+    block_t *p_msg = block_Alloc( sizeof (header) + 1 + i_ops_size );
+    assert( p_msg != NULL );
+
+    memcpy( p_msg->p_buffer, header, sizeof (header) );
+    SetWBE( &p_msg->p_buffer[2], p_msg->i_buffer );
+    p_msg->p_buffer[sizeof (header)] = i_ops;
+    memcpy( &p_msg->p_buffer[sizeof (header) + 1], p_ops, i_ops_size );
+    p_msg->i_pts = p_msg->i_dts = i_date;
+    return p_msg;
+}
+
+static uint32_t Crc32( const uint8_t *p, size_t i_size )
+{
+    uint32_t i_crc = 0xffffffff;
+
+    while( i_size-- > 0 )
+    {
+        i_crc ^= (uint32_t)*(p++) << 24;
+        for( unsigned i = 0; i < 8; i++ )
+            i_crc = (i_crc << 1) ^ ((i_crc & 0x80000000) ? 0x04c11db7 : 0);
+    }
+    return i_crc;
+}
+
+/* Checks the section around the command, and returns the command */
+static const uint8_t *Command( const block_t *p_block, uint8_t i_type,
+                               size_t i_cmd )
+{
+    const uint8_t *p = p_block->p_buffer;
+
+    assert( p[0] == 0x00 ); /* pointer_field */
+    p++;
+    size_t i_section = 3 + (((p[1] & 0x0f) << 8) | p[2]);
+    assert( p_block->i_buffer == 1 + i_section );
+    assert( p[0] == 0xfc && (p[1] & 0xf0) == 0x30 );
+    assert( p[3] == 0 && p[4] == 0 && GetDWBE( &p[5] ) == 0 );
+    assert( p[10] == 0xff && (p[11] & 0xf0) == 0xf0 );
+    assert( (((p[11] & 0x0f) << 8) | p[12]) == i_cmd );
+    assert( p[13] == i_type );
+    assert( GetWBE( &p[14 + i_cmd] ) == 0 );
+    assert( i_section == 14 + i_cmd + 2 + 4 );
+    assert( Crc32( p, i_section ) == 0 );
+    return &p[14];
+}
+
+static uint64_t Read33( const uint8_t *p )
+{
+    return ((uint64_t)(p[0] & 0x01) << 32) | GetDWBE( &p[1] );
+}
+
+int main( void )
+{
+    const mtime_t i_date = OFFSET + 2 * CLOCK_FREQ;
+
+    /* splice out in 4 s for 30 s, then splice_null */
+    static const uint8_t out_ops[] = {
+        0x01, 0x01, 0x00, 0x0e,
+        0x01, 0x12, 0x34, 0x56, 0x78, 0x00, 0x2a,
+        0x0f, 0xa0, 0x01, 0x2c, 0x01, 0x02, 0x01,
+        0x01, 0x02, 0x00, 0x00,
+    };
+    block_t *p_chain = SCTE104ToSCTE35( NULL,
+        Message( out_ops, sizeof (out_ops), 2, i_date ), OFFSET );
+    assert( p_chain != NULL && p_chain->p_next != NULL );
+    assert( p_chain->p_next->p_next == NULL );
+    assert( p_chain->i_dts == i_date );
+
+    const uint8_t *p = Command( p_chain, 0x05, 20 );
+    assert( GetDWBE( &p[0] ) == 0x12345678 );
+    assert( p[4] == 0x7f );
+    assert( p[5] == 0xef ); /* out of network, program, duration, not now */
+    assert( (p[6] & 0xfe) == 0xfe );
+    assert( Read33( &p[6] ) == 6 * 90000 );
+    assert( (p[11] & 0xfe) == 0xfe );
+    assert( Read33( &p[11] ) == 30 * 90000 );
+    assert( GetWBE( &p[16] ) == 0x002a );
+    assert( p[18] == 0x01 && p[19] == 0x02 );
+
+    Command( p_chain->p_next, 0x00, 0 );
+    block_ChainRelease( p_chain );
+
+    /* immediate return, and cancel */
+    static const uint8_t in_ops[] = {
+        0x01, 0x01, 0x00, 0x0e,
+        0x04, 0x00, 0x00, 0x00, 0x07, 0x00, 0x2a,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x01, 0x01, 0x00, 0x0e,
+        0x05, 0x00, 0x00, 0x00, 0x08, 0x00, 0x2a,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    };
+    p_chain = SCTE104ToSCTE35( NULL,
+        Message( in_ops, sizeof (in_ops), 2, i_date ), OFFSET );
+    assert( p_chain != NULL && p_chain->p_next != NULL );
+
+    p = Command( p_chain, 0x05, 10 );
+    assert( GetDWBE( &p[0] ) == 7 && p[4] == 0x7f );
+    assert( p[5] == 0x5f ); /* in network, program, immediate */
+    assert( GetWBE( &p[6] ) == 0x002a );
+
+    p = Command( p_chain->p_next, 0x05, 5 );
+    assert( GetDWBE( &p[0] ) == 8 && p[4] == 0xff );
+    block_ChainRelease( p_chain );
+
+    /* truncated operation, and single_operation_message */
+    p_chain = SCTE104ToSCTE35( NULL,
+        Message( out_ops, 10, 1, i_date ), OFFSET );
+    assert( p_chain == NULL );
+
+    block_t *p_single = Message( out_ops, sizeof (out_ops), 2, i_date );
+    p_single->p_buffer[0] = 0x00;
+    p_single->p_buffer[1] = 0x01;
+    assert( SCTE104ToSCTE35( NULL, p_single, OFFSET ) == NULL );
+
+    return 0;
+}
@@ -394,6 +394,17 @@ void BuildPMT( dvbpsi_t *p_dvbpsi, vlc_object_t *p_object,
             /* "registration" descriptor : "Opus" */
             dvbpsi_pmt_es_descriptor_add( p_es, 0x05, 4, format );
         }
+        else if( p_stream->pes->i_codec == VLC_CODEC_SCTE_104 )
+        {
+            /* SCTE 35: "CUEI" registration on the program, and the
+             * commands the stream may carry */
+            uint8_t format[4] = { 'C', 'U', 'E', 'I' };
+            dvbpsi_pmt_descriptor_add( &dvbpmt[p_stream->i_mapped_prog],
+                                       0x05, 4, format );
+            uint8_t data[1] = { 0x00 }; /* splice_insert, null, schedule */
+            dvbpsi_pmt_es_descriptor_add( p_es, 0x8a, 1, data );
+            continue;
+        }
         else if( p_stream->pes->i_codec == VLC_CODEC_TELETEXT )
         {
             if( p_stream->pes->i_extra )
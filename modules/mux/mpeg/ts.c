@@ -47,6 +47,7 @@
 #include "csa.h"
 #include "tsutil.h"
 #include "streams.h"
+#include "scte35.h"
 
 # include <dvbpsi/dvbpsi.h>
 # include <dvbpsi/demux.h>
@@ -238,6 +239,10 @@ static const char *const ppsz_sout_options[] = {
     NULL
 };
 
+/* Low latency: each frame is muxed on its own and sent right away */
+#define LOW_LATENCY_SHAPING     1000
+#define LOW_LATENCY_DTS_DELAY   40000
+
 typedef struct pmt_map_t   /* Holds the mapping between the pmt-pid/pmt table */
 {
     int i_pid;
@@ -316,6 +321,7 @@ typedef struct
     int                 i_pes_used;
     bool                b_key_frame;
 
+    ts_packetizer_t     packetizer;
 } pes_state_t;
 
 typedef struct
@@ -364,9 +370,14 @@ struct sout_mux_sys_t
     mtime_t         first_dts;
 
     bool            b_use_key_frames;
+    bool            b_low_latency;
 
     mtime_t         i_pcr;  /* last PCR emited */
 
+    sout_lag_t      lag_in;
+    sout_lag_t      lag_out;
+    mtime_t         i_lag_report;
+
     csa_t           *csa;
     int             i_csa_pkt_size;
     bool            b_crypt_audio;
@@ -715,6 +726,13 @@ static int Open( vlc_object_t *p_this )
     var_Get( p_mux, SOUT_CFG_PREFIX "dts-delay", &val );
     p_sys->i_dts_delay = val.i_int * 1000;
 
+    p_sys->b_low_latency = var_InheritBool( p_mux, "sout-low-latency" );
+    if( p_sys->b_low_latency )
+    {
+        p_sys->i_shaping_delay = LOW_LATENCY_SHAPING;
+        p_sys->i_dts_delay = __MIN( p_sys->i_dts_delay, LOW_LATENCY_DTS_DELAY );
+    }
+
     msg_Dbg( p_mux, "shaping=%"PRId64" pcr=%"PRId64" dts_delay=%"PRId64,
              p_sys->i_shaping_delay, p_sys->i_pcr_delay, p_sys->i_dts_delay );
 
@@ -988,6 +1006,14 @@ static int AddStream( sout_mux_t *p_mux, sout_input_t *p_input )
         p_stream->pes.i_stream_type = 0x06;
         p_stream->pes.i_stream_id = 0xbd; /* FIXME */
         break;
+
+    /* DATA */
+
+    case VLC_CODEC_SCTE_104:
+        /* sent as SCTE-35 sections, not PES */
+        p_stream->pes.i_stream_type = SCTE35_STREAM_TYPE;
+        p_stream->pes.i_stream_id = 0xbd;
+        break;
     }
 
     if (p_stream->pes.i_stream_type == -1)
@@ -1087,6 +1113,7 @@ static int AddStream( sout_mux_t *p_mux, sout_input_t *p_input )
 
     /* Init pes chain */
     BufferChainInit( &p_stream->state.chain_pes );
+    TSPacketizerInit( &p_stream->state.packetizer, p_stream->ts.i_pid );
 
     /* We only change PMT version (PAT isn't changed) */
     p_sys->i_pmt_version_number = ( p_sys->i_pmt_version_number + 1 )%32;
@@ -1165,6 +1192,7 @@ static void DelStream( sout_mux_t *p_mux, sout_input_t *p_input )
 
     /* Empty all data in chain_pes */
     BufferChainClean( &p_stream->state.chain_pes );
+    TSPacketizerClean( &p_stream->state.packetizer );
 
     free(p_stream->pes.lang);
     free( p_stream->pes.p_extra );
@@ -1261,13 +1289,16 @@ static bool MuxStreams(sout_mux_t *p_mux )
             continue;
 
         /* Need more data */
-        if( block_FifoCount( p_input->p_fifo ) <= 1 )
+        size_t i_queued = block_FifoCount( p_input->p_fifo );
+        if( i_queued <= 1 )
         {
             if( ( p_input->p_fmt->i_cat == AUDIO_ES ) ||
                 ( p_input->p_fmt->i_cat == VIDEO_ES ) )
             {
-                /* We need more data */
-                return true;
+                /* We need more data; the next block gives the length of
+                 * this one, unless we trust the encoder for low latency */
+                if( i_queued == 0 || !p_sys->b_low_latency )
+                    return true;
             }
             else if( block_FifoCount( p_input->p_fifo ) <= 0 )
             {
@@ -1320,10 +1351,13 @@ static bool MuxStreams(sout_mux_t *p_mux )
             block_t *p_next = block_FifoShow( p_input->p_fifo );
             p_data->i_length = p_next->i_dts - p_data->i_dts;
         }
-        else if( p_input->p_fmt->i_codec !=
-                   VLC_CODEC_SUBT )
+        else if( p_input->p_fmt->i_codec != VLC_CODEC_SUBT &&
+                 ( !p_sys->b_low_latency || p_data->i_length <= 0 ) )
             p_data->i_length = 1000;
 
+        if( p_sys->b_low_latency )
+            sout_LagAdd( &p_sys->lag_in, p_data->i_dts, mdate() );
+
         if (p_sys->first_dts == 0)
             p_sys->first_dts = p_data->i_dts;
 
@@ -1358,6 +1392,14 @@ static bool MuxStreams(sout_mux_t *p_mux )
             continue;
         }
 
+        if( p_input->p_fmt->i_codec == VLC_CODEC_SCTE_104 )
+        {
+            p_data = SCTE104ToSCTE35( VLC_OBJECT(p_mux), p_data,
+                                      p_sys->first_dts );
+            if( p_data == NULL )
+                continue;
+        }
+
         int i_header_size = 0;
         int i_max_pes_size = 0;
         int b_data_alignment = 0;
@@ -1433,9 +1475,10 @@ static bool MuxStreams(sout_mux_t *p_mux )
             i_max_pes_size = INT_MAX;
         }
 
-        EStoPES ( &p_data, p_input->p_fmt, p_stream->pes.i_stream_id,
-                       1, b_data_alignment, i_header_size,
-                       i_max_pes_size, p_sys->first_dts );
+        if( p_input->p_fmt->i_codec != VLC_CODEC_SCTE_104 )
+            EStoPES ( &p_data, p_input->p_fmt, p_stream->pes.i_stream_id,
+                           1, b_data_alignment, i_header_size,
+                           i_max_pes_size, p_sys->first_dts );
 
         BufferChainAppend( &p_stream->state.chain_pes, p_data );
 
@@ -1537,6 +1580,7 @@ static bool MuxStreams(sout_mux_t *p_mux )
         /* Build the TS packet */
         block_t *p_ts = TSNew( p_mux, p_stream, b_pcr );
         if( p_sys->csa != NULL &&
+             p_input->p_fmt->i_codec != VLC_CODEC_SCTE_104 && /* sections */
              (p_input->p_fmt->i_cat != AUDIO_ES || p_sys->b_crypt_audio) &&
              (p_input->p_fmt->i_cat != VIDEO_ES || p_sys->b_crypt_video) )
         {
@@ -1755,6 +1799,55 @@ static void TSSchedule( sout_mux_t *p_mux, sout_buffer_chain_t *p_chain_ts,
         TSDate( p_mux, &new_chain, i_pcr_length, i_pcr_dts );
 }
 
+/* Scrambles the flagged packets of the chain, in batches */
+static void TSScramble( sout_mux_t *p_mux, sout_buffer_chain_t *p_chain_ts )
+{
+    sout_mux_sys_t *p_sys = p_mux->p_sys;
+    uint8_t *pp_pkts[256];
+    size_t i_pkts = 0;
+
+    vlc_mutex_lock( &p_sys->csa_lock );
+    for( block_t *p_ts = p_chain_ts->p_first; p_ts; p_ts = p_ts->p_next )
+    {
+        if( !(p_ts->i_flags & BLOCK_FLAG_SCRAMBLED) )
+            continue;
+
+        pp_pkts[i_pkts++] = p_ts->p_buffer;
+        if( i_pkts == ARRAY_SIZE(pp_pkts) )
+        {
+            csa_EncryptBatch( p_sys->csa, pp_pkts, i_pkts,
+                              p_sys->i_csa_pkt_size );
+            i_pkts = 0;
+        }
+    }
+    if( i_pkts > 0 )
+        csa_EncryptBatch( p_sys->csa, pp_pkts, i_pkts, p_sys->i_csa_pkt_size );
+    vlc_mutex_unlock( &p_sys->csa_lock );
+}
+
+/* Reports how far behind the input clock the data comes in and goes out */
+static void LagReport( sout_mux_t *p_mux, mtime_t i_now )
+{
+    sout_mux_sys_t *p_sys = p_mux->p_sys;
+    const sout_lag_t *p_in = &p_sys->lag_in, *p_out = &p_sys->lag_out;
+
+    if( i_now < p_sys->i_lag_report )
+        return;
+
+    if( p_in->i_count > 0 && p_out->i_count > 0 )
+    {
+        mtime_t i_in = sout_LagAverage( p_in );
+        mtime_t i_out = sout_LagAverage( p_out );
+
+        msg_Info( p_mux, "latency: in %"PRId64" ms, out %"PRId64" ms "
+                  "(max %"PRId64" ms), muxing %"PRId64" ms", i_in / 1000,
+                  i_out / 1000, p_out->i_max / 1000, ( i_out - i_in ) / 1000 );
+    }
+    sout_LagReset( &p_sys->lag_in );
+    sout_LagReset( &p_sys->lag_out );
+    p_sys->i_lag_report = i_now + SOUT_LAG_REPORT_PERIOD;
+}
+
 static void TSDate( sout_mux_t *p_mux, sout_buffer_chain_t *p_chain_ts,
                     mtime_t i_pcr_length, mtime_t i_pcr_dts )
 {
@@ -1780,12 +1873,25 @@ static void TSDate( sout_mux_t *p_mux, sout_buffer_chain_t *p_chain_ts,
         i_pcr_length = i_packet_count;
     }
 
+    if( p_sys->csa )
+        TSScramble( p_mux, p_chain_ts );
+
+    const mtime_t i_now = p_sys->b_low_latency ? mdate() : 0;
+
     /* msg_Dbg( p_mux, "real pck=%d", i_packet_count ); */
     for (int i = 0; i < i_packet_count; i++ )
     {
         block_t *p_ts = BufferChainGet( p_chain_ts );
         mtime_t i_new_dts = i_pcr_dts + i_pcr_length * i / i_packet_count;
 
+        if( p_sys->b_low_latency )
+        {
+            /* The date of the data, rather than the sending one, is kept
+             * for the latency statistics of the access output */
+            p_ts->i_pts = p_ts->i_dts;
+            sout_LagAdd( &p_sys->lag_out, p_ts->i_dts, i_now );
+        }
+
         p_ts->i_dts    = i_new_dts;
         p_ts->i_length = i_pcr_length / i_packet_count;
 
@@ -1794,18 +1900,15 @@ static void TSDate( sout_mux_t *p_mux, sout_buffer_chain_t *p_chain_ts,
             /* msg_Dbg( p_mux, "pcr=%lld ms", p_ts->i_dts / 1000 ); */
             TSSetPCR( p_ts, p_ts->i_dts - p_sys->i_dts_delay - p_sys->first_dts );
         }
-        if( p_ts->i_flags & BLOCK_FLAG_SCRAMBLED )
-        {
-            vlc_mutex_lock( &p_sys->csa_lock );
-            csa_Encrypt( p_sys->csa, p_ts->p_buffer, p_sys->i_csa_pkt_size );
-            vlc_mutex_unlock( &p_sys->csa_lock );
-        }
 
         /* latency */
         p_ts->i_dts += p_sys->i_shaping_delay * 3 / 2;
 
         sout_AccessOutWrite( p_mux->p_access, p_ts );
     }
+
+    if( p_sys->b_low_latency )
+        LagReport( p_mux, i_now );
 }
 
 static block_t *TSNew( sout_mux_t *p_mux, sout_input_sys_t *p_stream,
@@ -1814,24 +1917,14 @@ static block_t *TSNew( sout_mux_t *p_mux, sout_input_sys_t *p_stream,
     VLC_UNUSED(p_mux);
     block_t *p_pes = p_stream->state.chain_pes.p_first;
 
-    bool b_new_pes = false;
-    bool b_adaptation_field = false;
-
-    int i_payload_max = 184 - ( b_pcr ? 8 : 0 );
-
-    if( p_stream->state.i_pes_used <= 0 )
-    {
-        b_new_pes = true;
-    }
+    bool b_new_pes = p_stream->state.i_pes_used <= 0;
     int i_payload = __MIN( (int)p_pes->i_buffer - p_stream->state.i_pes_used,
-                       i_payload_max );
-
-    if( b_pcr || i_payload < i_payload_max )
-    {
-        b_adaptation_field = true;
-    }
+                           184 - ( b_pcr ? 8 : 0 ) );
 
-    block_t *p_ts = block_Alloc( 188 );
+    block_t *p_ts = TSPacketizerNext( &p_stream->state.packetizer,
+                        &p_pes->p_buffer[p_stream->state.i_pes_used],
+                        p_pes->i_buffer - p_stream->state.i_pes_used,
+                        b_new_pes, b_pcr, &p_stream->ts.i_continuity_counter );
 
     if (b_new_pes && !(p_pes->i_flags & BLOCK_FLAG_NO_KEYFRAME) && p_pes->i_flags & BLOCK_FLAG_TYPE_I)
     {
@@ -1840,47 +1933,18 @@ static block_t *TSNew( sout_mux_t *p_mux, sout_input_sys_t *p_stream,
 
     p_ts->i_dts = p_pes->i_dts;
 
-    p_ts->p_buffer[0] = 0x47;
-    p_ts->p_buffer[1] = ( b_new_pes ? 0x40 : 0x00 ) |
-        ( ( p_stream->ts.i_pid >> 8 )&0x1f );
-    p_ts->p_buffer[2] = p_stream->ts.i_pid & 0xff;
-    p_ts->p_buffer[3] = ( b_adaptation_field ? 0x30 : 0x10 ) |
-        p_stream->ts.i_continuity_counter;
-
-    p_stream->ts.i_continuity_counter = (p_stream->ts.i_continuity_counter+1)%16;
     p_stream->ts.b_discontinuity = p_pes->i_flags & BLOCK_FLAG_DISCONTINUITY;
 
-    if( b_adaptation_field )
+    if( b_pcr )
     {
-        int i_stuffing = i_payload_max - i_payload;
-        if( b_pcr )
+        p_ts->i_flags |= BLOCK_FLAG_CLOCK;
+        if( p_stream->ts.b_discontinuity )
         {
-            p_ts->i_flags |= BLOCK_FLAG_CLOCK;
-
-            p_ts->p_buffer[4] = 7 + i_stuffing;
-            p_ts->p_buffer[5] = 1 << 4; /* PCR_flag */
-            if( p_stream->ts.b_discontinuity )
-            {
-                p_ts->p_buffer[5] |= 0x80; /* flag TS dicontinuity */
-                p_stream->ts.b_discontinuity = false;
-            }
-            memset(&p_ts->p_buffer[12], 0xff, i_stuffing);
-        }
-        else
-        {
-            p_ts->p_buffer[4] = --i_stuffing;
-            if( i_stuffing-- )
-            {
-                p_ts->p_buffer[5] = 0;
-                memset(&p_ts->p_buffer[6], 0xff, i_stuffing);
-            }
+            p_ts->p_buffer[5] |= 0x80; /* flag TS dicontinuity */
+            p_stream->ts.b_discontinuity = false;
         }
     }
 
-    /* copy payload */
-    memcpy( &p_ts->p_buffer[188 - i_payload],
-            &p_pes->p_buffer[p_stream->state.i_pes_used], i_payload );
-
     p_stream->state.i_pes_used += i_payload;
     p_stream->state.i_pes_dts = p_pes->i_dts + p_pes->i_length *
         p_stream->state.i_pes_used / p_pes->i_buffer;
@@ -104,3 +104,84 @@ void PEStoTS( void *p_opaque, PEStoTSCallback pf_callback, block_t *p_pes,
         }
     }
 }
+
+/* Packets reserved at once, per stream. They share one allocation, which
+ * stays alive as long as any of them is held downstream (UDP batches,
+ * HTTP queues), so keep it around the size of a small PES. */
+#define TS_RESERVE_MIN 16
+#define TS_RESERVE_MAX 64
+
+void TSPacketizerInit( ts_packetizer_t *p_tsp, int i_pid )
+{
+    p_tsp->i_header = 0x47000010 | ( ( i_pid & 0x1fff ) << 8 );
+    p_tsp->p_reserved = NULL;
+}
+
+void TSPacketizerClean( ts_packetizer_t *p_tsp )
+{
+    block_ChainRelease( p_tsp->p_reserved );
+    p_tsp->p_reserved = NULL;
+}
+
+block_t *TSPacketizerNext( ts_packetizer_t *p_tsp, const uint8_t *p_data,
+                           size_t i_size, bool b_unit_start, bool b_pcr,
+                           int *pi_continuity_counter )
+{
+    if( p_tsp->p_reserved == NULL )
+    {
+        /* Enough for the rest of the PES, even with a PCR in every packet,
+         * up to the cap. Leftovers go to the next PES. */
+        size_t i_count = ( i_size + 175 ) / 176;
+        i_count = VLC_CLIP( i_count, TS_RESERVE_MIN, TS_RESERVE_MAX );
+        p_tsp->p_reserved = block_ChainAlloc( i_count, 188 );
+    }
+
+    block_t *p_ts = p_tsp->p_reserved;
+    if( likely(p_ts != NULL) )
+    {
+        p_tsp->p_reserved = p_ts->p_next;
+        p_ts->p_next = NULL;
+    }
+    else
+    {
+        p_ts = block_Alloc( 188 );
+        if( unlikely(p_ts == NULL) )
+            return NULL;
+    }
+
+    uint8_t *p = p_ts->p_buffer;
+    uint32_t i_header = p_tsp->i_header | *pi_continuity_counter;
+    if( b_unit_start )
+        i_header |= 0x400000;
+    *pi_continuity_counter = ( *pi_continuity_counter + 1 ) & 0x0f;
+
+    if( likely(!b_pcr && i_size >= 184) )
+    {
+        SetDWBE( p, i_header );
+        memcpy( &p[4], p_data, 184 );
+        return p_ts;
+    }
+
+    const size_t i_payload_max = b_pcr ? 176 : 184;
+    const size_t i_payload = __MIN( i_size, i_payload_max );
+    size_t i_stuffing = i_payload_max - i_payload;
+
+    SetDWBE( p, i_header | 0x20 ); /* adaptation field */
+    if( b_pcr )
+    {
+        p[4] = 7 + i_stuffing;
+        p[5] = 0x10; /* PCR_flag */
+        memset( &p[12], 0xff, i_stuffing );
+    }
+    else
+    {
+        p[4] = --i_stuffing;
+        if( i_stuffing-- )
+        {
+            p[5] = 0;
+            memset( &p[6], 0xff, i_stuffing );
+        }
+    }
+    memcpy( &p[188 - i_payload], p_data, i_payload );
+    return p_ts;
+}
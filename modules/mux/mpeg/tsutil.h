@@ -25,4 +25,21 @@ typedef void(*PEStoTSCallback)(void *, block_t *);
 void PEStoTS( void *p_opaque, PEStoTSCallback pf_callback, block_t *p_pes,
               int i_pid, bool *pb_discontinuity, int *pi_continuity_counter );
 
+/* Fast path packetizer, slicing PES payloads into preallocated packets */
+typedef struct
+{
+    uint32_t i_header;      /* sync byte, PID, payload only, counter 0 */
+    block_t  *p_reserved;   /* packets carved out of a single allocation */
+} ts_packetizer_t;
+
+void TSPacketizerInit( ts_packetizer_t *, int i_pid );
+void TSPacketizerClean( ts_packetizer_t * );
+
+/* Builds the next packet out of the i_size remaining bytes of a PES, it
+ * carries __MIN(i_size, 184) of them, or __MIN(i_size, 176) with room for
+ * a PCR. The PCR value itself is left to the caller. */
+block_t *TSPacketizerNext( ts_packetizer_t *, const uint8_t *p_data,
+                           size_t i_size, bool b_unit_start, bool b_pcr,
+                           int *pi_continuity_counter );
+
 #endif
@@ -0,0 +1,250 @@
+/*****************************************************************************
+ * tsutil_test.c: TS packetizer test and benchmark
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#undef NDEBUG
+#include <assert.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vlc_common.h>
+#include <vlc_block.h>
+#include <vlc_es.h>
+
+#include "pes.h"
+#include "tsutil.h"
+
+static void Append( void *opaque, block_t *p_ts )
+{
+    block_ChainLastAppend( (block_t ***)opaque, p_ts );
+}
+
+static block_t *RandomPES( size_t i_size )
+{
+    block_t *p_pes = block_Alloc( i_size );
+    assert( p_pes != NULL );
+    for( size_t i = 0; i < i_size; i++ )
+        p_pes->p_buffer[i] = rand();
+    return p_pes;
+}
+
+/* Same packets as the generic packetizer */
+static void test_packets( void )
+{
+    ts_packetizer_t tsp;
+    int cc_ref = 3, cc = 3;
+    bool b_discontinuity = false;
+
+    TSPacketizerInit( &tsp, 0x1234 );
+    for( size_t i_size = 1; i_size < 2000; i_size += 1 + i_size / 8 )
+    {
+        block_t *p_pes = RandomPES( i_size );
+        block_t *p_ref = NULL, **pp_last = &p_ref;
+        size_t i_used = 0;
+
+        PEStoTS( &pp_last, Append, block_Duplicate( p_pes ), 0x1234,
+                 &b_discontinuity, &cc_ref );
+
+        for( block_t *p_ts = p_ref; p_ts != NULL; p_ts = p_ts->p_next )
+        {
+            block_t *p_new = TSPacketizerNext( &tsp, &p_pes->p_buffer[i_used],
+                                               i_size - i_used, i_used == 0,
+                                               false, &cc );
+            assert( p_new != NULL && p_new->i_buffer == 188 );
+            assert( !memcmp( p_new->p_buffer, p_ts->p_buffer, 188 ) );
+            i_used += __MIN( i_size - i_used, 184 );
+            block_Release( p_new );
+        }
+        assert( i_used == i_size && cc == cc_ref );
+        block_ChainRelease( p_ref );
+        block_Release( p_pes );
+    }
+
+    /* room for a PCR */
+    block_t *p_pes = RandomPES( 200 );
+    for( size_t i_used = 0; i_used < 200; i_used += 176 )
+    {
+        block_t *p_ts = TSPacketizerNext( &tsp, &p_pes->p_buffer[i_used],
+                                          200 - i_used, i_used == 0,
+                                          true, &cc );
+        const uint8_t *p = p_ts->p_buffer;
+        size_t i_payload = __MIN( 200 - i_used, 176 );
+
+        assert( p[0] == 0x47 && p[1] == ( i_used ? 0x12 : 0x52 ) );
+        assert( p[2] == 0x34 && ( p[3] & 0xf0 ) == 0x30 );
+        assert( p[4] == 183 - i_payload && p[5] == 0x10 );
+        for( size_t i = 12; i < 188 - i_payload; i++ )
+            assert( p[i] == 0xff );
+        assert( !memcmp( &p[188 - i_payload], &p_pes->p_buffer[i_used],
+                         i_payload ) );
+        block_Release( p_ts );
+    }
+    block_Release( p_pes );
+    TSPacketizerClean( &tsp );
+}
+
+#define VIDEO_PID  0x100
+#define AUDIO_PIDS 4
+#define FPS        50
+#define BITRATE    40000000
+
+struct mux
+{
+    es_format_t video, audio;
+    ts_packetizer_t tsp[1 + AUDIO_PIDS];
+    int cc[1 + AUDIO_PIDS];
+    bool discontinuity[1 + AUDIO_PIDS];
+    uint8_t *payload;
+    uint64_t packets;
+};
+
+static block_t *Frame( struct mux *mux, size_t i_size, mtime_t i_dts,
+                       bool b_key )
+{
+    block_t *p_es = block_Alloc( i_size );
+    assert( p_es != NULL );
+    memcpy( p_es->p_buffer, mux->payload, i_size );
+    p_es->i_dts = p_es->i_pts = i_dts;
+    p_es->i_flags = b_key ? BLOCK_FLAG_TYPE_I : BLOCK_FLAG_TYPE_P;
+    return p_es;
+}
+
+static void Packetize( struct mux *mux, unsigned i_es, block_t *p_pes,
+                       bool b_pcr, bool b_fast, block_t ***ppp_last )
+{
+    if( !b_fast )
+    {
+        PEStoTS( ppp_last, Append, p_pes, i_es ? VIDEO_PID + i_es : VIDEO_PID,
+                 &mux->discontinuity[i_es], &mux->cc[i_es] );
+        return;
+    }
+
+    for( size_t i_used = 0; i_used < p_pes->i_buffer; )
+    {
+        block_t *p_ts = TSPacketizerNext( &mux->tsp[i_es],
+                                          &p_pes->p_buffer[i_used],
+                                          p_pes->i_buffer - i_used,
+                                          i_used == 0, b_pcr, &mux->cc[i_es] );
+        i_used += __MIN( p_pes->i_buffer - i_used, b_pcr ? 176u : 184u );
+        b_pcr = false;
+        block_ChainLastAppend( ppp_last, p_ts );
+    }
+    block_Release( p_pes );
+}
+
+/* Muxes H.264 and AAC access units, as the TS muxer does, and drops the
+ * packets once per video frame, as an access output would */
+static void Mux( struct mux *mux, unsigned i_frames, bool b_fast )
+{
+    const mtime_t i_frame_length = CLOCK_FREQ / FPS;
+    const mtime_t i_audio_length = CLOCK_FREQ * 1024 / 48000;
+    mtime_t i_audio_dts = 0;
+
+    for( unsigned i = 0; i < i_frames; i++ )
+    {
+        const mtime_t i_dts = i * i_frame_length;
+        const bool b_key = ( i % FPS ) == 0;
+        /* I frames four times the size of P frames */
+        size_t i_size = BITRATE / 8 / ( FPS + 3 );
+        if( b_key )
+            i_size *= 4;
+
+        block_t *p_out = NULL, **pp_last = &p_out;
+        block_t *p_pes = Frame( mux, i_size, i_dts, b_key );
+        EStoPES( &p_pes, &mux->video, 0xe0, true, true, 0, INT_MAX, 0 );
+        Packetize( mux, 0, p_pes, ( i % 2 ) == 0, b_fast, &pp_last );
+
+        for( ; i_audio_dts < i_dts + i_frame_length;
+               i_audio_dts += i_audio_length )
+        {
+            for( unsigned a = 1; a <= AUDIO_PIDS; a++ )
+            {
+                p_pes = Frame( mux, 256000 / 8 * i_audio_length / CLOCK_FREQ,
+                               i_audio_dts, false );
+                EStoPES( &p_pes, &mux->audio, 0xc0 + a, true, true, 0, 0, 0 );
+                Packetize( mux, a, p_pes, false, b_fast, &pp_last );
+            }
+        }
+
+        for( block_t *p_ts = p_out; p_ts != NULL; p_ts = p_ts->p_next )
+            mux->packets++;
+        block_ChainRelease( p_out );
+    }
+}
+
+static void bench( unsigned i_frames )
+{
+    struct mux mux;
+
+    es_format_Init( &mux.video, VIDEO_ES, VLC_CODEC_H264 );
+    es_format_Init( &mux.audio, AUDIO_ES, VLC_CODEC_MP4A );
+    /* SPS and PPS, repeated before I frames */
+    static const uint8_t extra[] = {
+        0x00, 0x00, 0x00, 0x01, 0x67, 0x64, 0x00, 0x28, 0xac, 0xd9, 0x40, 0x78,
+        0x02, 0x27, 0xe5, 0x84, 0x00, 0x00, 0x03, 0x00, 0x04, 0x00, 0x00, 0x03,
+        0x00, 0xc8, 0x3c, 0x60, 0xc6, 0x58, 0x00, 0x00, 0x00, 0x01, 0x68, 0xeb,
+        0xe3, 0xcb, 0x22, 0xc0,
+    };
+    mux.video.i_extra = sizeof (extra);
+    mux.video.p_extra = (void *)extra;
+    mux.payload = malloc( BITRATE / 8 );
+    assert( mux.payload != NULL );
+    memset( mux.payload, 0x55, BITRATE / 8 );
+    /* starts with an access unit delimiter, kept as is */
+    memcpy( mux.payload, "\x00\x00\x00\x01\x09\xf0", 6 );
+
+    for( int b_fast = 0; b_fast < 2; b_fast++ )
+    {
+        for( unsigned i = 0; i <= AUDIO_PIDS; i++ )
+        {
+            TSPacketizerInit( &mux.tsp[i], VIDEO_PID + i );
+            mux.cc[i] = 0;
+            mux.discontinuity[i] = false;
+        }
+        mux.packets = 0;
+
+        mtime_t start = mdate();
+        Mux( &mux, i_frames, b_fast );
+        mtime_t spent = mdate() - start;
+
+        for( unsigned i = 0; i <= AUDIO_PIDS; i++ )
+            TSPacketizerClean( &mux.tsp[i] );
+
+        printf( "%s: %"PRIu64" packets, %.2f Mpackets/s, %.0f Mb/s\n",
+                b_fast ? "preallocated" : "per packet", mux.packets,
+                (double)mux.packets / ( spent ? spent : 1 ),
+                (double)mux.packets * 188 * 8 / ( spent ? spent : 1 ) );
+    }
+    free( mux.payload );
+}
+
+int main( int argc, char *argv[] )
+{
+    unsigned i_frames = ( argc > 1 ) ? strtoul( argv[1], NULL, 0 ) : 500;
+
+    test_packets();
+    bench( i_frames );
+    return 0;
+}
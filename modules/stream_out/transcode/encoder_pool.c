@@ -0,0 +1,326 @@
+/*****************************************************************************
+ * encoder_pool.c: GOP-parallel video encoding
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <stdlib.h>
+
+#include <vlc_common.h>
+#include <vlc_block.h>
+#include <vlc_picture.h>
+
+#include "encoder_pool.h"
+
+/* Segments queued or being encoded, per worker, before Push() waits */
+#define POOL_BACKLOG 2
+
+typedef struct transcode_segment_t transcode_segment_t;
+
+struct transcode_segment_t
+{
+    transcode_segment_t *p_next; /**< following segment, in output order */
+    block_t    *p_blocks;
+    bool        b_done;
+    unsigned    i_pics;
+    picture_t  *pp_pics[];
+};
+
+struct transcode_encoder_pool_t
+{
+    vlc_object_t *p_obj;
+    transcode_encoder_pool_cbs_t cbs;
+    unsigned    i_segment;
+    unsigned    i_workers;
+
+    /* Filled by Push(), not shared */
+    transcode_segment_t *p_current;
+
+    vlc_mutex_t lock;
+    vlc_cond_t  wait_work;
+    vlc_cond_t  wait_done;
+    transcode_segment_t *p_first; /**< oldest segment not output yet */
+    transcode_segment_t **pp_last;
+    transcode_segment_t *p_todo;  /**< oldest segment not taken yet */
+    unsigned    i_pending;        /**< segments not encoded yet */
+    bool        b_abort;
+
+    vlc_thread_t threads[];
+};
+
+/* Encoder of a worker, kept from one segment to the next */
+typedef struct
+{
+    encoder_t      *p_enc;
+    video_format_t  fmt;     /**< of the pictures it was opened for */
+    bool            b_whole; /**< its last segment was a whole one */
+} transcode_worker_t;
+
+static block_t *EncodeSegment( transcode_encoder_pool_t *p_pool,
+                               transcode_worker_t *p_worker,
+                               transcode_segment_t *p_seg )
+{
+    const video_format_t *p_fmt = &p_seg->pp_pics[0]->format;
+
+    /* A new format needs a new encoder, and so does the key frame cadence
+     * after a partial segment */
+    if( p_worker->p_enc != NULL
+     && ( !p_worker->b_whole
+       || !video_format_IsSimilar( &p_worker->fmt, p_fmt ) ) )
+    {
+        p_pool->cbs.pf_close( p_pool->p_obj, p_pool->cbs.opaque,
+                              p_worker->p_enc );
+        p_worker->p_enc = NULL;
+    }
+    if( p_worker->p_enc == NULL )
+    {
+        p_worker->p_enc = p_pool->cbs.pf_open( p_pool->p_obj,
+                                               p_pool->cbs.opaque, p_fmt );
+        p_worker->fmt = *p_fmt;
+        p_worker->fmt.p_palette = NULL;
+    }
+    p_worker->b_whole = p_seg->i_pics == p_pool->i_segment;
+
+    encoder_t *p_enc = p_worker->p_enc;
+    block_t *p_chain = NULL, **pp_last = &p_chain, *p_block;
+
+    for( unsigned i = 0; i < p_seg->i_pics; i++ )
+    {
+        if( likely( p_enc != NULL ) )
+        {
+            p_block = p_enc->pf_encode_video( p_enc, p_seg->pp_pics[i] );
+            if( p_block )
+                block_ChainLastAppend( &pp_last, p_block );
+        }
+        picture_Release( p_seg->pp_pics[i] );
+    }
+
+    if( likely( p_enc != NULL ) )
+    {
+        /* Closes the GOP */
+        while( (p_block = p_enc->pf_encode_video( p_enc, NULL )) )
+            block_ChainLastAppend( &pp_last, p_block );
+    }
+    return p_chain;
+}
+
+static void *Worker( void *data )
+{
+    transcode_encoder_pool_t *p_pool = data;
+    transcode_worker_t worker = { .p_enc = NULL };
+    int canc = vlc_savecancel();
+
+    vlc_mutex_lock( &p_pool->lock );
+    for( ;; )
+    {
+        while( !p_pool->b_abort && p_pool->p_todo == NULL )
+            vlc_cond_wait( &p_pool->wait_work, &p_pool->lock );
+
+        transcode_segment_t *p_seg = p_pool->p_todo;
+        if( p_seg == NULL )
+            break;
+        p_pool->p_todo = p_seg->p_next;
+
+        vlc_mutex_unlock( &p_pool->lock );
+        block_t *p_blocks = EncodeSegment( p_pool, &worker, p_seg );
+        vlc_mutex_lock( &p_pool->lock );
+
+        p_seg->p_blocks = p_blocks;
+        p_seg->b_done = true;
+        p_pool->i_pending--;
+        vlc_cond_broadcast( &p_pool->wait_done );
+    }
+    vlc_mutex_unlock( &p_pool->lock );
+
+    if( worker.p_enc != NULL )
+        p_pool->cbs.pf_close( p_pool->p_obj, p_pool->cbs.opaque,
+                              worker.p_enc );
+    vlc_restorecancel( canc );
+    return NULL;
+}
+
+transcode_encoder_pool_t *
+transcode_encoder_pool_New( vlc_object_t *p_obj, unsigned i_workers,
+                            unsigned i_segment, int i_priority,
+                            const transcode_encoder_pool_cbs_t *p_cbs )
+{
+    if( i_workers == 0 || i_segment == 0 )
+        return NULL;
+
+    transcode_encoder_pool_t *p_pool =
+        malloc( sizeof(*p_pool) + i_workers * sizeof(p_pool->threads[0]) );
+    if( unlikely( p_pool == NULL ) )
+        return NULL;
+
+    p_pool->p_obj = p_obj;
+    p_pool->cbs = *p_cbs;
+    p_pool->i_segment = i_segment;
+    p_pool->p_current = NULL;
+    vlc_mutex_init( &p_pool->lock );
+    vlc_cond_init( &p_pool->wait_work );
+    vlc_cond_init( &p_pool->wait_done );
+    p_pool->p_first = NULL;
+    p_pool->pp_last = &p_pool->p_first;
+    p_pool->p_todo = NULL;
+    p_pool->i_pending = 0;
+    p_pool->b_abort = false;
+
+    for( p_pool->i_workers = 0; p_pool->i_workers < i_workers;
+         p_pool->i_workers++ )
+    {
+        if( vlc_clone( &p_pool->threads[p_pool->i_workers], Worker, p_pool,
+                       i_priority ) )
+        {
+            if( p_pool->i_workers == 0 )
+            {
+                transcode_encoder_pool_Delete( p_pool );
+                return NULL;
+            }
+            break; /* fewer workers */
+        }
+    }
+    return p_pool;
+}
+
+static void FreeSegments( transcode_segment_t *p_seg )
+{
+    while( p_seg != NULL )
+    {
+        transcode_segment_t *p_next = p_seg->p_next;
+        block_ChainRelease( p_seg->p_blocks );
+        free( p_seg );
+        p_seg = p_next;
+    }
+}
+
+void transcode_encoder_pool_Delete( transcode_encoder_pool_t *p_pool )
+{
+    if( p_pool->p_current )
+    {
+        for( unsigned i = 0; i < p_pool->p_current->i_pics; i++ )
+            picture_Release( p_pool->p_current->pp_pics[i] );
+        free( p_pool->p_current );
+    }
+
+    /* The workers finish the queued segments first */
+    vlc_mutex_lock( &p_pool->lock );
+    p_pool->b_abort = true;
+    vlc_cond_broadcast( &p_pool->wait_work );
+    vlc_mutex_unlock( &p_pool->lock );
+
+    for( unsigned i = 0; i < p_pool->i_workers; i++ )
+        vlc_join( p_pool->threads[i], NULL );
+
+    FreeSegments( p_pool->p_first );
+    vlc_cond_destroy( &p_pool->wait_done );
+    vlc_cond_destroy( &p_pool->wait_work );
+    vlc_mutex_destroy( &p_pool->lock );
+    free( p_pool );
+}
+
+/* Hands the current segment over to the workers */
+static void Queue( transcode_encoder_pool_t *p_pool )
+{
+    transcode_segment_t *p_seg = p_pool->p_current;
+    if( p_seg == NULL )
+        return;
+    p_pool->p_current = NULL;
+
+    vlc_mutex_lock( &p_pool->lock );
+    /* Bounds the pictures held */
+    while( p_pool->i_pending >= POOL_BACKLOG * p_pool->i_workers )
+        vlc_cond_wait( &p_pool->wait_done, &p_pool->lock );
+
+    *p_pool->pp_last = p_seg;
+    p_pool->pp_last = &p_seg->p_next;
+    if( p_pool->p_todo == NULL )
+        p_pool->p_todo = p_seg;
+    p_pool->i_pending++;
+    vlc_cond_signal( &p_pool->wait_work );
+    vlc_mutex_unlock( &p_pool->lock );
+}
+
+void transcode_encoder_pool_Push( transcode_encoder_pool_t *p_pool,
+                                  picture_t *p_pic )
+{
+    transcode_segment_t *p_seg = p_pool->p_current;
+
+    if( p_seg == NULL )
+    {
+        p_seg = malloc( sizeof(*p_seg)
+                        + p_pool->i_segment * sizeof(p_seg->pp_pics[0]) );
+        if( unlikely( p_seg == NULL ) )
+        {
+            picture_Release( p_pic );
+            return;
+        }
+        p_seg->p_next = NULL;
+        p_seg->p_blocks = NULL;
+        p_seg->b_done = false;
+        p_seg->i_pics = 0;
+        p_pool->p_current = p_seg;
+    }
+
+    p_seg->pp_pics[p_seg->i_pics++] = p_pic;
+    if( p_seg->i_pics == p_pool->i_segment )
+        Queue( p_pool );
+}
+
+block_t *transcode_encoder_pool_Get( transcode_encoder_pool_t *p_pool )
+{
+    block_t *p_chain = NULL, **pp_last = &p_chain;
+    transcode_segment_t *p_done = NULL, **pp_done = &p_done;
+
+    vlc_mutex_lock( &p_pool->lock );
+    while( p_pool->p_first != NULL && p_pool->p_first->b_done )
+    {
+        transcode_segment_t *p_seg = p_pool->p_first;
+
+        p_pool->p_first = p_seg->p_next;
+        if( p_pool->p_first == NULL )
+            p_pool->pp_last = &p_pool->p_first;
+        p_seg->p_next = NULL;
+        *pp_done = p_seg;
+        pp_done = &p_seg->p_next;
+    }
+    vlc_mutex_unlock( &p_pool->lock );
+
+    for( transcode_segment_t *p_seg = p_done; p_seg; p_seg = p_seg->p_next )
+    {
+        if( p_seg->p_blocks )
+            block_ChainLastAppend( &pp_last, p_seg->p_blocks );
+        p_seg->p_blocks = NULL;
+    }
+    FreeSegments( p_done );
+    return p_chain;
+}
+
+block_t *transcode_encoder_pool_Flush( transcode_encoder_pool_t *p_pool )
+{
+    Queue( p_pool );
+
+    vlc_mutex_lock( &p_pool->lock );
+    while( p_pool->i_pending > 0 )
+        vlc_cond_wait( &p_pool->wait_done, &p_pool->lock );
+    vlc_mutex_unlock( &p_pool->lock );
+
+    return transcode_encoder_pool_Get( p_pool );
+}
@@ -0,0 +1,87 @@
+/*****************************************************************************
+ * encoder_pool.h: GOP-parallel video encoding
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef VLC_TRANSCODE_ENCODER_POOL_H
+#define VLC_TRANSCODE_ENCODER_POOL_H 1
+
+#include <vlc_codec.h>
+
+/**
+ * Encodes pictures on several threads.
+ *
+ * The pictures are cut into segments of a fixed number of pictures. Each
+ * segment is encoded from start to end by the encoder of a worker thread,
+ * then flushed, so that it references no other segment. A worker keeps its
+ * encoder for its next segments: they start with a key frame as long as the
+ * key frame interval of the encoder divides the segment length. The encoder
+ * is opened again when the picture format changes, or after a partial
+ * segment. The blocks are output in the order of the segments, which is
+ * also the decoding order, as long as the encoder delay does not exceed a
+ * segment.
+ *
+ * Only one thread may push pictures and get blocks.
+ */
+typedef struct transcode_encoder_pool_t transcode_encoder_pool_t;
+
+typedef struct
+{
+    /** Opens an encoder for pictures of the given format, from a worker
+     * thread.
+     * \return NULL if the segment cannot be encoded */
+    encoder_t *(*pf_open)( vlc_object_t *p_obj, void *opaque,
+                           const video_format_t *p_fmt );
+    /** Closes an encoder, once it has been flushed */
+    void (*pf_close)( vlc_object_t *p_obj, void *opaque, encoder_t *p_enc );
+    void *opaque;
+} transcode_encoder_pool_cbs_t;
+
+/**
+ * \param p_obj passed to the callbacks
+ * \param i_workers number of encoding threads
+ * \param i_segment number of pictures of the segments
+ */
+transcode_encoder_pool_t *
+transcode_encoder_pool_New( vlc_object_t *p_obj, unsigned i_workers,
+                            unsigned i_segment, int i_priority,
+                            const transcode_encoder_pool_cbs_t *p_cbs );
+
+/**
+ * Waits for the segments being encoded, drops the blocks not output yet,
+ * and stops the threads.
+ */
+void transcode_encoder_pool_Delete( transcode_encoder_pool_t * );
+
+/**
+ * Queues a picture for encoding. Waits if the workers are too far behind.
+ */
+void transcode_encoder_pool_Push( transcode_encoder_pool_t *, picture_t * );
+
+/**
+ * Gets the blocks of the segments encoded so far, if any, without waiting.
+ */
+block_t *transcode_encoder_pool_Get( transcode_encoder_pool_t * );
+
+/**
+ * Encodes all the queued pictures, even though the last segment is not
+ * full, and gets all the remaining blocks.
+ */
+block_t *transcode_encoder_pool_Flush( transcode_encoder_pool_t * );
+
+#endif
@@ -0,0 +1,279 @@
+/*****************************************************************************
+ * encoder_pool_test.c: GOP-parallel video encoding test and benchmark
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#undef NDEBUG
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vlc_common.h>
+#include <vlc_block.h>
+#include <vlc_picture.h>
+#include <vlc_atomic.h>
+
+#include "encoder_pool.h"
+
+/* Encoder with a fixed GOP, a delay of two pictures, and some work per
+ * pixel */
+struct encoder_sys_t
+{
+    picture_t *held[2];
+    unsigned   i_held;
+    unsigned   i_out;
+    unsigned   i_keyint;
+    unsigned   i_passes;
+    video_format_t fmt;
+};
+
+struct context
+{
+    atomic_uint opened;
+    atomic_uint closed;
+    unsigned    keyint;
+    unsigned    passes;
+};
+
+static block_t *Output( encoder_t *p_enc, picture_t *p_pic )
+{
+    encoder_sys_t *p_sys = p_enc->p_sys;
+    uint32_t sum = 0;
+
+    for( unsigned pass = 0; pass < p_sys->i_passes; pass++ )
+        for( int i = 0; i < p_pic->i_planes; i++ )
+        {
+            const plane_t *p = &p_pic->p[i];
+            for( int y = 0; y < p->i_visible_lines; y++ )
+                for( int x = 0; x < p->i_visible_pitch; x++ )
+                    sum = sum * 31 + p->p_pixels[y * p->i_pitch + x];
+        }
+
+    block_t *p_block = block_Alloc( 64 );
+    assert( p_block != NULL );
+    memcpy( p_block->p_buffer, &sum, sizeof (sum) );
+    p_block->i_dts = p_block->i_pts = p_pic->date;
+    p_block->i_flags = ( p_sys->i_out++ % p_sys->i_keyint )
+                     ? BLOCK_FLAG_TYPE_P : BLOCK_FLAG_TYPE_I;
+    picture_Release( p_pic );
+    return p_block;
+}
+
+static block_t *Encode( encoder_t *p_enc, picture_t *p_pic )
+{
+    encoder_sys_t *p_sys = p_enc->p_sys;
+
+    if( p_pic == NULL )
+    {   /* one at a time, as libavcodec does */
+        if( p_sys->i_held == 0 )
+            return NULL;
+        p_pic = p_sys->held[0];
+        p_sys->held[0] = p_sys->held[1];
+        p_sys->i_held--;
+        return Output( p_enc, p_pic );
+    }
+
+    assert( video_format_IsSimilar( &p_pic->format, &p_sys->fmt ) );
+    picture_Hold( p_pic );
+    if( p_sys->i_held < 2 )
+    {
+        p_sys->held[p_sys->i_held++] = p_pic;
+        return NULL;
+    }
+    picture_t *p_out = p_sys->held[0];
+    p_sys->held[0] = p_sys->held[1];
+    p_sys->held[1] = p_pic;
+    return Output( p_enc, p_out );
+}
+
+static encoder_t *Open( vlc_object_t *p_obj, void *opaque,
+                        const video_format_t *p_fmt )
+{
+    struct context *ctx = opaque;
+    encoder_t *p_enc = calloc( 1, sizeof (*p_enc) );
+    assert( p_enc != NULL && p_obj == NULL );
+
+    p_enc->p_sys = calloc( 1, sizeof (*p_enc->p_sys) );
+    assert( p_enc->p_sys != NULL );
+    p_enc->p_sys->i_keyint = ctx->keyint;
+    p_enc->p_sys->i_passes = ctx->passes;
+    p_enc->p_sys->fmt = *p_fmt;
+    p_enc->pf_encode_video = Encode;
+    atomic_fetch_add( &ctx->opened, 1 );
+    return p_enc;
+}
+
+static void Close( vlc_object_t *p_obj, void *opaque, encoder_t *p_enc )
+{
+    struct context *ctx = opaque;
+
+    (void) p_obj;
+    assert( p_enc->p_sys->i_held == 0 );
+    free( p_enc->p_sys );
+    free( p_enc );
+    atomic_fetch_add( &ctx->closed, 1 );
+}
+
+static picture_t *Picture( const video_format_t *fmt, unsigned i )
+{
+    picture_t *p_pic = picture_NewFromFormat( fmt );
+    assert( p_pic != NULL );
+    for( int p = 0; p < p_pic->i_planes; p++ )
+        memset( p_pic->p[p].p_pixels, i, p_pic->p[p].i_pitch
+                                         * p_pic->p[p].i_lines );
+    p_pic->date = VLC_TS_0 + i * CLOCK_FREQ / 25;
+    return p_pic;
+}
+
+/* Checks the blocks are in order, with a key frame every segment */
+static unsigned Check( block_t *p_chain, unsigned i_first, unsigned i_segment )
+{
+    unsigned i = i_first;
+
+    for( block_t *p_block = p_chain; p_block; p_block = p_block->p_next, i++ )
+    {
+        assert( p_block->i_dts == VLC_TS_0 + i * CLOCK_FREQ / 25 );
+        assert( !!( p_block->i_flags & BLOCK_FLAG_TYPE_I )
+                == ( i % i_segment == 0 ) );
+    }
+    block_ChainRelease( p_chain );
+    return i - i_first;
+}
+
+static void test_order( unsigned i_workers, unsigned i_segment,
+                        unsigned i_pics )
+{
+    struct context ctx = { .keyint = i_segment, .passes = 0 };
+    const transcode_encoder_pool_cbs_t cbs = {
+        .pf_open = Open, .pf_close = Close, .opaque = &ctx,
+    };
+    video_format_t fmt;
+    unsigned i_out = 0;
+
+    atomic_init( &ctx.opened, 0 );
+    atomic_init( &ctx.closed, 0 );
+    video_format_Setup( &fmt, VLC_CODEC_I420, 16, 16, 16, 16, 1, 1 );
+
+    transcode_encoder_pool_t *p_pool =
+        transcode_encoder_pool_New( NULL, i_workers, i_segment,
+                                    VLC_THREAD_PRIORITY_LOW, &cbs );
+    assert( p_pool != NULL );
+
+    for( unsigned i = 0; i < i_pics; i++ )
+    {
+        transcode_encoder_pool_Push( p_pool, Picture( &fmt, i ) );
+        i_out += Check( transcode_encoder_pool_Get( p_pool ), i_out,
+                        i_segment );
+    }
+    i_out += Check( transcode_encoder_pool_Flush( p_pool ), i_out, i_segment );
+    assert( i_out == i_pics );
+    assert( transcode_encoder_pool_Get( p_pool ) == NULL );
+
+    /* and once more, after the flush */
+    transcode_encoder_pool_Push( p_pool, Picture( &fmt, i_pics ) );
+    assert( Check( transcode_encoder_pool_Flush( p_pool ), i_pics, 1 ) == 1 );
+
+    /* then with another format, by a new encoder */
+    video_format_t fmt2;
+    video_format_Setup( &fmt2, VLC_CODEC_I420, 32, 16, 32, 16, 1, 1 );
+    for( unsigned i = 0; i < i_segment; i++ )
+        transcode_encoder_pool_Push( p_pool, Picture( &fmt2, i_pics + 1 + i ) );
+
+    block_t *p_chain = transcode_encoder_pool_Flush( p_pool );
+    unsigned i = 0;
+    for( block_t *p_block = p_chain; p_block; p_block = p_block->p_next, i++ )
+        assert( !!( p_block->i_flags & BLOCK_FLAG_TYPE_I ) == ( i == 0 ) );
+    assert( i == i_segment );
+    block_ChainRelease( p_chain );
+
+    /* left on deletion, encoded only if it makes a whole segment */
+    transcode_encoder_pool_Push( p_pool, Picture( &fmt2, 0 ) );
+    transcode_encoder_pool_Delete( p_pool );
+
+    /* Workers keep their encoders, but after a partial segment, and for the
+     * new format */
+    unsigned i_segments = ( i_pics + i_segment - 1 ) / i_segment + 2
+                        + ( i_segment == 1 );
+    unsigned i_partial = i_pics % i_segment != 0;
+    unsigned i_opened = atomic_load( &ctx.opened );
+    assert( i_opened >= 2 && i_opened <= i_segments );
+    if( i_workers == 1 )
+        assert( i_opened == 2 + i_partial );
+    assert( atomic_load( &ctx.closed ) == i_opened );
+}
+
+static void bench( unsigned i_pics, unsigned i_segment )
+{
+    struct context ctx = { .keyint = i_segment, .passes = 4 };
+    const transcode_encoder_pool_cbs_t cbs = {
+        .pf_open = Open, .pf_close = Close, .opaque = &ctx,
+    };
+    video_format_t fmt;
+    double f_base = 0.;
+
+    atomic_init( &ctx.opened, 0 );
+    atomic_init( &ctx.closed, 0 );
+    video_format_Setup( &fmt, VLC_CODEC_I420, 720, 576, 720, 576, 16, 15 );
+
+    for( unsigned i_workers = 1; i_workers <= 8; i_workers *= 2 )
+    {
+        transcode_encoder_pool_t *p_pool =
+            transcode_encoder_pool_New( NULL, i_workers, i_segment,
+                                        VLC_THREAD_PRIORITY_LOW, &cbs );
+        assert( p_pool != NULL );
+
+        unsigned i_out = 0;
+        mtime_t start = mdate();
+        for( unsigned i = 0; i < i_pics; i++ )
+        {
+            transcode_encoder_pool_Push( p_pool, Picture( &fmt, i ) );
+            i_out += Check( transcode_encoder_pool_Get( p_pool ), i_out,
+                            i_segment );
+        }
+        i_out += Check( transcode_encoder_pool_Flush( p_pool ), i_out,
+                        i_segment );
+        mtime_t spent = mdate() - start;
+        transcode_encoder_pool_Delete( p_pool );
+        assert( i_out == i_pics );
+
+        double f_fps = (double)i_pics * CLOCK_FREQ / ( spent ? spent : 1 );
+        if( i_workers == 1 )
+            f_base = f_fps;
+        printf( "%u workers, segments of %u: %.1f fps, x%.2f\n",
+                i_workers, i_segment, f_fps, f_fps / f_base );
+    }
+}
+
+int main( int argc, char *argv[] )
+{
+    unsigned i_pics = ( argc > 1 ) ? strtoul( argv[1], NULL, 0 ) : 200;
+
+    test_order( 1, 1, 10 );
+    test_order( 3, 1, 50 );
+    test_order( 2, 5, 52 );
+    test_order( 4, 12, 100 );
+    test_order( 8, 3, 7 );
+    bench( i_pics, 25 );
+    bench( i_pics, 1 );
+    return 0;
+}
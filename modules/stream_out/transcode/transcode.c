@@ -80,6 +80,12 @@
 #define VFILTER_LONGTEXT N_( \
     "Video filters will be applied to the video streams (after overlays " \
     "are applied). You can enter a colon-separated list of filters." )
+#define LADDER_TEXT N_("Video renditions")
+#define LADDER_LONGTEXT N_( \
+    "Colon-separated list of WIDTHxHEIGHT@BITRATE renditions, each encoded " \
+    "from the same decoded and filtered video into an elementary stream " \
+    "of its own (eg: 1920x1080@6000:1280x720@3000). Width, height or " \
+    "bitrate may be left out." )
 
 #define AENC_TEXT N_("Audio encoder")
 #define AENC_LONGTEXT N_( \
@@ -127,6 +133,12 @@
 #define THREADS_TEXT N_("Number of threads")
 #define THREADS_LONGTEXT N_( \
     "Number of threads used for the transcoding." )
+#define GOP_TEXT N_("Parallel segments length")
+#define GOP_LONGTEXT N_( \
+    "Cuts the video into segments of that many pictures, each starting " \
+    "with a key frame, and encodes them in parallel, one per thread. " \
+    "Meant for intra-only codecs, and fixed GOP encodes whose key frame " \
+    "interval divides the length (0 disables)." )
 #define HP_TEXT N_("High priority")
 #define HP_LONGTEXT N_( \
     "Runs the optional encoder thread at the OUTPUT priority instead of " \
@@ -179,6 +191,8 @@ vlc_module_begin ()
                  MAXHEIGHT_LONGTEXT, true )
     add_module_list( SOUT_CFG_PREFIX "vfilter", "video filter2",
                      NULL, VFILTER_TEXT, VFILTER_LONGTEXT, false )
+    add_string( SOUT_CFG_PREFIX "ladder", NULL, LADDER_TEXT,
+                LADDER_LONGTEXT, true )
 
     set_section( N_("Audio"), NULL )
     add_module( SOUT_CFG_PREFIX "aenc", "encoder", NULL, AENC_TEXT,
@@ -216,6 +230,9 @@ vlc_module_begin ()
     set_section( N_("Miscellaneous"), NULL )
     add_integer( SOUT_CFG_PREFIX "threads", 0, THREADS_TEXT,
                  THREADS_LONGTEXT, true )
+    add_integer( SOUT_CFG_PREFIX "gop", 0, GOP_TEXT,
+                 GOP_LONGTEXT, true )
+        change_integer_range( 0, 100000 )
     add_bool( SOUT_CFG_PREFIX "high-priority", false, HP_TEXT, HP_LONGTEXT,
               true )
 
@@ -226,8 +243,8 @@ static const char *const ppsz_sout_options[] = {
     "scale", "fps", "width", "height", "vfilter", "deinterlace",
     "deinterlace-module", "threads", "aenc", "acodec", "ab", "alang",
     "afilter", "samplerate", "channels", "senc", "scodec", "soverlay",
-    "sfilter", "osd", "high-priority", "maxwidth", "maxheight",
-    NULL
+    "sfilter", "osd", "high-priority", "maxwidth", "maxheight", "ladder",
+    "gop", NULL
 };
 
 /*****************************************************************************
@@ -237,6 +254,55 @@ static sout_stream_id_sys_t *Add( sout_stream_t *, const es_format_t * );
 static void              Del ( sout_stream_t *, sout_stream_id_sys_t * );
 static int               Send( sout_stream_t *, sout_stream_id_sys_t *, block_t* );
 
+#define LADDER_MAX 16
+
+/* Parses "[W]x[H][@kbps]:..." */
+static int ParseLadder( sout_stream_t *p_stream, sout_stream_sys_t *p_sys,
+                        const char *psz_ladder )
+{
+    const char *psz = psz_ladder;
+
+    p_sys->p_ladder = calloc( LADDER_MAX, sizeof(*p_sys->p_ladder) );
+    if( !p_sys->p_ladder )
+        return VLC_ENOMEM;
+
+    while( *psz )
+    {
+        transcode_rung_t *p_rung = &p_sys->p_ladder[p_sys->i_ladder];
+        char *psz_end;
+
+        if( p_sys->i_ladder == LADDER_MAX )
+        {
+            msg_Err( p_stream, "too many renditions (at most %d)", LADDER_MAX );
+            return VLC_EGENERIC;
+        }
+
+        p_rung->i_width = strtoul( psz, &psz_end, 10 );
+        if( *psz_end == 'x' )
+            p_rung->i_height = strtoul( psz_end + 1, &psz_end, 10 );
+        p_rung->i_bitrate = p_sys->i_vbitrate;
+        if( *psz_end == '@' )
+        {
+            p_rung->i_bitrate = strtol( psz_end + 1, &psz_end, 10 );
+            if( p_rung->i_bitrate < 16000 ) p_rung->i_bitrate *= 1000;
+        }
+        if( ( *psz_end != ':' && *psz_end != '\0' ) ||
+            ( !p_rung->i_width && !p_rung->i_height && psz_end == psz ) )
+        {
+            msg_Err( p_stream, "invalid rendition in `%s'", psz_ladder );
+            return VLC_EGENERIC;
+        }
+        msg_Dbg( p_stream, "rendition %u: %ux%u %dkb/s", p_sys->i_ladder,
+                 p_rung->i_width, p_rung->i_height, p_rung->i_bitrate / 1000 );
+        p_sys->i_ladder++;
+
+        psz = psz_end;
+        if( *psz == ':' )
+            psz++;
+    }
+    return VLC_SUCCESS;
+}
+
 /*****************************************************************************
  * Open:
  *****************************************************************************/
@@ -351,6 +417,17 @@ static int Open( vlc_object_t *p_this )
 
     p_sys->i_maxheight = var_GetInteger( p_stream, SOUT_CFG_PREFIX "maxheight" );
 
+    psz_string = var_GetString( p_stream, SOUT_CFG_PREFIX "ladder" );
+    if( psz_string && *psz_string &&
+        ParseLadder( p_stream, p_sys, psz_string ) != VLC_SUCCESS )
+    {
+        free( psz_string );
+        p_stream->p_sys = p_sys;
+        Close( p_this );
+        return VLC_EGENERIC;
+    }
+    free( psz_string );
+
     psz_string = var_GetString( p_stream, SOUT_CFG_PREFIX "vfilter" );
     if( psz_string && *psz_string )
         p_sys->psz_vf2 = strdup(psz_string );
@@ -374,7 +451,14 @@ static int Open( vlc_object_t *p_this )
     free( psz_string );
 
     p_sys->i_threads = var_GetInteger( p_stream, SOUT_CFG_PREFIX "threads" );
+    p_sys->i_gop = var_GetInteger( p_stream, SOUT_CFG_PREFIX "gop" );
     p_sys->b_high_priority = var_GetBool( p_stream, SOUT_CFG_PREFIX "high-priority" );
+    p_sys->b_low_latency = var_InheritBool( p_stream, "sout-low-latency" );
+    if( p_sys->b_low_latency && p_sys->i_gop > 0 )
+    {
+        msg_Warn( p_stream, "parallel segments disabled for low latency" );
+        p_sys->i_gop = 0;
+    }
 
     if( p_sys->i_vcodec )
     {
@@ -479,6 +563,7 @@ static void Close( vlc_object_t * p_this )
     free( p_sys->psz_alang );
 
     free( p_sys->psz_vf2 );
+    free( p_sys->p_ladder );
 
     config_ChainDestroy( p_sys->p_video_cfg );
     free( p_sys->psz_venc );
@@ -625,6 +710,37 @@ static void Del( sout_stream_t *p_stream, sout_stream_id_sys_t *id )
     free( id );
 }
 
+static void LagAdd( sout_lag_t *p_lag, const block_t *p_chain,
+                    mtime_t i_now )
+{
+    for( ; p_chain != NULL; p_chain = p_chain->p_next )
+        sout_LagAdd( p_lag, p_chain->i_dts, i_now );
+}
+
+/* Reports how far behind the input clock the blocks come in and out */
+static void LagReport( sout_stream_t *p_stream, sout_stream_id_sys_t *id,
+                       mtime_t i_now )
+{
+    const sout_lag_t *p_in = &id->lag_in, *p_out = &id->lag_out;
+
+    if( i_now < id->i_lag_report )
+        return;
+
+    if( p_in->i_count > 0 && p_out->i_count > 0 )
+    {
+        mtime_t i_in = sout_LagAverage( p_in );
+        mtime_t i_out = sout_LagAverage( p_out );
+
+        msg_Info( p_stream, "%4.4s latency: in %"PRId64" ms, out %"PRId64
+                  " ms (max %"PRId64" ms), transcoding %"PRId64" ms",
+                  (char *)&id->p_decoder->fmt_in.i_codec, i_in / 1000,
+                  i_out / 1000, p_out->i_max / 1000, ( i_out - i_in ) / 1000 );
+    }
+    sout_LagReset( &id->lag_in );
+    sout_LagReset( &id->lag_out );
+    id->i_lag_report = i_now + SOUT_LAG_REPORT_PERIOD;
+}
+
 static int Send( sout_stream_t *p_stream, sout_stream_id_sys_t *id,
                  block_t *p_buffer )
 {
@@ -640,6 +756,9 @@ static int Send( sout_stream_t *p_stream, sout_stream_id_sys_t *id,
         return VLC_EGENERIC;
     }
 
+    if( p_sys->b_low_latency )
+        LagAdd( &id->lag_in, p_buffer, mdate() );
+
     switch( id->p_decoder->fmt_in.i_cat )
     {
     case AUDIO_ES:
@@ -681,6 +800,14 @@ static int Send( sout_stream_t *p_stream, sout_stream_id_sys_t *id,
         break;
     }
 
+    if( p_sys->b_low_latency )
+    {
+        mtime_t i_now = mdate();
+
+        LagAdd( &id->lag_out, p_out, i_now );
+        LagReport( p_stream, id, i_now );
+    }
+
     if( p_out )
         return sout_StreamIdSend( p_stream->p_next, id->id, p_out );
     return VLC_SUCCESS;
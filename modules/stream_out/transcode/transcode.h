@@ -11,19 +11,21 @@
 
 #include <vlc_picture_fifo.h>
 
+#include "encoder_pool.h"
+
 /*100ms is around the limit where people are noticing lipsync issues*/
 #define MASTER_SYNC_MAX_DRIFT 100000
 
-struct sout_stream_sys_t
+/* One rendition of a video ladder */
+typedef struct
 {
-    sout_stream_id_sys_t *id_video;
-    block_t         *p_buffers;
-    vlc_mutex_t     lock_out;
-    vlc_cond_t      cond;
-    bool            b_abort;
-    picture_fifo_t *pp_pics;
-    vlc_thread_t    thread;
+    unsigned int    i_width;
+    unsigned int    i_height;
+    int             i_bitrate;
+} transcode_rung_t;
 
+struct sout_stream_sys_t
+{
     /* Audio */
     vlc_fourcc_t    i_acodec;   /* codec audio (0 if not transcode) */
     char            *psz_aenc;
@@ -47,12 +49,17 @@ struct sout_stream_sys_t
     char            *psz_deinterlace;
     config_chain_t  *p_deinterlace_cfg;
     int             i_threads;
+    unsigned int    i_gop;      /* parallel segments length (0 if none) */
     bool            b_high_priority;
     bool            b_hurry_up;
+    bool            b_low_latency;
     unsigned int    fps_num,fps_den;
 
     char            *psz_vf2;
 
+    transcode_rung_t *p_ladder;
+    unsigned int    i_ladder;
+
     /* SPU */
     vlc_fourcc_t    i_scodec;   /* codec spu (0 if not transcode) */
     char            *psz_senc;
@@ -92,6 +99,34 @@ struct sout_stream_id_sys_t
              filter_chain_t  *p_f_chain; /**< Video filters */
              filter_chain_t  *p_uf_chain; /**< User-specified video filters */
              video_format_t  fmt_input_video;
+
+             /* Encoder thread */
+             bool            b_threaded;
+             block_t         *p_buffers;
+             vlc_mutex_t     lock_out;
+             vlc_cond_t      cond;
+             bool            b_abort;
+             picture_fifo_t  *pp_pics;
+             vlc_thread_t    thread;
+
+             /* GOP-parallel encoders, instead of the thread */
+             transcode_encoder_pool_t *p_pool;
+
+             /* Ladder: the decoding stream shares its pictures with
+              * renditions, which only scale and encode them */
+             sout_stream_id_sys_t **pp_renditions;
+             unsigned int    i_renditions;
+             sout_stream_id_sys_t *p_parent;
+             mtime_t         i_ladder_start;
+             mtime_t         i_ladder_report;
+             struct
+             {
+                 uint64_t    i_frames;
+                 uint64_t    i_bytes;
+                 mtime_t     i_busy;   /**< converting and encoding */
+                 size_t      i_queued; /**< bytes of the pending pictures */
+                 size_t      i_queued_max;
+             } stats;
          };
          struct
          {
@@ -104,6 +139,11 @@ struct sout_stream_id_sys_t
     /* Encoder */
     encoder_t       *p_encoder;
 
+    /* Low latency statistics */
+    sout_lag_t      lag_in;
+    sout_lag_t      lag_out;
+    mtime_t         i_lag_report;
+
     /* Sync */
     date_t          next_input_pts; /**< Incoming calculated PTS */
     date_t          next_output_pts; /**< output calculated PTS */
@@ -37,6 +37,7 @@
 
 #define ENC_FRAMERATE (25 * 1000)
 #define ENC_FRAMERATE_BASE 1000
+#define LADDER_REPORT_PERIOD (CLOCK_FREQ * 10)
 
 struct decoder_owner_sys_t
 {
@@ -66,58 +67,298 @@ static picture_t *transcode_video_filter_buffer_new( filter_t *p_filter )
     return picture_NewFromFormat( &p_filter->fmt_out.video );
 }
 
+static size_t transcode_picture_size( const picture_t *p_pic )
+{
+    size_t i_size = 0;
+    for( int i = 0; i < p_pic->i_planes; i++ )
+        i_size += (size_t)p_pic->p[i].i_pitch * p_pic->p[i].i_lines;
+    return i_size;
+}
+
+static void transcode_video_picture_destroy( picture_t *p_pic )
+{
+    picture_Release( (picture_t *)p_pic->p_sys );
+    free( p_pic );
+}
+
+/* Gives a rendition a picture of its own, sharing the pixels of the
+ * original one, as the picture fifo cannot hold a picture twice. */
+static picture_t *transcode_video_picture_share( picture_t *p_pic )
+{
+    picture_resource_t res = {
+        .p_sys = (picture_sys_t *)picture_Hold( p_pic ),
+        .pf_destroy = transcode_video_picture_destroy,
+    };
+    for( int i = 0; i < p_pic->i_planes; i++ )
+    {
+        res.p[i].p_pixels = p_pic->p[i].p_pixels;
+        res.p[i].i_lines = p_pic->p[i].i_lines;
+        res.p[i].i_pitch = p_pic->p[i].i_pitch;
+    }
+
+    picture_t *p_share = picture_NewFromResource( &p_pic->format, &res );
+    if( unlikely( !p_share ) )
+    {
+        picture_Release( p_pic );
+        return NULL;
+    }
+    picture_CopyProperties( p_share, p_pic );
+    return p_share;
+}
+
+/* Scales a shared picture to the size of the rendition. The conversion is
+ * set up again, within the encoder thread, whenever the source changes. */
+static picture_t *transcode_video_rendition_convert( sout_stream_id_sys_t *id,
+                                                     picture_t *p_pic )
+{
+    const video_format_t *p_enc = &id->p_encoder->fmt_in.video;
+
+    if( unlikely( !video_format_IsSimilar( &id->fmt_input_video,
+                                           &p_pic->format ) ) )
+    {
+        es_format_t fmt;
+
+        es_format_Init( &fmt, VIDEO_ES, p_pic->format.i_chroma );
+        fmt.video = p_pic->format;
+        filter_chain_Reset( id->p_f_chain, &fmt, &id->p_encoder->fmt_in );
+        if( fmt.video.i_chroma != p_enc->i_chroma ||
+            fmt.video.i_width != p_enc->i_width ||
+            fmt.video.i_height != p_enc->i_height )
+            filter_chain_AppendFilter( id->p_f_chain, NULL, NULL, &fmt,
+                                       &id->p_encoder->fmt_in );
+        id->fmt_input_video = p_pic->format;
+    }
+
+    p_pic = filter_chain_VideoFilter( id->p_f_chain, p_pic );
+    if( p_pic && ( p_pic->format.i_chroma != p_enc->i_chroma ||
+                   p_pic->format.i_width != p_enc->i_width ||
+                   p_pic->format.i_height != p_enc->i_height ) )
+    {
+        /* no converter */
+        picture_Release( p_pic );
+        p_pic = NULL;
+    }
+    return p_pic;
+}
+
+static block_t *transcode_video_encode( sout_stream_id_sys_t *id,
+                                        picture_t *p_pic )
+{
+    if( id->p_parent )
+    {
+        p_pic = transcode_video_rendition_convert( id, p_pic );
+        if( !p_pic )
+            return NULL;
+    }
+
+    block_t *p_block = id->p_encoder->pf_encode_video( id->p_encoder, p_pic );
+    picture_Release( p_pic );
+    return p_block;
+}
+
 static void* EncoderThread( void *obj )
 {
-    sout_stream_sys_t *p_sys = (sout_stream_sys_t*)obj;
-    sout_stream_id_sys_t *id = p_sys->id_video;
+    sout_stream_id_sys_t *id = obj;
     picture_t *p_pic = NULL;
     int canc = vlc_savecancel ();
     block_t *p_block = NULL;
 
-    vlc_mutex_lock( &p_sys->lock_out );
+    vlc_mutex_lock( &id->lock_out );
 
     for( ;; )
     {
-        while( !p_sys->b_abort &&
-               (p_pic = picture_fifo_Pop( p_sys->pp_pics )) == NULL )
-            vlc_cond_wait( &p_sys->cond, &p_sys->lock_out );
+        while( !id->b_abort &&
+               (p_pic = picture_fifo_Pop( id->pp_pics )) == NULL )
+            vlc_cond_wait( &id->cond, &id->lock_out );
 
         if( p_pic )
         {
-            /* release lock while encoding */
-            vlc_mutex_unlock( &p_sys->lock_out );
-            p_block = id->p_encoder->pf_encode_video( id->p_encoder, p_pic );
-            picture_Release( p_pic );
-            vlc_mutex_lock( &p_sys->lock_out );
+            id->stats.i_queued -= transcode_picture_size( p_pic );
 
-            block_ChainAppend( &p_sys->p_buffers, p_block );
+            /* release lock while encoding */
+            vlc_mutex_unlock( &id->lock_out );
+            mtime_t i_start = mdate();
+            p_block = transcode_video_encode( id, p_pic );
+            mtime_t i_busy = mdate() - i_start;
+            vlc_mutex_lock( &id->lock_out );
+
+            id->stats.i_frames++;
+            id->stats.i_busy += i_busy;
+            block_ChainAppend( &id->p_buffers, p_block );
         }
 
-        if( p_sys->b_abort )
+        if( id->b_abort )
             break;
     }
 
     /*Encode what we have in the buffer on closing*/
-    while( (p_pic = picture_fifo_Pop( p_sys->pp_pics )) != NULL )
+    while( (p_pic = picture_fifo_Pop( id->pp_pics )) != NULL )
     {
-        p_block = id->p_encoder->pf_encode_video( id->p_encoder, p_pic );
-        picture_Release( p_pic );
-        block_ChainAppend( &p_sys->p_buffers, p_block );
+        id->stats.i_queued -= transcode_picture_size( p_pic );
+        p_block = transcode_video_encode( id, p_pic );
+        id->stats.i_frames++;
+        block_ChainAppend( &id->p_buffers, p_block );
     }
 
     /*Now flush encoder*/
     do {
         p_block = id->p_encoder->pf_encode_video(id->p_encoder, NULL );
-        block_ChainAppend( &p_sys->p_buffers, p_block );
+        block_ChainAppend( &id->p_buffers, p_block );
     } while( p_block );
 
-    vlc_mutex_unlock( &p_sys->lock_out );
+    vlc_mutex_unlock( &id->lock_out );
 
     vlc_restorecancel (canc);
 
     return NULL;
 }
 
+static int transcode_video_thread_start( sout_stream_t *p_stream,
+                                         sout_stream_id_sys_t *id )
+{
+    int i_priority = p_stream->p_sys->b_high_priority ?
+                        VLC_THREAD_PRIORITY_OUTPUT : VLC_THREAD_PRIORITY_VIDEO;
+
+    id->pp_pics = picture_fifo_New();
+    if( id->pp_pics == NULL )
+    {
+        msg_Err( p_stream, "cannot create picture fifo" );
+        return VLC_ENOMEM;
+    }
+    vlc_mutex_init( &id->lock_out );
+    vlc_cond_init( &id->cond );
+    id->p_buffers = NULL;
+    id->b_abort = false;
+    if( vlc_clone( &id->thread, EncoderThread, id, i_priority ) )
+    {
+        msg_Err( p_stream, "cannot spawn encoder thread" );
+        vlc_mutex_destroy( &id->lock_out );
+        vlc_cond_destroy( &id->cond );
+        picture_fifo_Delete( id->pp_pics );
+        return VLC_EGENERIC;
+    }
+    id->b_threaded = true;
+    return VLC_SUCCESS;
+}
+
+/* Encodes the pending pictures, flushes the encoder, and waits for the
+ * thread to end. The last blocks are left in p_buffers. */
+static void transcode_video_thread_stop( sout_stream_id_sys_t *id )
+{
+    vlc_mutex_lock( &id->lock_out );
+    id->b_abort = true;
+    vlc_cond_signal( &id->cond );
+    vlc_mutex_unlock( &id->lock_out );
+
+    vlc_join( id->thread, NULL );
+}
+
+static void transcode_video_thread_clean( sout_stream_id_sys_t *id )
+{
+    if( !id->b_threaded )
+        return;
+
+    if( !id->b_abort )
+        transcode_video_thread_stop( id );
+    picture_fifo_Delete( id->pp_pics );
+    block_ChainRelease( id->p_buffers );
+    vlc_mutex_destroy( &id->lock_out );
+    vlc_cond_destroy( &id->cond );
+    id->b_threaded = false;
+}
+
+static void transcode_video_queue( sout_stream_id_sys_t *id, picture_t *p_pic )
+{
+    size_t i_size = transcode_picture_size( p_pic );
+
+    vlc_mutex_lock( &id->lock_out );
+    picture_fifo_Push( id->pp_pics, p_pic );
+    id->stats.i_queued += i_size;
+    if( id->stats.i_queued > id->stats.i_queued_max )
+        id->stats.i_queued_max = id->stats.i_queued;
+    vlc_cond_signal( &id->cond );
+    vlc_mutex_unlock( &id->lock_out );
+}
+
+/* Opens a copy of the main encoder, for the segments of a worker */
+static encoder_t *transcode_video_pool_open( vlc_object_t *p_obj, void *opaque,
+                                             const video_format_t *p_fmt )
+{
+    sout_stream_t *p_stream = (sout_stream_t *)p_obj;
+    sout_stream_sys_t *p_sys = p_stream->p_sys;
+    sout_stream_id_sys_t *id = opaque;
+
+    encoder_t *p_enc = sout_EncoderCreate( p_stream );
+    if( !p_enc )
+        return NULL;
+
+    es_format_Copy( &p_enc->fmt_in, &id->p_encoder->fmt_in );
+    es_format_Copy( &p_enc->fmt_out, &id->p_encoder->fmt_out );
+    free( p_enc->fmt_out.p_extra );
+    p_enc->fmt_out.p_extra = NULL;
+    p_enc->fmt_out.i_extra = 0;
+    /* The pictures may have changed since the main encoder was opened */
+    p_enc->fmt_in.i_codec = p_fmt->i_chroma;
+    p_enc->fmt_in.video.i_chroma = p_fmt->i_chroma;
+    p_enc->fmt_in.video.i_width = p_fmt->i_width;
+    p_enc->fmt_in.video.i_height = p_fmt->i_height;
+    p_enc->fmt_in.video.i_visible_width = p_fmt->i_visible_width;
+    p_enc->fmt_in.video.i_visible_height = p_fmt->i_visible_height;
+    p_enc->fmt_in.video.i_x_offset = p_fmt->i_x_offset;
+    p_enc->fmt_in.video.i_y_offset = p_fmt->i_y_offset;
+    /* Segments run in parallel already */
+    p_enc->i_threads = 1;
+    p_enc->p_cfg = p_sys->p_video_cfg;
+
+    p_enc->p_module = module_need( p_enc, "encoder", p_sys->psz_venc, true );
+    if( !p_enc->p_module )
+    {
+        msg_Err( p_stream, "cannot open segment encoder" );
+        es_format_Clean( &p_enc->fmt_in );
+        es_format_Clean( &p_enc->fmt_out );
+        vlc_object_release( p_enc );
+        return NULL;
+    }
+    return p_enc;
+}
+
+static void transcode_video_pool_close( vlc_object_t *p_obj, void *opaque,
+                                        encoder_t *p_enc )
+{
+    VLC_UNUSED(p_obj); VLC_UNUSED(opaque);
+
+    module_unneed( p_enc, p_enc->p_module );
+    es_format_Clean( &p_enc->fmt_in );
+    es_format_Clean( &p_enc->fmt_out );
+    vlc_object_release( p_enc );
+}
+
+static int transcode_video_pool_start( sout_stream_t *p_stream,
+                                       sout_stream_id_sys_t *id )
+{
+    sout_stream_sys_t *p_sys = p_stream->p_sys;
+    const transcode_encoder_pool_cbs_t cbs = {
+        .pf_open = transcode_video_pool_open,
+        .pf_close = transcode_video_pool_close,
+        .opaque = id,
+    };
+    unsigned i_workers = p_sys->i_threads > 0 ? (unsigned)p_sys->i_threads
+                                               : vlc_GetCPUCount();
+    int i_priority = p_sys->b_high_priority ? VLC_THREAD_PRIORITY_OUTPUT
+                                            : VLC_THREAD_PRIORITY_VIDEO;
+
+    id->p_pool = transcode_encoder_pool_New( VLC_OBJECT(p_stream), i_workers,
+                                             p_sys->i_gop, i_priority, &cbs );
+    if( !id->p_pool )
+    {
+        msg_Err( p_stream, "cannot create encoder pool" );
+        return VLC_EGENERIC;
+    }
+    msg_Dbg( p_stream, "encoding segments of %u pictures on %u threads",
+             p_sys->i_gop, i_workers );
+    return VLC_SUCCESS;
+}
+
 int transcode_video_new( sout_stream_t *p_stream, sout_stream_id_sys_t *id )
 {
     sout_stream_sys_t *p_sys = p_stream->p_sys;
@@ -211,31 +452,15 @@ int transcode_video_new( sout_stream_t *p_stream, sout_stream_id_sys_t *id )
     }
     id->p_encoder->p_module = NULL;
 
-    if( p_sys->i_threads <= 0 )
+    /* Renditions of a ladder have threads of their own, and segments are
+     * encoded by a pool of them. For low latency, the encoder threads
+     * (if any) are its own, and pictures are not queued for it */
+    if( p_sys->i_threads <= 0 || p_sys->i_ladder > 0 || p_sys->i_gop > 0
+     || p_sys->b_low_latency )
         return VLC_SUCCESS;
 
-    int i_priority = p_sys->b_high_priority ? VLC_THREAD_PRIORITY_OUTPUT :
-                       VLC_THREAD_PRIORITY_VIDEO;
-    p_sys->id_video = id;
-    p_sys->pp_pics = picture_fifo_New();
-    if( p_sys->pp_pics == NULL )
+    if( transcode_video_thread_start( p_stream, id ) != VLC_SUCCESS )
     {
-        msg_Err( p_stream, "cannot create picture fifo" );
-        module_unneed( id->p_decoder, id->p_decoder->p_module );
-        id->p_decoder->p_module = NULL;
-        free( id->p_decoder->p_owner );
-        return VLC_ENOMEM;
-    }
-    vlc_mutex_init( &p_sys->lock_out );
-    vlc_cond_init( &p_sys->cond );
-    p_sys->p_buffers = NULL;
-    p_sys->b_abort = false;
-    if( vlc_clone( &p_sys->thread, EncoderThread, p_sys, i_priority ) )
-    {
-        msg_Err( p_stream, "cannot spawn encoder thread" );
-        vlc_mutex_destroy( &p_sys->lock_out );
-        vlc_cond_destroy( &p_sys->cond );
-        picture_fifo_Delete( p_sys->pp_pics );
         module_unneed( id->p_decoder, id->p_decoder->p_module );
         id->p_decoder->p_module = NULL;
         free( id->p_decoder->p_owner );
@@ -540,7 +765,16 @@ static int transcode_video_encoder_open( sout_stream_t *p_stream,
                                          sout_stream_id_sys_t *id )
 {
     sout_stream_sys_t *p_sys = p_stream->p_sys;
+    const es_format_t *p_fmt_out = &id->p_decoder->fmt_out;
 
+    if( id->p_f_chain )
+        p_fmt_out = filter_chain_GetFmtOut( id->p_f_chain );
+    if( id->p_uf_chain )
+        p_fmt_out = filter_chain_GetFmtOut( id->p_uf_chain );
+
+    /* Offer the pictures as the filters output them: the encoder keeps this
+     * chroma if it can read it, and no conversion filter copies them then */
+    id->p_encoder->fmt_in.i_codec = p_fmt_out->video.i_chroma;
 
     msg_Dbg( p_stream, "destination (after video filters) %ix%i",
              id->p_encoder->fmt_in.video.i_width,
@@ -557,6 +791,7 @@ static int transcode_video_encoder_open( sout_stream_t *p_stream,
     }
 
     id->p_encoder->fmt_in.video.i_chroma = id->p_encoder->fmt_in.i_codec;
+    conversion_video_filter_append( id );
 
     /*  */
     id->p_encoder->fmt_out.i_codec =
@@ -572,24 +807,225 @@ static int transcode_video_encoder_open( sout_stream_t *p_stream,
     return VLC_SUCCESS;
 }
 
-void transcode_video_close( sout_stream_t *p_stream,
-                                   sout_stream_id_sys_t *id )
+static int transcode_video_ladder_new( sout_stream_t *p_stream,
+                                       sout_stream_id_sys_t *id )
 {
-    if( p_stream->p_sys->i_threads >= 1 && !p_stream->p_sys->b_abort )
+    sout_stream_sys_t *p_sys = p_stream->p_sys;
+
+    id->pp_renditions = calloc( p_sys->i_ladder, sizeof(*id->pp_renditions) );
+    if( !id->pp_renditions )
+        return VLC_ENOMEM;
+
+    for( unsigned i = 0; i < p_sys->i_ladder; i++ )
+    {
+        const transcode_rung_t *p_rung = &p_sys->p_ladder[i];
+        sout_stream_id_sys_t *p_rendition = calloc( 1, sizeof(*p_rendition) );
+        if( !p_rendition )
+            return VLC_ENOMEM;
+        id->pp_renditions[id->i_renditions++] = p_rendition;
+
+        p_rendition->b_transcode = true;
+        p_rendition->p_parent = id;
+        /* Borrowed, for its output format only */
+        p_rendition->p_decoder = id->p_decoder;
+
+        encoder_t *p_enc = sout_EncoderCreate( p_stream );
+        if( !p_enc )
+            return VLC_ENOMEM;
+        p_enc->p_module = NULL;
+        p_rendition->p_encoder = p_enc;
+
+        /* Same encoder as the probed one, but for the size and bitrate */
+        es_format_Copy( &p_enc->fmt_in, &id->p_encoder->fmt_in );
+        es_format_Copy( &p_enc->fmt_out, &id->p_encoder->fmt_out );
+        p_enc->fmt_out.video.i_visible_width  = p_rung->i_width & ~1;
+        p_enc->fmt_out.video.i_visible_height = p_rung->i_height & ~1;
+        p_enc->fmt_out.i_bitrate = p_rung->i_bitrate;
+        /* The first rendition stands for the source stream */
+        if( i > 0 )
+            p_enc->fmt_out.i_id = -1;
+
+        p_enc->i_threads = p_sys->i_threads;
+        p_enc->p_cfg = p_sys->p_video_cfg;
+    }
+    return VLC_SUCCESS;
+}
+
+/* Sets up the shared filters, and the renditions on the first picture */
+static int transcode_video_ladder_init( sout_stream_t *p_stream,
+                                        sout_stream_id_sys_t *id )
+{
+    const bool b_open = id->pp_renditions[0]->p_encoder->p_module != NULL;
+
+    if( b_open && video_format_IsSimilar( &id->fmt_input_video,
+                                          &id->p_decoder->fmt_out.video ) )
+        return VLC_SUCCESS;
+
+    if( id->p_f_chain )
+        filter_chain_Delete( id->p_f_chain );
+    if( id->p_uf_chain )
+        filter_chain_Delete( id->p_uf_chain );
+    id->p_f_chain = id->p_uf_chain = NULL;
+
+    transcode_video_filter_init( p_stream, id );
+    memcpy( &id->fmt_input_video, &id->p_decoder->fmt_out.video, sizeof(video_format_t));
+    if( b_open )
+        return VLC_SUCCESS; /* renditions follow on their own */
+
+    filter_owner_t owner = {
+        .sys = p_stream->p_sys,
+        .video = {
+            .buffer_new = transcode_video_filter_buffer_new,
+        },
+    };
+    const es_format_t *p_fmt_out =
+        filter_chain_GetFmtOut( id->p_uf_chain ? id->p_uf_chain : id->p_f_chain );
+
+    for( unsigned i = 0; i < id->i_renditions; i++ )
+    {
+        sout_stream_id_sys_t *p_rendition = id->pp_renditions[i];
+        encoder_t *p_enc = p_rendition->p_encoder;
+
+        /* Scaling and chroma conversion only */
+        p_rendition->p_f_chain = filter_chain_NewVideo( p_stream, false, &owner );
+        if( !p_rendition->p_f_chain )
+            return VLC_ENOMEM;
+        filter_chain_Reset( p_rendition->p_f_chain, p_fmt_out, p_fmt_out );
+        p_enc->fmt_in.video.i_chroma = p_enc->fmt_in.i_codec;
+
+        transcode_video_encoder_init( p_stream, p_rendition );
+        p_rendition->fmt_input_video = p_fmt_out->video;
+
+        free( p_enc->fmt_out.psz_description );
+        if( asprintf( &p_enc->fmt_out.psz_description, "%ux%u %d kb/s",
+                      p_enc->fmt_out.video.i_visible_width,
+                      p_enc->fmt_out.video.i_visible_height,
+                      p_enc->fmt_out.i_bitrate / 1000 ) < 0 )
+            p_enc->fmt_out.psz_description = NULL;
+
+        if( transcode_video_encoder_open( p_stream, p_rendition ) != VLC_SUCCESS
+         || transcode_video_thread_start( p_stream, p_rendition ) != VLC_SUCCESS )
+            return VLC_EGENERIC;
+    }
+
+    id->i_ladder_start = mdate();
+    id->i_ladder_report = id->i_ladder_start + LADDER_REPORT_PERIOD;
+    return VLC_SUCCESS;
+}
+
+static void transcode_video_ladder_report( sout_stream_t *p_stream,
+                                           sout_stream_id_sys_t *id,
+                                           bool b_final )
+{
+    mtime_t i_elapsed = __MAX( mdate() - id->i_ladder_start, 1 );
+
+    for( unsigned i = 0; i < id->i_renditions; i++ )
+    {
+        sout_stream_id_sys_t *p_rendition = id->pp_renditions[i];
+        const video_format_t *p_fmt = &p_rendition->p_encoder->fmt_out.video;
+
+        if( !p_rendition->b_threaded )
+            continue;
+
+        vlc_mutex_lock( &p_rendition->lock_out );
+        uint64_t i_frames = p_rendition->stats.i_frames;
+        mtime_t i_busy = p_rendition->stats.i_busy;
+        size_t i_queued = p_rendition->stats.i_queued;
+        size_t i_queued_max = p_rendition->stats.i_queued_max;
+        vlc_mutex_unlock( &p_rendition->lock_out );
+
+        msg_Generic( p_stream, b_final ? VLC_MSG_INFO : VLC_MSG_DBG,
+                     "rendition %ux%u: %"PRIu64" frames, %"PRIu64" kb/s, "
+                     "%.1f%% of a CPU, %zu KiB of pending pictures "
+                     "(%zu KiB at most)",
+                     p_fmt->i_visible_width, p_fmt->i_visible_height,
+                     i_frames,
+                     p_rendition->stats.i_bytes * 8000 / i_elapsed,
+                     100. * i_busy / i_elapsed,
+                     i_queued / 1024, i_queued_max / 1024 );
+    }
+}
+
+/* Sends what the renditions have encoded so far */
+static void transcode_video_ladder_send( sout_stream_t *p_stream,
+                                         sout_stream_id_sys_t *id )
+{
+    for( unsigned i = 0; i < id->i_renditions; i++ )
+    {
+        sout_stream_id_sys_t *p_rendition = id->pp_renditions[i];
+
+        if( !p_rendition->b_threaded )
+            continue;
+
+        vlc_mutex_lock( &p_rendition->lock_out );
+        block_t *p_out = p_rendition->p_buffers;
+        p_rendition->p_buffers = NULL;
+        vlc_mutex_unlock( &p_rendition->lock_out );
+
+        if( !p_out )
+            continue;
+        for( block_t *p_block = p_out; p_block; p_block = p_block->p_next )
+            p_rendition->stats.i_bytes += p_block->i_buffer;
+        sout_StreamIdSend( p_stream->p_next, p_rendition->id, p_out );
+    }
+
+    if( id->i_ladder_start && mdate() >= id->i_ladder_report )
+    {
+        transcode_video_ladder_report( p_stream, id, false );
+        id->i_ladder_report += LADDER_REPORT_PERIOD;
+    }
+}
+
+static void transcode_video_ladder_close( sout_stream_t *p_stream,
+                                          sout_stream_id_sys_t *id )
+{
+    if( !id->i_renditions )
+        return;
+
+    for( unsigned i = 0; i < id->i_renditions; i++ )
     {
-        vlc_mutex_lock( &p_stream->p_sys->lock_out );
-        p_stream->p_sys->b_abort = true;
-        vlc_cond_signal( &p_stream->p_sys->cond );
-        vlc_mutex_unlock( &p_stream->p_sys->lock_out );
+        sout_stream_id_sys_t *p_rendition = id->pp_renditions[i];
+        if( p_rendition->b_threaded && !p_rendition->b_abort )
+            transcode_video_thread_stop( p_rendition );
+    }
+    if( id->i_ladder_start )
+        transcode_video_ladder_report( p_stream, id, true );
 
-        vlc_join( p_stream->p_sys->thread, NULL );
+    for( unsigned i = 0; i < id->i_renditions; i++ )
+    {
+        sout_stream_id_sys_t *p_rendition = id->pp_renditions[i];
 
-        picture_fifo_Delete( p_stream->p_sys->pp_pics );
-        block_ChainRelease( p_stream->p_sys->p_buffers );
+        transcode_video_thread_clean( p_rendition );
+        if( p_rendition->p_encoder )
+        {
+            if( p_rendition->p_encoder->p_module )
+                module_unneed( p_rendition->p_encoder,
+                               p_rendition->p_encoder->p_module );
+            es_format_Clean( &p_rendition->p_encoder->fmt_in );
+            es_format_Clean( &p_rendition->p_encoder->fmt_out );
+            vlc_object_release( p_rendition->p_encoder );
+        }
+        if( p_rendition->p_f_chain )
+            filter_chain_Delete( p_rendition->p_f_chain );
+        if( p_rendition->id )
+            sout_StreamIdDel( p_stream->p_next, p_rendition->id );
+        free( p_rendition );
     }
+    free( id->pp_renditions );
+    id->pp_renditions = NULL;
+    id->i_renditions = 0;
+}
 
-    vlc_mutex_destroy( &p_stream->p_sys->lock_out );
-    vlc_cond_destroy( &p_stream->p_sys->cond );
+void transcode_video_close( sout_stream_t *p_stream,
+                                   sout_stream_id_sys_t *id )
+{
+    if( id->p_pool )
+    {
+        transcode_encoder_pool_Delete( id->p_pool );
+        id->p_pool = NULL;
+    }
+    transcode_video_thread_clean( id );
+    transcode_video_ladder_close( p_stream, id );
 
     /* Close decoder */
     if( id->p_decoder->p_module )
@@ -613,7 +1049,6 @@ void transcode_video_close( sout_stream_t *p_stream,
 static void OutputFrame( sout_stream_t *p_stream, picture_t *p_pic, sout_stream_id_sys_t *id, block_t **out )
 {
     sout_stream_sys_t *p_sys = p_stream->p_sys;
-    picture_t *p_pic2 = NULL;
 
     /*
      * Encoding
@@ -621,7 +1056,9 @@ static void OutputFrame( sout_stream_t *p_stream, picture_t *p_pic, sout_stream_
     /* Check if we have a subpicture to overlay */
     if( p_sys->p_spu )
     {
-        video_format_t fmt = id->p_encoder->fmt_in.video;
+        /* Renditions are scaled afterwards, overlay on the shared picture */
+        video_format_t fmt = id->i_renditions ? p_pic->format
+                                              : id->p_encoder->fmt_in.video;
         if( fmt.i_visible_width <= 0 || fmt.i_visible_height <= 0 )
         {
             fmt.i_visible_width  = fmt.i_width;
@@ -641,7 +1078,9 @@ static void OutputFrame( sout_stream_t *p_stream, picture_t *p_pic, sout_stream_
             {
                 /* We can't modify the picture, we need to duplicate it,
                  * in this point the picture is already p_encoder->fmt.in format*/
-                picture_t *p_tmp = video_new_buffer_encoder( id->p_encoder );
+                picture_t *p_tmp = id->i_renditions
+                                 ? picture_NewFromFormat( &p_pic->format )
+                                 : video_new_buffer_encoder( id->p_encoder );
                 if( likely( p_tmp ) )
                 {
                     picture_Copy( p_tmp, p_pic );
@@ -657,26 +1096,29 @@ static void OutputFrame( sout_stream_t *p_stream, picture_t *p_pic, sout_stream_
         }
     }
 
-    if( p_sys->i_threads == 0 )
+    if( id->i_renditions )
+    {
+        /* Fan out, without copying the pixels */
+        for( unsigned i = 0; i < id->i_renditions; i++ )
+        {
+            picture_t *p_share = transcode_video_picture_share( p_pic );
+            if( likely( p_share ) )
+                transcode_video_queue( id->pp_renditions[i], p_share );
+        }
+        picture_Release( p_pic );
+    }
+    else if( id->p_pool )
+        transcode_encoder_pool_Push( id->p_pool, p_pic );
+    else if( !id->b_threaded )
     {
         block_t *p_block;
 
         p_block = id->p_encoder->pf_encode_video( id->p_encoder, p_pic );
         block_ChainAppend( out, p_block );
-    }
-
-    if( p_sys->i_threads )
-    {
-        vlc_mutex_lock( &p_sys->lock_out );
-        picture_fifo_Push( p_sys->pp_pics, p_pic );
-        vlc_cond_signal( &p_sys->cond );
-        vlc_mutex_unlock( &p_sys->lock_out );
-    }
-
-    if( p_sys->i_threads && p_pic2 )
-        picture_Release( p_pic2 );
-    else if ( p_sys->i_threads == 0 )
         picture_Release( p_pic );
+    }
+    else
+        transcode_video_queue( id, p_pic );
 }
 
 int transcode_video_process( sout_stream_t *p_stream, sout_stream_id_sys_t *id,
@@ -688,7 +1130,19 @@ int transcode_video_process( sout_stream_t *p_stream, sout_stream_id_sys_t *id,
 
     if( unlikely( in == NULL ) )
     {
-        if( p_sys->i_threads == 0 )
+        if( id->i_renditions )
+        {
+            for( unsigned i = 0; i < id->i_renditions; i++ )
+            {
+                sout_stream_id_sys_t *p_rendition = id->pp_renditions[i];
+                if( p_rendition->b_threaded && !p_rendition->b_abort )
+                    transcode_video_thread_stop( p_rendition );
+            }
+            transcode_video_ladder_send( p_stream, id );
+        }
+        else if( id->p_pool )
+            *out = transcode_encoder_pool_Flush( id->p_pool );
+        else if( !id->b_threaded )
         {
             block_t *p_block;
             do {
@@ -699,16 +1153,11 @@ int transcode_video_process( sout_stream_t *p_stream, sout_stream_id_sys_t *id,
         else
         {
             msg_Dbg( p_stream, "Flushing thread and waiting that");
-            vlc_mutex_lock( &p_stream->p_sys->lock_out );
-            p_stream->p_sys->b_abort = true;
-            vlc_cond_signal( &p_stream->p_sys->cond );
-            vlc_mutex_unlock( &p_stream->p_sys->lock_out );
-
-            vlc_join( p_stream->p_sys->thread, NULL );
-            vlc_mutex_lock( &p_sys->lock_out );
-            *out = p_sys->p_buffers;
-            p_sys->p_buffers = NULL;
-            vlc_mutex_unlock( &p_sys->lock_out );
+            transcode_video_thread_stop( id );
+            vlc_mutex_lock( &id->lock_out );
+            *out = id->p_buffers;
+            id->p_buffers = NULL;
+            vlc_mutex_unlock( &id->lock_out );
 
             msg_Dbg( p_stream, "Flushing done");
         }
@@ -729,6 +1178,10 @@ int transcode_video_process( sout_stream_t *p_stream, sout_stream_id_sys_t *id,
                         id->fmt_input_video.i_sar_num, id->p_decoder->fmt_out.video.i_sar_num,
                         id->fmt_input_video.i_sar_den, id->p_decoder->fmt_out.video.i_sar_den
                     );
+            /* Segments are encoded with the former format */
+            if( id->p_pool )
+                block_ChainAppend( out, transcode_encoder_pool_Flush( id->p_pool ) );
+
             /* Close filters */
             if( id->p_f_chain )
                 filter_chain_Delete( id->p_f_chain );
@@ -749,7 +1202,17 @@ int transcode_video_process( sout_stream_t *p_stream, sout_stream_id_sys_t *id,
         }
 
 
-        if( unlikely( !id->p_encoder->p_module ) )
+        if( id->i_renditions )
+        {
+            if( transcode_video_ladder_init( p_stream, id ) != VLC_SUCCESS )
+            {
+                picture_Release( p_pic );
+                transcode_video_close( p_stream, id );
+                id->b_transcode = false;
+                return VLC_EGENERIC;
+            }
+        }
+        else if( unlikely( !id->p_encoder->p_module ) )
         {
             if( id->p_f_chain )
                 filter_chain_Delete( id->p_f_chain );
@@ -759,10 +1222,11 @@ int transcode_video_process( sout_stream_t *p_stream, sout_stream_id_sys_t *id,
 
             transcode_video_filter_init( p_stream, id );
             transcode_video_encoder_init( p_stream, id );
-            conversion_video_filter_append( id );
             memcpy( &id->fmt_input_video, &id->p_decoder->fmt_out.video, sizeof(video_format_t));
 
-            if( transcode_video_encoder_open( p_stream, id ) != VLC_SUCCESS )
+            if( transcode_video_encoder_open( p_stream, id ) != VLC_SUCCESS ||
+                ( p_sys->i_gop > 0 &&
+                  transcode_video_pool_start( p_stream, id ) != VLC_SUCCESS ) )
             {
                 picture_Release( p_pic );
                 transcode_video_close( p_stream, id );
@@ -802,13 +1266,17 @@ int transcode_video_process( sout_stream_t *p_stream, sout_stream_id_sys_t *id,
         }
     }
 
-    if( p_sys->i_threads >= 1 )
+    if( id->i_renditions )
+        transcode_video_ladder_send( p_stream, id );
+    else if( id->p_pool )
+        block_ChainAppend( out, transcode_encoder_pool_Get( id->p_pool ) );
+    else if( id->b_threaded )
     {
         /* Pick up any return data the encoder thread wants to output. */
-        vlc_mutex_lock( &p_sys->lock_out );
-        *out = p_sys->p_buffers;
-        p_sys->p_buffers = NULL;
-        vlc_mutex_unlock( &p_sys->lock_out );
+        vlc_mutex_lock( &id->lock_out );
+        *out = id->p_buffers;
+        id->p_buffers = NULL;
+        vlc_mutex_unlock( &id->lock_out );
     }
 
     return VLC_SUCCESS;
@@ -846,6 +1314,14 @@ bool transcode_video_add( sout_stream_t *p_stream, const es_format_t *p_fmt,
         id->p_encoder->fmt_in.video.i_frame_rate_base = id->p_encoder->fmt_out.video.i_frame_rate_base = (p_sys->fps_den ? p_sys->fps_den : 1);
     }
 
+    if( p_sys->i_ladder > 0 &&
+        transcode_video_ladder_new( p_stream, id ) != VLC_SUCCESS )
+    {
+        msg_Err( p_stream, "cannot create video renditions" );
+        transcode_video_close( p_stream, id );
+        return false;
+    }
+
     return true;
 }
 
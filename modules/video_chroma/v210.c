@@ -0,0 +1,493 @@
+/*****************************************************************************
+ * v210.c: v210 packing and unpacking
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ * Copyright (C) 2009 Michael Niedermayer <michaelni@gmx.at>
+ * Copyright (c) 2009 Baptiste Coudurier <baptiste dot coudurier at gmail dot com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <vlc_common.h>
+#include <vlc_cpu.h>
+
+#include "v210.h"
+
+/*
+ * A v210 group packs 6 pixels (6 Y, 3 U, 3 V) in 4 little-endian words:
+ *   U0 Y0 V0 | Y1 U1 Y2 | V1 Y3 U2 | Y4 V2 Y5
+ * The C versions below are the reference: the SIMD versions process as many
+ * whole groups as they safely can and let the C code finish the line.
+ */
+
+static void UnpackC(uint16_t *y, uint16_t *u, uint16_t *v,
+                    const uint32_t *src, unsigned width)
+{
+    uint32_t val = 0;
+    unsigned w;
+
+#define READ_PIXELS(a, b, c)         \
+    do {                             \
+        val  = GetDWLE(src++);       \
+        *a++ =  val & 0x3FF;         \
+        *b++ = (val >> 10) & 0x3FF;  \
+        *c++ = (val >> 20) & 0x3FF;  \
+    } while (0)
+
+    for (w = 0; w + 6 <= width; w += 6) {
+        READ_PIXELS(u, y, v);
+        READ_PIXELS(y, u, y);
+        READ_PIXELS(v, y, u);
+        READ_PIXELS(y, v, y);
+    }
+    if (w + 2 <= width) {
+        READ_PIXELS(u, y, v);
+
+        val  = GetDWLE(src++);
+        *y++ =  val & 0x3FF;
+    }
+    if (w + 4 <= width) {
+        *u++ = (val >> 10) & 0x3FF;
+        *y++ = (val >> 20) & 0x3FF;
+
+        val  = GetDWLE(src++);
+        *v++ =  val & 0x3FF;
+        *y++ = (val >> 10) & 0x3FF;
+    }
+#undef READ_PIXELS
+}
+
+static inline uint32_t Clip(unsigned a)
+{
+    if      (a < 4)    return 4;
+    else if (a > 1019) return 1019;
+    else               return a;
+}
+
+static void PackC(uint32_t *dst, const uint16_t *y,
+                  const uint16_t *u, const uint16_t *v, unsigned width)
+{
+    uint8_t *data = (uint8_t *)dst;
+    uint32_t val = 0;
+    unsigned w;
+
+#define WRITE_PIXELS(a, b, c)           \
+    do {                                \
+        val =   Clip(*a++);             \
+        val |= (Clip(*b++) << 10) |     \
+               (Clip(*c++) << 20);      \
+        SetDWLE(data, val);             \
+        data += 4;                      \
+    } while (0)
+
+    for (w = 0; w + 6 <= width; w += 6) {
+        WRITE_PIXELS(u, y, v);
+        WRITE_PIXELS(y, u, y);
+        WRITE_PIXELS(v, y, u);
+        WRITE_PIXELS(y, v, y);
+    }
+    if (w + 2 <= width) {
+        WRITE_PIXELS(u, y, v);
+
+        val = Clip(*y++);
+        if (w + 2 == width) {
+            SetDWLE(data, val);
+            data += 4;
+        }
+    }
+    if (w + 4 <= width) {
+        val |= (Clip(*u++) << 10) | (Clip(*y++) << 20);
+        SetDWLE(data, val);
+        data += 4;
+
+        val = Clip(*v++) | (Clip(*y++) << 10);
+        SetDWLE(data, val);
+    }
+#undef WRITE_PIXELS
+}
+
+#if (defined(__i386__) || defined(__x86_64__)) && \
+    defined(HAVE_SSE2_INTRINSICS) && (VLC_GCC_VERSION(4, 9) || defined(__clang__))
+# define V210_X86 1
+# include <immintrin.h>
+
+# define V210_SSE2  __attribute__ ((__target__ ("sse2")))
+# define V210_SSSE3 __attribute__ ((__target__ ("ssse3")))
+# define V210_AVX2  __attribute__ ((__target__ ("avx2")))
+
+/* The 128-bits routines store whole 64-bits or 128-bits registers and read
+ * 128 bits of luma: they run while at least 2 more pixels follow the current
+ * group, so that the overflowing samples land inside the line and are
+ * rewritten by the next group. The AVX2 routines handle two groups at once. */
+
+/* Unsigned 16-bits clipping to [4;1019] without SSE4.1 min/max */
+V210_SSE2
+static inline __m128i Clip128(__m128i x)
+{
+    x = _mm_sub_epi16(x, _mm_subs_epu16(x, _mm_set1_epi16(1019)));
+    return _mm_add_epi16(_mm_subs_epu16(x, _mm_set1_epi16(4)),
+                         _mm_set1_epi16(4));
+}
+
+V210_SSE2
+static void UnpackSSE2(uint16_t *y, uint16_t *u, uint16_t *v,
+                       const uint32_t *src, unsigned width)
+{
+    const __m128i mask = _mm_set1_epi32(0x3FF);
+    const __m128i ty_mask  = _mm_setr_epi16(-1, -1, 0, 0, -1, -1, 0, 0);
+    const __m128i cy_mask  = _mm_setr_epi16(0, 0, -1, 0, 0, 0, -1, 0);
+    const __m128i tuv_mask = _mm_setr_epi16(-1, -1, 0, 0, 0, -1, -1, 0);
+    const __m128i cuv_mask = _mm_setr_epi16(0, 0, -1, 0, -1, 0, 0, 0);
+    unsigned w;
+
+    for (w = 0; w + 8 <= width; w += 6) {
+        __m128i p = _mm_loadu_si128((const __m128i *)src);
+        __m128i a = _mm_and_si128(p, mask);
+        __m128i b = _mm_and_si128(_mm_srli_epi32(p, 10), mask);
+        __m128i c = _mm_and_si128(_mm_srli_epi32(p, 20), mask);
+        /* t: U0 Y0 Y1 U1 V1 Y3 Y4 V2, c: V0 - Y2 - U2 - Y5 - */
+        __m128i t = _mm_or_si128(a, _mm_slli_epi32(b, 16));
+
+        __m128i ty = _mm_shufflelo_epi16(t, _MM_SHUFFLE(3, 3, 2, 1));
+        ty = _mm_shufflehi_epi16(ty, _MM_SHUFFLE(3, 3, 2, 1));
+        __m128i luma = _mm_or_si128(_mm_and_si128(ty, ty_mask),
+                                    _mm_and_si128(c, cy_mask));
+        /* Y0 Y1 Y2 - Y3 Y4 Y5 - */
+        _mm_storel_epi64((__m128i *)y, luma);
+        _mm_storel_epi64((__m128i *)(y + 3), _mm_srli_si128(luma, 8));
+
+        __m128i tuv = _mm_shufflelo_epi16(t, _MM_SHUFFLE(0, 0, 3, 0));
+        tuv = _mm_shufflehi_epi16(tuv, _MM_SHUFFLE(0, 3, 0, 0));
+        __m128i cuv = _mm_shuffle_epi32(c, _MM_SHUFFLE(1, 0, 3, 2));
+        cuv = _mm_shufflelo_epi16(cuv, _MM_SHUFFLE(0, 0, 0, 0));
+        __m128i chroma = _mm_or_si128(_mm_and_si128(tuv, tuv_mask),
+                                      _mm_and_si128(cuv, cuv_mask));
+        /* U0 U1 U2 - V0 V1 V2 - */
+        _mm_storel_epi64((__m128i *)u, chroma);
+        _mm_storel_epi64((__m128i *)v, _mm_srli_si128(chroma, 8));
+
+        y += 6; u += 3; v += 3; src += 4;
+    }
+    UnpackC(y, u, v, src, width - w);
+}
+
+/* Selects dword lane n from the n-th argument */
+V210_SSE2
+static inline __m128i Select128(__m128i l0, __m128i l1, __m128i l2, __m128i l3)
+{
+    const __m128i m0 = _mm_setr_epi32(-1, 0, 0, 0);
+    const __m128i m1 = _mm_setr_epi32(0, -1, 0, 0);
+    const __m128i m2 = _mm_setr_epi32(0, 0, -1, 0);
+    const __m128i m3 = _mm_setr_epi32(0, 0, 0, -1);
+
+    return _mm_or_si128(_mm_or_si128(_mm_and_si128(l0, m0),
+                                     _mm_and_si128(l1, m1)),
+                        _mm_or_si128(_mm_and_si128(l2, m2),
+                                     _mm_and_si128(l3, m3)));
+}
+
+V210_SSE2
+static void PackSSE2(uint32_t *dst, const uint16_t *y,
+                     const uint16_t *u, const uint16_t *v, unsigned width)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i low = _mm_set1_epi32(0xFFFF);
+    unsigned w;
+
+    for (w = 0; w + 8 <= width; w += 6) {
+        __m128i luma = Clip128(_mm_loadu_si128((const __m128i *)y));
+        __m128i chroma = Clip128(_mm_unpacklo_epi64(
+                                    _mm_loadl_epi64((const __m128i *)u),
+                                    _mm_loadl_epi64((const __m128i *)v)));
+
+        __m128i cu = _mm_unpacklo_epi16(chroma, zero);  /* U0 U1 U2 U3 */
+        __m128i cv = _mm_unpackhi_epi16(chroma, zero);  /* V0 V1 V2 V3 */
+        __m128i ye = _mm_and_si128(luma, low);          /* Y0 Y2 Y4 Y6 */
+        __m128i yo = _mm_srli_epi32(luma, 16);          /* Y1 Y3 Y5 Y7 */
+
+        yo = _mm_slli_si128(yo, 4);                           /* -  Y1 Y3 Y5 */
+        cv = _mm_shuffle_epi32(cv, _MM_SHUFFLE(2, 1, 0, 0));  /* V0 V0 V1 V2 */
+        ye = _mm_shuffle_epi32(ye, _MM_SHUFFLE(2, 1, 1, 0));  /* Y0 Y2 Y2 Y4 */
+
+        __m128i a = Select128(cu, yo, cv, ye);  /* U0 Y1 V1 Y4 */
+        __m128i b = Select128(ye, cu, yo, cv);  /* Y0 U1 Y3 V2 */
+        __m128i c = Select128(cv, ye, cu, yo);  /* V0 Y2 U2 Y5 */
+
+        a = _mm_or_si128(a, _mm_slli_epi32(b, 10));
+        a = _mm_or_si128(a, _mm_slli_epi32(c, 20));
+        _mm_storeu_si128((__m128i *)dst, a);
+
+        y += 6; u += 3; v += 3; dst += 4;
+    }
+    PackC(dst, y, u, v, width - w);
+}
+
+#define SHUF(a, b, c, d, e, f, g, h) \
+    (a) * 2, (a) * 2 + 1, (b) * 2, (b) * 2 + 1, \
+    (c) * 2, (c) * 2 + 1, (d) * 2, (d) * 2 + 1, \
+    (e) * 2, (e) * 2 + 1, (f) * 2, (f) * 2 + 1, \
+    (g) * 2, (g) * 2 + 1, (h) * 2, (h) * 2 + 1
+#define Z (-64) /* out of range 16-bits index: zeroes both bytes */
+
+/* Unpacking: shuffles from t = U0 Y0 Y1 U1 V1 Y3 Y4 V2
+ *                     and c = V0 -  Y2 -  U2 -  Y5 - */
+#define UNPACK_Y_T  SHUF(1, 2, Z, 5, 6, Z, Z, Z)
+#define UNPACK_Y_C  SHUF(Z, Z, 2, Z, Z, 6, Z, Z)
+#define UNPACK_UV_T SHUF(0, 3, Z, Z, Z, 4, 7, Z)
+#define UNPACK_UV_C SHUF(Z, Z, 4, Z, 0, Z, Z, Z)
+
+/* Packing: shuffles from Y0..Y7 and U0 U1 U2 U3 V0 V1 V2 V3,
+ * into the low 16 bits of each dword */
+#define PACK_A_Y  SHUF(Z, Z, 1, Z, Z, Z, 4, Z)
+#define PACK_A_UV SHUF(0, Z, Z, Z, 5, Z, Z, Z)
+#define PACK_B_Y  SHUF(0, Z, Z, Z, 3, Z, Z, Z)
+#define PACK_B_UV SHUF(Z, Z, 1, Z, Z, Z, 6, Z)
+#define PACK_C_Y  SHUF(Z, Z, 2, Z, Z, Z, 5, Z)
+#define PACK_C_UV SHUF(4, Z, Z, Z, 2, Z, Z, Z)
+
+V210_SSSE3
+static void UnpackSSSE3(uint16_t *y, uint16_t *u, uint16_t *v,
+                        const uint32_t *src, unsigned width)
+{
+    const __m128i mask = _mm_set1_epi32(0x3FF);
+    const __m128i y_t  = _mm_setr_epi8(UNPACK_Y_T);
+    const __m128i y_c  = _mm_setr_epi8(UNPACK_Y_C);
+    const __m128i uv_t = _mm_setr_epi8(UNPACK_UV_T);
+    const __m128i uv_c = _mm_setr_epi8(UNPACK_UV_C);
+    unsigned w;
+
+    for (w = 0; w + 8 <= width; w += 6) {
+        __m128i p = _mm_loadu_si128((const __m128i *)src);
+        __m128i a = _mm_and_si128(p, mask);
+        __m128i b = _mm_and_si128(_mm_srli_epi32(p, 10), mask);
+        __m128i c = _mm_and_si128(_mm_srli_epi32(p, 20), mask);
+        __m128i t = _mm_or_si128(a, _mm_slli_epi32(b, 16));
+
+        __m128i luma = _mm_or_si128(_mm_shuffle_epi8(t, y_t),
+                                    _mm_shuffle_epi8(c, y_c));
+        _mm_storeu_si128((__m128i *)y, luma);
+
+        __m128i chroma = _mm_or_si128(_mm_shuffle_epi8(t, uv_t),
+                                      _mm_shuffle_epi8(c, uv_c));
+        _mm_storel_epi64((__m128i *)u, chroma);
+        _mm_storel_epi64((__m128i *)v, _mm_srli_si128(chroma, 8));
+
+        y += 6; u += 3; v += 3; src += 4;
+    }
+    UnpackC(y, u, v, src, width - w);
+}
+
+V210_SSSE3
+static void PackSSSE3(uint32_t *dst, const uint16_t *y,
+                      const uint16_t *u, const uint16_t *v, unsigned width)
+{
+    const __m128i a_y  = _mm_setr_epi8(PACK_A_Y);
+    const __m128i a_uv = _mm_setr_epi8(PACK_A_UV);
+    const __m128i b_y  = _mm_setr_epi8(PACK_B_Y);
+    const __m128i b_uv = _mm_setr_epi8(PACK_B_UV);
+    const __m128i c_y  = _mm_setr_epi8(PACK_C_Y);
+    const __m128i c_uv = _mm_setr_epi8(PACK_C_UV);
+    unsigned w;
+
+    for (w = 0; w + 8 <= width; w += 6) {
+        __m128i luma = Clip128(_mm_loadu_si128((const __m128i *)y));
+        __m128i chroma = Clip128(_mm_unpacklo_epi64(
+                                    _mm_loadl_epi64((const __m128i *)u),
+                                    _mm_loadl_epi64((const __m128i *)v)));
+
+        __m128i a = _mm_or_si128(_mm_shuffle_epi8(luma, a_y),
+                                 _mm_shuffle_epi8(chroma, a_uv));
+        __m128i b = _mm_or_si128(_mm_shuffle_epi8(luma, b_y),
+                                 _mm_shuffle_epi8(chroma, b_uv));
+        __m128i c = _mm_or_si128(_mm_shuffle_epi8(luma, c_y),
+                                 _mm_shuffle_epi8(chroma, c_uv));
+
+        a = _mm_or_si128(a, _mm_slli_epi32(b, 10));
+        a = _mm_or_si128(a, _mm_slli_epi32(c, 20));
+        _mm_storeu_si128((__m128i *)dst, a);
+
+        y += 6; u += 3; v += 3; dst += 4;
+    }
+    PackC(dst, y, u, v, width - w);
+}
+
+V210_AVX2
+static void UnpackAVX2(uint16_t *y, uint16_t *u, uint16_t *v,
+                       const uint32_t *src, unsigned width)
+{
+    const __m256i mask = _mm256_set1_epi32(0x3FF);
+    const __m256i y_t  = _mm256_setr_epi8(UNPACK_Y_T, UNPACK_Y_T);
+    const __m256i y_c  = _mm256_setr_epi8(UNPACK_Y_C, UNPACK_Y_C);
+    const __m256i uv_t = _mm256_setr_epi8(UNPACK_UV_T, UNPACK_UV_T);
+    const __m256i uv_c = _mm256_setr_epi8(UNPACK_UV_C, UNPACK_UV_C);
+    unsigned w;
+
+    for (w = 0; w + 14 <= width; w += 12) {
+        __m256i p = _mm256_loadu_si256((const __m256i *)src);
+        __m256i a = _mm256_and_si256(p, mask);
+        __m256i b = _mm256_and_si256(_mm256_srli_epi32(p, 10), mask);
+        __m256i c = _mm256_and_si256(_mm256_srli_epi32(p, 20), mask);
+        __m256i t = _mm256_or_si256(a, _mm256_slli_epi32(b, 16));
+
+        __m256i luma = _mm256_or_si256(_mm256_shuffle_epi8(t, y_t),
+                                       _mm256_shuffle_epi8(c, y_c));
+        _mm_storeu_si128((__m128i *)y, _mm256_castsi256_si128(luma));
+        _mm_storeu_si128((__m128i *)(y + 6), _mm256_extracti128_si256(luma, 1));
+
+        __m256i chroma = _mm256_or_si256(_mm256_shuffle_epi8(t, uv_t),
+                                         _mm256_shuffle_epi8(c, uv_c));
+        __m128i lo = _mm256_castsi256_si128(chroma);
+        __m128i hi = _mm256_extracti128_si256(chroma, 1);
+        _mm_storel_epi64((__m128i *)u, lo);
+        _mm_storel_epi64((__m128i *)(u + 3), hi);
+        _mm_storel_epi64((__m128i *)v, _mm_srli_si128(lo, 8));
+        _mm_storel_epi64((__m128i *)(v + 3), _mm_srli_si128(hi, 8));
+
+        y += 12; u += 6; v += 6; src += 8;
+    }
+    UnpackC(y, u, v, src, width - w);
+}
+
+V210_AVX2
+static void PackAVX2(uint32_t *dst, const uint16_t *y,
+                     const uint16_t *u, const uint16_t *v, unsigned width)
+{
+    const __m256i a_y  = _mm256_setr_epi8(PACK_A_Y, PACK_A_Y);
+    const __m256i a_uv = _mm256_setr_epi8(PACK_A_UV, PACK_A_UV);
+    const __m256i b_y  = _mm256_setr_epi8(PACK_B_Y, PACK_B_Y);
+    const __m256i b_uv = _mm256_setr_epi8(PACK_B_UV, PACK_B_UV);
+    const __m256i c_y  = _mm256_setr_epi8(PACK_C_Y, PACK_C_Y);
+    const __m256i c_uv = _mm256_setr_epi8(PACK_C_UV, PACK_C_UV);
+    const __m256i lo = _mm256_set1_epi16(4);
+    const __m256i hi = _mm256_set1_epi16(1019);
+    unsigned w;
+
+    for (w = 0; w + 14 <= width; w += 12) {
+        __m256i luma = _mm256_inserti128_si256(_mm256_castsi128_si256(
+                            _mm_loadu_si128((const __m128i *)y)),
+                            _mm_loadu_si128((const __m128i *)(y + 6)), 1);
+        __m128i uv0 = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *)u),
+                                         _mm_loadl_epi64((const __m128i *)v));
+        __m128i uv1 = _mm_unpacklo_epi64(
+                            _mm_loadl_epi64((const __m128i *)(u + 3)),
+                            _mm_loadl_epi64((const __m128i *)(v + 3)));
+        __m256i chroma = _mm256_inserti128_si256(
+                            _mm256_castsi128_si256(uv0), uv1, 1);
+
+        luma = _mm256_max_epu16(_mm256_min_epu16(luma, hi), lo);
+        chroma = _mm256_max_epu16(_mm256_min_epu16(chroma, hi), lo);
+
+        __m256i a = _mm256_or_si256(_mm256_shuffle_epi8(luma, a_y),
+                                    _mm256_shuffle_epi8(chroma, a_uv));
+        __m256i b = _mm256_or_si256(_mm256_shuffle_epi8(luma, b_y),
+                                    _mm256_shuffle_epi8(chroma, b_uv));
+        __m256i c = _mm256_or_si256(_mm256_shuffle_epi8(luma, c_y),
+                                    _mm256_shuffle_epi8(chroma, c_uv));
+
+        a = _mm256_or_si256(a, _mm256_slli_epi32(b, 10));
+        a = _mm256_or_si256(a, _mm256_slli_epi32(c, 20));
+        _mm256_storeu_si256((__m256i *)dst, a);
+
+        y += 12; u += 6; v += 6; dst += 8;
+    }
+    PackC(dst, y, u, v, width - w);
+}
+#endif /* V210_X86 */
+
+#ifdef CAN_COMPILE_ARM
+/* arm_neon/v210.S: whole groups only */
+void v210_unpack_arm_neon(uint16_t *y, uint16_t *u, uint16_t *v,
+                          const uint32_t *src, unsigned groups);
+void v210_pack_arm_neon(uint32_t *dst, const uint16_t *y,
+                        const uint16_t *u, const uint16_t *v, unsigned groups);
+
+static void UnpackNEON(uint16_t *y, uint16_t *u, uint16_t *v,
+                       const uint32_t *src, unsigned width)
+{
+    unsigned groups = width / 6;
+
+    v210_unpack_arm_neon(y, u, v, src, groups);
+    UnpackC(y + 6 * groups, u + 3 * groups, v + 3 * groups, src + 4 * groups,
+            width - 6 * groups);
+}
+
+static void PackNEON(uint32_t *dst, const uint16_t *y,
+                     const uint16_t *u, const uint16_t *v, unsigned width)
+{
+    unsigned groups = width / 6;
+
+    v210_pack_arm_neon(dst, y, u, v, groups);
+    PackC(dst + 4 * groups, y + 6 * groups, u + 3 * groups, v + 3 * groups,
+          width - 6 * groups);
+}
+#endif
+
+v210_unpack_line_t v210_GetUnpackLine(unsigned cpu)
+{
+#ifdef V210_X86
+    if (cpu & VLC_CPU_AVX2)
+        return UnpackAVX2;
+    if (cpu & VLC_CPU_SSSE3)
+        return UnpackSSSE3;
+    if (cpu & VLC_CPU_SSE2)
+        return UnpackSSE2;
+#endif
+#ifdef CAN_COMPILE_ARM
+    if (cpu & VLC_CPU_ARM_NEON)
+        return UnpackNEON;
+#endif
+    VLC_UNUSED(cpu);
+    return UnpackC;
+}
+
+v210_pack_line_t v210_GetPackLine(unsigned cpu)
+{
+#ifdef V210_X86
+    if (cpu & VLC_CPU_AVX2)
+        return PackAVX2;
+    if (cpu & VLC_CPU_SSSE3)
+        return PackSSSE3;
+    if (cpu & VLC_CPU_SSE2)
+        return PackSSE2;
+#endif
+#ifdef CAN_COMPILE_ARM
+    if (cpu & VLC_CPU_ARM_NEON)
+        return PackNEON;
+#endif
+    VLC_UNUSED(cpu);
+    return PackC;
+}
+
+const char *v210_GetName(unsigned cpu)
+{
+#ifdef V210_X86
+    if (cpu & VLC_CPU_AVX2)
+        return "AVX2";
+    if (cpu & VLC_CPU_SSSE3)
+        return "SSSE3";
+    if (cpu & VLC_CPU_SSE2)
+        return "SSE2";
+#endif
+#ifdef CAN_COMPILE_ARM
+    if (cpu & VLC_CPU_ARM_NEON)
+        return "NEON";
+#endif
+    VLC_UNUSED(cpu);
+    return "C";
+}
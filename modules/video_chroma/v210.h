@@ -0,0 +1,77 @@
+/*****************************************************************************
+ * v210.h: v210 packing and unpacking
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef _VLC_VIDEOCHROMA_V210_H
+#define _VLC_VIDEOCHROMA_V210_H 1
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Unpacks one v210 line into planar 10-bits 4:2:2 (I422_10L).
+ * \param width width of the line in pixels, must be even.
+ */
+typedef void (*v210_unpack_line_t)(uint16_t *y, uint16_t *u, uint16_t *v,
+                                   const uint32_t *src, unsigned width);
+
+/**
+ * Packs one planar 10-bits 4:2:2 line into v210.
+ * Samples are clipped to the SDI legal range [4;1019].
+ * Line padding, if any, is left untouched.
+ * \param width width of the line in pixels, must be even.
+ */
+typedef void (*v210_pack_line_t)(uint32_t *dst, const uint16_t *y,
+                                 const uint16_t *u, const uint16_t *v,
+                                 unsigned width);
+
+/**
+ * Returns the fastest unpacking routine usable with the given CPU flags.
+ * \param cpu CPU capabilities, usually vlc_CPU()
+ */
+v210_unpack_line_t v210_GetUnpackLine(unsigned cpu);
+
+/**
+ * Returns the fastest packing routine usable with the given CPU flags.
+ * \param cpu CPU capabilities, usually vlc_CPU()
+ */
+v210_pack_line_t v210_GetPackLine(unsigned cpu);
+
+/**
+ * Returns the name of the implementation selected for the given CPU flags.
+ */
+const char *v210_GetName(unsigned cpu);
+
+/**
+ * Size in bytes of a v210 line (48 pixels / 128 bytes blocks).
+ */
+static inline size_t v210_GetStride(unsigned width)
+{
+    return ((width + 47) / 48) * 128;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,191 @@
+/*****************************************************************************
+ * v210_test.c: v210 packing and unpacking test and benchmark
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#undef NDEBUG
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vlc_common.h>
+#include <vlc_cpu.h>
+
+#include "v210.h"
+
+#define GUARD 32
+
+static const unsigned widths[] = {
+    2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 22, 24, 26, 28, 30,
+    720, 1280, 1920, 2048, 3840, 4096,
+};
+
+static const unsigned variants[] = {
+    0,
+#if defined (__i386__) || defined (__x86_64__)
+    VLC_CPU_SSE2,
+    VLC_CPU_SSE2 | VLC_CPU_SSSE3,
+    VLC_CPU_SSE2 | VLC_CPU_SSSE3 | VLC_CPU_AVX2,
+#elif defined (__arm__)
+    VLC_CPU_ARM_NEON,
+#endif
+};
+
+static void test_unpack(unsigned cpu, unsigned width)
+{
+    v210_unpack_line_t ref = v210_GetUnpackLine(0);
+    v210_unpack_line_t unpack = v210_GetUnpackLine(cpu);
+    size_t stride = v210_GetStride(width);
+    uint32_t *src = malloc(stride);
+    uint16_t *out[2][3];
+
+    assert(src != NULL);
+    for (size_t i = 0; i < stride / 4; i++)
+        src[i] = ((uint32_t)rand() << 16) ^ rand();
+
+    for (unsigned i = 0; i < 2; i++)
+        for (unsigned p = 0; p < 3; p++) {
+            size_t len = (p ? width / 2 : width) + GUARD;
+            out[i][p] = malloc(len * 2);
+            assert(out[i][p] != NULL);
+            memset(out[i][p], 0xA5, len * 2);
+        }
+
+    ref(out[0][0], out[0][1], out[0][2], src, width);
+    unpack(out[1][0], out[1][1], out[1][2], src, width);
+
+    for (unsigned p = 0; p < 3; p++) {
+        size_t len = (p ? width / 2 : width) + GUARD;
+        if (memcmp(out[0][p], out[1][p], len * 2)) {
+            fprintf(stderr, "%s unpack mismatch (width %u, plane %u)\n",
+                    v210_GetName(cpu), width, p);
+            abort();
+        }
+        free(out[0][p]);
+        free(out[1][p]);
+    }
+    free(src);
+}
+
+static void test_pack(unsigned cpu, unsigned width)
+{
+    v210_pack_line_t ref = v210_GetPackLine(0);
+    v210_pack_line_t pack = v210_GetPackLine(cpu);
+    size_t len = v210_GetStride(width) + GUARD;
+    uint8_t *dst[2];
+    uint16_t *in[3];
+
+    for (unsigned p = 0; p < 3; p++) {
+        size_t count = p ? width / 2 : width;
+        in[p] = malloc(count * 2);
+        assert(in[p] != NULL);
+        /* full 16-bits range, to exercise clipping */
+        for (size_t i = 0; i < count; i++)
+            in[p][i] = rand();
+    }
+    for (unsigned i = 0; i < 2; i++) {
+        dst[i] = malloc(len);
+        assert(dst[i] != NULL);
+        memset(dst[i], 0x5A, len);
+    }
+
+    ref((uint32_t *)dst[0], in[0], in[1], in[2], width);
+    pack((uint32_t *)dst[1], in[0], in[1], in[2], width);
+
+    if (memcmp(dst[0], dst[1], len)) {
+        fprintf(stderr, "%s pack mismatch (width %u)\n",
+                v210_GetName(cpu), width);
+        abort();
+    }
+
+    for (unsigned i = 0; i < 2; i++)
+        free(dst[i]);
+    for (unsigned p = 0; p < 3; p++)
+        free(in[p]);
+}
+
+static void bench(unsigned cpu, unsigned width, unsigned height,
+                  unsigned frames)
+{
+    v210_unpack_line_t unpack = v210_GetUnpackLine(cpu);
+    v210_pack_line_t pack = v210_GetPackLine(cpu);
+    size_t stride = v210_GetStride(width);
+    uint8_t *v210 = malloc(stride * height);
+    uint16_t *planes = malloc(width * height * 2 * 2);
+
+    assert(v210 != NULL && planes != NULL);
+    for (size_t i = 0; i < stride * height; i++)
+        v210[i] = rand();
+
+    uint16_t *y = planes;
+    uint16_t *u = y + width * height;
+    uint16_t *v = u + width * height / 2;
+
+    mtime_t start = mdate();
+    for (unsigned f = 0; f < frames; f++)
+        for (unsigned h = 0; h < height; h++)
+            unpack(y + h * width, u + h * width / 2, v + h * width / 2,
+                   (const uint32_t *)(v210 + h * stride), width);
+    mtime_t unpack_time = mdate() - start;
+
+    start = mdate();
+    for (unsigned f = 0; f < frames; f++)
+        for (unsigned h = 0; h < height; h++)
+            pack((uint32_t *)(v210 + h * stride), y + h * width,
+                 u + h * width / 2, v + h * width / 2, width);
+    mtime_t pack_time = mdate() - start;
+
+    double pixels = (double)width * height * frames * CLOCK_FREQ;
+    printf("%-5s unpack %8.1f Mpixels/s, pack %8.1f Mpixels/s\n",
+           v210_GetName(cpu),
+           pixels / (unpack_time ? unpack_time : 1) / 1000000.,
+           pixels / (pack_time ? pack_time : 1) / 1000000.);
+
+    free(planes);
+    free(v210);
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned cpu = vlc_CPU();
+    unsigned frames = (argc > 1) ? strtoul(argv[1], NULL, 0) : 10;
+
+    srand(0);
+
+    for (size_t i = 0; i < ARRAY_SIZE(variants); i++) {
+        if (variants[i] & ~cpu)
+            continue;
+
+        for (size_t j = 0; j < ARRAY_SIZE(widths); j++)
+            for (unsigned k = 0; k < 16; k++) {
+                test_unpack(variants[i], widths[j]);
+                test_pack(variants[i], widths[j]);
+            }
+    }
+
+    for (size_t i = 0; i < ARRAY_SIZE(variants); i++)
+        if (!(variants[i] & ~cpu))
+            bench(variants[i], 1920, 1080, frames);
+
+    return 0;
+}
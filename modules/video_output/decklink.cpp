@@ -22,19 +22,19 @@
  * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
  *****************************************************************************/
 
-/*
- * TODO: test non stereo audio
- */
-
 #ifdef HAVE_CONFIG_H
 # include "config.h"
 #endif
 
 #include <stdint.h>
+#include <assert.h>
+#include <new>
 
 #include <vlc_common.h>
 #include <vlc_plugin.h>
 #include <vlc_threads.h>
+#include <vlc_atomic.h>
+#include <vlc_cpu.h>
 
 #include <vlc_vout_display.h>
 #include <vlc_picture_pool.h>
@@ -47,21 +47,18 @@
 #include <DeckLinkAPI.h>
 #include <DeckLinkAPIDispatch.cpp>
 
+#include "../video_chroma/v210.h"
+#include "sdi_audio.h"
+
 #define FRAME_SIZE 1920
-#define CHANNELS_MAX 6
 
-#if 0
-static const int pi_channels_maps[CHANNELS_MAX+1] =
+/* Order of the embedded audio channels (SMPTE / WAVE) */
+static const uint32_t pi_sdi_chan_order[] =
 {
-    0,
-    AOUT_CHAN_CENTER,
-    AOUT_CHANS_STEREO,
-    AOUT_CHANS_3_0,
-    AOUT_CHANS_4_0,
-    AOUT_CHANS_5_0,
-    AOUT_CHANS_5_1,
+    AOUT_CHAN_LEFT, AOUT_CHAN_RIGHT, AOUT_CHAN_CENTER, AOUT_CHAN_LFE,
+    AOUT_CHAN_REARLEFT, AOUT_CHAN_REARRIGHT,
+    AOUT_CHAN_MIDDLELEFT, AOUT_CHAN_MIDDLERIGHT, AOUT_CHAN_REARCENTER, 0
 };
-#endif
 
 #define NOSIGNAL_INDEX_TEXT N_("Timelength after which we assume there is no signal.")
 #define NOSIGNAL_INDEX_LONGTEXT N_(\
@@ -98,6 +95,15 @@ static const int pi_channels_maps[CHANNELS_MAX+1] =
     "Number of output channels for DeckLink output. " \
     "Must be 2, 8 or 16. 0 disables audio output.")
 
+#define BITS_TEXT N_("Audio sample size")
+#define BITS_LONGTEXT N_(\
+    "Size in bits of the audio samples sent to the DeckLink card.")
+
+#define PASSTHROUGH_TEXT N_("Compressed audio passthrough")
+#define PASSTHROUGH_LONGTEXT N_(\
+    "Send compressed audio (A/52, DTS) untouched on the first channel " \
+    "pair, as SMPTE 337 data bursts.")
+
 #define VIDEO_CONNECTION_TEXT N_("Video connection")
 #define VIDEO_CONNECTION_LONGTEXT N_(\
     "Video connection for DeckLink output.")
@@ -106,12 +112,22 @@ static const int pi_channels_maps[CHANNELS_MAX+1] =
 #define VIDEO_TENBITS_LONGTEXT N_(\
     "Use 10 bits per pixel for video frames.")
 
+#define PREROLL_TEXT N_("Scheduling preroll (ms)")
+#define PREROLL_LONGTEXT N_(\
+    "How far ahead of display time video frames may be scheduled. " \
+    "This sets the number of frames allocated on the card.")
+
 #define CFG_PREFIX "decklink-output-"
 #define VIDEO_CFG_PREFIX "decklink-vout-"
 #define AUDIO_CFG_PREFIX "decklink-aout-"
 
 
 
+static const int pi_audio_bits[] = { 16, 32 };
+static const char *const ppsz_audio_bits_text[] = {
+    N_("16 bits"), N_("32 bits")
+};
+
 static const char *const ppsz_videoconns[] = {
     "sdi", "hdmi", "opticalsdi", "component", "composite", "svideo"
 };
@@ -119,10 +135,15 @@ static const char *const ppsz_videoconns_text[] = {
     N_("SDI"), N_("HDMI"), N_("Optical SDI"), N_("Component"), N_("Composite"), N_("S-video")
 };
 
+class DeckLinkFrameRing;
+
 struct vout_display_sys_t
 {
     picture_pool_t *pool;
+    DeckLinkFrameRing *ring;
+    BMDTimeValue last_slot; /* last card frame scheduled, in frame durations */
     bool tenbits;
+    v210_pack_line_t v210_pack;
     int nosignal_delay;
     picture_t *pic_nosignal;
 };
@@ -143,8 +164,9 @@ struct decklink_sys_t
     vlc_cond_t cond;
     uint8_t users;
 
-    //int i_channels;
+    int i_channels;
     int i_rate;
+    int i_bits;
 
     int i_width;
     int i_height;
@@ -152,8 +174,11 @@ struct decklink_sys_t
     BMDTimeScale timescale;
     BMDTimeValue frameduration;
 
-    /* XXX: workaround card clock drift */
-    mtime_t offset;
+    /* Card clock recovery, see UpdateClock() */
+    mtime_t offset;     /* system clock minus card clock */
+    double  drift;      /* in ppm, positive when the card is slow */
+    double  phase;      /* filtered offset */
+    mtime_t last_clock; /* last update, VLC_TS_INVALID before the first */
 };
 
 /*****************************************************************************
@@ -190,6 +215,8 @@ vlc_module_begin()
                 MODE_TEXT, MODE_LONGTEXT, true)
     add_bool(VIDEO_CFG_PREFIX "tenbits", false,
                 VIDEO_TENBITS_TEXT, VIDEO_TENBITS_LONGTEXT, true)
+    add_integer(VIDEO_CFG_PREFIX "preroll", 200,
+                PREROLL_TEXT, PREROLL_LONGTEXT, true)
     add_integer(VIDEO_CFG_PREFIX "nosignal-delay", 5,
                 NOSIGNAL_INDEX_TEXT, NOSIGNAL_INDEX_LONGTEXT, true)
     add_loadfile(VIDEO_CFG_PREFIX "nosignal-image", NULL,
@@ -208,6 +235,11 @@ vlc_module_begin()
                 RATE_TEXT, RATE_LONGTEXT, true)
     add_integer(AUDIO_CFG_PREFIX "audio-channels", 2,
                 CHANNELS_TEXT, CHANNELS_LONGTEXT, true)
+    add_integer(AUDIO_CFG_PREFIX "audio-bits", 16,
+                BITS_TEXT, BITS_LONGTEXT, true)
+                change_integer_list(pi_audio_bits, ppsz_audio_bits_text)
+    add_bool(AUDIO_CFG_PREFIX "passthrough", false,
+                PASSTHROUGH_TEXT, PASSTHROUGH_LONGTEXT, true)
 vlc_module_end ()
 
 /* Protects decklink_sys_t creation/deletion */
@@ -227,6 +259,9 @@ static struct decklink_sys_t *GetDLSys(vlc_object_t *obj)
         if (sys) {
             sys->p_output = NULL;
             sys->offset = 0;
+            sys->drift = 0.;
+            sys->phase = 0.;
+            sys->last_clock = VLC_TS_INVALID;
             sys->users = 0;
             sys->i_rate = -1;
             vlc_mutex_init(&sys->lock);
@@ -449,12 +484,13 @@ static struct decklink_sys_t *OpenDecklink(vout_display_t *vd)
         goto error;
     }
 
-    if (/*decklink_sys->i_channels > 0 &&*/ decklink_sys->i_rate > 0)
+    if (decklink_sys->i_channels > 0 && decklink_sys->i_rate > 0)
     {
         result = decklink_sys->p_output->EnableAudioOutput(
             decklink_sys->i_rate,
-            bmdAudioSampleType16bitInteger,
-            /*decklink_sys->i_channels*/ 2,
+            decklink_sys->i_bits == 32 ? bmdAudioSampleType32bitInteger
+                                       : bmdAudioSampleType16bitInteger,
+            decklink_sys->i_channels,
             bmdAudioOutputStreamTimestamped);
     }
     CHECK("Could not start audio output");
@@ -503,78 +539,292 @@ error:
  * Video
  *****************************************************************************/
 
-static picture_pool_t *PoolVideo(vout_display_t *vd, unsigned requested_count)
+/* Fixed set of video frames allocated once on the card, given back to us
+ * through the completion callback when the card is done with them.
+ * The ring is reference counted as the SDK wants of callbacks, but it lives
+ * as long as the vout: CloseFrameRing() unregisters the callback before
+ * releasing it, and the frames still held by the card keep their own
+ * references. */
+class DeckLinkFrameRing : public IDeckLinkVideoOutputCallback
+{
+public:
+    DeckLinkFrameRing(vout_display_t *vd) : vd_(vd), frames_(NULL), free_(NULL),
+        count_(0), free_count_(0), late_(0), dropped_(0), flushed_(0)
+    {
+        m_ref_.store(1);
+        vlc_mutex_init(&lock_);
+    }
+
+    virtual HRESULT STDMETHODCALLTYPE QueryInterface(REFIID, LPVOID *) { return E_NOINTERFACE; }
+
+    virtual ULONG STDMETHODCALLTYPE AddRef(void)
+    {
+        return m_ref_.fetch_add(1) + 1;
+    }
+
+    virtual ULONG STDMETHODCALLTYPE Release(void)
+    {
+        uintptr_t new_ref = m_ref_.fetch_sub(1) - 1;
+        if (new_ref == 0)
+            delete this;
+        return new_ref;
+    }
+
+    HRESULT Alloc(IDeckLinkOutput *output, unsigned count, int w, int h,
+                  int stride, BMDPixelFormat format)
+    {
+        frames_ = (IDeckLinkMutableVideoFrame **)calloc(count, sizeof(*frames_));
+        free_ = (IDeckLinkMutableVideoFrame **)calloc(count, sizeof(*free_));
+        if (!frames_ || !free_)
+            return E_OUTOFMEMORY;
+
+        for (; count_ < count; count_++) {
+            HRESULT result = output->CreateVideoFrame(w, h, stride, format,
+                bmdFrameFlagDefault, &frames_[count_]);
+            if (result != S_OK)
+                return result;
+            free_[free_count_++] = frames_[count_];
+        }
+        return S_OK;
+    }
+
+    /* Called when the vout goes away */
+    void Detach(void)
+    {
+        vlc_mutex_lock(&lock_);
+        if (vd_)
+            msg_Dbg(vd_, "%u frames displayed late, %u dropped, %u flushed",
+                    late_, dropped_, flushed_);
+        vd_ = NULL;
+        vlc_mutex_unlock(&lock_);
+    }
+
+    IDeckLinkMutableVideoFrame *Get(void)
+    {
+        IDeckLinkMutableVideoFrame *frame = NULL;
+
+        vlc_mutex_lock(&lock_);
+        if (free_count_ > 0)
+            frame = free_[--free_count_];
+        vlc_mutex_unlock(&lock_);
+        return frame;
+    }
+
+    void Put(IDeckLinkVideoFrame *frame)
+    {
+        vlc_mutex_lock(&lock_);
+        PutLocked(frame);
+        vlc_mutex_unlock(&lock_);
+    }
+
+    /* A picture was not handed over to the card */
+    void Drop(void)
+    {
+        vlc_mutex_lock(&lock_);
+        Count(&dropped_, "decklink-frames-dropped");
+        vlc_mutex_unlock(&lock_);
+    }
+
+    virtual HRESULT STDMETHODCALLTYPE ScheduledFrameCompleted(
+        IDeckLinkVideoFrame *frame, BMDOutputFrameCompletionResult result)
+    {
+        vlc_mutex_lock(&lock_);
+        switch (result) {
+        case bmdOutputFrameDisplayedLate:
+            Count(&late_, "decklink-frames-late");
+            break;
+        case bmdOutputFrameDropped:
+            Count(&dropped_, "decklink-frames-dropped");
+            break;
+        case bmdOutputFrameFlushed:
+            Count(&flushed_, "decklink-frames-flushed");
+            break;
+        default:
+            break;
+        }
+        PutLocked(frame);
+        vlc_mutex_unlock(&lock_);
+        return S_OK;
+    }
+
+    virtual HRESULT STDMETHODCALLTYPE ScheduledPlaybackHasStopped(void)
+    {
+        return S_OK;
+    }
+
+private:
+    virtual ~DeckLinkFrameRing()
+    {
+        for (unsigned i = 0; i < count_; i++)
+            frames_[i]->Release();
+        free(frames_);
+        free(free_);
+        vlc_mutex_destroy(&lock_);
+    }
+
+    void PutLocked(IDeckLinkVideoFrame *frame)
+    {
+        for (unsigned i = 0; i < count_; i++)
+            if (frames_[i] == frame) {
+                assert(free_count_ < count_);
+                free_[free_count_++] = frames_[i];
+                return;
+            }
+    }
+
+    void Count(unsigned *counter, const char *var)
+    {
+        ++*counter;
+        if (!vd_)
+            return;
+        var_SetInteger(vd_, var, *counter);
+        if (counter != &late_)
+            vout_display_SendEventPicturesLost(vd_, 1);
+    }
+
+    vout_display_t *vd_;
+    vlc_mutex_t lock_;
+    IDeckLinkMutableVideoFrame **frames_;
+    IDeckLinkMutableVideoFrame **free_;
+    unsigned count_;
+    unsigned free_count_;
+    unsigned late_, dropped_, flushed_;
+    std::atomic_uint m_ref_;
+};
+
+static int OpenFrameRing(vout_display_t *vd, struct decklink_sys_t *decklink_sys)
 {
     vout_display_sys_t *sys = vd->sys;
-    if (!sys->pool)
-        sys->pool = picture_pool_NewFromFormat(&vd->fmt, requested_count);
-    return sys->pool;
+    int w = decklink_sys->i_width;
+    int h = decklink_sys->i_height;
+
+    /* frames scheduled ahead, plus the one on screen and the one being filled */
+    mtime_t preroll = var_InheritInteger(vd, VIDEO_CFG_PREFIX "preroll") * 1000;
+    mtime_t length = (decklink_sys->frameduration * CLOCK_FREQ) / decklink_sys->timescale;
+    unsigned count = (preroll + length - 1) / length + 2;
+
+    sys->ring = new (std::nothrow) DeckLinkFrameRing(vd);
+    if (!sys->ring)
+        return VLC_ENOMEM;
+
+    HRESULT result = sys->ring->Alloc(decklink_sys->p_output, count, w, h,
+        sys->tenbits ? v210_GetStride(w) : w * 2,
+        sys->tenbits ? bmdFormat10BitYUV : bmdFormat8BitYUV);
+    if (result != S_OK) {
+        msg_Err(vd, "Failed to create video frames: 0x%X", result);
+        goto error;
+    }
+
+    result = decklink_sys->p_output->SetScheduledFrameCompletionCallback(sys->ring);
+    if (result != S_OK) {
+        msg_Err(vd, "Failed to set completion callback: 0x%X", result);
+        goto error;
+    }
+
+    var_Create(vd, "decklink-frames-late", VLC_VAR_INTEGER);
+    var_Create(vd, "decklink-frames-dropped", VLC_VAR_INTEGER);
+    var_Create(vd, "decklink-frames-flushed", VLC_VAR_INTEGER);
+    var_Create(vd, "decklink-drift", VLC_VAR_FLOAT);
+    sys->last_slot = -1;
+
+    msg_Dbg(vd, "Using %u video frames", count);
+    return VLC_SUCCESS;
+
+error:
+    sys->ring->Detach();
+    sys->ring->Release();
+    sys->ring = NULL;
+    return VLC_EGENERIC;
 }
 
-static inline void put_le32(uint8_t **p, uint32_t d)
+static void CloseFrameRing(vout_display_t *vd, struct decklink_sys_t *decklink_sys)
 {
-    SetDWLE(*p, d);
-    (*p) += 4;
+    vout_display_sys_t *sys = vd->sys;
+
+    decklink_sys->p_output->SetScheduledFrameCompletionCallback(NULL);
+    sys->ring->Detach();
+    sys->ring->Release();
+
+    var_Destroy(vd, "decklink-frames-late");
+    var_Destroy(vd, "decklink-frames-dropped");
+    var_Destroy(vd, "decklink-frames-flushed");
+    var_Destroy(vd, "decklink-drift");
 }
 
-static inline int clip(int a)
+static picture_pool_t *PoolVideo(vout_display_t *vd, unsigned requested_count)
 {
-    if      (a < 4) return 4;
-    else if (a > 1019) return 1019;
-    else               return a;
+    vout_display_sys_t *sys = vd->sys;
+    if (!sys->pool)
+        sys->pool = picture_pool_NewFromFormat(&vd->fmt, requested_count);
+    return sys->pool;
 }
 
-static void v210_convert(void *frame_bytes, picture_t *pic, int dst_stride)
+static void v210_convert(vout_display_t *vd, void *frame_bytes, picture_t *pic, int dst_stride)
 {
+    vout_display_sys_t *sys = vd->sys;
     int width = pic->format.i_width;
     int height = pic->format.i_height;
     int line_padding = dst_stride - ((width * 8 + 11) / 12) * 4;
-    int h, w;
     uint8_t *data = (uint8_t*)frame_bytes;
 
-    const uint16_t *y = (const uint16_t*)pic->p[0].p_pixels;
-    const uint16_t *u = (const uint16_t*)pic->p[1].p_pixels;
-    const uint16_t *v = (const uint16_t*)pic->p[2].p_pixels;
-
-#define WRITE_PIXELS(a, b, c)           \
-    do {                                \
-        val =   clip(*a++);             \
-        val |= (clip(*b++) << 10) |     \
-               (clip(*c++) << 20);      \
-        put_le32(&data, val);           \
-    } while (0)
-
-    for (h = 0; h < height; h++) {
-        uint32_t val = 0;
-        for (w = 0; w < width - 5; w += 6) {
-            WRITE_PIXELS(u, y, v);
-            WRITE_PIXELS(y, u, y);
-            WRITE_PIXELS(v, y, u);
-            WRITE_PIXELS(y, v, y);
-        }
-        if (w < width - 1) {
-            WRITE_PIXELS(u, y, v);
+    const uint8_t *y = pic->p[0].p_pixels;
+    const uint8_t *u = pic->p[1].p_pixels;
+    const uint8_t *v = pic->p[2].p_pixels;
 
-            val = clip(*y++);
-            if (w == width - 2)
-                put_le32(&data, val);
-#undef WRITE_PIXELS
-        }
-        if (w < width - 3) {
-            val |= (clip(*u++) << 10) | (clip(*y++) << 20);
-            put_le32(&data, val);
+    for (int h = 0; h < height; h++) {
+        sys->v210_pack((uint32_t *)data, (const uint16_t *)y,
+                (const uint16_t *)u, (const uint16_t *)v, width);
+        memset(data + dst_stride - line_padding, 0, line_padding);
 
-            val = clip(*v++) | (clip(*y++) << 10);
-            put_le32(&data, val);
-        }
-
-        memset(data, 0, line_padding);
-        data += line_padding;
+        data += dst_stride;
+        y += pic->p[0].i_pitch;
+        u += pic->p[1].i_pitch;
+        v += pic->p[2].i_pitch;
+    }
+}
 
-        y += pic->p[0].i_pitch / 2 - width;
-        u += pic->p[1].i_pitch / 2 - width / 2;
-        v += pic->p[2].i_pitch / 2 - width / 2;
+/* Recovers the card clock against the system clock.
+ * The card plays out at its own pace, so the stream time it reports slowly
+ * drifts away from mdate(). The offset between both is tracked by a second
+ * order loop (PI controller), which follows a constant drift without static
+ * error and is slow enough to filter out scheduling jitter.
+ * Pictures and audio samples are scheduled at their date minus that offset:
+ * as it moves, the card ends up showing a frame twice or skipping one, and
+ * audio gets resampled by the core. */
+#define CLOCK_LOOP_TIME   30.   /* seconds */
+#define CLOCK_LOOP_DAMP   0.707
+#define CLOCK_LOOP_RESET  (CLOCK_FREQ)
+
+static void UpdateClock(vout_display_t *vd, struct decklink_sys_t *decklink_sys,
+                        mtime_t now, mtime_t decklink_now)
+{
+    const double wn = 1. / CLOCK_LOOP_TIME;
+    double phase = decklink_sys->phase;
+    double drift = decklink_sys->drift;
+    double error = (now - decklink_now) - phase;
+
+    if (decklink_sys->last_clock == VLC_TS_INVALID
+     || llabs((mtime_t)error) > CLOCK_LOOP_RESET) {
+        if (decklink_sys->last_clock != VLC_TS_INVALID)
+            msg_Warn(vd, "Card clock jumped by %" PRId64 " us",
+                     (mtime_t)error);
+        phase += error;
+    } else {
+        double dt = double(now - decklink_sys->last_clock) / CLOCK_FREQ;
+        /* drift is in us per s, i.e. ppm */
+        drift += wn * wn * error * dt;
+        phase += (drift + 2. * CLOCK_LOOP_DAMP * wn * error) * dt;
     }
+    decklink_sys->last_clock = now;
+
+    /* offset and drift are also read by the audio output */
+    vlc_mutex_lock(&decklink_sys->lock);
+    decklink_sys->phase = phase;
+    decklink_sys->drift = drift;
+    decklink_sys->offset = (mtime_t)phase;
+    vlc_mutex_unlock(&decklink_sys->lock);
+
+    var_SetFloat(vd, "decklink-drift", drift);
 }
 
 static void DisplayVideo(vout_display_t *vd, picture_t *picture, subpicture_t *)
@@ -615,18 +865,47 @@ static void DisplayVideo(vout_display_t *vd, picture_t *picture, subpicture_t *)
     }
 
     HRESULT result;
-    int w, h, stride, length;
+    int w, h, stride;
     w = decklink_sys->i_width;
     h = decklink_sys->i_height;
 
     IDeckLinkMutableVideoFrame *pDLVideoFrame;
-    result = decklink_sys->p_output->CreateVideoFrame(w, h, w*3,
-        sys->tenbits ? bmdFormat10BitYUV : bmdFormat8BitYUV,
-        bmdFrameFlagDefault, &pDLVideoFrame);
-
-    if (result != S_OK) {
-        msg_Err(vd, "Failed to create video frame: 0x%X", result);
-        pDLVideoFrame = NULL;
+    BMDTimeValue decklink_now, slot;
+    BMDTimeValue hw_time, in_frame, frame_ticks;
+    double speed;
+    decklink_sys->p_output->GetScheduledStreamTime(decklink_sys->timescale,
+        &decklink_now, &speed);
+    /* the stream time only moves by whole frames */
+    if (decklink_sys->p_output->GetHardwareReferenceClock(decklink_sys->timescale,
+            &hw_time, &in_frame, &frame_ticks) != S_OK)
+        in_frame = 0;
+    UpdateClock(vd, decklink_sys, now,
+        (decklink_now + in_frame) * CLOCK_FREQ / decklink_sys->timescale);
+
+    /* Card frame in which the picture falls */
+    slot = (picture->date - decklink_sys->offset) * decklink_sys->timescale
+         / CLOCK_FREQ + decklink_sys->frameduration / 2;
+    slot /= decklink_sys->frameduration;
+
+    if (slot * decklink_sys->frameduration <= decklink_now) {
+        msg_Dbg(vd, "Picture too late, dropping");
+        sys->ring->Drop();
+        goto end;
+    }
+    if (slot <= sys->last_slot) {
+        /* the card clock is slower: drop a picture */
+        msg_Dbg(vd, "Card frame already scheduled, dropping picture");
+        sys->ring->Drop();
+        goto end;
+    }
+    if (sys->last_slot >= 0 && slot > sys->last_slot + 1)
+        /* the card clock is faster: it repeats the previous frame */
+        msg_Dbg(vd, "Repeating %" PRId64 " frame(s)", slot - sys->last_slot - 1);
+
+    pDLVideoFrame = sys->ring->Get();
+    if (!pDLVideoFrame) {
+        msg_Warn(vd, "No free video frame, dropping picture");
+        sys->ring->Drop();
         goto end;
     }
 
@@ -635,7 +914,7 @@ static void DisplayVideo(vout_display_t *vd, picture_t *picture, subpicture_t *)
     stride = pDLVideoFrame->GetRowBytes();
 
     if (sys->tenbits)
-        v210_convert(frame_bytes, picture, stride);
+        v210_convert(vd, frame_bytes, picture, stride);
     else for(int y = 0; y < h; ++y) {
         uint8_t *dst = (uint8_t *)frame_bytes + stride * y;
         const uint8_t *src = (const uint8_t *)picture->p[0].p_pixels +
@@ -644,34 +923,20 @@ static void DisplayVideo(vout_display_t *vd, picture_t *picture, subpicture_t *)
     }
 
 
-    // compute frame duration in CLOCK_FREQ units
-    length = (decklink_sys->frameduration * CLOCK_FREQ) / decklink_sys->timescale;
-
-    picture->date -= decklink_sys->offset;
     result = decklink_sys->p_output->ScheduleVideoFrame(pDLVideoFrame,
-        picture->date, length, CLOCK_FREQ);
+        slot * decklink_sys->frameduration, decklink_sys->frameduration,
+        decklink_sys->timescale);
 
     if (result != S_OK) {
         msg_Err(vd, "Dropped Video frame %" PRId64 ": 0x%x",
             picture->date, result);
+        sys->ring->Put(pDLVideoFrame);
+        sys->ring->Drop();
         goto end;
     }
-
-    now = mdate() - decklink_sys->offset;
-
-    BMDTimeValue decklink_now;
-    double speed;
-    decklink_sys->p_output->GetScheduledStreamTime (CLOCK_FREQ, &decklink_now, &speed);
-
-    if ((now - decklink_now) > 400000) {
-        /* XXX: workaround card clock drift */
-        decklink_sys->offset += 50000;
-        msg_Err(vd, "Delaying: offset now %" PRId64, decklink_sys->offset);
-    }
+    sys->last_slot = slot;
 
 end:
-    if (pDLVideoFrame)
-        pDLVideoFrame->Release();
     picture_Release(orig_picture);
 }
 
@@ -692,6 +957,10 @@ static int OpenVideo(vlc_object_t *p_this)
         return VLC_ENOMEM;
 
     sys->tenbits = var_InheritBool(p_this, VIDEO_CFG_PREFIX "tenbits");
+    if (sys->tenbits) {
+        sys->v210_pack = v210_GetPackLine(vlc_CPU());
+        msg_Dbg(vd, "Using %s v210 packing", v210_GetName(vlc_CPU()));
+    }
     sys->nosignal_delay = var_InheritInteger(p_this, VIDEO_CFG_PREFIX "nosignal-delay");
     sys->pic_nosignal = NULL;
 
@@ -705,6 +974,14 @@ static int OpenVideo(vlc_object_t *p_this)
 
     sys->pool = NULL;
 
+    if (OpenFrameRing(vd, decklink_sys) != VLC_SUCCESS) {
+        if (sys->pic_nosignal)
+            picture_Release(sys->pic_nosignal);
+        free(sys);
+        ReleaseDLSys(p_this);
+        return VLC_EGENERIC;
+    }
+
     vd->fmt.i_chroma = sys->tenbits
         ? VLC_CODEC_I422_10L /* we will convert to v210 */
         : VLC_CODEC_UYVY;
@@ -766,6 +1043,8 @@ static void CloseVideo(vlc_object_t *p_this)
     if (sys->pic_nosignal)
         picture_Release(sys->pic_nosignal);
 
+    CloseFrameRing(vd, GetDLSys(p_this));
+
     free(sys);
 
     ReleaseDLSys(p_this);
@@ -775,8 +1054,72 @@ static void CloseVideo(vlc_object_t *p_this)
  * Audio
  *****************************************************************************/
 
+struct aout_sys_t
+{
+    bool spdif;
+    unsigned channels;                  /* input channels */
+    uint8_t table[AOUT_CHAN_MAX];       /* input to card channel index */
+    sdi_audio_map_t map;
+
+    /* Samples are gathered until the next video frame boundary, and
+     * scheduled at once */
+    uint8_t *buffer;
+    size_t buffer_size;                 /* in sample frames */
+    size_t buffer_bytes;
+    int64_t start;                      /* card time of the first sample frame */
+    uint32_t staged;                    /* sample frames in buffer */
+    bool started;
+};
+
+/* SMPTE 337 16 bits mode: data words are left-justified in wider samples,
+ * and must not go through any gain or resampling. */
+static void InterleaveData32(void *dst_, const void *src_, size_t frames,
+                             unsigned out_channels)
+{
+    uint32_t *dst = (uint32_t *)dst_;
+    const uint16_t *src = (const uint16_t *)src_;
+
+    for (size_t i = 0; i < frames; i++) {
+        dst[0] = (uint32_t)src[0] << 16;
+        dst[1] = (uint32_t)src[1] << 16;
+        dst += out_channels;
+        src += 2;
+    }
+}
+
+static void ScheduleAudio(audio_output_t *aout, struct decklink_sys_t *decklink_sys)
+{
+    aout_sys_t *sys = aout->sys;
+
+    if (sys->staged == 0)
+        return;
+
+    uint32_t written;
+    HRESULT result = decklink_sys->p_output->ScheduleAudioSamples(
+            sys->buffer, sys->staged, sys->start, decklink_sys->i_rate, &written);
+
+    if (result != S_OK)
+        msg_Err(aout, "Failed to schedule audio sample: 0x%X", result);
+    else if (sys->staged != written)
+        msg_Err(aout, "Written only %d samples out of %d", written, sys->staged);
+
+    sys->start += sys->staged;
+    sys->staged = 0;
+}
+
+/* Drops the staged samples, and silences the channels of the previous
+ * layout */
+static void ResetAudio(aout_sys_t *sys)
+{
+    if (sys->buffer)
+        memset(sys->buffer, 0, sys->buffer_bytes);
+    sys->staged = 0;
+    sys->started = false;
+}
+
 static void Flush (audio_output_t *aout, bool drain)
 {
+    aout_sys_t *sys = aout->sys;
     struct decklink_sys_t *decklink_sys = GetDLSys(VLC_OBJECT(aout));
     vlc_mutex_lock(&decklink_sys->lock);
     IDeckLinkOutput *p_output = decklink_sys->p_output;
@@ -785,59 +1128,175 @@ static void Flush (audio_output_t *aout, bool drain)
         return;
 
     if (drain) {
+        ScheduleAudio(aout, decklink_sys);
         uint32_t samples;
         decklink_sys->p_output->GetBufferedAudioSampleFrameCount(&samples);
         msleep(CLOCK_FREQ * samples / decklink_sys->i_rate);
     } else if (decklink_sys->p_output->FlushBufferedAudioSamples() == E_FAIL)
         msg_Err(aout, "Flush failed");
+
+    ResetAudio(sys);
 }
 
-static int TimeGet(audio_output_t *, mtime_t* restrict)
+static int TimeGet(audio_output_t *aout, mtime_t *restrict delay)
 {
-    /* synchronization is handled by the card */
-    return -1;
+    aout_sys_t *sys = aout->sys;
+    struct decklink_sys_t *decklink_sys = GetDLSys(VLC_OBJECT(aout));
+    vlc_mutex_lock(&decklink_sys->lock);
+    IDeckLinkOutput *p_output = decklink_sys->p_output;
+    double drift = decklink_sys->drift;
+    vlc_mutex_unlock(&decklink_sys->lock);
+    if (!p_output)
+        return -1;
+
+    uint32_t samples;
+    if (p_output->GetBufferedAudioSampleFrameCount(&samples) != S_OK)
+        return -1;
+    samples += sys->staged;
+
+    /* Buffered samples are played at the card pace: report the delay in
+     * system time so that the core resamples to follow the card clock. */
+    *delay = (mtime_t)(CLOCK_FREQ * samples / decklink_sys->i_rate
+                       * 1000000. / (1000000. - drift));
+    return 0;
 }
 
 static int Start(audio_output_t *aout, audio_sample_format_t *restrict fmt)
 {
+    aout_sys_t *sys = aout->sys;
     struct decklink_sys_t *decklink_sys = GetDLSys(VLC_OBJECT(aout));
 
     if (decklink_sys->i_rate == 0)
         return VLC_EGENERIC;
 
-    fmt->i_format = VLC_CODEC_S16N;
-    fmt->i_channels = 2; //decklink_sys->i_channels;
-    fmt->i_physical_channels = AOUT_CHANS_STEREO; //pi_channels_maps[fmt->i_channels];
-    fmt->i_rate = decklink_sys->i_rate;
-    fmt->i_bitspersample = 16;
-    fmt->i_blockalign = fmt->i_channels * fmt->i_bitspersample /8 ;
-    fmt->i_frame_length  = FRAME_SIZE;
+    sys->spdif = AOUT_FMT_SPDIF(fmt)
+              && var_InheritBool(aout, AUDIO_CFG_PREFIX "passthrough");
+    if (sys->spdif) {
+        if (fmt->i_rate != (unsigned)decklink_sys->i_rate) {
+            msg_Err(aout, "Cannot pass %u Hz compressed audio through",
+                    fmt->i_rate);
+            return VLC_EGENERIC;
+        }
+        fmt->i_format = VLC_CODEC_SPDIFL;
+        fmt->i_physical_channels = AOUT_CHANS_STEREO;
+        fmt->i_original_channels = AOUT_CHANS_STEREO;
+        fmt->i_channels = 2;
+        fmt->i_bytes_per_frame = AOUT_SPDIF_SIZE;
+        fmt->i_frame_length = A52_FRAME_NB;
+        sys->channels = 2;
+        sys->table[0] = 0;
+        sys->table[1] = 1;
+    } else {
+        fmt->i_format = decklink_sys->i_bits == 32 ? VLC_CODEC_S32N
+                                                   : VLC_CODEC_S16N;
+        if (decklink_sys->i_channels == 2
+         || aout_FormatNbChannels(fmt) == 0
+         || aout_FormatNbChannels(fmt) > (unsigned)decklink_sys->i_channels)
+            fmt->i_physical_channels = AOUT_CHANS_STEREO;
+        else
+            /* keep the source layout, the extra card channels are silent */
+            fmt->i_physical_channels &= AOUT_CHANS_8_1;
+        fmt->i_original_channels = fmt->i_physical_channels;
+        fmt->i_rate = decklink_sys->i_rate;
+        aout_FormatPrepare(fmt);
+        fmt->i_frame_length = FRAME_SIZE;
+
+        sys->channels = aout_FormatNbChannels(fmt);
+        aout_CheckChannelReorder(NULL, pi_sdi_chan_order,
+                                 fmt->i_physical_channels, sys->table);
+    }
 
+    /* Unused card channels are never written, so they stay silent (the
+     * buffer is zeroed by ResetAudio()) */
+    sdi_audio_MapInit(&sys->map, decklink_sys->i_bits / 8, sys->channels,
+                      decklink_sys->i_channels, sys->table, vlc_CPU());
+
+    msg_Dbg(aout, "%s %u channel(s) on %d %d-bits channels (%s)",
+            sys->spdif ? "passing" : "mapping", sys->channels,
+            decklink_sys->i_channels, decklink_sys->i_bits, sys->map.name);
+
+    ResetAudio(sys);
     return VLC_SUCCESS;
 }
 
 static void PlayAudio(audio_output_t *aout, block_t *audio)
 {
+    aout_sys_t *sys = aout->sys;
     struct decklink_sys_t *decklink_sys = GetDLSys(VLC_OBJECT(aout));
     vlc_mutex_lock(&decklink_sys->lock);
     IDeckLinkOutput *p_output = decklink_sys->p_output;
+    mtime_t offset = decklink_sys->offset;
     vlc_mutex_unlock(&decklink_sys->lock);
     if (!p_output) {
         block_Release(audio);
         return;
     }
 
-    audio->i_pts -= decklink_sys->offset;
+    const int rate = decklink_sys->i_rate;
+    const unsigned out_channels = decklink_sys->i_channels;
+    const size_t out_size = out_channels * decklink_sys->i_bits / 8;
+    const size_t in_size = sys->channels * (sys->spdif ? 2 : decklink_sys->i_bits / 8);
+    /* one video frame worth of samples, rounded up */
+    const int64_t frame_samples = ((int64_t)decklink_sys->frameduration * rate
+        + decklink_sys->timescale - 1) / decklink_sys->timescale;
+
+    if (sys->buffer_size < (size_t)frame_samples) {
+        free(sys->buffer);
+        sys->buffer = (uint8_t *)calloc(frame_samples, out_size);
+        sys->buffer_size = sys->buffer ? frame_samples : 0;
+        sys->buffer_bytes = sys->buffer_size * out_size;
+        sys->staged = 0;
+        if (!sys->buffer) {
+            block_Release(audio);
+            return;
+        }
+    }
 
-    uint32_t sampleFrameCount = audio->i_buffer / (2 * 2 /*decklink_sys->i_channels*/);
-    uint32_t written;
-    HRESULT result = decklink_sys->p_output->ScheduleAudioSamples(
-            audio->p_buffer, sampleFrameCount, audio->i_pts, CLOCK_FREQ, &written);
+    int64_t start = (audio->i_pts - offset) * rate / CLOCK_FREQ;
+    if (sys->started
+     && llabs(start - (sys->start + sys->staged)) > rate / 200) {
+        /* discontinuity: send what we have and start over */
+        ScheduleAudio(aout, decklink_sys);
+        sys->started = false;
+    }
+    if (!sys->started) {
+        sys->start = start;
+        sys->started = true;
+    }
 
-    if (result != S_OK)
-        msg_Err(aout, "Failed to schedule audio sample: 0x%X", result);
-    else if (sampleFrameCount != written)
-        msg_Err(aout, "Written only %d samples out of %d", written, sampleFrameCount);
+    const uint8_t *src = audio->p_buffer;
+    size_t frames = audio->i_buffer / in_size;
+    while (frames > 0) {
+        /* next video frame boundary, in samples */
+        int64_t pos = sys->start + sys->staged;
+        int64_t k = pos * decklink_sys->timescale
+                  / (decklink_sys->frameduration * rate) + 1;
+        int64_t boundary = k * decklink_sys->frameduration * rate
+                         / decklink_sys->timescale;
+        if (boundary <= pos)
+            boundary = (k + 1) * decklink_sys->frameduration * rate
+                     / decklink_sys->timescale;
+
+        size_t n = boundary - pos;
+        if (n > sys->buffer_size - sys->staged)
+            n = sys->buffer_size - sys->staged;
+        if (n > frames)
+            n = frames;
+
+        uint8_t *dst = sys->buffer + sys->staged * out_size;
+        if (sys->spdif && decklink_sys->i_bits == 32)
+            InterleaveData32(dst, src, n, out_channels);
+        else
+            sys->map.interleave(dst, src, n, &sys->map);
+
+        sys->staged += n;
+        src += n * in_size;
+        frames -= n;
+
+        if (sys->start + sys->staged >= boundary
+         || sys->staged == sys->buffer_size)
+            ScheduleAudio(aout, decklink_sys);
+    }
 
     block_Release(audio);
 }
@@ -846,10 +1305,33 @@ static int OpenAudio(vlc_object_t *p_this)
 {
     audio_output_t *aout = (audio_output_t *)p_this;
     struct decklink_sys_t *decklink_sys = GetDLSys(VLC_OBJECT(aout));
+    aout_sys_t *sys;
+
+    aout->sys = sys = (aout_sys_t *)malloc(sizeof(*sys));
+    if (!sys)
+        return VLC_ENOMEM;
+
+    sys->buffer = NULL;
+    sys->buffer_size = 0;
+    sys->buffer_bytes = 0;
+    sys->staged = 0;
+    sys->started = false;
+
+    int channels = var_InheritInteger(aout, AUDIO_CFG_PREFIX "audio-channels");
+    int bits = var_InheritInteger(aout, AUDIO_CFG_PREFIX "audio-bits");
+    if (channels != 0 && channels != 2 && channels != 8 && channels != 16) {
+        msg_Err(aout, "Invalid number of audio channels %d, using 2", channels);
+        channels = 2;
+    }
+    if (bits != 16 && bits != 32) {
+        msg_Err(aout, "Invalid audio sample size %d, using 16", bits);
+        bits = 16;
+    }
 
     vlc_mutex_lock(&decklink_sys->lock);
-    //decklink_sys->i_channels = var_InheritInteger(vd, AUDIO_CFG_PREFIX "audio-channels");
-    decklink_sys->i_rate = var_InheritInteger(aout, AUDIO_CFG_PREFIX "audio-rate");
+    decklink_sys->i_channels = channels;
+    decklink_sys->i_bits = bits;
+    decklink_sys->i_rate = channels ? var_InheritInteger(aout, AUDIO_CFG_PREFIX "audio-rate") : 0;
     decklink_sys->users++;
     vlc_cond_signal(&decklink_sys->cond);
     vlc_mutex_unlock(&decklink_sys->lock);
@@ -869,8 +1351,11 @@ static int OpenAudio(vlc_object_t *p_this)
 
 static void CloseAudio(vlc_object_t *p_this)
 {
+    audio_output_t *aout = (audio_output_t *)p_this;
     struct decklink_sys_t *decklink_sys = GetDLSys(p_this);
     vlc_mutex_lock(&decklink_sys->lock);
     vlc_mutex_unlock(&decklink_sys->lock);
+    free(aout->sys->buffer);
+    free(aout->sys);
     ReleaseDLSys(p_this);
 }
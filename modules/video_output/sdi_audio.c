@@ -0,0 +1,224 @@
+/*****************************************************************************
+ * sdi_audio.c: PCM samples to SDI embedded audio channels
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <assert.h>
+#include <string.h>
+
+#include <vlc_common.h>
+#include <vlc_cpu.h>
+
+#include "sdi_audio.h"
+
+/* Any channel map, one sample at a time */
+static void Interleave16C(void *dst_, const void *src_, size_t frames,
+                          const sdi_audio_map_t *map)
+{
+    int16_t *dst = dst_;
+    const int16_t *src = src_;
+
+    for (size_t i = 0; i < frames; i++) {
+        for (unsigned c = 0; c < map->in_channels; c++)
+            dst[map->table[c]] = src[c];
+        dst += map->out_channels;
+        src += map->in_channels;
+    }
+}
+
+static void Interleave32C(void *dst_, const void *src_, size_t frames,
+                          const sdi_audio_map_t *map)
+{
+    int32_t *dst = dst_;
+    const int32_t *src = src_;
+
+    for (size_t i = 0; i < frames; i++) {
+        for (unsigned c = 0; c < map->in_channels; c++)
+            dst[map->table[c]] = src[c];
+        dst += map->out_channels;
+        src += map->in_channels;
+    }
+}
+
+/* Contiguous channel map: each input frame is copied as a whole. The
+ * common frame sizes get a constant size copy, that is a few vector moves. */
+static inline void CopyFrames(uint8_t *dst, const uint8_t *src, size_t frames,
+                              size_t in_size, size_t out_size)
+{
+    for (size_t i = 0; i < frames; i++) {
+        memcpy(dst, src, in_size);
+        dst += out_size;
+        src += in_size;
+    }
+}
+
+#define COPY(size) \
+static void Copy##size(void *dst, const void *src, size_t frames, \
+                       const sdi_audio_map_t *map) \
+{ \
+    CopyFrames((uint8_t *)dst + map->table[0] * map->bytes, src, frames, \
+               size, map->out_channels * map->bytes); \
+}
+COPY(4)
+COPY(8)
+COPY(16)
+COPY(32)
+#undef COPY
+
+static void CopyAny(void *dst, const void *src, size_t frames,
+                    const sdi_audio_map_t *map)
+{
+    CopyFrames((uint8_t *)dst + map->table[0] * map->bytes, src, frames,
+               map->in_channels * map->bytes, map->out_channels * map->bytes);
+}
+
+static void CopyAll(void *dst, const void *src, size_t frames,
+                    const sdi_audio_map_t *map)
+{
+    memcpy(dst, src, frames * map->in_channels * map->bytes);
+}
+
+#if (defined(__i386__) || defined(__x86_64__)) && \
+    defined(HAVE_SSE2_INTRINSICS) && (VLC_GCC_VERSION(4, 9) || defined(__clang__))
+# define SDI_AUDIO_X86 1
+# include <immintrin.h>
+
+# define SDI_AUDIO_SSSE3 __attribute__ ((__target__ ("ssse3")))
+
+/* Channel permutations within the first 16 or 32 bytes of the card frame,
+ * that is 8 channels of s16 or s32: the input frame is reordered with byte
+ * shuffles. Each output vector gathers from every input vector. */
+SDI_AUDIO_SSSE3
+static void Shuffle16SSSE3(void *dst_, const void *src_, size_t frames,
+                           const sdi_audio_map_t *map)
+{
+    uint8_t *dst = dst_;
+    const uint8_t *src = src_;
+    const size_t out_size = map->out_channels * map->bytes;
+    const __m128i m = _mm_loadu_si128((const __m128i *)map->shuffle[0]);
+
+    for (size_t i = 0; i < frames; i++) {
+        __m128i in = _mm_loadu_si128((const __m128i *)src);
+        _mm_storeu_si128((__m128i *)dst, _mm_shuffle_epi8(in, m));
+        dst += out_size;
+        src += 16;
+    }
+}
+
+SDI_AUDIO_SSSE3
+static void Shuffle32SSSE3(void *dst_, const void *src_, size_t frames,
+                           const sdi_audio_map_t *map)
+{
+    uint8_t *dst = dst_;
+    const uint8_t *src = src_;
+    const size_t out_size = map->out_channels * map->bytes;
+    const __m128i m00 = _mm_loadu_si128((const __m128i *)map->shuffle[0]);
+    const __m128i m01 = _mm_loadu_si128((const __m128i *)map->shuffle[1]);
+    const __m128i m10 = _mm_loadu_si128((const __m128i *)map->shuffle[2]);
+    const __m128i m11 = _mm_loadu_si128((const __m128i *)map->shuffle[3]);
+
+    for (size_t i = 0; i < frames; i++) {
+        __m128i in0 = _mm_loadu_si128((const __m128i *)src);
+        __m128i in1 = _mm_loadu_si128((const __m128i *)(src + 16));
+        __m128i out0 = _mm_or_si128(_mm_shuffle_epi8(in0, m00),
+                                    _mm_shuffle_epi8(in1, m01));
+        __m128i out1 = _mm_or_si128(_mm_shuffle_epi8(in0, m10),
+                                    _mm_shuffle_epi8(in1, m11));
+        _mm_storeu_si128((__m128i *)dst, out0);
+        _mm_storeu_si128((__m128i *)(dst + 16), out1);
+        dst += out_size;
+        src += 32;
+    }
+}
+
+/* shuffle[j * vectors + i] picks, for the output vector j, the bytes of
+ * the input vector i; 0x80 clears a byte */
+static void SetShuffle(sdi_audio_map_t *map)
+{
+    const unsigned size = map->in_channels * map->bytes;
+    const unsigned vectors = size / 16;
+
+    memset(map->shuffle, 0x80, sizeof (map->shuffle));
+    for (unsigned c = 0; c < map->in_channels; c++)
+        for (unsigned b = 0; b < map->bytes; b++) {
+            unsigned from = c * map->bytes + b;
+            unsigned to = map->table[c] * map->bytes + b;
+            map->shuffle[(to / 16) * vectors + from / 16][to % 16] = from % 16;
+        }
+}
+#endif
+
+void sdi_audio_MapInit(sdi_audio_map_t *map, unsigned bytes,
+                       unsigned in_channels, unsigned out_channels,
+                       const uint8_t *table, unsigned cpu)
+{
+    assert(bytes == 2 || bytes == 4);
+    assert(in_channels > 0 && in_channels <= out_channels);
+    assert(out_channels <= ARRAY_SIZE(map->table));
+
+    bool contiguous = true, permutation = true;
+
+    map->bytes = bytes;
+    map->in_channels = in_channels;
+    map->out_channels = out_channels;
+    for (unsigned c = 0; c < in_channels; c++) {
+        assert(table[c] < out_channels);
+        map->table[c] = table[c];
+        if (table[c] != table[0] + c)
+            contiguous = false;
+        if (table[c] >= in_channels)
+            permutation = false;
+    }
+
+    const unsigned size = in_channels * bytes;
+
+    if (contiguous) {
+        if (in_channels == out_channels) {
+            map->interleave = CopyAll;
+            map->name = "copy";
+            return;
+        }
+        switch (size) {
+        case 4:  map->interleave = Copy4;  break;
+        case 8:  map->interleave = Copy8;  break;
+        case 16: map->interleave = Copy16; break;
+        case 32: map->interleave = Copy32; break;
+        default: map->interleave = CopyAny; break;
+        }
+        map->name = "frame copy";
+        return;
+    }
+
+#ifdef SDI_AUDIO_X86
+    if ((cpu & VLC_CPU_SSSE3) && permutation && (size == 16 || size == 32)) {
+        SetShuffle(map);
+        map->interleave = size == 16 ? Shuffle16SSSE3 : Shuffle32SSSE3;
+        map->name = "SSSE3";
+        return;
+    }
+#else
+    VLC_UNUSED(permutation);
+#endif
+    VLC_UNUSED(cpu);
+    map->interleave = bytes == 2 ? Interleave16C : Interleave32C;
+    map->name = "C";
+}
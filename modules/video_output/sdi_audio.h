@@ -0,0 +1,67 @@
+/*****************************************************************************
+ * sdi_audio.h: PCM samples to SDI embedded audio channels
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef _VLC_VIDEOOUTPUT_SDI_AUDIO_H
+#define _VLC_VIDEOOUTPUT_SDI_AUDIO_H 1
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct sdi_audio_map_t sdi_audio_map_t;
+
+/**
+ * Copies sample frames into the card frame layout.
+ * Card channels without input channel are not written.
+ */
+typedef void (*sdi_audio_interleave_t)(void *dst, const void *src,
+                                       size_t frames,
+                                       const sdi_audio_map_t *map);
+
+struct sdi_audio_map_t
+{
+    sdi_audio_interleave_t interleave;
+    const char *name;
+    unsigned bytes;        /* per sample, 2 or 4 */
+    unsigned in_channels;
+    unsigned out_channels;
+    uint8_t  table[16];    /* input to card channel index */
+    uint8_t  shuffle[4][16];
+};
+
+/**
+ * Sets the channel map up, and picks the fastest interleaving routine
+ * usable with it and the given CPU flags.
+ * \param bytes bytes per sample, 2 (s16) or 4 (s32)
+ * \param table card channel of each input channel, below out_channels
+ * \param cpu CPU capabilities, usually vlc_CPU()
+ */
+void sdi_audio_MapInit(sdi_audio_map_t *map, unsigned bytes,
+                       unsigned in_channels, unsigned out_channels,
+                       const uint8_t *table, unsigned cpu);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
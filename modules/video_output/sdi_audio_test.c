@@ -0,0 +1,148 @@
+/*****************************************************************************
+ * sdi_audio_test.c: SDI embedded audio interleaving test and benchmark
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#undef NDEBUG
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vlc_common.h>
+#include <vlc_cpu.h>
+
+#include "sdi_audio.h"
+
+#define FRAMES 1602 /* one 29.97 Hz video frame at 48 kHz */
+
+static const unsigned variants[] = {
+    0,
+#if defined (__i386__) || defined (__x86_64__)
+    VLC_CPU_SSE2 | VLC_CPU_SSSE3,
+#endif
+};
+
+/* stereo, swapped stereo, 5.1, 7.1 and 8.1, as mapped by the DeckLink output */
+static const uint8_t maps[][9] = {
+    { 0, 1 },
+    { 1, 0 },
+    { 0, 1, 4, 5, 2, 3 },
+    { 0, 1, 6, 7, 4, 5, 2, 3 },
+    { 0, 1, 6, 7, 4, 5, 8, 2, 3 },
+};
+static const unsigned map_channels[] = { 2, 2, 6, 8, 9 };
+
+/* the contiguous ones, into more card channels */
+static const uint8_t offsets[] = { 0, 2, 8 };
+
+static void check(unsigned cpu, unsigned bytes, unsigned in, unsigned out,
+                  const uint8_t *table)
+{
+    sdi_audio_map_t map;
+    size_t in_size = in * bytes, out_size = out * bytes;
+    uint8_t *src = malloc(FRAMES * in_size);
+    uint8_t *dst[2] = { malloc(FRAMES * out_size), malloc(FRAMES * out_size) };
+
+    assert(src && dst[0] && dst[1]);
+    for (size_t i = 0; i < FRAMES * in_size; i++)
+        src[i] = rand();
+    /* card channels without input must be left untouched */
+    memset(dst[0], 0x5a, FRAMES * out_size);
+    memset(dst[1], 0x5a, FRAMES * out_size);
+
+    for (size_t i = 0; i < FRAMES; i++)
+        for (unsigned c = 0; c < in; c++)
+            memcpy(dst[0] + i * out_size + table[c] * bytes,
+                   src + i * in_size + c * bytes, bytes);
+    sdi_audio_MapInit(&map, bytes, in, out, table, cpu);
+    map.interleave(dst[1], src, FRAMES, &map);
+    if (memcmp(dst[0], dst[1], FRAMES * out_size)) {
+        fprintf(stderr, "%s: %u x s%u to %u channels differs\n", map.name,
+                in, bytes * 8, out);
+        abort();
+    }
+
+    free(src);
+    free(dst[0]);
+    free(dst[1]);
+}
+
+static void bench(unsigned cpu, unsigned bytes, unsigned in, unsigned out,
+                  const uint8_t *table, unsigned rounds)
+{
+    sdi_audio_map_t map;
+    uint8_t *src = calloc(FRAMES, in * bytes);
+    uint8_t *dst = calloc(FRAMES, out * bytes);
+
+    assert(src && dst);
+    sdi_audio_MapInit(&map, bytes, in, out, table, cpu);
+
+    mtime_t start = mdate();
+    for (unsigned r = 0; r < rounds; r++)
+        map.interleave(dst, src, FRAMES, &map);
+    mtime_t spent = mdate() - start;
+
+    printf("%-10s %u x s%u to %2u channels: %8.1f Msamples/s\n", map.name,
+           in, bytes * 8, out,
+           (double)rounds * FRAMES * in / (spent ? spent : 1));
+    free(src);
+    free(dst);
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned rounds = (argc > 1) ? strtoul(argv[1], NULL, 0) : 2000;
+    static const unsigned outs[] = { 2, 8, 16 };
+
+    srand(0);
+    for (unsigned v = 0; v < ARRAY_SIZE(variants); v++)
+        for (unsigned bytes = 2; bytes <= 4; bytes += 2)
+            for (unsigned o = 0; o < ARRAY_SIZE(outs); o++) {
+                for (unsigned m = 0; m < ARRAY_SIZE(maps); m++)
+                    if (map_channels[m] <= outs[o])
+                        check(variants[v], bytes, map_channels[m], outs[o],
+                              maps[m]);
+
+                for (unsigned in = 1; in <= 8; in++)
+                    for (unsigned k = 0; k < ARRAY_SIZE(offsets); k++) {
+                        uint8_t table[16];
+                        if (offsets[k] + in > outs[o])
+                            continue;
+                        for (unsigned c = 0; c < in; c++)
+                            table[c] = offsets[k] + c;
+                        check(variants[v], bytes, in, outs[o], table);
+                    }
+            }
+
+    for (unsigned v = 0; v < ARRAY_SIZE(variants); v++)
+        for (unsigned bytes = 2; bytes <= 4; bytes += 2) {
+            bench(variants[v], bytes, 8, 8, maps[3], rounds);
+            bench(variants[v], bytes, 8, 16, maps[3], rounds);
+        }
+    uint8_t identity[8] = { 0, 1, 2, 3, 4, 5, 6, 7 };
+    for (unsigned bytes = 2; bytes <= 4; bytes += 2) {
+        bench(0, bytes, 8, 8, identity, rounds);
+        bench(0, bytes, 8, 16, identity, rounds);
+    }
+    return 0;
+}
@@ -115,6 +115,12 @@ void stats_ComputeInputStats(input_thread_t *input, input_stats_t *st)
     st->i_displayed_pictures = stats_GetTotal(input->p->counters.p_displayed_pictures);
     st->i_lost_pictures = stats_GetTotal(input->p->counters.p_lost_pictures);
 
+    /* Block pool */
+    uint64_t hits, misses;
+    st->i_block_pool_cached = block_pool_GetStats(&hits, &misses);
+    st->i_block_pool_hits = hits;
+    st->i_block_pool_misses = misses;
+
     vlc_mutex_unlock(&st->lock);
     vlc_mutex_unlock(&input->p->counters.counters_lock);
 }
@@ -130,8 +136,9 @@ void stats_ReinitInputStats( input_stats_t *p_stats )
     p_stats->i_displayed_pictures = p_stats->i_lost_pictures =
     p_stats->i_played_abuffers = p_stats->i_lost_abuffers =
     p_stats->i_decoded_video = p_stats->i_decoded_audio =
-    p_stats->i_sent_bytes = p_stats->i_sent_packets = p_stats->f_send_bitrate
-     = 0;
+    p_stats->i_sent_bytes = p_stats->i_sent_packets = p_stats->f_send_bitrate =
+    p_stats->i_block_pool_hits = p_stats->i_block_pool_misses =
+    p_stats->i_block_pool_cached = 0;
     vlc_mutex_unlock( &p_stats->lock );
 }
 
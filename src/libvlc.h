@@ -77,6 +77,13 @@ int vlc_LogPreinit(libvlc_int_t *);
 int vlc_LogInit(libvlc_int_t *);
 void vlc_LogDeinit(libvlc_int_t *);
 
+/*
+ * Block pool
+ */
+void block_pool_Init(libvlc_int_t *);
+void block_pool_Deinit(libvlc_int_t *);
+size_t block_pool_GetStats(uint64_t *hits, uint64_t *misses);
+
 /*
  * LibVLC exit event handling
  */
@@ -37,6 +37,8 @@
 #include <vlc_common.h>
 #include <vlc_block.h>
 #include <vlc_fs.h>
+#include <vlc_atomic.h>
+#include "libvlc.h"
 
 /**
  * @section Block handling functions.
@@ -124,15 +126,470 @@ static void BlockMetaCopy( block_t *restrict out, const block_t *in )
 /** Initial reserved header and footer size. */
 #define BLOCK_PADDING      32
 
+/** Allocation size of a block_Alloc() block of the given payload size */
+#define BLOCK_ALLOC(size) \
+    (sizeof (block_t) + BLOCK_ALIGN + (2 * BLOCK_PADDING) + (size))
+
+/**
+ * @section Block pool
+ *
+ * block_Alloc() recycles the blocks of a few size classes, tuned for TS
+ * packets, UDP datagrams, audio frames and video frames. Each thread caches
+ * the small blocks it releases. Threads exchange them through a global
+ * depot, by magazines of several blocks, so that the depot lock is seldom
+ * taken. Video frames are few and large: they go through the depot alone.
+ */
+
+/** Payload capacity of the size classes */
+static const size_t block_pool_classes[] = {
+    192,        /* TS and M2TS packets */
+    384, 768,
+    1344,       /* 7 TS packets in a datagram */
+    2048,       /* Ethernet frame */
+    4096, 8192, 16384, 32768,
+    65536,      /* largest datagram */
+    131072, 262144, 524288, 1048576,
+    2 << 20,
+    3 << 20,    /* 1080p 4:2:0 8-bits frame */
+    4 << 20,
+    6 << 20,    /* 1080p 4:2:2 10-bits frame */
+    8 << 20,
+    12 << 20,   /* 2160p 4:2:0 8-bits frame */
+    16 << 20,   /* 2160p 4:2:2 8-bits frame */
+};
+#define BLOCK_POOL_CLASSES ARRAY_SIZE(block_pool_classes)
+
+/** Bytes worth of blocks per magazine (but at least one block) */
+#define BLOCK_POOL_MAGAZINE (128 << 10)
+/** Maximum blocks per magazine */
+#define BLOCK_POOL_MAGAZINE_MAX 32
+/** Maximum bytes in the global depot, beyond which blocks are freed */
+#define BLOCK_POOL_DEPOT_MAX (64 << 20)
+/** Largest payload cached by threads */
+#define BLOCK_POOL_CACHE_CLASS_MAX (1 << 20)
+/** Maximum bytes cached per thread, beyond which they go to the depot */
+#define BLOCK_POOL_CACHE_MAX (4 << 20)
+/** Statistics are published at least every so many allocations */
+#define BLOCK_POOL_STATS_PERIOD 4096
+
+/* Per-thread cache */
+typedef struct block_cache
+{
+    block_t *blocks[BLOCK_POOL_CLASSES]; /**< LIFO lists */
+    unsigned count[BLOCK_POOL_CLASSES];
+    size_t bytes;
+
+    /* Statistics not yet published */
+    unsigned hits;
+    unsigned misses;
+    size_t cached; /**< change of cached bytes (modulo SIZE_MAX + 1) */
+} block_cache_t;
+
+static struct
+{
+    vlc_mutex_t lock;
+    unsigned refs;
+    bool keyed; /**< the thread key is created, never deleted */
+    vlc_threadvar_t key;
+    atomic_bool enabled;
+
+    /* Depot */
+    block_t *blocks[BLOCK_POOL_CLASSES];
+    unsigned count[BLOCK_POOL_CLASSES];
+    size_t bytes;
+
+    /* Statistics */
+    atomic_ullong hits;
+    atomic_ullong misses;
+    atomic_size_t cached;
+} block_pool = { .lock = VLC_STATIC_MUTEX };
+
+/* Returns the size class for a payload size, or -1 if none is suitable */
+static int BlockPoolClass(size_t size)
+{
+    for (unsigned c = 0; c < BLOCK_POOL_CLASSES; c++)
+        if (size <= block_pool_classes[c])
+        {   /* Do not waste more than half of a block */
+            if (c > 0 && size <= block_pool_classes[c] / 2)
+                break;
+            return c;
+        }
+    return -1;
+}
+
+static unsigned BlockPoolMagazine(unsigned c)
+{
+    size_t n = BLOCK_POOL_MAGAZINE / BLOCK_ALLOC(block_pool_classes[c]);
+
+    return __MAX(__MIN(n, BLOCK_POOL_MAGAZINE_MAX), 1);
+}
+
+static void BlockCachePublish(block_cache_t *cache)
+{
+    atomic_fetch_add_explicit(&block_pool.hits, cache->hits,
+                              memory_order_relaxed);
+    atomic_fetch_add_explicit(&block_pool.misses, cache->misses,
+                              memory_order_relaxed);
+    atomic_fetch_add_explicit(&block_pool.cached, cache->cached,
+                              memory_order_relaxed);
+    cache->hits = cache->misses = 0;
+    cache->cached = 0;
+}
+
+/* Moves up to n blocks of class c from the cache to the depot */
+static void BlockCacheFlush(block_cache_t *cache, unsigned c, unsigned n)
+{
+    const size_t alloc = BLOCK_ALLOC(block_pool_classes[c]);
+    bool enabled = atomic_load_explicit(&block_pool.enabled,
+                                        memory_order_relaxed);
+
+    vlc_mutex_lock(&block_pool.lock);
+    while (n > 0 && cache->blocks[c] != NULL)
+    {
+        block_t *block = cache->blocks[c];
+
+        cache->blocks[c] = block->p_next;
+        cache->count[c]--;
+        cache->bytes -= alloc;
+        cache->cached -= alloc;
+        n--;
+
+        if (enabled && block_pool.bytes + alloc <= BLOCK_POOL_DEPOT_MAX)
+        {
+            block->p_next = block_pool.blocks[c];
+            block_pool.blocks[c] = block;
+            block_pool.count[c]++;
+            block_pool.bytes += alloc;
+            cache->cached += alloc;
+        }
+        else
+            free(block);
+    }
+    vlc_mutex_unlock(&block_pool.lock);
+    BlockCachePublish(cache);
+}
+
+/* Moves a magazine of blocks of class c from the depot to the cache */
+static void BlockCacheRefill(block_cache_t *cache, unsigned c)
+{
+    const size_t alloc = BLOCK_ALLOC(block_pool_classes[c]);
+    unsigned n = BlockPoolMagazine(c);
+
+    vlc_mutex_lock(&block_pool.lock);
+    while (n > 0 && block_pool.blocks[c] != NULL)
+    {
+        block_t *block = block_pool.blocks[c];
+
+        block_pool.blocks[c] = block->p_next;
+        block_pool.count[c]--;
+        block_pool.bytes -= alloc;
+        n--;
+
+        block->p_next = cache->blocks[c];
+        cache->blocks[c] = block;
+        cache->count[c]++;
+        cache->bytes += alloc;
+    }
+    vlc_mutex_unlock(&block_pool.lock);
+    BlockCachePublish(cache);
+}
+
+/* Hands the cached blocks over to the depot, or frees them if the pool is
+ * off; only the owner thread may do that */
+static void BlockCacheEmpty(block_cache_t *cache)
+{
+    for (unsigned c = 0; c < BLOCK_POOL_CLASSES; c++)
+        BlockCacheFlush(cache, c, cache->count[c]);
+}
+
+/* Thread exit */
+static void BlockCacheDestroy(void *data)
+{
+    block_cache_t *cache = data;
+
+    BlockCacheEmpty(cache);
+    free(cache);
+}
+
+static block_cache_t *BlockCacheGet(void)
+{
+    block_cache_t *cache = vlc_threadvar_get(block_pool.key);
+
+    if (unlikely(cache == NULL))
+    {
+        cache = calloc(1, sizeof (*cache));
+        if (unlikely(cache == NULL))
+            return NULL;
+        if (unlikely(vlc_threadvar_set(block_pool.key, cache)))
+        {
+            free(cache);
+            return NULL;
+        }
+    }
+    return cache;
+}
+
+/* Large blocks, straight from and to the depot */
+static block_t *BlockDepotGet(unsigned c)
+{
+    const size_t alloc = BLOCK_ALLOC(block_pool_classes[c]);
+
+    vlc_mutex_lock(&block_pool.lock);
+    block_t *block = block_pool.blocks[c];
+    if (block != NULL)
+    {
+        block_pool.blocks[c] = block->p_next;
+        block_pool.count[c]--;
+        block_pool.bytes -= alloc;
+    }
+    vlc_mutex_unlock(&block_pool.lock);
+
+    if (block != NULL)
+    {
+        atomic_fetch_add_explicit(&block_pool.hits, 1, memory_order_relaxed);
+        atomic_fetch_sub_explicit(&block_pool.cached, alloc,
+                                  memory_order_relaxed);
+        return block;
+    }
+    atomic_fetch_add_explicit(&block_pool.misses, 1, memory_order_relaxed);
+    return malloc(alloc);
+}
+
+static void BlockDepotPut(block_t *block, unsigned c)
+{
+    const size_t alloc = BLOCK_ALLOC(block_pool_classes[c]);
+
+    vlc_mutex_lock(&block_pool.lock);
+    if (atomic_load_explicit(&block_pool.enabled, memory_order_relaxed)
+     && block_pool.bytes + alloc <= BLOCK_POOL_DEPOT_MAX)
+    {
+        block->p_next = block_pool.blocks[c];
+        block_pool.blocks[c] = block;
+        block_pool.count[c]++;
+        block_pool.bytes += alloc;
+        atomic_fetch_add_explicit(&block_pool.cached, alloc,
+                                  memory_order_relaxed);
+        block = NULL;
+    }
+    vlc_mutex_unlock(&block_pool.lock);
+    free(block);
+}
+
+/* Returns an uninitialized block of class c */
+static block_t *BlockPoolGet(unsigned c)
+{
+    const size_t alloc = BLOCK_ALLOC(block_pool_classes[c]);
+
+    if (block_pool_classes[c] > BLOCK_POOL_CACHE_CLASS_MAX)
+        return BlockDepotGet(c);
+
+    block_cache_t *cache = BlockCacheGet();
+
+    if (likely(cache != NULL))
+    {
+        if (cache->blocks[c] == NULL)
+            BlockCacheRefill(cache, c);
+
+        block_t *block = cache->blocks[c];
+        if (block != NULL)
+        {
+            cache->blocks[c] = block->p_next;
+            cache->count[c]--;
+            cache->bytes -= alloc;
+            cache->cached -= alloc;
+            cache->hits++;
+        }
+        else
+            cache->misses++;
+
+        if (cache->hits + cache->misses >= BLOCK_POOL_STATS_PERIOD)
+            BlockCachePublish(cache);
+        if (block != NULL)
+            return block;
+    }
+    return malloc(alloc);
+}
+
+static void block_pool_Release(block_t *block)
+{
+    /* That is always true for blocks allocated with block_Alloc(). */
+    assert (block->p_start == (unsigned char *)(block + 1));
+    block_Invalidate (block);
+
+    if (atomic_load_explicit(&block_pool.enabled, memory_order_relaxed))
+    {
+        const size_t alloc = sizeof (*block) + block->i_size;
+        unsigned c = 0;
+
+        while (BLOCK_ALLOC(block_pool_classes[c]) != alloc)
+        {
+            c++;
+            assert(c < BLOCK_POOL_CLASSES);
+        }
+
+        if (block_pool_classes[c] > BLOCK_POOL_CACHE_CLASS_MAX)
+        {
+            BlockDepotPut(block, c);
+            return;
+        }
+
+        block_cache_t *cache = BlockCacheGet();
+        if (likely(cache != NULL))
+        {
+            unsigned n = BlockPoolMagazine(c);
+
+            if (cache->count[c] >= 2 * n)
+                BlockCacheFlush(cache, c, n);
+            if (cache->bytes + alloc > BLOCK_POOL_CACHE_MAX)
+                for (unsigned i = 0; i < BLOCK_POOL_CLASSES; i++)
+                    BlockCacheFlush(cache, i, cache->count[i]);
+            block->p_next = cache->blocks[c];
+            cache->blocks[c] = block;
+            cache->count[c]++;
+            cache->bytes += alloc;
+            cache->cached += alloc;
+            return;
+        }
+    }
+    free (block);
+}
+
+/* Frees the blocks in the depot; the pool lock must be held */
+static void BlockDepotEmpty(void)
+{
+    vlc_assert_locked(&block_pool.lock);
+
+    for (unsigned c = 0; c < BLOCK_POOL_CLASSES; c++)
+    {
+        const size_t alloc = BLOCK_ALLOC(block_pool_classes[c]);
+
+        while (block_pool.blocks[c] != NULL)
+        {
+            block_t *block = block_pool.blocks[c];
+
+            block_pool.blocks[c] = block->p_next;
+            free(block);
+            atomic_fetch_sub_explicit(&block_pool.cached, alloc,
+                                      memory_order_relaxed);
+        }
+        block_pool.count[c] = 0;
+    }
+    block_pool.bytes = 0;
+}
+
+static void BlockPoolEnable(bool enabled)
+{
+    atomic_store(&block_pool.enabled, enabled);
+    if (enabled)
+        return;
+
+    /* Blocks cached by threads are freed when they exit. */
+    vlc_mutex_lock(&block_pool.lock);
+    BlockDepotEmpty();
+    vlc_mutex_unlock(&block_pool.lock);
+}
+
+static int BlockPoolCallback(vlc_object_t *obj, const char *var,
+                             vlc_value_t old, vlc_value_t cur, void *data)
+{
+    VLC_UNUSED(obj); VLC_UNUSED(var); VLC_UNUSED(old); VLC_UNUSED(data);
+    BlockPoolEnable(cur.b_bool);
+    return VLC_SUCCESS;
+}
+
+/**
+ * Sets the block pool up for a LibVLC instance.
+ * The "block-pool" variable of the instance switches the pool on and off.
+ */
+void block_pool_Init(libvlc_int_t *libvlc)
+{
+    vlc_mutex_lock(&block_pool.lock);
+    if (!block_pool.keyed)
+    {
+        if (vlc_threadvar_create(&block_pool.key, BlockCacheDestroy))
+        {
+            vlc_mutex_unlock(&block_pool.lock);
+            return;
+        }
+        block_pool.keyed = true;
+    }
+    block_pool.refs++;
+    vlc_mutex_unlock(&block_pool.lock);
+
+    var_Create(libvlc, "block-pool", VLC_VAR_BOOL | VLC_VAR_DOINHERIT);
+    var_AddCallback(libvlc, "block-pool", BlockPoolCallback, NULL);
+    BlockPoolEnable(var_GetBool(libvlc, "block-pool"));
+}
+
+/**
+ * Releases the block pool for a LibVLC instance.
+ * When the last instance goes away, the depot and the cache of the calling
+ * thread are emptied; other threads empty their caches when they exit.
+ */
+void block_pool_Deinit(libvlc_int_t *libvlc)
+{
+    if (var_Type(libvlc, "block-pool") == 0)
+        return; /* block_pool_Init() failed */
+
+    var_DelCallback(libvlc, "block-pool", BlockPoolCallback, NULL);
+    var_Destroy(libvlc, "block-pool");
+
+    vlc_mutex_lock(&block_pool.lock);
+    assert(block_pool.refs > 0);
+    bool last = --block_pool.refs == 0;
+    if (last)
+    {
+        atomic_store(&block_pool.enabled, false);
+        BlockDepotEmpty();
+    }
+    vlc_mutex_unlock(&block_pool.lock);
+
+    /* Other threads may still use their caches without the lock: the key is
+     * kept, so that each of them frees its own cache when it exits. */
+    if (last)
+    {
+        block_cache_t *cache = vlc_threadvar_get(block_pool.key);
+        if (cache != NULL)
+            BlockCacheEmpty(cache);
+    }
+}
+
+/**
+ * Gets the block pool statistics.
+ * @param hits number of allocations served from the pool
+ * @param misses number of allocations of pooled sizes served by the heap
+ * @return the number of bytes held by the pool
+ */
+size_t block_pool_GetStats(uint64_t *hits, uint64_t *misses)
+{
+    size_t cached = atomic_load_explicit(&block_pool.cached,
+                                         memory_order_relaxed);
+
+    *hits = atomic_load_explicit(&block_pool.hits, memory_order_relaxed);
+    *misses = atomic_load_explicit(&block_pool.misses, memory_order_relaxed);
+    /* Unpublished changes may transiently wrap the total around. */
+    return (cached <= SIZE_MAX / 2) ? cached : 0;
+}
+
 block_t *block_Alloc (size_t size)
 {
     /* 2 * BLOCK_PADDING: pre + post padding */
-    const size_t alloc = sizeof (block_t) + BLOCK_ALIGN + (2 * BLOCK_PADDING)
-                       + size;
+    size_t alloc = BLOCK_ALLOC(size);
     if (unlikely(alloc <= size))
         return NULL;
 
-    block_t *b = malloc (alloc);
+    int c = -1;
+    if (atomic_load_explicit(&block_pool.enabled, memory_order_relaxed))
+        c = BlockPoolClass(size);
+
+    block_t *b;
+    if (c >= 0)
+    {
+        alloc = BLOCK_ALLOC(block_pool_classes[c]);
+        b = BlockPoolGet(c);
+    }
+    else
+        b = malloc (alloc);
     if (unlikely(b == NULL))
         return NULL;
 
@@ -142,7 +599,7 @@ block_t *block_Alloc (size_t size)
     b->p_buffer += BLOCK_PADDING + BLOCK_ALIGN - 1;
     b->p_buffer = (void *)(((uintptr_t)b->p_buffer) & ~(BLOCK_ALIGN - 1));
     b->i_buffer = size;
-    b->pf_release = block_generic_Release;
+    b->pf_release = (c >= 0) ? block_pool_Release : block_generic_Release;
     return b;
 }
 
@@ -278,6 +735,75 @@ block_t *block_heap_Alloc (void *addr, size_t length)
     return block;
 }
 
+typedef struct block_slab block_slab_t;
+
+typedef struct
+{
+    block_t self;
+    block_slab_t *slab;
+} block_slice_t;
+
+struct block_slab
+{
+    atomic_uint refs;
+    block_slice_t slices[];
+};
+
+static void block_slice_Release (block_t *block)
+{
+    block_slab_t *slab = ((block_slice_t *)block)->slab;
+
+    block_Invalidate (block);
+    if (atomic_fetch_sub (&slab->refs, 1) == 1)
+        free (slab);
+}
+
+/**
+ * Allocates a chain of blocks of the same size, all carved out of a single
+ * heap allocation. Their payloads are contiguous, in chain order.
+ * The memory is freed once the last of the blocks is released, in any order
+ * and from any thread.
+ *
+ * This trades one allocation per block for a single one, for producers that
+ * know beforehand how many small blocks they will output, such as packet
+ * multiplexers.
+ *
+ * @param count number of blocks
+ * @param size payload size of each block
+ * @return the first block of the chain, or NULL in case of error.
+ */
+block_t *block_ChainAlloc (size_t count, size_t size)
+{
+    if (unlikely(count == 0 || count > SIZE_MAX / 2 / (sizeof (block_slice_t)
+                                                       + size)))
+        return NULL;
+
+    const size_t header = (sizeof (block_slab_t)
+                        + count * sizeof (block_slice_t) + BLOCK_ALIGN - 1)
+                        & ~(size_t)(BLOCK_ALIGN - 1);
+    block_slab_t *slab = malloc (header + count * size);
+    if (unlikely(slab == NULL))
+        return NULL;
+
+    atomic_init (&slab->refs, count);
+
+    block_slice_t *slices = slab->slices;
+    uint8_t *buf = (uint8_t *)slab + header;
+    block_t *first = NULL, **pp_last = &first;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        block_t *block = &slices[i].self;
+
+        block_Init (block, buf + i * size, size);
+        block->pf_release = block_slice_Release;
+        slices[i].slab = slab;
+        *pp_last = block;
+        pp_last = &block->p_next;
+    }
+    return first;
+}
+
 #ifdef HAVE_MMAP
 # include <sys/mman.h>
 
@@ -30,12 +30,49 @@
 
 #include <vlc_common.h>
 #include <vlc_block.h>
+#include <vlc_atomic.h>
 #include "libvlc.h"
 
 /**
  * @section Thread-safe block queue functions
  */
 
+#define FIFO_SEGMENT_SIZE 256
+
+typedef struct block_fifo_segment_t
+{
+    struct block_fifo_segment_t *p_next;
+    block_t *pp_blocks[FIFO_SEGMENT_SIZE];
+} block_fifo_segment_t;
+
+/**
+ * Lock-free ring for FIFOs with a single producer and a single consumer.
+ *
+ * Each side owns its own index and byte count, so that neither needs
+ * read-modify-write operations. The ring grows by segments: queuing never
+ * fails nor waits. The consumer hands the segments it leaves back to the
+ * producer, one at a time.
+ */
+typedef struct
+{
+    /* producer side */
+    block_fifo_segment_t *p_tail;
+    size_t                i_tail_base; /**< index of the first tail slot */
+    atomic_size_t         i_put;       /**< number of blocks queued so far */
+    atomic_size_t         i_put_bytes;
+    char                  pad[64];
+
+    /* consumer side */
+    block_fifo_segment_t *p_head;
+    size_t                i_head_base;
+    atomic_size_t         i_get;
+    atomic_size_t         i_get_bytes;
+    atomic_bool           b_waiting;  /**< the consumer is (going) asleep */
+    char                  pad2[64];
+
+    atomic_uintptr_t      spare;      /**< recycled segment */
+} block_fifo_ring_t;
+
 /**
  * Internal state for block queues
  */
@@ -48,8 +85,135 @@ struct block_fifo_t
     block_t             **pp_last;
     size_t              i_depth;
     size_t              i_size;
+
+    block_fifo_ring_t   *p_ring; /**< single producer/consumer ring or NULL */
 };
 
+static block_fifo_ring_t *FifoRingNew(void)
+{
+    block_fifo_ring_t *ring = malloc(sizeof (*ring));
+    block_fifo_segment_t *seg = malloc(sizeof (*seg));
+
+    if (unlikely(ring == NULL || seg == NULL))
+    {
+        free(seg);
+        free(ring);
+        return NULL;
+    }
+
+    seg->p_next = NULL;
+    ring->p_tail = ring->p_head = seg;
+    ring->i_tail_base = ring->i_head_base = 0;
+    atomic_init(&ring->i_put, 0);
+    atomic_init(&ring->i_put_bytes, 0);
+    atomic_init(&ring->i_get, 0);
+    atomic_init(&ring->i_get_bytes, 0);
+    atomic_init(&ring->b_waiting, false);
+    atomic_init(&ring->spare, 0);
+    return ring;
+}
+
+/* Producer side: returns false if out of memory */
+static bool FifoRingPush(block_fifo_ring_t *ring, block_t *block)
+{
+    size_t put = atomic_load_explicit(&ring->i_put, memory_order_relaxed);
+
+    if (put - ring->i_tail_base == FIFO_SEGMENT_SIZE)
+    {
+        block_fifo_segment_t *seg = (block_fifo_segment_t *)
+            atomic_exchange(&ring->spare, (uintptr_t)NULL);
+
+        if (seg == NULL)
+        {
+            seg = malloc(sizeof (*seg));
+            if (unlikely(seg == NULL))
+                return false;
+        }
+        seg->p_next = NULL;
+        ring->p_tail->p_next = seg;
+        ring->p_tail = seg;
+        ring->i_tail_base = put;
+    }
+
+    ring->p_tail->pp_blocks[put - ring->i_tail_base] = block;
+    atomic_store_explicit(&ring->i_put_bytes, block->i_buffer +
+        atomic_load_explicit(&ring->i_put_bytes, memory_order_relaxed),
+                          memory_order_release);
+    /* sequentially consistent: pairs with the consumer going to sleep */
+    atomic_store(&ring->i_put, put + 1);
+    return true;
+}
+
+/* Consumer side: returns the first block, or NULL if empty */
+static block_t *FifoRingPeek(block_fifo_ring_t *ring)
+{
+    size_t get = atomic_load_explicit(&ring->i_get, memory_order_relaxed);
+
+    if (get == atomic_load_explicit(&ring->i_put, memory_order_acquire))
+        return NULL;
+
+    if (get - ring->i_head_base == FIFO_SEGMENT_SIZE)
+    {
+        block_fifo_segment_t *seg = ring->p_head;
+
+        ring->p_head = seg->p_next;
+        ring->i_head_base = get;
+        free((block_fifo_segment_t *)
+             atomic_exchange(&ring->spare, (uintptr_t)seg));
+    }
+    return ring->p_head->pp_blocks[get - ring->i_head_base];
+}
+
+static block_t *FifoRingPop(block_fifo_ring_t *ring)
+{
+    block_t *block = FifoRingPeek(ring);
+
+    if (block == NULL)
+        return NULL;
+
+    atomic_store_explicit(&ring->i_get_bytes, block->i_buffer +
+        atomic_load_explicit(&ring->i_get_bytes, memory_order_relaxed),
+                          memory_order_release);
+    atomic_store_explicit(&ring->i_get,
+        atomic_load_explicit(&ring->i_get, memory_order_relaxed) + 1,
+                          memory_order_release);
+    return block;
+}
+
+static size_t FifoRingCount(block_fifo_ring_t *ring)
+{
+    size_t get = atomic_load_explicit(&ring->i_get, memory_order_acquire);
+
+    return atomic_load_explicit(&ring->i_put, memory_order_acquire) - get;
+}
+
+static size_t FifoRingBytes(block_fifo_ring_t *ring)
+{
+    size_t get = atomic_load_explicit(&ring->i_get_bytes,
+                                      memory_order_acquire);
+
+    return atomic_load_explicit(&ring->i_put_bytes, memory_order_acquire)
+           - get;
+}
+
+static void FifoRingDelete(block_fifo_ring_t *ring)
+{
+    block_t *block;
+
+    while ((block = FifoRingPop(ring)) != NULL)
+        block_Release(block);
+    free(ring->p_head);
+    free((block_fifo_segment_t *)atomic_load(&ring->spare));
+    free(ring);
+}
+
+static void FifoRingAwake(void *data)
+{
+    block_fifo_ring_t *ring = data;
+
+    atomic_store_explicit(&ring->b_waiting, false, memory_order_relaxed);
+}
+
 /**
  * Locks a block FIFO. No more than one thread can lock the FIFO at any given
  * time, and no other thread can modify the FIFO while it is locked.
@@ -105,9 +269,37 @@ void vlc_fifo_Wait(vlc_fifo_t *fifo)
     vlc_fifo_WaitCond(fifo, &fifo->wait);
 }
 
+/* The producer of a ring only signals the FIFO if it sees the consumer
+ * waiting. The consumer checks the ring again after raising the flag, and
+ * returns early (spuriously) if a block has arrived in between. */
+static bool FifoRingSleep(block_fifo_ring_t *ring)
+{
+    atomic_store(&ring->b_waiting, true);
+    if (atomic_load(&ring->i_put)
+     != atomic_load_explicit(&ring->i_get, memory_order_relaxed))
+    {
+        FifoRingAwake(ring);
+        return false;
+    }
+    return true;
+}
+
 void vlc_fifo_WaitCond(vlc_fifo_t *fifo, vlc_cond_t *condvar)
 {
+    block_fifo_ring_t *ring = fifo->p_ring;
+
+    if (ring == NULL)
+    {
+        vlc_cond_wait(condvar, &fifo->lock);
+        return;
+    }
+
+    if (!FifoRingSleep(ring))
+        return;
+    vlc_cleanup_push(FifoRingAwake, ring);
     vlc_cond_wait(condvar, &fifo->lock);
+    vlc_cleanup_pop();
+    FifoRingAwake(ring);
 }
 
 /**
@@ -116,7 +308,19 @@ void vlc_fifo_WaitCond(vlc_fifo_t *fifo, vlc_cond_t *condvar)
  */
 int vlc_fifo_TimedWaitCond(vlc_fifo_t *fifo, vlc_cond_t *condvar, mtime_t deadline)
 {
-    return vlc_cond_timedwait(condvar, &fifo->lock, deadline);
+    block_fifo_ring_t *ring = fifo->p_ring;
+    int ret;
+
+    if (ring == NULL)
+        return vlc_cond_timedwait(condvar, &fifo->lock, deadline);
+
+    if (!FifoRingSleep(ring))
+        return 0;
+    vlc_cleanup_push(FifoRingAwake, ring);
+    ret = vlc_cond_timedwait(condvar, &fifo->lock, deadline);
+    vlc_cleanup_pop();
+    FifoRingAwake(ring);
+    return ret;
 }
 
 /**
@@ -131,6 +335,8 @@ int vlc_fifo_TimedWaitCond(vlc_fifo_t *fifo, vlc_cond_t *condvar, mtime_t deadli
  */
 size_t vlc_fifo_GetCount(const vlc_fifo_t *fifo)
 {
+    if (fifo->p_ring != NULL)
+        return FifoRingCount(fifo->p_ring);
     return fifo->i_depth;
 }
 
@@ -150,9 +356,25 @@ size_t vlc_fifo_GetCount(const vlc_fifo_t *fifo)
  */
 size_t vlc_fifo_GetBytes(const vlc_fifo_t *fifo)
 {
+    if (fifo->p_ring != NULL)
+        return FifoRingBytes(fifo->p_ring);
     return fifo->i_size;
 }
 
+/* Queues a linked-list of blocks into a ring, one by one */
+static void FifoRingQueue(block_fifo_ring_t *ring, block_t *block)
+{
+    while (block != NULL)
+    {
+        block_t *next = block->p_next;
+
+        block->p_next = NULL;
+        if (unlikely(!FifoRingPush(ring, block)))
+            block_Release(block);
+        block = next;
+    }
+}
+
 /**
  * Queues a linked-list of blocks into a locked FIFO.
  *
@@ -167,6 +389,13 @@ size_t vlc_fifo_GetBytes(const vlc_fifo_t *fifo)
 void vlc_fifo_QueueUnlocked(block_fifo_t *fifo, block_t *block)
 {
     vlc_assert_locked(&fifo->lock);
+
+    if (fifo->p_ring != NULL)
+    {
+        FifoRingQueue(fifo->p_ring, block);
+        vlc_fifo_Signal(fifo);
+        return;
+    }
     assert(*(fifo->pp_last) == NULL);
 
     *(fifo->pp_last) = block;
@@ -197,6 +426,9 @@ block_t *vlc_fifo_DequeueUnlocked(block_fifo_t *fifo)
 {
     vlc_assert_locked(&fifo->lock);
 
+    if (fifo->p_ring != NULL)
+        return FifoRingPop(fifo->p_ring);
+
     block_t *block = fifo->p_first;
 
     if (block == NULL)
@@ -231,6 +463,18 @@ block_t *vlc_fifo_DequeueAllUnlocked(block_fifo_t *fifo)
 {
     vlc_assert_locked(&fifo->lock);
 
+    if (fifo->p_ring != NULL)
+    {
+        block_t *head = NULL, **pp_last = &head, *block;
+
+        while ((block = FifoRingPop(fifo->p_ring)) != NULL)
+        {
+            *pp_last = block;
+            pp_last = &block->p_next;
+        }
+        return head;
+    }
+
     block_t *block = fifo->p_first;
 
     fifo->p_first = NULL;
@@ -258,16 +502,45 @@ block_fifo_t *block_FifoNew( void )
     p_fifo->p_first = NULL;
     p_fifo->pp_last = &p_fifo->p_first;
     p_fifo->i_depth = p_fifo->i_size = 0;
+    p_fifo->p_ring = NULL;
 
     return p_fifo;
 }
 
+/**
+ * Creates a thread-safe FIFO queue of blocks, for exactly one producer thread
+ * and one consumer thread. block_FifoPut() and block_FifoGet() do not lock
+ * the FIFO, unless the consumer has to sleep.
+ *
+ * Only the producer thread may queue blocks, and only the consumer thread
+ * may dequeue, show or empty them, or wait on the FIFO. Both can count blocks
+ * and bytes. The other functions work as with block_FifoNew().
+ *
+ * @return the FIFO or NULL on memory error
+ */
+block_fifo_t *block_FifoNewSPSC( void )
+{
+    block_fifo_t *p_fifo = block_FifoNew();
+    if( !p_fifo )
+        return NULL;
+
+    p_fifo->p_ring = FifoRingNew();
+    if( unlikely(p_fifo->p_ring == NULL) )
+    {
+        block_FifoRelease( p_fifo );
+        return NULL;
+    }
+    return p_fifo;
+}
+
 /**
  * Destroys a FIFO created by block_FifoNew().
  * Any queued blocks are also destroyed.
  */
 void block_FifoRelease( block_fifo_t *p_fifo )
 {
+    if( p_fifo->p_ring != NULL )
+        FifoRingDelete( p_fifo->p_ring );
     block_ChainRelease( p_fifo->p_first );
     vlc_cond_destroy( &p_fifo->wait );
     vlc_mutex_destroy( &p_fifo->lock );
@@ -294,6 +567,20 @@ void block_FifoEmpty(block_fifo_t *fifo)
  */
 void block_FifoPut(block_fifo_t *fifo, block_t *block)
 {
+    block_fifo_ring_t *ring = fifo->p_ring;
+
+    if (ring != NULL)
+    {
+        FifoRingQueue(ring, block);
+        if (atomic_load(&ring->b_waiting))
+        {
+            vlc_fifo_Lock(fifo);
+            vlc_fifo_Signal(fifo);
+            vlc_fifo_Unlock(fifo);
+        }
+        return;
+    }
+
     vlc_fifo_Lock(fifo);
     vlc_fifo_QueueUnlocked(fifo, block);
     vlc_fifo_Unlock(fifo);
@@ -311,6 +598,13 @@ block_t *block_FifoGet(block_fifo_t *fifo)
 
     vlc_testcancel();
 
+    if (fifo->p_ring != NULL)
+    {
+        block = FifoRingPop(fifo->p_ring);
+        if (block != NULL)
+            return block;
+    }
+
     vlc_fifo_Lock(fifo);
     while (vlc_fifo_IsEmpty(fifo))
     {
@@ -339,6 +633,13 @@ block_t *block_FifoShow( block_fifo_t *p_fifo )
 {
     block_t *b;
 
+    if( p_fifo->p_ring != NULL )
+    {
+        b = FifoRingPeek( p_fifo->p_ring );
+        assert(b != NULL);
+        return b;
+    }
+
     vlc_mutex_lock( &p_fifo->lock );
     assert(p_fifo->p_first != NULL);
     b = p_fifo->p_first;
@@ -352,6 +653,9 @@ size_t block_FifoSize (block_fifo_t *fifo)
 {
     size_t size;
 
+    if (fifo->p_ring != NULL)
+        return FifoRingBytes(fifo->p_ring);
+
     vlc_mutex_lock (&fifo->lock);
     size = fifo->i_size;
     vlc_mutex_unlock (&fifo->lock);
@@ -363,6 +667,9 @@ size_t block_FifoCount (block_fifo_t *fifo)
 {
     size_t depth;
 
+    if (fifo->p_ring != NULL)
+        return FifoRingCount(fifo->p_ring);
+
     vlc_mutex_lock (&fifo->lock);
     depth = fifo->i_depth;
     vlc_mutex_unlock (&fifo->lock);
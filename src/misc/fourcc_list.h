@@ -1536,6 +1536,9 @@ static const staticentry_t p_list_spu[] = {
     B(VLC_CODEC_SCTE_27, "SCTE-27 subtitles"),
         A("SC27"),
 
+    B(VLC_CODEC_SCTE_104, "SCTE-104 ad insertion messages"),
+        A("S104"),
+
     B(VLC_CODEC_EIA608_1, "EIA-608 subtitles"),
         A("cc1 "),
         A("cc2 "),
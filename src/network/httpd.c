@@ -40,6 +40,7 @@
 #include <vlc_url.h>
 #include <vlc_mime.h>
 #include <vlc_block.h>
+#include <vlc_atomic.h>
 #include "../libvlc.h"
 
 #include <string.h>
@@ -49,6 +50,12 @@
 #ifdef HAVE_POLL
 # include <poll.h>
 #endif
+#if defined(HAVE_SYS_EPOLL_H) && defined(HAVE_SYS_EVENTFD_H)
+# include <sys/epoll.h>
+# include <sys/eventfd.h>
+# include <sys/uio.h>
+# define HTTPD_WORKERS 1
+#endif
 
 #if defined(_WIN32)
 #   include <winsock2.h>
@@ -63,8 +70,21 @@
 #define HTTPD_CL_BUFSIZE 10000
 #endif
 
+/* Stream data is stored in chunks of at least this size */
+#define HTTPD_CHUNK_SIZE 32768
+/* Chunks sent at once to a client */
+#define HTTPD_CHUNK_IOV 16
+/* Stream clients waiting for data are served at most this often */
+#define HTTPD_WORKER_PERIOD 10000
+
+typedef struct httpd_chunk_t httpd_chunk_t;
+typedef struct httpd_worker_t httpd_worker_t;
+
 static void httpd_ClientClean(httpd_client_t *cl);
-static void httpd_AppendData(httpd_stream_t *stream, uint8_t *p_data, int i_data);
+static void httpd_WorkersInit(httpd_host_t *host);
+static void httpd_WorkersStop(httpd_host_t *host);
+static void httpd_WorkersSignal(httpd_host_t *host);
+static void httpd_WorkersUrlDelete(httpd_host_t *host, httpd_url_t *url);
 
 /* each host run in his own thread */
 struct httpd_host_t
@@ -93,6 +113,13 @@ struct httpd_host_t
     int            i_client;
     httpd_client_t **client;
 
+    /* threads sending stream data, one more started with each new stream
+     * client until there are i_worker_max of them */
+    atomic_uint    i_worker;
+    unsigned       i_worker_max;
+    unsigned       i_next_worker;
+    httpd_worker_t *worker;
+
     /* TLS data */
     vlc_tls_creds_t *p_tls;
 };
@@ -165,6 +192,11 @@ struct httpd_client_t
      */
     int64_t i_keyframe_wait_to_pass;
 
+    /* Stream served by a worker thread, from answer.i_body_offset on */
+    httpd_stream_t *stream;
+    httpd_chunk_t  *p_chunk;    /* last chunk sent from, held */
+    bool            b_blocked;  /* socket full, waiting to be writable */
+
     /* */
     httpd_message_t query;  /* client -> httpd */
     httpd_message_t answer; /* httpd -> client */
@@ -592,6 +624,42 @@ void httpd_RedirectDelete(httpd_redirect_t *rdir)
 /*****************************************************************************
  * High Level Funtions: httpd_stream_t
  *****************************************************************************/
+
+/* Piece of stream data, shared by all the clients sending it. Bytes below
+ * i_size never change, so that they can be read without the stream lock. */
+struct httpd_chunk_t
+{
+    httpd_chunk_t *p_next;  /* following chunk, valid while queued */
+    atomic_uint    refs;
+    bool           b_queued;
+    int64_t        i_pos;   /* absolute position of the first byte */
+    size_t         i_size;
+    size_t         i_alloc;
+    uint8_t        p_data[];
+};
+
+static httpd_chunk_t *httpd_ChunkNew(int64_t i_pos, size_t i_min)
+{
+    size_t i_alloc = __MAX(i_min, HTTPD_CHUNK_SIZE);
+    httpd_chunk_t *chunk = malloc(sizeof(*chunk) + i_alloc);
+    if (!chunk)
+        return NULL;
+
+    chunk->p_next = NULL;
+    atomic_init(&chunk->refs, 1);
+    chunk->b_queued = true;
+    chunk->i_pos = i_pos;
+    chunk->i_size = 0;
+    chunk->i_alloc = i_alloc;
+    return chunk;
+}
+
+static void httpd_ChunkRelease(httpd_chunk_t *chunk)
+{
+    if (atomic_fetch_sub(&chunk->refs, 1) == 1)
+        free(chunk);
+}
+
 struct httpd_stream_t
 {
     vlc_mutex_t lock;
@@ -611,9 +679,10 @@ struct httpd_stream_t
     bool        b_has_keyframes;
     int64_t     i_last_keyframe_seen_pos;
 
-    /* circular buffer */
-    int         i_buffer_size;      /* buffer size, can't be reallocated smaller */
-    uint8_t     *p_buffer;          /* buffer */
+    /* queued chunks, the oldest ones are dropped past the buffer size */
+    int64_t     i_buffer_size;
+    httpd_chunk_t *p_first;
+    httpd_chunk_t *p_last;
     int64_t     i_buffer_pos;       /* absolute position from begining */
     int64_t     i_buffer_last_pos;  /* a new connection will start with that */
 
@@ -622,6 +691,49 @@ struct httpd_stream_t
     httpd_header * p_http_headers;
 };
 
+/* Moves a client to where it can read from, with the stream lock held.
+ * Returns the queued chunk holding the position, or NULL to wait for data. */
+static httpd_chunk_t *httpd_StreamSeek(httpd_stream_t *stream,
+                                       httpd_client_t *cl, int64_t *pi_pos)
+{
+    if (*pi_pos >= stream->i_buffer_pos)
+        return NULL;    /* wait, no data available */
+
+    if (cl->i_keyframe_wait_to_pass >= 0) {
+        if (stream->i_last_keyframe_seen_pos <= cl->i_keyframe_wait_to_pass)
+            /* still waiting for the next keyframe */
+            return NULL;
+
+        /* seek to the new keyframe */
+        *pi_pos = stream->i_last_keyframe_seen_pos;
+        cl->i_keyframe_wait_to_pass = -1;
+    }
+
+    if (*pi_pos < stream->p_first->i_pos) {
+        /* this client isn't fast enough: skip to the last keyframe if it is
+         * still queued, or wait for the next one, rather than lag behind */
+        msg_Dbg(stream->url->host, "slow client skipping %"PRId64" bytes",
+                stream->p_first->i_pos - *pi_pos);
+        if (!stream->b_has_keyframes)
+            *pi_pos = stream->i_buffer_last_pos;
+        else if (stream->i_last_keyframe_seen_pos >= stream->p_first->i_pos)
+            *pi_pos = stream->i_last_keyframe_seen_pos;
+        else {
+            cl->i_keyframe_wait_to_pass = stream->i_last_keyframe_seen_pos;
+            return NULL;
+        }
+    }
+
+    /* chunks are contiguous: start from the last one used if still queued */
+    httpd_chunk_t *chunk = stream->p_first;
+    if (cl->p_chunk != NULL && cl->p_chunk->b_queued
+     && cl->p_chunk->i_pos <= *pi_pos)
+        chunk = cl->p_chunk;
+    while (chunk->i_pos + (int64_t)chunk->i_size <= *pi_pos)
+        chunk = chunk->p_next;
+    return chunk;
+}
+
 static int httpd_StreamCallBack(httpd_callback_sys_t *p_sys,
                                  httpd_client_t *cl, httpd_message_t *answer,
                                  const httpd_message_t *query)
@@ -632,34 +744,18 @@ static int httpd_StreamCallBack(httpd_callback_sys_t *p_sys,
         return VLC_SUCCESS;
 
     if (answer->i_body_offset > 0) {
-        int     i_pos;
+        int64_t i_pos = answer->i_body_offset;
 
-        if (answer->i_body_offset >= stream->i_buffer_pos)
+        vlc_mutex_lock(&stream->lock);
+        httpd_chunk_t *chunk = httpd_StreamSeek(stream, cl, &i_pos);
+        if (chunk == NULL) {
+            answer->i_body_offset = i_pos;
+            vlc_mutex_unlock(&stream->lock);
             return VLC_EGENERIC;    /* wait, no data available */
-
-        if (cl->i_keyframe_wait_to_pass >= 0) {
-            if (stream->i_last_keyframe_seen_pos <= cl->i_keyframe_wait_to_pass)
-                /* still waiting for the next keyframe */
-                return VLC_EGENERIC;
-
-            /* seek to the new keyframe */
-            answer->i_body_offset = stream->i_last_keyframe_seen_pos;
-            cl->i_keyframe_wait_to_pass = -1;
         }
 
-        if (answer->i_body_offset + stream->i_buffer_size < stream->i_buffer_pos)
-            answer->i_body_offset = stream->i_buffer_last_pos; /* this client isn't fast enough */
-
-        i_pos   = answer->i_body_offset % stream->i_buffer_size;
-        int64_t i_write = stream->i_buffer_pos - answer->i_body_offset;
-
-        if (i_write > HTTPD_CL_BUFSIZE)
-            i_write = HTTPD_CL_BUFSIZE;
-        else if (i_write <= 0)
-            return VLC_EGENERIC;    /* wait, no data available */
-
-        /* Don't go past the end of the circular buffer */
-        i_write = __MIN(i_write, stream->i_buffer_size - i_pos);
+        size_t i_offset = i_pos - chunk->i_pos;
+        size_t i_write = __MIN(chunk->i_size - i_offset, HTTPD_CL_BUFSIZE);
 
         /* using HTTPD_MSG_ANSWER -> data available */
         answer->i_proto  = HTTPD_PROTO_HTTP;
@@ -668,9 +764,10 @@ static int httpd_StreamCallBack(httpd_callback_sys_t *p_sys,
 
         answer->i_body = i_write;
         answer->p_body = xmalloc(i_write);
-        memcpy(answer->p_body, &stream->p_buffer[i_pos], i_write);
+        memcpy(answer->p_body, &chunk->p_data[i_offset], i_write);
 
-        answer->i_body_offset += i_write;
+        answer->i_body_offset = i_pos + i_write;
+        vlc_mutex_unlock(&stream->lock);
 
         return VLC_SUCCESS;
     } else {
@@ -766,7 +863,8 @@ httpd_stream_t *httpd_StreamNew(httpd_host_t *host,
     stream->i_header = 0;
     stream->p_header = NULL;
     stream->i_buffer_size = 5000000;    /* 5 Mo per stream */
-    stream->p_buffer = xmalloc(stream->i_buffer_size);
+    stream->p_first = NULL;
+    stream->p_last = NULL;
     /* We set to 1 to make life simpler
      * (this way i_body_offset can never be 0) */
     stream->i_buffer_pos = 1;
@@ -802,22 +900,44 @@ int httpd_StreamHeader(httpd_stream_t *stream, uint8_t *p_data, int i_data)
     return VLC_SUCCESS;
 }
 
-static void httpd_AppendData(httpd_stream_t *stream, uint8_t *p_data, int i_data)
+static void httpd_DropChunk(httpd_stream_t *stream)
+{
+    httpd_chunk_t *chunk = stream->p_first;
+
+    stream->p_first = chunk->p_next;
+    if (stream->p_first == NULL)
+        stream->p_last = NULL;
+    chunk->b_queued = false;
+    httpd_ChunkRelease(chunk);
+}
+
+/* Keyframes start new chunks, so that slow clients can skip to them */
+static int httpd_AppendData(httpd_stream_t *stream, const uint8_t *p_data,
+                            size_t i_data, bool b_keyframe)
 {
-    int i_pos = stream->i_buffer_pos % stream->i_buffer_size;
-    int i_count = i_data;
-    while (i_count > 0) {
-        int i_copy = __MIN(i_count, stream->i_buffer_size - i_pos);
+    httpd_chunk_t *chunk = stream->p_last;
 
-        /* Ok, we can't go past the end of our buffer */
-        memcpy(&stream->p_buffer[i_pos], p_data, i_copy);
+    if (chunk == NULL || b_keyframe || chunk->i_alloc - chunk->i_size < i_data) {
+        chunk = httpd_ChunkNew(stream->i_buffer_pos, i_data);
+        if (unlikely(chunk == NULL))
+            return VLC_ENOMEM;
 
-        i_pos = (i_pos + i_copy) % stream->i_buffer_size;
-        i_count -= i_copy;
-        p_data  += i_copy;
+        if (stream->p_last != NULL)
+            stream->p_last->p_next = chunk;
+        else
+            stream->p_first = chunk;
+        stream->p_last = chunk;
     }
 
+    memcpy(&chunk->p_data[chunk->i_size], p_data, i_data);
+    chunk->i_size += i_data;
     stream->i_buffer_pos += i_data;
+
+    while (stream->p_first != stream->p_last
+        && stream->i_buffer_pos - stream->p_first->p_next->i_pos
+                                                   >= stream->i_buffer_size)
+        httpd_DropChunk(stream);
+    return VLC_SUCCESS;
 }
 
 int httpd_StreamSend(httpd_stream_t *stream, const block_t *p_block)
@@ -825,19 +945,25 @@ int httpd_StreamSend(httpd_stream_t *stream, const block_t *p_block)
     if (!p_block || !p_block->p_buffer)
         return VLC_SUCCESS;
 
+    bool b_keyframe = (p_block->i_flags & BLOCK_FLAG_TYPE_I) != 0;
+
     vlc_mutex_lock(&stream->lock);
+    if (httpd_AppendData(stream, p_block->p_buffer, p_block->i_buffer,
+                         b_keyframe)) {
+        vlc_mutex_unlock(&stream->lock);
+        return VLC_ENOMEM;
+    }
 
     /* save this pointer (to be used by new connection) */
-    stream->i_buffer_last_pos = stream->i_buffer_pos;
+    stream->i_buffer_last_pos = stream->i_buffer_pos - p_block->i_buffer;
 
-    if (p_block->i_flags & BLOCK_FLAG_TYPE_I) {
+    if (b_keyframe) {
         stream->b_has_keyframes = true;
-        stream->i_last_keyframe_seen_pos = stream->i_buffer_pos;
+        stream->i_last_keyframe_seen_pos = stream->i_buffer_last_pos;
     }
-
-    httpd_AppendData(stream, p_block->p_buffer, p_block->i_buffer);
-
     vlc_mutex_unlock(&stream->lock);
+
+    httpd_WorkersSignal(stream->url->host);
     return VLC_SUCCESS;
 }
 
@@ -852,7 +978,8 @@ void httpd_StreamDelete(httpd_stream_t *stream)
     vlc_mutex_destroy(&stream->lock);
     free(stream->psz_mime);
     free(stream->p_header);
-    free(stream->p_buffer);
+    while (stream->p_first != NULL)
+        httpd_DropChunk(stream);
     free(stream);
 }
 
@@ -861,12 +988,12 @@ void httpd_StreamDelete(httpd_stream_t *stream)
  *****************************************************************************/
 static void* httpd_HostThread(void *);
 static httpd_host_t *httpd_HostCreate(vlc_object_t *, const char *,
-                                       const char *, vlc_tls_creds_t *);
+                                       const char *, vlc_tls_creds_t *, bool);
 
 /* create a new host */
 httpd_host_t *vlc_http_HostNew(vlc_object_t *p_this)
 {
-    return httpd_HostCreate(p_this, "http-host", "http-port", NULL);
+    return httpd_HostCreate(p_this, "http-host", "http-port", NULL, true);
 }
 
 httpd_host_t *vlc_https_HostNew(vlc_object_t *obj)
@@ -890,12 +1017,12 @@ httpd_host_t *vlc_https_HostNew(vlc_object_t *obj)
     free(key);
     free(cert);
 
-    return httpd_HostCreate(obj, "http-host", "https-port", tls);
+    return httpd_HostCreate(obj, "http-host", "https-port", tls, false);
 }
 
 httpd_host_t *vlc_rtsp_HostNew(vlc_object_t *p_this)
 {
-    return httpd_HostCreate(p_this, "rtsp-host", "rtsp-port", NULL);
+    return httpd_HostCreate(p_this, "rtsp-host", "rtsp-port", NULL, false);
 }
 
 static struct httpd
@@ -909,7 +1036,8 @@ static struct httpd
 static httpd_host_t *httpd_HostCreate(vlc_object_t *p_this,
                                        const char *hostvar,
                                        const char *portvar,
-                                       vlc_tls_creds_t *p_tls)
+                                       vlc_tls_creds_t *p_tls,
+                                       bool b_workers)
 {
     httpd_host_t *host;
     char *hostname = var_InheritString(p_this, hostvar);
@@ -972,12 +1100,21 @@ static httpd_host_t *httpd_HostCreate(vlc_object_t *p_this,
     host->url      = NULL;
     host->i_client = 0;
     host->client   = NULL;
+    atomic_init(&host->i_worker, 0);
+    host->i_worker_max = 0;
+    host->i_next_worker = 0;
+    host->worker   = NULL;
     host->p_tls    = p_tls;
 
+    /* stream clients are sent data by worker threads, except over TLS */
+    if (b_workers)
+        httpd_WorkersInit(host);
+
     /* create the thread */
     if (vlc_clone(&host->thread, httpd_HostThread, host,
                    VLC_THREAD_PRIORITY_LOW)) {
         msg_Err(p_this, "cannot spawn http host thread");
+        httpd_WorkersStop(host);
         goto error;
     }
 
@@ -1026,6 +1163,7 @@ void httpd_HostDelete(httpd_host_t *host)
 
     vlc_cancel(host->thread);
     vlc_join(host->thread, NULL);
+    httpd_WorkersStop(host);
 
     msg_Dbg(host, "HTTP host removed");
 
@@ -1123,6 +1261,7 @@ void httpd_UrlDelete(httpd_url_t *url)
         free(client);
         i--;
     }
+    httpd_WorkersUrlDelete(host, url);
     free(url);
     vlc_mutex_unlock(&host->lock);
 }
@@ -1247,6 +1386,9 @@ static httpd_client_t *httpd_ClientNew(int fd, vlc_tls_t *p_tls, mtime_t now)
     cl->fd      = fd;
     cl->url     = NULL;
     cl->p_tls = p_tls;
+    cl->stream  = NULL;
+    cl->p_chunk = NULL;
+    cl->b_blocked = false;
 
     httpd_ClientInit(cl, now);
     if (p_tls)
@@ -1676,6 +1818,367 @@ static void httpd_ClientTlsHandshake(httpd_client_t *cl)
     }
 }
 
+/*****************************************************************************
+ * Stream workers: once the answer headers are sent, stream clients are spread
+ * over these threads, which send the queued chunks as they are.
+ *****************************************************************************/
+#ifdef HTTPD_WORKERS
+struct httpd_worker_t
+{
+    httpd_host_t   *host;
+    vlc_thread_t    thread;
+    vlc_mutex_t     lock;
+    int             epfd;
+    int             evfd;
+    atomic_bool     signaled;   /* new stream data since the last pass */
+    bool            b_quit;
+
+    int             i_client;
+    httpd_client_t  **client;
+};
+
+static httpd_chunk_t *httpd_ChunkHold(httpd_chunk_t *chunk)
+{
+    atomic_fetch_add(&chunk->refs, 1);
+    return chunk;
+}
+
+static void httpd_WorkerClientDelete(httpd_worker_t *w, httpd_client_t *cl)
+{
+    epoll_ctl(w->epfd, EPOLL_CTL_DEL, cl->fd, NULL);
+    TAB_REMOVE(w->i_client, w->client, cl);
+    if (cl->p_chunk != NULL)
+        httpd_ChunkRelease(cl->p_chunk);
+    httpd_ClientClean(cl);
+    free(cl);
+}
+
+/* Sends the queued data from the chunks, until the client is up to date or
+ * its socket is full */
+static void httpd_WorkerSend(httpd_client_t *cl, mtime_t now)
+{
+    httpd_stream_t *stream = cl->stream;
+
+    for (;;) {
+        struct iovec iov[HTTPD_CHUNK_IOV];
+        httpd_chunk_t *chunks[HTTPD_CHUNK_IOV];
+        int64_t i_pos = cl->answer.i_body_offset;
+        size_t i_total = 0;
+        unsigned n = 0;
+
+        vlc_mutex_lock(&stream->lock);
+        httpd_chunk_t *chunk = httpd_StreamSeek(stream, cl, &i_pos);
+        size_t i_offset = chunk ? i_pos - chunk->i_pos : 0;
+        for (; chunk != NULL && n < HTTPD_CHUNK_IOV; chunk = chunk->p_next) {
+            chunks[n] = httpd_ChunkHold(chunk);
+            iov[n].iov_base = &chunk->p_data[i_offset];
+            iov[n].iov_len = chunk->i_size - i_offset;
+            i_total += iov[n].iov_len;
+            i_offset = 0;
+            n++;
+        }
+        vlc_mutex_unlock(&stream->lock);
+
+        cl->answer.i_body_offset = i_pos;
+        if (n == 0)
+            return; /* up to date */
+
+        struct msghdr hdr = { .msg_iov = iov, .msg_iovlen = n };
+        ssize_t val;
+        do
+            val = sendmsg(cl->fd, &hdr, MSG_NOSIGNAL);
+        while (val == -1 && errno == EINTR);
+
+        /* keep the chunk the client is now in, for the next lookup */
+        if (cl->p_chunk != NULL)
+            httpd_ChunkRelease(cl->p_chunk);
+        cl->p_chunk = chunks[0];
+        for (unsigned i = 1; i < n; i++) {
+            if (val > 0 && chunks[i]->i_pos <= i_pos + val) {
+                httpd_ChunkRelease(cl->p_chunk);
+                cl->p_chunk = chunks[i];
+            } else
+                httpd_ChunkRelease(chunks[i]);
+        }
+
+        if (val < 0) {
+            if (errno != EAGAIN)
+                cl->i_state = HTTPD_CLIENT_DEAD;
+            cl->b_blocked = true;
+            return;
+        }
+
+        cl->answer.i_body_offset += val;
+        cl->i_activity_date = now;
+        if ((size_t)val < i_total) {
+            cl->b_blocked = true; /* wait for the socket to be writable */
+            return;
+        }
+    }
+}
+
+/* Handles a socket event: stream clients are not expected to send anything,
+ * they are only read to notice them leaving */
+static void httpd_WorkerEvent(httpd_client_t *cl, uint32_t events, mtime_t now)
+{
+    if (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+        uint8_t buf[512];
+        ssize_t val;
+
+        while ((val = httpd_NetRecv(cl, buf, sizeof (buf))) > 0);
+        if (val == 0 || errno != EAGAIN) {
+            cl->i_state = HTTPD_CLIENT_DEAD;
+            return;
+        }
+    }
+
+    if (events & EPOLLOUT) {
+        cl->b_blocked = false;
+        httpd_WorkerSend(cl, now);
+    }
+}
+
+static void *httpd_WorkerThread(void *data)
+{
+    httpd_worker_t *w = data;
+    struct epoll_event ev[64];
+    mtime_t next_pass = 0;
+    bool b_pending = false;
+
+    vlc_mutex_lock(&w->lock);
+    while (!w->b_quit) {
+        int timeout = 1000;
+
+        if (b_pending)
+            timeout = (__MAX(next_pass - mdate(), 0) + 999) / 1000;
+        vlc_mutex_unlock(&w->lock);
+
+        int n = epoll_wait(w->epfd, ev, ARRAY_SIZE(ev), timeout);
+        mtime_t now = mdate();
+
+        vlc_mutex_lock(&w->lock);
+        for (int i = 0; i < n; i++) {
+            httpd_client_t *cl = ev[i].data.ptr;
+
+            if (cl == NULL) {
+                uint64_t val;
+
+                if (read(w->evfd, &val, sizeof (val)) == sizeof (val))
+                    b_pending = true;
+                continue;
+            }
+            httpd_WorkerEvent(cl, ev[i].events, now);
+        }
+
+        /* new data: serve the clients which were up to date, in batches */
+        if (b_pending && now >= next_pass) {
+            b_pending = false;
+            next_pass = now + HTTPD_WORKER_PERIOD;
+            atomic_store(&w->signaled, false);
+
+            for (int i = 0; i < w->i_client; i++) {
+                httpd_client_t *cl = w->client[i];
+                if (!cl->b_blocked && cl->i_state != HTTPD_CLIENT_DEAD)
+                    httpd_WorkerSend(cl, now);
+            }
+        }
+
+        for (int i = 0; i < w->i_client; i++) {
+            httpd_client_t *cl = w->client[i];
+
+            if (cl->i_state == HTTPD_CLIENT_DEAD
+             || (cl->i_activity_timeout > 0
+              && cl->i_activity_date + cl->i_activity_timeout < now)) {
+                httpd_WorkerClientDelete(w, cl);
+                i--;
+            }
+        }
+    }
+    vlc_mutex_unlock(&w->lock);
+    return NULL;
+}
+
+/* Called by the stream senders, without the host lock: started workers are
+ * published by the count */
+static void httpd_WorkersSignal(httpd_host_t *host)
+{
+    unsigned n = atomic_load_explicit(&host->i_worker, memory_order_acquire);
+
+    for (unsigned i = 0; i < n; i++) {
+        httpd_worker_t *w = &host->worker[i];
+
+        if (!atomic_exchange(&w->signaled, true))
+            eventfd_write(w->evfd, 1);
+    }
+}
+
+/* Only reserves the workers, their threads are started on demand */
+static void httpd_WorkersInit(httpd_host_t *host)
+{
+    int i_max = var_InheritInteger(host, "http-threads");
+    if (i_max <= 0)
+        i_max = vlc_GetCPUCount();
+
+    host->worker = malloc(i_max * sizeof (*host->worker));
+    if (likely(host->worker != NULL))
+        host->i_worker_max = i_max;
+}
+
+/* Starts one more worker, with the host lock held */
+static httpd_worker_t *httpd_WorkerStart(httpd_host_t *host)
+{
+    unsigned i = atomic_load_explicit(&host->i_worker, memory_order_relaxed);
+    httpd_worker_t *w = &host->worker[i];
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = NULL };
+
+    w->host = host;
+    w->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (w->epfd == -1)
+        goto error;
+    w->evfd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (w->evfd == -1) {
+        close(w->epfd);
+        goto error;
+    }
+    epoll_ctl(w->epfd, EPOLL_CTL_ADD, w->evfd, &ev);
+    vlc_mutex_init(&w->lock);
+    atomic_init(&w->signaled, false);
+    w->b_quit = false;
+    w->i_client = 0;
+    w->client = NULL;
+
+    if (vlc_clone(&w->thread, httpd_WorkerThread, w,
+                  VLC_THREAD_PRIORITY_LOW)) {
+        vlc_mutex_destroy(&w->lock);
+        close(w->evfd);
+        close(w->epfd);
+        goto error;
+    }
+
+    atomic_store_explicit(&host->i_worker, i + 1, memory_order_release);
+    msg_Dbg(host, "HTTP stream thread %u started", i + 1);
+    return w;
+
+error:
+    /* do not try again for every client */
+    msg_Warn(host, "cannot start HTTP stream thread");
+    host->i_worker_max = i;
+    return NULL;
+}
+
+static void httpd_WorkersStop(httpd_host_t *host)
+{
+    unsigned n = atomic_load(&host->i_worker);
+
+    for (unsigned i = 0; i < n; i++) {
+        httpd_worker_t *w = &host->worker[i];
+
+        vlc_mutex_lock(&w->lock);
+        w->b_quit = true;
+        vlc_mutex_unlock(&w->lock);
+        eventfd_write(w->evfd, 1);
+        vlc_join(w->thread, NULL);
+
+        while (w->i_client > 0) {
+            msg_Warn(host, "client still connected");
+            httpd_WorkerClientDelete(w, w->client[0]);
+        }
+        vlc_mutex_destroy(&w->lock);
+        close(w->evfd);
+        close(w->epfd);
+    }
+    free(host->worker);
+}
+
+/* Closes the worker clients of a URL being deleted */
+static void httpd_WorkersUrlDelete(httpd_host_t *host, httpd_url_t *url)
+{
+    unsigned n = atomic_load(&host->i_worker);
+
+    for (unsigned i = 0; i < n; i++) {
+        httpd_worker_t *w = &host->worker[i];
+
+        vlc_mutex_lock(&w->lock);
+        for (int j = 0; j < w->i_client; j++) {
+            httpd_client_t *cl = w->client[j];
+
+            if (cl->url != url)
+                continue;
+            msg_Warn(host, "force closing connections");
+            httpd_WorkerClientDelete(w, cl);
+            j--;
+        }
+        vlc_mutex_unlock(&w->lock);
+    }
+}
+
+/* Hands a stream client over to a worker, with the host lock held */
+static bool httpd_WorkerAttach(httpd_host_t *host, httpd_client_t *cl)
+{
+    int i_msg = cl->query.i_type;
+
+    /* TLS sessions cannot send from the chunks */
+    if (host->i_worker_max == 0 || cl->p_tls != NULL
+     || cl->url->catch[i_msg].cb != httpd_StreamCallBack)
+        return false;
+
+    unsigned i_worker = atomic_load(&host->i_worker);
+    httpd_worker_t *w = NULL;
+
+    if (i_worker < host->i_worker_max)
+        w = httpd_WorkerStart(host);
+    if (w == NULL) {
+        if (i_worker == 0)
+            return false;
+        w = &host->worker[host->i_next_worker++ % i_worker];
+    }
+
+    struct epoll_event ev = {
+        .events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET,
+        .data.ptr = cl,
+    };
+
+    cl->stream = (httpd_stream_t *)cl->url->catch[i_msg].p_sys;
+    cl->p_chunk = NULL;
+    cl->b_blocked = false;
+
+    vlc_mutex_lock(&w->lock);
+    if (epoll_ctl(w->epfd, EPOLL_CTL_ADD, cl->fd, &ev)) {
+        vlc_mutex_unlock(&w->lock);
+        return false;
+    }
+    TAB_APPEND(w->i_client, w->client, cl);
+    vlc_mutex_unlock(&w->lock);
+    return true;
+}
+#else
+static void httpd_WorkersSignal(httpd_host_t *host)
+{
+    (void) host;
+}
+
+static void httpd_WorkersInit(httpd_host_t *host)
+{
+    (void) host;
+}
+
+static void httpd_WorkersStop(httpd_host_t *host)
+{
+    (void) host;
+}
+
+static void httpd_WorkersUrlDelete(httpd_host_t *host, httpd_url_t *url)
+{
+    (void) host; (void) url;
+}
+
+static bool httpd_WorkerAttach(httpd_host_t *host, httpd_client_t *cl)
+{
+    (void) host; (void) cl;
+    return false;
+}
+#endif
+
 static bool httpdAuthOk(const char *user, const char *pass, const char *b64)
 {
     if (!*user && !*pass)
@@ -1951,6 +2454,12 @@ static void httpdLoop(httpd_host_t *host)
                     cl->i_buffer_size = 0;
 
                     cl->i_state = HTTPD_CLIENT_WAITING;
+
+                    if (httpd_WorkerAttach(host, cl)) {
+                        TAB_REMOVE(host->i_client, host->client, cl);
+                        i_client--;
+                        continue;
+                    }
                 }
                 break;
 
@@ -0,0 +1,213 @@
+/*****************************************************************************
+ * fifo.c: Test for block FIFO and contention benchmark
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#undef NDEBUG
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <vlc_common.h>
+#include <vlc_block.h>
+
+#define POOL 64
+
+static block_fifo_t *(*const fifo_new[])(void) = {
+    block_FifoNew,
+    block_FifoNewSPSC,
+};
+
+static const char *const fifo_names[] = { "locked", "SPSC" };
+
+static size_t fifo_Bytes(block_fifo_t *fifo)
+{
+    size_t bytes;
+
+    vlc_fifo_Lock(fifo);
+    bytes = vlc_fifo_GetBytes(fifo);
+    vlc_fifo_Unlock(fifo);
+    return bytes;
+}
+
+static void test_accounting(block_fifo_t *(*create)(void))
+{
+    block_fifo_t *fifo = create();
+    size_t bytes = 0;
+    block_t *block;
+
+    assert(fifo != NULL);
+    assert(block_FifoCount(fifo) == 0 && fifo_Bytes(fifo) == 0);
+
+    /* enough blocks to span several segments */
+    for (unsigned i = 0; i < 1000; i++)
+    {
+        block = block_Alloc(i % 13);
+        assert(block != NULL);
+        block->i_dts = i;
+        block_FifoPut(fifo, block);
+        bytes += i % 13;
+        assert(block_FifoCount(fifo) == i + 1);
+        assert(fifo_Bytes(fifo) == bytes);
+    }
+
+    for (unsigned i = 0; i < 600; i++)
+    {
+        assert(block_FifoShow(fifo)->i_dts == i);
+        block = block_FifoGet(fifo);
+        assert(block->i_dts == i);
+        bytes -= block->i_buffer;
+        block_Release(block);
+    }
+    assert(block_FifoCount(fifo) == 400 && fifo_Bytes(fifo) == bytes);
+
+    /* chains are split into blocks */
+    block_t *chain = NULL, **pp_last = &chain;
+    for (unsigned i = 1000; i < 1010; i++)
+    {
+        block = block_Alloc(1);
+        assert(block != NULL);
+        block->i_dts = i;
+        block_ChainLastAppend(&pp_last, block);
+    }
+    vlc_fifo_Lock(fifo);
+    vlc_fifo_QueueUnlocked(fifo, chain);
+    assert(vlc_fifo_GetCount(fifo) == 410);
+    assert(vlc_fifo_GetBytes(fifo) == bytes + 10);
+
+    chain = vlc_fifo_DequeueAllUnlocked(fifo);
+    assert(vlc_fifo_IsEmpty(fifo) && vlc_fifo_GetBytes(fifo) == 0);
+    vlc_fifo_Unlock(fifo);
+
+    unsigned i = 600;
+    for (block = chain; block != NULL; block = block->p_next)
+        assert(block->i_dts == i++);
+    assert(i == 1010);
+    block_ChainRelease(chain);
+
+    for (i = 0; i < 300; i++)
+        block_FifoPut(fifo, block_Alloc(1));
+    block_FifoEmpty(fifo);
+    assert(block_FifoCount(fifo) == 0 && fifo_Bytes(fifo) == 0);
+
+    /* release with blocks left */
+    for (i = 0; i < 300; i++)
+        block_FifoPut(fifo, block_Alloc(1));
+    block_FifoRelease(fifo);
+}
+
+static void *consume_forever(void *data)
+{
+    block_t *block = block_FifoGet(data);
+    assert(block == NULL);
+    return NULL;
+}
+
+static void test_cancel(block_fifo_t *(*create)(void))
+{
+    block_fifo_t *fifo = create();
+    vlc_thread_t th;
+
+    assert(fifo != NULL);
+    assert(vlc_clone(&th, consume_forever, fifo,
+                     VLC_THREAD_PRIORITY_LOW) == 0);
+    msleep(CLOCK_FREQ / 10); /* let the thread go to sleep */
+    vlc_cancel(th);
+    vlc_join(th, NULL);
+
+    /* the FIFO must still be usable */
+    block_FifoPut(fifo, block_Alloc(1));
+    block_Release(block_FifoGet(fifo));
+    block_FifoRelease(fifo);
+}
+
+struct pingpong
+{
+    block_fifo_t *forth;
+    block_fifo_t *back;
+    unsigned count;
+};
+
+/* Sends numbered blocks out of the pool */
+static void *produce(void *data)
+{
+    struct pingpong *pp = data;
+
+    for (unsigned i = 0; i < pp->count; i++)
+    {
+        block_t *block = block_FifoGet(pp->back);
+
+        block->i_dts = i;
+        block_FifoPut(pp->forth, block);
+    }
+    return NULL;
+}
+
+static void test_pingpong(unsigned i, unsigned count)
+{
+    struct pingpong pp = {
+        .forth = fifo_new[i](),
+        .back = fifo_new[i](),
+        .count = count,
+    };
+    vlc_thread_t th;
+
+    assert(pp.forth != NULL && pp.back != NULL);
+    for (unsigned k = 0; k < POOL; k++)
+        block_FifoPut(pp.back, block_Alloc(188));
+
+    mtime_t start = mdate();
+    assert(vlc_clone(&th, produce, &pp, VLC_THREAD_PRIORITY_LOW) == 0);
+
+    for (unsigned k = 0; k < count; k++)
+    {
+        block_t *block = block_FifoGet(pp.forth);
+
+        assert(block->i_dts == k);
+        block_FifoPut(pp.back, block);
+    }
+    vlc_join(th, NULL);
+    mtime_t spent = mdate() - start;
+
+    assert(block_FifoCount(pp.back) == POOL);
+    assert(fifo_Bytes(pp.back) == POOL * 188);
+    printf("%-6s FIFO: %6.2f Mblocks/s\n", fifo_names[i],
+           (double)count * CLOCK_FREQ / (spent ? spent : 1) / 1000000.);
+
+    block_FifoRelease(pp.back);
+    block_FifoRelease(pp.forth);
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned count = (argc > 1) ? strtoul(argv[1], NULL, 0) : 1000000;
+
+    for (size_t i = 0; i < ARRAY_SIZE(fifo_new); i++)
+    {
+        test_accounting(fifo_new[i]);
+        test_cancel(fifo_new[i]);
+    }
+
+    for (size_t i = 0; i < ARRAY_SIZE(fifo_new); i++)
+        test_pingpong(i, count);
+    return 0;
+}
@@ -712,6 +712,13 @@ static void VoutDisplayEvent(vout_display_t *vd, int event, va_list args)
         vlc_mutex_unlock(&osys->lock);
         break;
     }
+
+    case VOUT_DISPLAY_EVENT_PICTURES_LOST: {
+        const int count = (int)va_arg(args, int);
+
+        vout_SendDisplayEventPicturesLost(osys->vout, count);
+        break;
+    }
     default:
         msg_Err(vd, "VoutDisplayEvent received event %d", event);
         /* TODO add an assert when all event are handled */
@@ -1395,6 +1402,7 @@ static void SplitterEvent(vout_display_t *vd, int event, va_list args)
     case VOUT_DISPLAY_EVENT_FULLSCREEN:
     case VOUT_DISPLAY_EVENT_DISPLAY_SIZE:
     case VOUT_DISPLAY_EVENT_PICTURES_INVALID:
+    case VOUT_DISPLAY_EVENT_PICTURES_LOST:
         VoutDisplayEvent(vd, event, args);
         break;
 
@@ -1622,3 +1630,9 @@ void vout_SendDisplayEventMouse(vout_thread_t *vout, const vlc_mouse_t *m)
         vout_SendEventMouseDoubleClick(vout);
     vout->p->mouse = *m;
 }
+
+void vout_SendDisplayEventPicturesLost(vout_thread_t *vout, int count)
+{
+    /* those went through display(), and were counted as displayed */
+    vout_statistic_AddUndisplayed(&vout->p->statistic, count);
+}
@@ -25,18 +25,20 @@
 # define LIBVLC_VOUT_STATISTIC_H
 # include <vlc_atomic.h>
 
-/* NOTE: Both statistics are atomic on their own, so one might be older than
- * the other one. Currently, only one of them is updated at a time, so this
+/* NOTE: All statistics are atomic on their own, so one might be older than
+ * the other ones. Currently, only one of them is updated at a time, so this
  * is a non-issue. */
 typedef struct {
     atomic_uint displayed;
     atomic_uint lost;
+    atomic_uint undisplayed; /* counted as displayed, but lost afterwards */
 } vout_statistic_t;
 
 static inline void vout_statistic_Init(vout_statistic_t *stat)
 {
     atomic_init(&stat->displayed, 0);
     atomic_init(&stat->lost, 0);
+    atomic_init(&stat->undisplayed, 0);
 }
 
 static inline void vout_statistic_Clean(vout_statistic_t *stat)
@@ -46,8 +48,17 @@ static inline void vout_statistic_Clean(vout_statistic_t *stat)
 
 static inline void vout_statistic_GetReset(vout_statistic_t *stat, int *displayed, int *lost)
 {
-    *displayed = atomic_exchange(&stat->displayed, 0);
-    *lost      = atomic_exchange(&stat->lost, 0);
+    unsigned shown = atomic_exchange(&stat->displayed, 0);
+    unsigned dropped = atomic_exchange(&stat->undisplayed, 0);
+
+    /* Pictures displayed before the last reading are taken back from the
+     * next ones */
+    if (dropped > shown) {
+        atomic_fetch_add(&stat->undisplayed, dropped - shown);
+        dropped = shown;
+    }
+    *displayed = shown - dropped;
+    *lost      = atomic_exchange(&stat->lost, 0) + dropped;
 }
 
 static inline void vout_statistic_AddDisplayed(vout_statistic_t *stat,
@@ -61,4 +72,12 @@ static inline void vout_statistic_AddLost(vout_statistic_t *stat, int lost)
     atomic_fetch_add(&stat->lost, lost);
 }
 
+/* Pictures already counted as displayed, which did not reach the screen:
+ * they are reported as lost instead */
+static inline void vout_statistic_AddUndisplayed(vout_statistic_t *stat,
+                                                 int undisplayed)
+{
+    atomic_fetch_add(&stat->undisplayed, undisplayed);
+}
+
 #endif
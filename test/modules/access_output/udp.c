@@ -0,0 +1,187 @@
+/*****************************************************************************
+ * udp.c: UDP stream output packetisation test and benchmark
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include "../../libvlc/test.h"
+#include "../lib/libvlc_internal.h"
+
+#include <vlc_common.h>
+#include <vlc_sout.h>
+#include <vlc_block.h>
+#include <vlc_network.h>
+
+#include <errno.h>
+#include <inttypes.h>
+#include <string.h>
+
+#define TS_SIZE 188
+#define CHAIN   5   /* blocks per Write() call */
+
+struct receiver
+{
+    int fd;
+    unsigned datagrams;
+    unsigned packets;
+    uint32_t next;
+    bool corrupted;
+};
+
+static void *Receive( void *data )
+{
+    struct receiver *rx = data;
+    uint8_t buf[65536];
+
+    for( ;; )
+    {
+        ssize_t len = recv( rx->fd, buf, sizeof( buf ), 0 );
+        if( len < 0 )
+        {
+            if( errno == EINTR )
+                continue;
+            break;
+        }
+        if( len == 0 ) /* shutdown */
+            break;
+
+        rx->datagrams++;
+        if( len % TS_SIZE )
+        {
+            rx->corrupted = true;
+            continue;
+        }
+
+        for( ssize_t i = 0; i < len; i += TS_SIZE )
+        {
+            const uint8_t *p = buf + i;
+            uint32_t seq;
+
+            memcpy( &seq, p + 1, sizeof( seq ) );
+            /* losses are tolerated, reordering and corruption are not */
+            if( p[0] != 0x47 || seq < rx->next
+             || p[TS_SIZE - 1] != (uint8_t)seq )
+                rx->corrupted = true;
+            rx->next = seq + 1;
+            rx->packets++;
+        }
+    }
+    return NULL;
+}
+
+static block_t *NewPacket( uint32_t seq )
+{
+    block_t *block = block_Alloc( TS_SIZE );
+    assert( block != NULL );
+
+    memset( block->p_buffer, 0xff, TS_SIZE );
+    block->p_buffer[0] = 0x47;
+    memcpy( block->p_buffer + 1, &seq, sizeof( seq ) );
+    block->p_buffer[TS_SIZE - 1] = seq;
+    block->i_dts = mdate();
+    if( seq % 40 == 0 )
+        block->i_flags |= BLOCK_FLAG_CLOCK;
+    return block;
+}
+
+static void test( vlc_object_t *obj, bool gather, unsigned count )
+{
+    struct receiver rx = { .fd = -1 };
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_addr.s_addr = htonl( INADDR_LOOPBACK ),
+    };
+    socklen_t addrlen = sizeof( addr );
+    vlc_thread_t thread;
+
+    rx.fd = socket( AF_INET, SOCK_DGRAM, IPPROTO_UDP );
+    assert( rx.fd != -1 );
+    setsockopt( rx.fd, SOL_SOCKET, SO_RCVBUF, &(int){ 1 << 22 },
+                sizeof (int) );
+    assert( bind( rx.fd, (struct sockaddr *)&addr, sizeof( addr ) ) == 0 );
+    assert( getsockname( rx.fd, (struct sockaddr *)&addr, &addrlen ) == 0 );
+    assert( vlc_clone( &thread, Receive, &rx, VLC_THREAD_PRIORITY_LOW ) == 0 );
+
+    char dst[32], chain[64];
+    snprintf( dst, sizeof( dst ), "127.0.0.1:%u", ntohs( addr.sin_port ) );
+    snprintf( chain, sizeof( chain ), "udp{caching=0,%sgather}",
+              gather ? "" : "no-" );
+
+    sout_access_out_t *out = sout_AccessOutNew( obj, chain, dst );
+    assert( out != NULL );
+
+    mtime_t spent = 0;
+    for( unsigned seq = 0; seq < count; )
+    {
+        block_t *list = NULL, **pp = &list;
+
+        for( unsigned i = 0; i < CHAIN && seq < count; i++ )
+        {
+            *pp = NewPacket( seq++ );
+            pp = &(*pp)->p_next;
+        }
+
+        mtime_t start = mdate();
+        sout_AccessOutWrite( out, list );
+        spent += mdate() - start;
+    }
+
+    uint64_t copied = var_GetInteger( out, "sout-udp-copied" );
+    double bytes = (double)count * TS_SIZE;
+
+    /* Let the sending thread and the receiver drain */
+    mwait( mdate() + CLOCK_FREQ / 4 );
+    sout_AccessOutDelete( out );
+    mwait( mdate() + CLOCK_FREQ / 10 );
+    shutdown( rx.fd, SHUT_RDWR );
+    vlc_join( thread, NULL );
+    net_Close( rx.fd );
+
+    printf( "%-6s write %8.1f MB/s, copied %8.1f MB/s (%5.1f%% of input), "
+            "received %u/%u packets in %u datagrams\n",
+            gather ? "gather" : "copy",
+            bytes * CLOCK_FREQ / (spent ? spent : 1) / 1000000.,
+            (double)copied * CLOCK_FREQ / (spent ? spent : 1) / 1000000.,
+            100. * copied / bytes, rx.packets, count, rx.datagrams );
+
+    fflush( stdout );
+    assert( !rx.corrupted );
+    assert( rx.packets > 0 );
+    if( gather )
+        assert( copied == 0 );
+    else
+        assert( copied == bytes );
+}
+
+int main( int argc, char *argv[] )
+{
+    unsigned count = (argc > 1) ? strtoul( argv[1], NULL, 0 ) : 20000;
+
+    test_init();
+
+    libvlc_instance_t *vlc = libvlc_new( test_defaults_nargs,
+                                         test_defaults_args );
+    assert( vlc != NULL );
+
+    vlc_object_t *obj = VLC_OBJECT( vlc->p_libvlc_int );
+
+    test( obj, false, count );
+    test( obj, true, count );
+
+    libvlc_release( vlc );
+    return 0;
+}
@@ -0,0 +1,415 @@
+/*****************************************************************************
+ * ts.c: MPEG-TS demuxer multiple programs throughput benchmark
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include "../../libvlc/test.h"
+#include "../lib/libvlc_internal.h"
+
+#include <vlc_common.h>
+#include <vlc_demux.h>
+#include <vlc_es_out.h>
+#include <vlc_stream.h>
+
+#include <inttypes.h>
+#include <string.h>
+
+#define TS_SIZE      188
+#define ES_PER_PMT   8
+#define PMT_PID_BASE 0x20
+#define ES_PID_BASE  0x100
+#define PES_PACKETS  8      /* TS packets per PES */
+#define PSI_INTERVAL 4096   /* TS packets between PAT/PMT repetitions */
+#define BITRATE      40000000
+#define GARBAGE_INTERVAL 1000 /* TS packets between garbage insertions */
+
+/*****************************************************************************
+ * Synthetic MPTS
+ *****************************************************************************/
+struct mpts
+{
+    uint8_t *buf;
+    size_t   count, max;
+    unsigned programs;
+    unsigned pids;
+    uint8_t  cc[8192];
+    bool     pes_open[8192];
+    unsigned pes_total;
+    unsigned pes_pending; /* PES not terminated by a later one */
+};
+
+static uint32_t crc32_mpeg( const uint8_t *p, size_t n )
+{
+    uint32_t crc = 0xffffffff;
+
+    while( n-- )
+    {
+        crc ^= (uint32_t)*p++ << 24;
+        for( unsigned i = 0; i < 8; i++ )
+            crc = (crc << 1) ^ ((crc & 0x80000000) ? 0x04c11db7 : 0);
+    }
+    return crc;
+}
+
+static uint8_t *NextPacket( struct mpts *ts, uint16_t pid, bool start,
+                            bool payload )
+{
+    assert( ts->count < ts->max );
+
+    uint8_t *p = ts->buf + ts->count++ * TS_SIZE;
+    memset( p, 0xff, TS_SIZE );
+    p[0] = 0x47;
+    p[1] = (start ? 0x40 : 0) | (pid >> 8);
+    p[2] = pid;
+    p[3] = (payload ? 0x10 : 0) | (ts->cc[pid] & 0xf);
+    if( payload )
+        ts->cc[pid]++;
+    return p;
+}
+
+static void PutSection( struct mpts *ts, uint16_t pid, uint8_t *sec,
+                        size_t len )
+{
+    uint32_t crc = crc32_mpeg( sec, len - 4 );
+
+    SetDWBE( sec + len - 4, crc );
+
+    uint8_t *p = NextPacket( ts, pid, true, true );
+    p[4] = 0; /* pointer field */
+
+    size_t chunk = __MIN( len, TS_SIZE - 5 );
+    memcpy( p + 5, sec, chunk );
+    for( size_t done = chunk; done < len; done += chunk )
+    {
+        p = NextPacket( ts, pid, false, true );
+        chunk = __MIN( len - done, TS_SIZE - 4 );
+        memcpy( p + 4, sec + done, chunk );
+    }
+}
+
+static void PutPSI( struct mpts *ts )
+{
+    uint8_t sec[1024];
+    size_t len;
+
+    /* PAT */
+    len = 8 + 4 * ts->programs + 4;
+    sec[0] = 0x00;
+    SetWBE( sec + 1, 0xb000 | (len - 3) );
+    SetWBE( sec + 3, 1 );
+    sec[5] = 0xc1;
+    sec[6] = sec[7] = 0;
+    for( unsigned i = 0; i < ts->programs; i++ )
+    {
+        SetWBE( sec + 8 + 4 * i, i + 1 );
+        SetWBE( sec + 10 + 4 * i, 0xe000 | (PMT_PID_BASE + i) );
+    }
+    PutSection( ts, 0, sec, len );
+
+    /* PMTs */
+    for( unsigned i = 0; i < ts->programs; i++ )
+    {
+        unsigned first = i * ES_PER_PMT;
+        unsigned es = __MIN( ts->pids - first, ES_PER_PMT );
+
+        len = 12 + 5 * es + 4;
+        sec[0] = 0x02;
+        SetWBE( sec + 1, 0xb000 | (len - 3) );
+        SetWBE( sec + 3, i + 1 );
+        sec[5] = 0xc1;
+        sec[6] = sec[7] = 0;
+        SetWBE( sec + 8, 0xe000 | (ES_PID_BASE + first) ); /* PCR PID */
+        SetWBE( sec + 10, 0xf000 );
+        for( unsigned j = 0; j < es; j++ )
+        {
+            uint8_t *e = sec + 12 + 5 * j;
+            e[0] = 0x02; /* MPEG-2 video */
+            SetWBE( e + 1, 0xe000 | (ES_PID_BASE + first + j) );
+            SetWBE( e + 3, 0xf000 );
+        }
+        PutSection( ts, PMT_PID_BASE + i, sec, len );
+    }
+}
+
+static void PutPES( struct mpts *ts, unsigned es, unsigned part )
+{
+    uint16_t pid = ES_PID_BASE + es;
+    uint8_t *p = NextPacket( ts, pid, part == 0, true );
+    uint8_t *payload = p + 4;
+    mtime_t pcr = (mtime_t)ts->count * TS_SIZE * 8 * 27000000 / BITRATE;
+
+    if( part == 0 && es % ES_PER_PMT == 0 )
+    {
+        /* adaptation field with PCR */
+        p[3] |= 0x20;
+        p[4] = 7;
+        p[5] = 0x10;
+        SetDWBE( p + 6, (pcr / 300) >> 1 );
+        p[10] = (((pcr / 300) & 1) << 7) | 0x7e;
+        p[11] = 0;
+        payload = p + 12;
+    }
+
+    if( part == 0 )
+    {
+        mtime_t pts = pcr / 300 + 45000;
+
+        /* unbounded video PES with PTS */
+        payload[0] = payload[1] = 0; payload[2] = 1;
+        payload[3] = 0xe0;
+        payload[4] = payload[5] = 0;
+        payload[6] = 0x80;
+        payload[7] = 0x80;
+        payload[8] = 5;
+        payload[9]  = 0x21 | ((pts >> 29) & 0x0e);
+        payload[10] = pts >> 22;
+        payload[11] = 0x01 | ((pts >> 14) & 0xfe);
+        payload[12] = pts >> 7;
+        payload[13] = 0x01 | ((pts << 1) & 0xfe);
+        ts->pes_total++;
+        if( !ts->pes_open[pid] )
+        {
+            ts->pes_open[pid] = true;
+            ts->pes_pending++;
+        }
+    }
+}
+
+static void GenerateMPTS( struct mpts *ts, unsigned pids, size_t count )
+{
+    memset( ts, 0, sizeof( *ts ) );
+    ts->pids = pids;
+    ts->programs = (pids + ES_PER_PMT - 1) / ES_PER_PMT;
+    ts->max = count;
+    ts->buf = malloc( count * TS_SIZE );
+    assert( ts->buf != NULL );
+
+    /* Walk the PIDs with a stride coprime to their count, so that
+     * consecutive packets belong to unrelated PIDs as in a real mux. */
+    unsigned stride = 1;
+    for( unsigned s = pids / 2 + 1; s < pids; s++ )
+    {
+        unsigned a = s, b = pids;
+        while( b ) { unsigned t = a % b; a = b; b = t; }
+        if( a == 1 )
+        {
+            stride = s;
+            break;
+        }
+    }
+
+    unsigned es = 0, part = 0;
+    while( ts->count < count )
+    {
+        if( ts->count % PSI_INTERVAL == 0 )
+        {
+            if( count - ts->count < ts->programs + 4 )
+                break;
+            PutPSI( ts );
+            continue;
+        }
+
+        PutPES( ts, es, part );
+        es = (es + stride) % pids;
+        if( es == 0 )
+            part = (part + 1) % PES_PACKETS;
+    }
+    ts->count = __MIN( ts->count, count );
+}
+
+/*****************************************************************************
+ * Dummy elementary streams output
+ *****************************************************************************/
+struct es_out_sys_t
+{
+    vlc_mutex_t lock; /* the demux may send from several threads */
+    unsigned es;
+    unsigned blocks;
+};
+
+struct es_out_id_t
+{
+    mtime_t last_pts;
+};
+
+static es_out_id_t *EsOutAdd( es_out_t *out, const es_format_t *fmt )
+{
+    es_out_id_t *id = malloc( sizeof( *id ) );
+
+    (void)fmt;
+    assert( id != NULL );
+    id->last_pts = VLC_TS_INVALID;
+    vlc_mutex_lock( &out->p_sys->lock );
+    out->p_sys->es++;
+    vlc_mutex_unlock( &out->p_sys->lock );
+    return id;
+}
+
+static int EsOutSend( es_out_t *out, es_out_id_t *id, block_t *block )
+{
+    /* each elementary stream is sent in order */
+    assert( block->i_pts > id->last_pts );
+    id->last_pts = block->i_pts;
+
+    vlc_mutex_lock( &out->p_sys->lock );
+    out->p_sys->blocks++;
+    vlc_mutex_unlock( &out->p_sys->lock );
+    block_ChainRelease( block );
+    return VLC_SUCCESS;
+}
+
+static void EsOutDel( es_out_t *out, es_out_id_t *id )
+{
+    free( id );
+    vlc_mutex_lock( &out->p_sys->lock );
+    out->p_sys->es--;
+    vlc_mutex_unlock( &out->p_sys->lock );
+}
+
+static int EsOutControl( es_out_t *out, int query, va_list args )
+{
+    (void)out;
+    switch( query )
+    {
+        case ES_OUT_GET_ES_STATE:
+            (void)va_arg( args, es_out_id_t * );
+            *va_arg( args, bool * ) = true;
+            break;
+    }
+    return VLC_SUCCESS;
+}
+
+/* Inserts garbage bytes between packets, to lose synchronization */
+static size_t InsertGarbage( struct mpts *ts, size_t garbage )
+{
+    size_t insertions = (ts->count - 1) / GARBAGE_INTERVAL;
+    size_t size = ts->count * TS_SIZE + insertions * garbage;
+    uint8_t *buf = malloc( size ), *p = buf;
+
+    assert( buf != NULL );
+    for( size_t i = 0; i < ts->count; i++ )
+    {
+        if( i > 0 && i % GARBAGE_INTERVAL == 0 )
+        {
+            memset( p, 0, garbage );
+            p += garbage;
+        }
+        memcpy( p, ts->buf + i * TS_SIZE, TS_SIZE );
+        p += TS_SIZE;
+    }
+    free( ts->buf );
+    ts->buf = buf;
+    return size;
+}
+
+static void test( vlc_object_t *obj, unsigned pids, size_t count, bool all,
+                  size_t garbage, unsigned threads )
+{
+    struct es_out_sys_t sys = { .es = 0, .blocks = 0 };
+    es_out_t out = {
+        .pf_add = EsOutAdd,
+        .pf_send = EsOutSend,
+        .pf_del = EsOutDel,
+        .pf_control = EsOutControl,
+        .p_sys = &sys,
+    };
+    struct mpts ts;
+
+    GenerateMPTS( &ts, pids, count );
+
+    vlc_mutex_init( &sys.lock );
+    var_SetInteger( obj, "ts-threads", threads );
+
+    size_t size = ts.count * TS_SIZE;
+    if( garbage > 0 )
+        size = InsertGarbage( &ts, garbage );
+
+    stream_t *s = stream_MemoryNew( obj, ts.buf, size, true );
+    assert( s != NULL );
+
+    demux_t *demux = demux_New( obj, "ts", "", s, &out );
+    if( demux == NULL )
+    {
+        stream_Delete( s );
+        free( ts.buf );
+        printf( "ts demux not available, skipping\n" );
+        exit( 77 );
+    }
+    /* select all programs and elementary streams,
+     * otherwise only the first program is */
+    if( all )
+        demux_Control( demux, DEMUX_SET_GROUP, -1, (vlc_list_t *)NULL );
+
+    mtime_t start = mdate();
+    while( demux_Demux( demux ) == VLC_DEMUXER_SUCCESS );
+    mtime_t spent = mdate() - start;
+
+    printf( "%4u PIDs, %-5s selected, %u threads%s: %8.0f kpackets/s, "
+            "%7.1f MB/s, %u/%u PES output\n", pids, all ? "all" : "first",
+            threads, garbage ? " (garbage)" : "",
+            (double)ts.count * CLOCK_FREQ / (spent ? spent : 1) / 1000.,
+            (double)ts.count * TS_SIZE * CLOCK_FREQ / (spent ? spent : 1)
+                / 1000000., sys.blocks, ts.pes_total );
+    fflush( stdout );
+
+    /* every PES is terminated by the next one on the same PID,
+     * but the last one of each PID */
+    if( all )
+        assert( sys.blocks + ts.pes_pending == ts.pes_total );
+    else
+        assert( sys.blocks > 0 );
+
+    demux_Delete( demux ); /* also deletes the stream */
+    assert( sys.es == 0 );
+    vlc_mutex_destroy( &sys.lock );
+    free( ts.buf );
+}
+
+int main( int argc, char *argv[] )
+{
+    static const unsigned pids[] = { 1, 16, 64, 256, 1024 };
+    size_t count = (argc > 1) ? strtoul( argv[1], NULL, 0 ) : 200000;
+
+    test_init();
+
+    libvlc_instance_t *vlc = libvlc_new( test_defaults_nargs,
+                                         test_defaults_args );
+    assert( vlc != NULL );
+
+    vlc_object_t *obj = VLC_OBJECT( vlc->p_libvlc_int );
+
+    var_Create( obj, "ts-threads", VLC_VAR_INTEGER );
+
+    for( size_t i = 0; i < ARRAY_SIZE( pids ); i++ )
+    {
+        test( obj, pids[i], count, true, 0, 0 );
+        test( obj, pids[i], count, false, 0, 0 );
+    }
+    /* no packet may be lost when re-synchronizing */
+    test( obj, 16, count, true, 100, 0 );
+    test( obj, 16, count, true, TS_SIZE + 1, 0 );
+
+    /* programs spread over PES threads */
+    for( unsigned threads = 1; threads <= 4; threads *= 2 )
+        for( size_t i = 1; i < ARRAY_SIZE( pids ); i++ )
+            test( obj, pids[i], count, true, 0, threads );
+    test( obj, 64, count, true, 100, 2 );
+
+    libvlc_release( vlc );
+    return 0;
+}
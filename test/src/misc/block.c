@@ -0,0 +1,251 @@
+/*****************************************************************************
+ * block.c: block allocator test and benchmark
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include "../../libvlc/test.h"
+#include "../lib/libvlc_internal.h"
+
+#include <vlc_common.h>
+#include <vlc_block.h>
+
+#include <string.h>
+
+static const size_t bench_sizes[] = {
+    188,        /* TS packet */
+    1316,       /* UDP datagram */
+    4608,       /* audio frame */
+    3110400,    /* 1080p 4:2:0 frame */
+};
+
+static void check_block(block_t *block, size_t size)
+{
+    assert(block != NULL);
+    assert(block->i_buffer == size);
+    assert(((uintptr_t)block->p_buffer % 32) == 0);
+    assert(block->p_buffer >= block->p_start + 32);
+    assert(block->p_buffer + size + 32 <= block->p_start + block->i_size);
+    assert(block->p_next == NULL);
+    assert(block->i_flags == 0 && block->i_nb_samples == 0);
+    assert(block->i_pts == VLC_TS_INVALID && block->i_dts == VLC_TS_INVALID);
+    assert(block->i_length == 0);
+}
+
+static void test_sizes(void)
+{
+    for (unsigned i = 0; i < 2000; i++)
+    {
+        /* mostly small sizes, some class boundaries and a few frames */
+        size_t size = (i < 1000) ? i : (i < 1800) ? (1u << (i % 25)) + i % 3 - 1
+                                                  : (size_t)rand() % (20 << 20);
+        block_t *block = block_Alloc(size);
+
+        check_block(block, size);
+        memset(block->p_buffer, i, size);
+        block->i_dts = i;
+        block->i_flags = BLOCK_FLAG_DISCONTINUITY;
+
+        block = block_Realloc(block, 16, size + 16);
+        assert(block != NULL && block->i_buffer == size + 32);
+        assert(block->p_buffer[16] == (uint8_t)i || size == 0);
+        block_Release(block);
+
+        /* recycled blocks are reset */
+        block = block_Alloc(size);
+        check_block(block, size);
+        block_Release(block);
+    }
+}
+
+static void test_chain_alloc(void)
+{
+    block_t *chain = block_ChainAlloc(7, 188);
+    assert(chain != NULL);
+
+    size_t count = 0;
+    for (block_t *b = chain; b != NULL; b = b->p_next)
+    {
+        assert(b->i_buffer == 188);
+        if (b->p_next != NULL)
+            assert(b->p_next->p_buffer == b->p_buffer + 188);
+        memset(b->p_buffer, count++, 188);
+    }
+    assert(count == 7);
+
+    /* released out of order, and one of them reallocated */
+    block_t *second = chain->p_next;
+    chain->p_next = second->p_next;
+    second->p_next = NULL;
+    second = block_Realloc(second, 0, 1000);
+    assert(second != NULL && second->i_buffer == 1000);
+    assert(second->p_buffer[0] == 1 && second->p_buffer[187] == 1);
+
+    block_t *first = chain;
+    chain = chain->p_next;
+    first->p_next = NULL;
+    block_ChainRelease(chain);
+    assert(first->p_buffer[0] == 0 && first->p_buffer[187] == 0);
+    block_Release(first);
+    block_Release(second);
+
+    assert(block_ChainAlloc(0, 188) == NULL);
+    assert(block_ChainAlloc(SIZE_MAX / 2, 188) == NULL);
+}
+
+struct stream
+{
+    block_fifo_t *fifo;
+    unsigned count;
+};
+
+static void *produce(void *data)
+{
+    struct stream *st = data;
+
+    for (unsigned i = 0; i < st->count; i++)
+    {
+        size_t size = bench_sizes[i % (ARRAY_SIZE(bench_sizes) - 1)];
+        block_t *block = block_Alloc(size);
+
+        assert(block != NULL);
+        memset(block->p_buffer, i, size);
+        block->i_dts = i;
+        block_FifoPut(st->fifo, block);
+    }
+    return NULL;
+}
+
+/* Blocks released by another thread than the allocating one */
+static void test_threads(libvlc_int_t *libvlc, unsigned count)
+{
+    struct stream st = { .fifo = block_FifoNewSPSC(), .count = count };
+    vlc_thread_t th;
+
+    assert(st.fifo != NULL);
+    assert(vlc_clone(&th, produce, &st, VLC_THREAD_PRIORITY_LOW) == 0);
+
+    for (unsigned i = 0; i < count; i++)
+    {
+        block_t *block = block_FifoGet(st.fifo);
+        size_t size = bench_sizes[i % (ARRAY_SIZE(bench_sizes) - 1)];
+
+        assert(block->i_dts == i && block->i_buffer == size);
+        assert(block->p_buffer[0] == (uint8_t)i);
+        assert(block->p_buffer[size - 1] == (uint8_t)i);
+        block_Release(block);
+
+        /* switch the pool off and on while blocks are in flight */
+        if ((i % (count / 4)) == 0)
+            var_ToggleBool(libvlc, "block-pool");
+    }
+    vlc_join(th, NULL);
+    block_FifoRelease(st.fifo);
+    var_SetBool(libvlc, "block-pool", true);
+}
+
+struct lingerer
+{
+    vlc_sem_t cached;
+    vlc_sem_t leave;
+};
+
+/* Caches blocks, and outlives the instance */
+static void *linger(void *data)
+{
+    struct lingerer *l = data;
+
+    for (unsigned i = 0; i < 64; i++)
+        block_Release(block_Alloc(bench_sizes[i % ARRAY_SIZE(bench_sizes)]));
+    vlc_sem_post(&l->cached);
+    vlc_sem_wait(&l->leave);
+
+    /* the pool is gone: these go to the heap */
+    block_Release(block_Alloc(188));
+    return NULL;
+}
+
+static void bench(libvlc_int_t *libvlc, size_t size, unsigned loops)
+{
+    block_t *blocks[16];
+    mtime_t spent[2];
+
+    for (unsigned pool = 0; pool < 2; pool++)
+    {
+        var_SetBool(libvlc, "block-pool", pool);
+
+        mtime_t start = mdate();
+        for (unsigned i = 0; i < loops; i++)
+        {
+            for (unsigned k = 0; k < ARRAY_SIZE(blocks); k++)
+            {
+                blocks[k] = block_Alloc(size);
+                assert(blocks[k] != NULL);
+                blocks[k]->p_buffer[0] = k; /* touch the block */
+            }
+            for (unsigned k = 0; k < ARRAY_SIZE(blocks); k++)
+                block_Release(blocks[k]);
+        }
+        spent[pool] = mdate() - start;
+    }
+
+    printf("%8zu bytes: heap %7.2f, pool %7.2f Mblocks/s\n", size,
+           (double)loops * ARRAY_SIZE(blocks) / (spent[0] ? spent[0] : 1),
+           (double)loops * ARRAY_SIZE(blocks) / (spent[1] ? spent[1] : 1));
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned loops = (argc > 1) ? strtoul(argv[1], NULL, 0) : 20000;
+
+    test_init();
+
+    libvlc_instance_t *vlc = libvlc_new(test_defaults_nargs,
+                                        test_defaults_args);
+    assert(vlc != NULL);
+
+    libvlc_int_t *libvlc = vlc->p_libvlc_int;
+
+    srand(0);
+    for (unsigned pool = 0; pool < 2; pool++)
+    {
+        var_SetBool(libvlc, "block-pool", pool);
+        test_sizes();
+        test_chain_alloc();
+    }
+    test_threads(libvlc, 4000);
+
+    for (size_t i = 0; i < ARRAY_SIZE(bench_sizes); i++)
+        bench(libvlc, bench_sizes[i], loops / (1 + bench_sizes[i] / 65536));
+
+    struct lingerer l;
+    vlc_thread_t th;
+
+    var_SetBool(libvlc, "block-pool", true);
+    vlc_sem_init(&l.cached, 0);
+    vlc_sem_init(&l.leave, 0);
+    assert(vlc_clone(&th, linger, &l, VLC_THREAD_PRIORITY_LOW) == 0);
+    vlc_sem_wait(&l.cached);
+
+    libvlc_release(vlc);
+
+    vlc_sem_post(&l.leave);
+    vlc_join(th, NULL);
+    vlc_sem_destroy(&l.leave);
+    vlc_sem_destroy(&l.cached);
+    return 0;
+}